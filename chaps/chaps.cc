@@ -7,11 +7,15 @@
 
 #include "chaps/chaps.h"
 
+#include <algorithm>
+#include <map>
 #include <string>
 #include <vector>
 
+#include <base/lazy_instance.h>
 #include <base/macros.h>
 #include <base/logging.h>
+#include <base/synchronization/lock.h>
 #include <base/synchronization/waitable_event.h>
 
 #include "chaps/attributes.h"
@@ -20,7 +24,9 @@
 #include "chaps/isolate.h"
 #include "pkcs11/cryptoki.h"
 
+using base::AutoLock;
 using base::WaitableEvent;
+using std::map;
 using std::string;
 using std::vector;
 
@@ -41,12 +47,120 @@ static bool g_is_initialized = false;
 // to provide access to the user's private slots.
 static brillo::SecureBlob* g_user_isolate = NULL;
 
+namespace {
+
+// Holds the results of the object searches that are in progress, per session.
+// C_FindObjectsInit fetches all the matching objects from chapsd at once, and
+// C_FindObjects and C_FindObjectsFinal are then served from here, which saves
+// a D-Bus round trip for each of them. Session handles are never reused by
+// chapsd so a stale entry cannot be mistaken for a new search. The slot of each
+// session opened through this library is kept too, so that C_CloseAllSessions
+// can end the searches of the slot's sessions without asking chapsd. chapsd may
+// still close a session on its own, so C_FindObjects checks that the session is
+// valid once the results run out.
+class FindResults {
+ public:
+  FindResults() {}
+
+  // Starts a search with the given results. Returns false if a search is
+  // already in progress in the session.
+  bool Start(CK_SESSION_HANDLE session, const vector<uint64_t>& objects) {
+    AutoLock lock(lock_);
+    if (searches_.count(session) > 0)
+      return false;
+    Search& search = searches_[session];
+    search.objects = objects;
+    search.next = 0;
+    return true;
+  }
+
+  bool IsActive(CK_SESSION_HANDLE session) {
+    AutoLock lock(lock_);
+    return searches_.count(session) > 0;
+  }
+
+  // Moves up to |max_count| of the remaining results of the search in the
+  // session to |objects|. Returns false if no search is in progress.
+  bool Next(CK_SESSION_HANDLE session,
+            size_t max_count,
+            vector<uint64_t>* objects) {
+    AutoLock lock(lock_);
+    map<CK_SESSION_HANDLE, Search>::iterator it = searches_.find(session);
+    if (it == searches_.end())
+      return false;
+    Search& search = it->second;
+    size_t count = std::min(max_count, search.objects.size() - search.next);
+    objects->assign(search.objects.begin() + search.next,
+                    search.objects.begin() + search.next + count);
+    search.next += count;
+    return true;
+  }
+
+  // Ends the search in the session. Returns false if no search is in
+  // progress.
+  bool Finish(CK_SESSION_HANDLE session) {
+    AutoLock lock(lock_);
+    return searches_.erase(session) > 0;
+  }
+
+  // Records that |session| was opened in |slot|.
+  void AddSession(CK_SESSION_HANDLE session, CK_SLOT_ID slot) {
+    AutoLock lock(lock_);
+    session_slots_[session] = slot;
+  }
+
+  // Forgets |session| and ends its search, if any.
+  void RemoveSession(CK_SESSION_HANDLE session) {
+    AutoLock lock(lock_);
+    session_slots_.erase(session);
+    searches_.erase(session);
+  }
+
+  // Forgets the sessions opened in |slot| and ends their searches.
+  void RemoveSlot(CK_SLOT_ID slot) {
+    AutoLock lock(lock_);
+    map<CK_SESSION_HANDLE, CK_SLOT_ID>::iterator it = session_slots_.begin();
+    while (it != session_slots_.end()) {
+      if (it->second == slot) {
+        searches_.erase(it->first);
+        session_slots_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void Clear() {
+    AutoLock lock(lock_);
+    searches_.clear();
+    session_slots_.clear();
+  }
+
+ private:
+  struct Search {
+    vector<uint64_t> objects;
+    size_t next;
+  };
+
+  base::Lock lock_;
+  map<CK_SESSION_HANDLE, Search> searches_;
+  map<CK_SESSION_HANDLE, CK_SLOT_ID> session_slots_;
+
+  DISALLOW_COPY_AND_ASSIGN(FindResults);
+};
+
+base::LazyInstance<FindResults>::Leaky g_find_results =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
 // Tear down helper.
 static void TearDown() {
   if (g_is_initialized && !g_is_using_mock && g_proxy) {
     delete g_proxy;
     delete g_user_isolate;
   }
+  g_find_results.Get().Clear();
   g_is_initialized = false;
 }
 
@@ -97,6 +211,7 @@ EXPORT_SPEC void EnableMockProxy(ChapsInterface* proxy,
 
 EXPORT_SPEC void DisableMockProxy() {
   // We don't own the mock proxy.
+  g_find_results.Get().Clear();
   g_proxy = NULL;
   g_user_isolate = NULL;
   g_is_using_mock = false;
@@ -423,6 +538,7 @@ CK_RV C_OpenSession(CK_SLOT_ID slotID,
   CK_RV result = g_proxy->OpenSession(*g_user_isolate, slotID, flags,
                                       chaps::PreservedCK_ULONG(phSession));
   LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  g_find_results.Get().AddSession(*phSession, slotID);
   VLOG(1) << __func__ << " - CKR_OK";
   return CKR_OK;
 }
@@ -432,6 +548,7 @@ CK_RV C_CloseSession(CK_SESSION_HANDLE hSession) {
   LOG_CK_RV_AND_RETURN_IF(!g_is_initialized, CKR_CRYPTOKI_NOT_INITIALIZED);
   CK_RV result = g_proxy->CloseSession(*g_user_isolate, hSession);
   LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  g_find_results.Get().RemoveSession(hSession);
   VLOG(1) << __func__ << " - CKR_OK";
   return CKR_OK;
 }
@@ -441,6 +558,7 @@ CK_RV C_CloseAllSessions(CK_SLOT_ID slotID) {
   LOG_CK_RV_AND_RETURN_IF(!g_is_initialized, CKR_CRYPTOKI_NOT_INITIALIZED);
   CK_RV result = g_proxy->CloseAllSessions(*g_user_isolate, slotID);
   LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  g_find_results.Get().RemoveSlot(slotID);
   VLOG(1) << __func__ << " - CKR_OK";
   return CKR_OK;
 }
@@ -660,9 +778,14 @@ CK_RV C_FindObjectsInit(CK_SESSION_HANDLE hSession,
   vector<uint8_t> serialized_attributes;
   if (!attributes.Serialize(&serialized_attributes))
     LOG_CK_RV_AND_RETURN(CKR_TEMPLATE_INCONSISTENT);
-  CK_RV result = g_proxy->FindObjectsInit(*g_user_isolate, hSession,
-                                          serialized_attributes);
+  LOG_CK_RV_AND_RETURN_IF(g_find_results.Get().IsActive(hSession),
+                          CKR_OPERATION_ACTIVE);
+  vector<uint64_t> object_list;
+  CK_RV result = g_proxy->FindAllObjects(*g_user_isolate, hSession,
+                                         serialized_attributes, &object_list);
   LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  LOG_CK_RV_AND_RETURN_IF(!g_find_results.Get().Start(hSession, object_list),
+                          CKR_OPERATION_ACTIVE);
   VLOG(1) << __func__ << " - CKR_OK";
   return CKR_OK;
 }
@@ -675,9 +798,23 @@ CK_RV C_FindObjects(CK_SESSION_HANDLE hSession,
   LOG_CK_RV_AND_RETURN_IF(!g_is_initialized, CKR_CRYPTOKI_NOT_INITIALIZED);
   LOG_CK_RV_AND_RETURN_IF(!phObject || !pulObjectCount, CKR_ARGUMENTS_BAD);
   vector<uint64_t> object_list;
-  CK_RV result = g_proxy->FindObjects(*g_user_isolate, hSession,
-                                      ulMaxObjectCount, &object_list);
-  LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  // Searches started by C_FindObjectsInit are served locally. Anything else is
+  // left to chapsd, which reports the appropriate error.
+  if (!g_find_results.Get().Next(hSession, ulMaxObjectCount, &object_list)) {
+    CK_RV result = g_proxy->FindObjects(*g_user_isolate, hSession,
+                                        ulMaxObjectCount, &object_list);
+    LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  } else if (object_list.empty()) {
+    // chapsd may have closed the session on its own, e.g. when its token was
+    // removed. Check before reporting the end of the search.
+    uint64_t slot_id, state, flags, device_error;
+    CK_RV result = g_proxy->GetSessionInfo(*g_user_isolate, hSession, &slot_id,
+                                           &state, &flags, &device_error);
+    if (result != CKR_OK) {
+      g_find_results.Get().RemoveSession(hSession);
+      LOG_CK_RV_AND_RETURN(result);
+    }
+  }
   LOG_CK_RV_AND_RETURN_IF(object_list.size() > ulMaxObjectCount,
                           CKR_GENERAL_ERROR);
   *pulObjectCount = static_cast<CK_ULONG>(object_list.size());
@@ -691,6 +828,10 @@ CK_RV C_FindObjects(CK_SESSION_HANDLE hSession,
 // PKCS #11 v2.20 section 11.7 page 138.
 CK_RV C_FindObjectsFinal(CK_SESSION_HANDLE hSession) {
   LOG_CK_RV_AND_RETURN_IF(!g_is_initialized, CKR_CRYPTOKI_NOT_INITIALIZED);
+  if (g_find_results.Get().Finish(hSession)) {
+    VLOG(1) << __func__ << " - CKR_OK";
+    return CKR_OK;
+  }
   CK_RV result = g_proxy->FindObjectsFinal(*g_user_isolate, hSession);
   LOG_CK_RV_AND_RETURN_IF_ERR(result);
   VLOG(1) << __func__ << " - CKR_OK";
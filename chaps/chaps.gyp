@@ -245,6 +245,11 @@
             'libchaps_static',
             'libchaps_test',
           ],
+          'variables': {
+            'deps': [
+              'libmetrics-<(libbase_ver)',
+            ],
+          },
           'includes': ['../common-mk/common_test.gypi'],
           'sources': [
             'session_impl.cc',
@@ -382,6 +387,11 @@
             'libchaps_static',
             'libchaps_test',
           ],
+          'variables': {
+            'deps': [
+              'libmetrics-<(libbase_ver)',
+            ],
+          },
           'includes' : ['../common-mk/common_test.gypi'],
           'sources': ['tpm_utility_test.cc',],
           'conditions': [
@@ -954,6 +954,36 @@ uint32_t ChapsAdaptor::FindObjectsFinal(
   return FindObjectsFinal(isolate_credential, session_id);
 }
 
+void ChapsAdaptor::FindAllObjects(const vector<uint8_t>& isolate_credential,
+                                  const uint64_t& session_id,
+                                  const vector<uint8_t>& attributes,
+                                  vector<uint64_t>& object_list,  // NOLINT - refs
+                                  uint32_t& result) {  // NOLINT - refs
+  AutoLock lock(*lock_);
+  VLOG(1) << "CALL: " << __func__;
+  VLOG(2) << "IN: " << "session_id=" << session_id;
+  VLOG(2) << "IN: " << "attributes=" << PrintAttributes(attributes, true);
+  SecureBlob isolate_credential_blob(isolate_credential.begin(),
+                                     isolate_credential.end());
+  ClearVector(const_cast<vector<uint8_t>*>(&isolate_credential));
+  result = service_->FindAllObjects(isolate_credential_blob,
+                                    session_id,
+                                    attributes,
+                                    &object_list);
+  VLOG_IF(2, result == CKR_OK) << "OUT: " << "object_list="
+                               << PrintIntVector(object_list);
+}
+
+void ChapsAdaptor::FindAllObjects(const vector<uint8_t>& isolate_credential,
+                                  const uint64_t& session_id,
+                                  const vector<uint8_t>& attributes,
+                                  vector<uint64_t>& object_list,  // NOLINT - refs
+                                  uint32_t& result,  // NOLINT - refs
+                                  ::DBus::Error& /*error*/) {
+  FindAllObjects(isolate_credential, session_id, attributes, object_list,
+                 result);
+}
+
 uint32_t ChapsAdaptor::EncryptInit(
     const vector<uint8_t>& isolate_credential,
     const uint64_t& session_id,
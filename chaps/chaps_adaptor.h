@@ -228,6 +228,12 @@ class ChapsAdaptor : public org::chromium::Chaps_adaptor,
       const std::vector<uint8_t>& isolate_credential,
       const uint64_t& session_id,
       ::DBus::Error& error);  // NOLINT - refs
+  virtual void FindAllObjects(const std::vector<uint8_t>& isolate_credential,
+                              const uint64_t& session_id,
+                              const std::vector<uint8_t>& attributes,
+                              std::vector<uint64_t>& object_list,  // NOLINT - refs
+                              uint32_t& result,  // NOLINT - refs
+                              ::DBus::Error& error);  // NOLINT - refs
   virtual uint32_t EncryptInit(const std::vector<uint8_t>& isolate_credential,
                                const uint64_t& session_id,
                                const uint64_t& mechanism_type,
@@ -660,6 +666,11 @@ class ChapsAdaptor : public org::chromium::Chaps_adaptor,
   virtual uint32_t FindObjectsFinal(
       const std::vector<uint8_t>& isolate_credential,
       const uint64_t& session_id);
+  virtual void FindAllObjects(const std::vector<uint8_t>& isolate_credential,
+                              const uint64_t& session_id,
+                              const std::vector<uint8_t>& attributes,
+                              std::vector<uint64_t>& object_list,  // NOLINT - refs
+                              uint32_t& result);  // NOLINT - refs
   virtual uint32_t EncryptInit(const std::vector<uint8_t>& isolate_credential,
                                const uint64_t& session_id,
                                const uint64_t& mechanism_type,
@@ -182,6 +182,13 @@ class ChapsInterface {
   virtual uint32_t FindObjectsFinal(
       const brillo::SecureBlob& isolate_credential,
       uint64_t session_id) = 0;
+  // PKCS #11 v2.20 section 11.7 pages 136-138. Equivalent to FindObjectsInit,
+  // FindObjects until no more objects are found, and FindObjectsFinal, but
+  // costs a single call.
+  virtual uint32_t FindAllObjects(const brillo::SecureBlob& isolate_credential,
+                                  uint64_t session_id,
+                                  const std::vector<uint8_t>& attributes,
+                                  std::vector<uint64_t>* object_list) = 0;
   // PKCS #11 v2.20 section 11.8 page 139.
   virtual uint32_t EncryptInit(const brillo::SecureBlob& isolate_credential,
                                uint64_t session_id,
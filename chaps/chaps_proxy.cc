@@ -693,6 +693,25 @@ uint32_t ChapsProxyImpl::FindObjectsFinal(const SecureBlob& isolate_credential,
   return result;
 }
 
+uint32_t ChapsProxyImpl::FindAllObjects(const SecureBlob& isolate_credential,
+                                        uint64_t session_id,
+                                        const vector<uint8_t>& attributes,
+                                        vector<uint64_t>* object_list) {
+  AutoLock lock(lock_);
+  LOG_CK_RV_AND_RETURN_IF(!proxy_.get(), CKR_CRYPTOKI_NOT_INITIALIZED);
+  if (!object_list || object_list->size() > 0)
+    LOG_CK_RV_AND_RETURN(CKR_ARGUMENTS_BAD);
+  uint32_t result = CKR_GENERAL_ERROR;
+  try {
+    proxy_->FindAllObjects(isolate_credential, session_id, attributes,
+                           *object_list, result);
+  } catch (DBus::Error err) {
+    result = CKR_GENERAL_ERROR;
+    LOG(ERROR) << "DBus::Error - " << err.what();
+  }
+  return result;
+}
+
 uint32_t ChapsProxyImpl::EncryptInit(
     const SecureBlob& isolate_credential,
     uint64_t session_id,
@@ -127,6 +127,9 @@ class ChapsProxyMock : public ChapsInterface {
                                      uint64_t, std::vector<uint64_t>*));
   MOCK_METHOD2(FindObjectsFinal, uint32_t(const brillo::SecureBlob&,
                                           uint64_t));
+  MOCK_METHOD4(FindAllObjects, uint32_t(const brillo::SecureBlob&, uint64_t,
+                                        const std::vector<uint8_t>&,
+                                        std::vector<uint64_t>*));
   MOCK_METHOD5(EncryptInit, uint32_t(const brillo::SecureBlob&,
                                      uint64_t,
                                      uint64_t,
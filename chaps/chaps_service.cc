@@ -19,6 +19,14 @@ using brillo::SecureBlob;
 
 namespace chaps {
 
+namespace {
+
+// The number of objects that FindAllObjects collects from the session at a
+// time.
+const int kMaxFindObjectsPerCall = 100;
+
+}  // namespace
+
 ChapsServiceImpl::ChapsServiceImpl(SlotManager* slot_manager)
     : slot_manager_(slot_manager),
       init_(false) {
@@ -563,6 +571,39 @@ uint32_t ChapsServiceImpl::FindObjectsFinal(
   return session->FindObjectsFinal();
 }
 
+uint32_t ChapsServiceImpl::FindAllObjects(const SecureBlob& isolate_credential,
+                                          uint64_t session_id,
+                                          const vector<uint8_t>& attributes,
+                                          vector<uint64_t>* object_list) {
+  if (!object_list || object_list->size() > 0)
+    LOG_CK_RV_AND_RETURN(CKR_ARGUMENTS_BAD);
+  Session* session = NULL;
+  LOG_CK_RV_AND_RETURN_IF(!slot_manager_->GetSession(isolate_credential,
+                                                     session_id,
+                                                     &session),
+                          CKR_SESSION_HANDLE_INVALID);
+  CHECK(session);
+  Attributes tmp;
+  LOG_CK_RV_AND_RETURN_IF(!tmp.Parse(attributes), CKR_TEMPLATE_INCONSISTENT);
+  CK_RV result = session->FindObjectsInit(tmp.attributes(),
+                                          tmp.num_attributes());
+  LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  vector<int> handles;
+  do {
+    handles.clear();
+    result = session->FindObjects(kMaxFindObjectsPerCall, &handles);
+    if (result != CKR_OK) {
+      session->FindObjectsFinal();
+      object_list->clear();
+      LOG_CK_RV_AND_RETURN(result);
+    }
+    for (size_t i = 0; i < handles.size(); ++i) {
+      object_list->push_back(static_cast<uint64_t>(handles[i]));
+    }
+  } while (!handles.empty());
+  return session->FindObjectsFinal();
+}
+
 uint32_t ChapsServiceImpl::EncryptInit(
     const SecureBlob& isolate_credential,
     uint64_t session_id,
@@ -149,6 +149,10 @@ class ChapsServiceImpl : public ChapsInterface {
   virtual uint32_t FindObjectsFinal(
       const brillo::SecureBlob& isolate_credential,
       uint64_t session_id);
+  virtual uint32_t FindAllObjects(const brillo::SecureBlob& isolate_credential,
+                                  uint64_t session_id,
+                                  const std::vector<uint8_t>& attributes,
+                                  std::vector<uint64_t>* object_list);
   virtual uint32_t EncryptInit(const brillo::SecureBlob& isolate_credential,
                                uint64_t session_id,
                                uint64_t mechanism_type,
@@ -557,6 +557,42 @@ uint32_t ChapsServiceRedirect::FindObjectsFinal(
   return CKR_OK;
 }
 
+uint32_t ChapsServiceRedirect::FindAllObjects(
+    const SecureBlob& isolate_credential,
+    uint64_t session_id,
+    const vector<uint8_t>& attributes,
+    vector<uint64_t>* object_list) {
+  LOG_CK_RV_AND_RETURN_IF(!Init2(), CKR_GENERAL_ERROR);
+  if (!object_list || object_list->size() > 0)
+    LOG_CK_RV_AND_RETURN(CKR_ARGUMENTS_BAD);
+  Attributes tmp;
+  LOG_CK_RV_AND_RETURN_IF(!tmp.Parse(attributes), CKR_TEMPLATE_INCONSISTENT);
+  uint32_t result = functions_->C_FindObjectsInit(session_id,
+                                                  tmp.attributes(),
+                                                  tmp.num_attributes());
+  LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  const CK_ULONG kMaxObjectCount = 100;
+  CK_OBJECT_HANDLE object_handles[kMaxObjectCount];
+  CK_ULONG object_count = 0;
+  do {
+    result = functions_->C_FindObjects(session_id,
+                                       object_handles,
+                                       kMaxObjectCount,
+                                       &object_count);
+    if (result != CKR_OK) {
+      functions_->C_FindObjectsFinal(session_id);
+      object_list->clear();
+      LOG_CK_RV_AND_RETURN(result);
+    }
+    for (CK_ULONG i = 0; i < object_count; i++) {
+      object_list->push_back(static_cast<uint64_t>(object_handles[i]));
+    }
+  } while (object_count > 0);
+  result = functions_->C_FindObjectsFinal(session_id);
+  LOG_CK_RV_AND_RETURN_IF_ERR(result);
+  return CKR_OK;
+}
+
 uint32_t ChapsServiceRedirect::EncryptInit(
     const SecureBlob& isolate_credential,
     uint64_t session_id,
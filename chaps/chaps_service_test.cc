@@ -696,6 +696,44 @@ TEST_F(TestService, FindObjectsFinal) {
   EXPECT_EQ(CKR_OK, service_->FindObjectsFinal(ic_, 1));
 }
 
+TEST_F(TestService, FindAllObjects) {
+  vector<uint64_t> objects_ret(12, 12);
+  vector<int> objects_mock(12, 12);
+  vector<int> no_objects;
+  EXPECT_CALL(slot_manager_, GetSession(ic_, 1, _))
+    .WillOnce(Return(false))
+    .WillRepeatedly(DoAll(SetArgumentPointee<2>(&session_), Return(true)));
+  EXPECT_CALL(session_, FindObjectsInit(_, 1))
+    .WillOnce(Return(CKR_OPERATION_ACTIVE))
+    .WillRepeatedly(Return(CKR_OK));
+  EXPECT_CALL(session_, FindObjects(_, _))
+    .WillOnce(Return(CKR_FUNCTION_FAILED))
+    .WillOnce(DoAll(SetArgumentPointee<1>(objects_mock), Return(CKR_OK)))
+    .WillOnce(DoAll(SetArgumentPointee<1>(no_objects), Return(CKR_OK)));
+  EXPECT_CALL(session_, FindObjectsFinal())
+    .Times(2)
+    .WillRepeatedly(Return(CKR_OK));
+  EXPECT_EQ(CKR_ARGUMENTS_BAD,
+            service_->FindAllObjects(ic_, 1, good_attributes_, NULL));
+  vector<uint64_t> objects(1, 1);
+  EXPECT_EQ(CKR_ARGUMENTS_BAD,
+            service_->FindAllObjects(ic_, 1, good_attributes_, &objects));
+  objects.clear();
+  EXPECT_EQ(CKR_SESSION_HANDLE_INVALID,
+            service_->FindAllObjects(ic_, 1, good_attributes_, &objects));
+  EXPECT_EQ(CKR_TEMPLATE_INCONSISTENT,
+            service_->FindAllObjects(ic_, 1, bad_attributes_, &objects));
+  EXPECT_EQ(CKR_OPERATION_ACTIVE,
+            service_->FindAllObjects(ic_, 1, good_attributes_, &objects));
+  // A failed search is finalized and returns no objects.
+  EXPECT_EQ(CKR_FUNCTION_FAILED,
+            service_->FindAllObjects(ic_, 1, good_attributes_, &objects));
+  EXPECT_TRUE(objects.empty());
+  EXPECT_EQ(CKR_OK,
+            service_->FindAllObjects(ic_, 1, good_attributes_, &objects));
+  EXPECT_TRUE(objects == objects_ret);
+}
+
 TEST_F(TestService, EncryptInit) {
   EXPECT_CALL(slot_manager_, GetSession(ic_, 1, _))
     .WillOnce(Return(false))
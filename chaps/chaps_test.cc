@@ -1148,7 +1148,7 @@ TEST_F(TestAttributes, SetAttributeValueFail) {
 // FindObjects Tests
 TEST_F(TestAttributes, FindObjectsInitOK) {
   ChapsProxyMock proxy(true);
-  EXPECT_CALL(proxy, FindObjectsInit(_, 1, attributes_))
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, attributes_, _))
       .WillOnce(Return(CKR_OK));
   EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, attribute_template_, 2));
 }
@@ -1156,7 +1156,7 @@ TEST_F(TestAttributes, FindObjectsInitOK) {
 TEST(TestFindObjects, FindObjectsInitNULL) {
   ChapsProxyMock proxy(true);
   vector<uint8_t> empty;
-  EXPECT_CALL(proxy, FindObjectsInit(_, 1, empty))
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, empty, _))
       .WillOnce(Return(CKR_OK));
   EXPECT_EQ(CKR_ARGUMENTS_BAD, C_FindObjectsInit(1, NULL, 1));
   EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
@@ -1170,11 +1170,105 @@ TEST(TestFindObjects, FindObjectsInitNotInit) {
 TEST(TestFindObjects, FindObjectsInitFail) {
   ChapsProxyMock proxy(true);
   vector<uint8_t> empty;
-  EXPECT_CALL(proxy, FindObjectsInit(_, 1, empty))
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, empty, _))
       .WillOnce(Return(CKR_SESSION_CLOSED));
   EXPECT_EQ(CKR_SESSION_CLOSED, C_FindObjectsInit(1, NULL, 0));
 }
 
+// A search started by C_FindObjectsInit is served without further calls to the
+// proxy, except to check that the session is still open once the results run
+// out.
+TEST(TestFindObjects, FindObjectsBatched) {
+  ChapsProxyMock proxy(true);
+  vector<uint8_t> empty;
+  vector<uint64_t> object_list;
+  for (uint64_t i = 0; i < 5; ++i)
+    object_list.push_back(20 + i);
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, empty, _))
+      .WillOnce(DoAll(SetArgumentPointee<3>(object_list), Return(CKR_OK)));
+  EXPECT_CALL(proxy, FindObjects(_, _, _, _)).Times(0);
+  EXPECT_CALL(proxy, FindObjectsFinal(_, _)).Times(0);
+  EXPECT_CALL(proxy, GetSessionInfo(_, 1, _, _, _, _))
+      .WillOnce(Return(CKR_OK));
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
+  EXPECT_EQ(CKR_OPERATION_ACTIVE, C_FindObjectsInit(1, NULL, 0));
+  CK_OBJECT_HANDLE object_array[3];
+  CK_ULONG size = 0;
+  EXPECT_EQ(CKR_OK, C_FindObjects(1, object_array, 3, &size));
+  EXPECT_EQ(size, 3);
+  EXPECT_EQ(object_array[0], object_list[0]);
+  EXPECT_EQ(object_array[2], object_list[2]);
+  EXPECT_EQ(CKR_OK, C_FindObjects(1, object_array, 3, &size));
+  EXPECT_EQ(size, 2);
+  EXPECT_EQ(object_array[0], object_list[3]);
+  EXPECT_EQ(object_array[1], object_list[4]);
+  EXPECT_EQ(CKR_OK, C_FindObjects(1, object_array, 3, &size));
+  EXPECT_EQ(size, 0);
+  EXPECT_EQ(CKR_OK, C_FindObjectsFinal(1));
+}
+
+// Closing a session ends its search.
+TEST(TestFindObjects, FindObjectsSessionClosed) {
+  ChapsProxyMock proxy(true);
+  vector<uint8_t> empty;
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, empty, _))
+      .WillRepeatedly(Return(CKR_OK));
+  EXPECT_CALL(proxy, CloseSession(_, 1))
+      .WillOnce(Return(CKR_OK));
+  EXPECT_CALL(proxy, FindObjectsFinal(_, 1))
+      .WillOnce(Return(CKR_SESSION_HANDLE_INVALID));
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
+  EXPECT_EQ(CKR_OK, C_CloseSession(1));
+  EXPECT_EQ(CKR_SESSION_HANDLE_INVALID, C_FindObjectsFinal(1));
+}
+
+// A session closed by chapsd is reported once the cached results run out, and
+// its search is ended.
+TEST(TestFindObjects, FindObjectsSessionClosedByChapsd) {
+  ChapsProxyMock proxy(true);
+  vector<uint8_t> empty;
+  vector<uint64_t> object_list(1, 20);
+  EXPECT_CALL(proxy, FindAllObjects(_, 1, empty, _))
+      .WillOnce(DoAll(SetArgumentPointee<3>(object_list), Return(CKR_OK)));
+  EXPECT_CALL(proxy, GetSessionInfo(_, 1, _, _, _, _))
+      .WillOnce(Return(CKR_SESSION_HANDLE_INVALID));
+  EXPECT_CALL(proxy, FindObjectsFinal(_, 1))
+      .WillOnce(Return(CKR_SESSION_HANDLE_INVALID));
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
+  CK_OBJECT_HANDLE object_array[3];
+  CK_ULONG size = 0;
+  EXPECT_EQ(CKR_OK, C_FindObjects(1, object_array, 3, &size));
+  EXPECT_EQ(size, 1);
+  EXPECT_EQ(CKR_SESSION_HANDLE_INVALID,
+            C_FindObjects(1, object_array, 3, &size));
+  EXPECT_EQ(CKR_SESSION_HANDLE_INVALID, C_FindObjectsFinal(1));
+}
+
+// Closing all the sessions of a slot ends their searches, without asking the
+// proxy which slot each session belongs to.
+TEST(TestFindObjects, FindObjectsAllSessionsClosed) {
+  ChapsProxyMock proxy(true);
+  vector<uint8_t> empty;
+  EXPECT_CALL(proxy, OpenSession(_, 0, CKF_SERIAL_SESSION, _))
+      .WillOnce(DoAll(SetArgumentPointee<3>(1), Return(CKR_OK)));
+  EXPECT_CALL(proxy, OpenSession(_, 1, CKF_SERIAL_SESSION, _))
+      .WillOnce(DoAll(SetArgumentPointee<3>(2), Return(CKR_OK)));
+  EXPECT_CALL(proxy, FindAllObjects(_, _, empty, _))
+      .WillRepeatedly(Return(CKR_OK));
+  EXPECT_CALL(proxy, CloseAllSessions(_, 0))
+      .WillOnce(Return(CKR_OK));
+  EXPECT_CALL(proxy, GetSessionInfo(_, _, _, _, _, _)).Times(0);
+  CK_SESSION_HANDLE session;
+  EXPECT_EQ(CKR_OK, C_OpenSession(0, CKF_SERIAL_SESSION, NULL, NULL, &session));
+  EXPECT_EQ(CKR_OK, C_OpenSession(1, CKF_SERIAL_SESSION, NULL, NULL, &session));
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(2, NULL, 0));
+  EXPECT_EQ(CKR_OK, C_CloseAllSessions(0));
+  // The search in slot 0 is gone; the one in slot 1 is still active.
+  EXPECT_EQ(CKR_OK, C_FindObjectsInit(1, NULL, 0));
+  EXPECT_EQ(CKR_OPERATION_ACTIVE, C_FindObjectsInit(2, NULL, 0));
+}
+
 TEST(TestFindObjects, FindObjectsOK) {
   ChapsProxyMock proxy(true);
   vector<uint64_t> object_list;
@@ -10,6 +10,7 @@
 #include <vector>
 
 #include <base/logging.h>
+#include <base/macros.h>
 #include <base/synchronization/lock.h>
 #include <base/synchronization/waitable_event.h>
 
@@ -32,6 +33,23 @@ using std::vector;
 
 namespace chaps {
 
+namespace {
+
+// The attributes ObjectPoolImpl keeps an index on.
+const CK_ATTRIBUTE_TYPE kIndexedAttributes[] = {
+  CKA_CLASS,
+  CKA_ID,
+  CKA_LABEL,
+  CKA_KEY_TYPE,
+};
+
+const ObjectSet& EmptyObjectSet() {
+  static const ObjectSet* empty = new ObjectSet();
+  return *empty;
+}
+
+}  // namespace
+
 ObjectPoolImpl::ObjectPoolImpl(ChapsFactory* factory,
                                HandleGenerator* handle_generator,
                                ObjectStore* store,
@@ -42,7 +60,8 @@ ObjectPoolImpl::ObjectPoolImpl(ChapsFactory* factory,
       importer_(importer),
       is_private_loaded_(false),
       private_loaded_event_(true, false),  // Manual reset, not signaled.
-      finish_import_required_(false) {}
+      finish_import_required_(false),
+      is_import_batch_open_(false) {}
 
 ObjectPoolImpl::~ObjectPoolImpl() {}
 
@@ -57,8 +76,13 @@ bool ObjectPoolImpl::Init() {
     AutoUnlock unlock(lock_);
     string imported_blob;
     if (importer_.get() && !GetInternalBlob(kImportedTracker, &imported_blob)) {
+      BeginImportBatch();
       finish_import_required_ = importer_->ImportObjects(this);
-      if (!SetInternalBlob(kImportedTracker, imported_blob)) {
+      // The imported objects must be persistent before the tracker says so.
+      if (!CommitImportBatch()) {
+        LOG(WARNING) << "Failed to write imported objects; the import will be "
+                     << "attempted again.";
+      } else if (!SetInternalBlob(kImportedTracker, imported_blob)) {
         LOG(WARNING) << "Failed to set the import tracker.";
       }
     }
@@ -98,8 +122,11 @@ bool ObjectPoolImpl::SetEncryptionKey(const SecureBlob& key) {
       CHECK(importer_.get());
       // Unlock because FinishImportAsync inserts objects into this pool.
       AutoUnlock unlock(lock_);
+      BeginImportBatch();
       if (!importer_->FinishImportAsync(this))
         LOG(WARNING) << "Failed to finish importing objects.";
+      if (!CommitImportBatch())
+        LOG(WARNING) << "Failed to write imported objects.";
     }
   }
   // Signal any callers waiting for private objects that they're ready.
@@ -115,11 +142,17 @@ bool ObjectPoolImpl::Insert(Object* object) {
     AutoLock lock(lock_);
     WaitForPrivateObjects();
   }
-  return Import(object);
+  AutoLock lock(lock_);
+  return AddObject(object, true);
 }
 
 bool ObjectPoolImpl::Import(Object* object) {
   AutoLock lock(lock_);
+  // Imported objects may wait in the import batch.
+  return AddObject(object, false);
+}
+
+bool ObjectPoolImpl::AddObject(Object* object, bool persist) {
   if (objects_.find(object) != objects_.end())
     return false;
   if (store_.get()) {
@@ -134,11 +167,14 @@ bool ObjectPoolImpl::Import(Object* object) {
     int store_id;
     if (!store_->InsertObjectBlob(serialized, &store_id))
       return false;
+    if (persist && !PersistChanges())
+      return false;
     object->set_store_id(store_id);
   }
   object->set_handle(handle_generator_->CreateHandle());
   objects_.insert(object);
   handle_object_map_[object->handle()] = shared_ptr<const Object>(object);
+  AddToIndexes(object);
   return true;
 }
 
@@ -151,9 +187,10 @@ bool ObjectPoolImpl::Delete(const Object* object) {
     // loaded.
     if (object->IsPrivate() && !is_private_loaded_)
       WaitForPrivateObjects();
-    if (!store_->DeleteObjectBlob(object->store_id()))
+    if (!store_->DeleteObjectBlob(object->store_id()) || !PersistChanges())
       return false;
   }
+  RemoveFromIndexes(object);
   handle_object_map_.erase(object->handle());
   objects_.erase(object);
   return true;
@@ -163,6 +200,8 @@ bool ObjectPoolImpl::DeleteAll() {
   AutoLock lock(lock_);
   objects_.clear();
   handle_object_map_.clear();
+  attribute_indexes_.clear();
+  indexed_values_.clear();
   if (store_.get())
     return store_->DeleteAllObjectBlobs();
   return true;
@@ -179,7 +218,12 @@ bool ObjectPoolImpl::Find(const Object* search_template,
       search_template->GetObjectClass() == CKO_PRIVATE_KEY)) &&
       !is_private_loaded_)
     WaitForPrivateObjects();
-  for (ObjectSet::iterator it = objects_.begin(); it != objects_.end(); ++it) {
+  const ObjectSet* candidates = FindCandidates(search_template);
+  if (!candidates)
+    candidates = &objects_;
+  for (ObjectSet::const_iterator it = candidates->begin();
+       it != candidates->end();
+       ++it) {
     if (Matches(search_template, *it))
       matching_objects->push_back(*it);
   }
@@ -204,6 +248,10 @@ bool ObjectPoolImpl::Flush(const Object* object) {
   AutoLock lock(lock_);
   if (objects_.find(object) == objects_.end())
     return false;
+  // The object may have been modified since it was last indexed. The indexes
+  // follow the object in memory even if it fails to reach the store.
+  RemoveFromIndexes(object);
+  AddToIndexes(object);
   if (store_.get()) {
     ObjectBlob serialized;
     if (!Serialize(object, &serialized))
@@ -212,7 +260,8 @@ bool ObjectPoolImpl::Flush(const Object* object) {
     // loaded.
     if (object->IsPrivate() && !is_private_loaded_)
       WaitForPrivateObjects();
-    if (!store_->UpdateObjectBlob(object->store_id(), serialized))
+    if (!store_->UpdateObjectBlob(object->store_id(), serialized) ||
+        !PersistChanges())
       return false;
   }
   return true;
@@ -289,6 +338,7 @@ bool ObjectPoolImpl::LoadBlobs(const map<int, ObjectBlob>& object_blobs) {
       object->set_store_id(it->first);
       objects_.insert(object.get());
       handle_object_map_[object->handle()] = object;
+      AddToIndexes(object.get());
     } else {
       LOG(WARNING) << "Object not parsable: " << it->first;
     }
@@ -319,4 +369,84 @@ void ObjectPoolImpl::WaitForPrivateObjects() {
   LOG(INFO) << "Done waiting for private objects.";
 }
 
+void ObjectPoolImpl::BeginImportBatch() {
+  AutoLock lock(lock_);
+  if (!store_.get())
+    return;
+  is_import_batch_open_ = store_->BeginBatch();
+  if (!is_import_batch_open_)
+    LOG(WARNING) << "Failed to start a batch; objects are imported one by one.";
+}
+
+bool ObjectPoolImpl::CommitImportBatch() {
+  AutoLock lock(lock_);
+  if (!is_import_batch_open_)
+    return true;
+  is_import_batch_open_ = false;
+  return store_->CommitBatch();
+}
+
+bool ObjectPoolImpl::PersistChanges() {
+  if (!is_import_batch_open_)
+    return true;
+  // Changes made by other callers while objects are being imported go into the
+  // same batch, so commit it now and start a new one for the rest.
+  bool result = store_->CommitBatch();
+  if (!result)
+    LOG(ERROR) << "Failed to write pending changes.";
+  is_import_batch_open_ = store_->BeginBatch();
+  return result;
+}
+
+void ObjectPoolImpl::AddToIndexes(const Object* object) {
+  map<CK_ATTRIBUTE_TYPE, string>& values = indexed_values_[object];
+  for (size_t i = 0; i < arraysize(kIndexedAttributes); ++i) {
+    CK_ATTRIBUTE_TYPE type = kIndexedAttributes[i];
+    if (!object->IsAttributePresent(type))
+      continue;
+    string value = object->GetAttributeString(type);
+    attribute_indexes_[type][value].insert(object);
+    values[type] = value;
+  }
+}
+
+void ObjectPoolImpl::RemoveFromIndexes(const Object* object) {
+  map<const Object*, map<CK_ATTRIBUTE_TYPE, string>>::iterator values_it =
+      indexed_values_.find(object);
+  if (values_it == indexed_values_.end())
+    return;
+  map<CK_ATTRIBUTE_TYPE, string>::const_iterator it;
+  for (it = values_it->second.begin(); it != values_it->second.end(); ++it) {
+    AttributeValueIndex& index = attribute_indexes_[it->first];
+    AttributeValueIndex::iterator entry = index.find(it->second);
+    if (entry == index.end())
+      continue;
+    entry->second.erase(object);
+    if (entry->second.empty())
+      index.erase(entry);
+  }
+  indexed_values_.erase(values_it);
+}
+
+const ObjectSet* ObjectPoolImpl::FindCandidates(
+    const Object* search_template) {
+  const ObjectSet* candidates = NULL;
+  for (size_t i = 0; i < arraysize(kIndexedAttributes); ++i) {
+    CK_ATTRIBUTE_TYPE type = kIndexedAttributes[i];
+    if (!search_template->IsAttributePresent(type))
+      continue;
+    const AttributeValueIndex& index = attribute_indexes_[type];
+    AttributeValueIndex::const_iterator entry =
+        index.find(search_template->GetAttributeString(type));
+    // An object without the value cannot match the template.
+    if (entry == index.end())
+      return &EmptyObjectSet();
+    // Matching the smallest set of candidates is enough since every object
+    // must match all of the template attributes anyway.
+    if (!candidates || entry->second.size() < candidates->size())
+      candidates = &entry->second;
+  }
+  return candidates;
+}
+
 }  // namespace chaps
@@ -29,6 +29,9 @@ class ObjectImporter;
 // Value: Object shared pointer.
 typedef std::map<int, std::shared_ptr<const Object>> HandleObjectMap;
 typedef std::set<const Object*> ObjectSet;
+// Key: Attribute value.
+// Value: The objects that hold the value.
+typedef std::map<std::string, ObjectSet> AttributeValueIndex;
 
 class ObjectPoolImpl : public ObjectPool {
  public:
@@ -66,9 +69,35 @@ class ObjectPoolImpl : public ObjectPool {
   bool LoadPublicObjects();
   bool LoadPrivateObjects();
   void WaitForPrivateObjects();
+  // Adds an object to the pool and the store. Unless |persist| is false, the
+  // object has reached persistent storage when this returns.
+  bool AddObject(Object* object, bool persist);
+  // Starts and ends a store batch which groups the writes of objects imported
+  // by |importer_|. Must be called without holding |lock_|. CommitImportBatch
+  // returns false if the imported objects could not be written.
+  void BeginImportBatch();
+  bool CommitImportBatch();
+  // Makes sure all changes to the store so far are persistent, committing the
+  // import batch in progress if there is one.
+  bool PersistChanges();
+  // Adds an object to, or removes it from, the attribute indexes.
+  void AddToIndexes(const Object* object);
+  void RemoveFromIndexes(const Object* object);
+  // Returns the objects that may match the given template according to the
+  // attribute indexes, or NULL if the template does not hold any indexed
+  // attribute and all objects need to be searched.
+  const ObjectSet* FindCandidates(const Object* search_template);
 
   // Allows us to quickly check whether an object exists in the pool.
   ObjectSet objects_;
+  // Indexes on the attributes most commonly used in search templates so that
+  // Find() does not need to match every object in large pools.
+  // Key: Attribute type.
+  std::map<CK_ATTRIBUTE_TYPE, AttributeValueIndex> attribute_indexes_;
+  // The values each object was last indexed with. These differ from the
+  // current values while an object is being modified and not yet flushed.
+  std::map<const Object*, std::map<CK_ATTRIBUTE_TYPE, std::string>>
+      indexed_values_;
   HandleObjectMap handle_object_map_;
   ChapsFactory* factory_;
   HandleGenerator* handle_generator_;
@@ -78,6 +107,7 @@ class ObjectPoolImpl : public ObjectPool {
   base::Lock lock_;
   base::WaitableEvent private_loaded_event_;
   bool finish_import_required_;
+  bool is_import_batch_open_;
 
   DISALLOW_COPY_AND_ASSIGN(ObjectPoolImpl);
 };
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 
+#include <base/macros.h>
+#include <base/strings/stringprintf.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -26,6 +28,7 @@ using std::vector;
 using ::testing::_;
 using ::testing::AnyNumber;
 using ::testing::DoAll;
+using ::testing::InSequence;
 using ::testing::Invoke;
 using ::testing::Return;
 using ::testing::SetArgumentPointee;
@@ -58,6 +61,16 @@ Object* CreateObjectMock() {
   return o;
 }
 
+Object* CreateObjectMockWithAttributes(CK_OBJECT_CLASS object_class,
+                                      const string& id,
+                                      const string& label) {
+  Object* o = CreateObjectMock();
+  o->SetAttributeInt(CKA_CLASS, object_class);
+  o->SetAttributeString(CKA_ID, id);
+  o->SetAttributeString(CKA_LABEL, label);
+  return o;
+}
+
 int CreateHandle() {
   static int last_handle = 0;
   return ++last_handle;
@@ -80,6 +93,8 @@ class TestObjectPool : public ::testing::Test {
     pool_.reset(
         new ObjectPoolImpl(&factory_, &handle_generator_, store_, importer_));
     pool2_.reset(new ObjectPoolImpl(&factory_, &handle_generator_, NULL, NULL));
+    EXPECT_CALL(*store_, BeginBatch()).Times(AnyNumber());
+    EXPECT_CALL(*store_, CommitBatch()).Times(AnyNumber());
   }
 
   ChapsFactoryMock factory_;
@@ -278,6 +293,177 @@ TEST_F(TestObjectPool, DeleteAll) {
   EXPECT_EQ(0, v.size());
 }
 
+// Test that imported objects are written to the store in a batch which is
+// committed before the pool records that the import is done.
+TEST_F(TestObjectPool, ImportBatch) {
+  const int kNumObjects = 3;
+  EXPECT_CALL(*store_, LoadPublicObjectBlobs(_)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*store_, GetInternalBlob(kImportedTracker, _))
+      .WillRepeatedly(Return(false));
+  ObjectPoolImpl* pool = pool_.get();
+  EXPECT_CALL(*importer_, ImportObjects(pool))
+      .WillOnce(Invoke([pool](ObjectPool*) {
+        for (int i = 0; i < kNumObjects; ++i)
+          EXPECT_TRUE(pool->Import(CreateObjectMock()));
+        return false;
+      }));
+  {
+    InSequence sequence;
+    EXPECT_CALL(*store_, BeginBatch()).WillOnce(Return(true));
+    EXPECT_CALL(*store_, InsertObjectBlob(_, _))
+        .Times(kNumObjects)
+        .WillRepeatedly(DoAll(SetArgumentPointee<1>(3), Return(true)));
+    EXPECT_CALL(*store_, CommitBatch()).WillOnce(Return(true));
+    EXPECT_CALL(*store_, SetInternalBlob(kImportedTracker, _))
+        .WillOnce(Return(true));
+  }
+  EXPECT_TRUE(pool_->Init());
+  vector<const Object*> v;
+  std::unique_ptr<Object> find_all(CreateObjectMock());
+  EXPECT_TRUE(pool_->Find(find_all.get(), &v));
+  EXPECT_EQ(kNumObjects, v.size());
+}
+
+// Test that the import is not recorded as done if the imported objects could
+// not be written.
+TEST_F(TestObjectPool, ImportBatchFailure) {
+  EXPECT_CALL(*store_, LoadPublicObjectBlobs(_)).WillRepeatedly(Return(true));
+  EXPECT_CALL(*store_, GetInternalBlob(kImportedTracker, _))
+      .WillRepeatedly(Return(false));
+  ObjectPoolImpl* pool = pool_.get();
+  EXPECT_CALL(*importer_, ImportObjects(pool))
+      .WillOnce(Invoke([pool](ObjectPool*) {
+        EXPECT_TRUE(pool->Import(CreateObjectMock()));
+        return false;
+      }));
+  EXPECT_CALL(*store_, BeginBatch()).WillOnce(Return(true));
+  EXPECT_CALL(*store_, InsertObjectBlob(_, _))
+      .WillOnce(DoAll(SetArgumentPointee<1>(3), Return(true)));
+  EXPECT_CALL(*store_, CommitBatch()).WillOnce(Return(false));
+  EXPECT_CALL(*store_, SetInternalBlob(kImportedTracker, _)).Times(0);
+  EXPECT_TRUE(pool_->Init());
+}
+
+// Test that searches using the attribute indexes find the same objects as a
+// full scan, including after objects are modified and deleted.
+TEST_F(TestObjectPool, IndexedFind) {
+  EXPECT_TRUE(pool2_->Insert(
+      CreateObjectMockWithAttributes(CKO_CERTIFICATE, "id1", "a")));
+  EXPECT_TRUE(pool2_->Insert(
+      CreateObjectMockWithAttributes(CKO_PUBLIC_KEY, "id1", "b")));
+  EXPECT_TRUE(pool2_->Insert(
+      CreateObjectMockWithAttributes(CKO_CERTIFICATE, "id2", "a")));
+  vector<const Object*> v;
+  std::unique_ptr<Object> find_all(CreateObjectMock());
+  EXPECT_TRUE(pool2_->Find(find_all.get(), &v));
+  EXPECT_EQ(3, v.size());
+  std::unique_ptr<Object> find_certs(CreateObjectMock());
+  find_certs->SetAttributeInt(CKA_CLASS, CKO_CERTIFICATE);
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_certs.get(), &v));
+  EXPECT_EQ(2, v.size());
+  std::unique_ptr<Object> find_cert_id1(CreateObjectMock());
+  find_cert_id1->SetAttributeInt(CKA_CLASS, CKO_CERTIFICATE);
+  find_cert_id1->SetAttributeString(CKA_ID, "id1");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_cert_id1.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ("a", v[0]->GetAttributeString(CKA_LABEL));
+  std::unique_ptr<Object> find_unknown_id(CreateObjectMock());
+  find_unknown_id->SetAttributeString(CKA_ID, "id3");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_unknown_id.get(), &v));
+  EXPECT_EQ(0, v.size());
+  // Attributes without an index fall back to matching every object.
+  std::unique_ptr<Object> find_subject(CreateObjectMock());
+  find_subject->SetAttributeString(CKA_SUBJECT, "subject");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_subject.get(), &v));
+  EXPECT_EQ(0, v.size());
+
+  // Modify the ID of the first certificate.
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_cert_id1.get(), &v));
+  ASSERT_EQ(1, v.size());
+  Object* o = pool2_->GetModifiableObject(v[0]);
+  o->SetAttributeString(CKA_ID, "id3");
+  EXPECT_TRUE(pool2_->Flush(o));
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_cert_id1.get(), &v));
+  EXPECT_EQ(0, v.size());
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_unknown_id.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(o, v[0]);
+
+  EXPECT_TRUE(pool2_->Delete(o));
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_unknown_id.get(), &v));
+  EXPECT_EQ(0, v.size());
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_certs.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ("id2", v[0]->GetAttributeString(CKA_ID));
+}
+
+// Searches on indexed attributes return exactly the matching objects among
+// many, also after a change to an indexed attribute is flushed.
+TEST_F(TestObjectPool, FindManyObjects) {
+  const int kNumObjects = 30;
+  const CK_OBJECT_CLASS kClasses[] = {
+    CKO_CERTIFICATE, CKO_PUBLIC_KEY, CKO_PRIVATE_KEY
+  };
+  for (int i = 0; i < kNumObjects; ++i) {
+    ASSERT_TRUE(pool2_->Insert(CreateObjectMockWithAttributes(
+        kClasses[i % arraysize(kClasses)],
+        base::StringPrintf("id%d", i / arraysize(kClasses)),
+        base::StringPrintf("label%d", i))));
+  }
+  vector<const Object*> v;
+  for (int i = 0; i < kNumObjects / 3; ++i) {
+    std::unique_ptr<Object> find_cert(CreateObjectMock());
+    find_cert->SetAttributeInt(CKA_CLASS, CKO_CERTIFICATE);
+    find_cert->SetAttributeString(CKA_ID, base::StringPrintf("id%d", i));
+    v.clear();
+    EXPECT_TRUE(pool2_->Find(find_cert.get(), &v));
+    ASSERT_EQ(1, v.size());
+    EXPECT_EQ(base::StringPrintf("label%d", i * 3),
+              v[0]->GetAttributeString(CKA_LABEL));
+  }
+  std::unique_ptr<Object> find_id0(CreateObjectMock());
+  find_id0->SetAttributeString(CKA_ID, "id0");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_id0.get(), &v));
+  EXPECT_EQ(3, v.size());
+
+  // Relabel the public key with ID "id4".
+  std::unique_ptr<Object> find_label13(CreateObjectMock());
+  find_label13->SetAttributeString(CKA_LABEL, "label13");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_label13.get(), &v));
+  ASSERT_EQ(1, v.size());
+  Object* o = pool2_->GetModifiableObject(v[0]);
+  o->SetAttributeString(CKA_LABEL, "relabeled");
+  EXPECT_TRUE(pool2_->Flush(o));
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_label13.get(), &v));
+  EXPECT_EQ(0, v.size());
+  std::unique_ptr<Object> find_relabeled(CreateObjectMock());
+  find_relabeled->SetAttributeInt(CKA_CLASS, CKO_PUBLIC_KEY);
+  find_relabeled->SetAttributeString(CKA_LABEL, "relabeled");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_relabeled.get(), &v));
+  ASSERT_EQ(1, v.size());
+  EXPECT_EQ(o, v[0]);
+  EXPECT_EQ("id4", v[0]->GetAttributeString(CKA_ID));
+  // The other indexes still hold the object.
+  std::unique_ptr<Object> find_id4(CreateObjectMock());
+  find_id4->SetAttributeString(CKA_ID, "id4");
+  v.clear();
+  EXPECT_TRUE(pool2_->Find(find_id4.get(), &v));
+  EXPECT_EQ(3, v.size());
+}
+
 }  // namespace chaps
 
 int main(int argc, char** argv) {
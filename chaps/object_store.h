@@ -56,6 +56,14 @@ class ObjectStore {
   virtual bool LoadPublicObjectBlobs(std::map<int, ObjectBlob>* blobs) = 0;
   // Loads all private non-internal objects.
   virtual bool LoadPrivateObjectBlobs(std::map<int, ObjectBlob>* blobs) = 0;
+  // Starts a batch of object blob changes. Until CommitBatch is called, the
+  // changes made by InsertObjectBlob, UpdateObjectBlob and DeleteObjectBlob
+  // may be held in memory and written later, together, in a single atomic
+  // write. A crash loses the changes that have not been written yet, but never
+  // part of a write. Internal blobs are not affected by batches.
+  virtual bool BeginBatch() = 0;
+  // Writes any pending changes of the current batch and ends it.
+  virtual bool CommitBatch() = 0;
 };
 
 }  // namespace chaps
@@ -55,6 +55,12 @@ class ObjectStoreFake : public ObjectStore {
   virtual bool LoadPrivateObjectBlobs(std::map<int, ObjectBlob>* blobs) {
     return true;
   }
+  virtual bool BeginBatch() {
+    return true;
+  }
+  virtual bool CommitBatch() {
+    return true;
+  }
 
  private:
   int last_handle_;
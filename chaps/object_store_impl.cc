@@ -4,9 +4,12 @@
 
 #include "chaps/object_store_impl.h"
 
+#include <algorithm>
 #include <limits>
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <base/files/file_util.h>
@@ -15,9 +18,12 @@
 #include <base/strings/string_piece.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
+#include <base/sys_info.h>
+#include <base/threading/platform_thread.h>
 #include <brillo/secure_blob.h>
 #include <leveldb/db.h>
 #include <leveldb/env.h>
+#include <leveldb/write_batch.h>
 #ifndef NO_MEMENV
 #include <leveldb/helpers/memenv.h>
 #endif
@@ -79,10 +85,54 @@ const char ObjectStoreImpl::kObfuscationKey[] = {
     '\x14', '\x9c', '\xae', '\x57', '\xfb', '\x04', '\x13', '\x92', '\xc0',
     '\x84', '\x2a', '\xea', '\xf6', '\xfb'};
 const int ObjectStoreImpl::kBlobVersion = 1;
+const int ObjectStoreImpl::kDefaultMaxBatchSize = 100;
+const int ObjectStoreImpl::kMaxDecryptThreads = 4;
+const int ObjectStoreImpl::kMinBlobsPerDecryptThread = 32;
 
-ObjectStoreImpl::ObjectStoreImpl() {}
+class ObjectStoreImpl::DecryptThread : public base::PlatformThread::Delegate {
+ public:
+  // Decrypts the blobs of 'encrypted_blobs' in [begin, end).
+  DecryptThread(ObjectStoreImpl* store,
+                const ObjectBlobList* encrypted_blobs,
+                size_t begin,
+                size_t end)
+      : store_(store),
+        encrypted_blobs_(encrypted_blobs),
+        begin_(begin),
+        end_(end) {}
+  void ThreadMain() override {
+    for (size_t i = begin_; i < end_; ++i) {
+      ObjectBlob blob;
+      if (!store_->Decrypt((*encrypted_blobs_)[i].second, &blob)) {
+        LOG(WARNING) << "Failed to decrypt object blob.";
+        continue;
+      }
+      blobs_.push_back(std::make_pair((*encrypted_blobs_)[i].first, blob));
+    }
+  }
+  const ObjectBlobList& blobs() const { return blobs_; }
+
+  base::PlatformThreadHandle handle;
+
+ private:
+  ObjectStoreImpl* store_;
+  const ObjectBlobList* encrypted_blobs_;
+  size_t begin_;
+  size_t end_;
+  ObjectBlobList blobs_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecryptThread);
+};
 
-ObjectStoreImpl::~ObjectStoreImpl() {}
+ObjectStoreImpl::ObjectStoreImpl()
+    : batch_size_(0),
+      max_batch_size_(kDefaultMaxBatchSize),
+      batch_next_id_(0) {}
+
+ObjectStoreImpl::~ObjectStoreImpl() {
+  if (batch_.get() && !CommitBatch())
+    LOG(WARNING) << "Failed to write pending object blob changes.";
+}
 
 bool ObjectStoreImpl::Init(const FilePath& database_path) {
   MetricsWrapper metrics;
@@ -195,38 +245,30 @@ bool ObjectStoreImpl::InsertObjectBlob(const ObjectBlob& blob,
 }
 
 bool ObjectStoreImpl::DeleteObjectBlob(int handle) {
-  leveldb::WriteOptions options;
-  options.sync = true;
-  string db_key = CreateBlobKey(GetBlobType(handle), handle);
-  leveldb::Status status = db_->Delete(options, db_key);
-  if (!status.ok()) {
-    LOG(ERROR) << "Failed to delete blob: " << status.ToString();
-    return false;
-  }
-  return true;
+  return DeleteObjectChange(CreateBlobKey(GetBlobType(handle), handle));
 }
 
 bool ObjectStoreImpl::DeleteAllObjectBlobs() {
-  vector<string> blobs_to_delete;
+  // Pending changes must reach the database before it is scanned.
+  if (batch_.get() && !WriteBatch())
+    return false;
+  leveldb::WriteBatch deletions;
   std::unique_ptr<leveldb::Iterator>
       it(db_->NewIterator(leveldb::ReadOptions()));
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
     BlobType type;
     int id = 0;
     if (ParseBlobKey(it->key().ToString(), &type, &id) && type != kInternal)
-      blobs_to_delete.push_back(it->key().ToString());
-  }
-  bool deleted_all = true;
-  for (size_t i = 0; i < blobs_to_delete.size(); ++i) {
-    leveldb::WriteOptions options;
-    options.sync = true;
-    leveldb::Status status = db_->Delete(options, blobs_to_delete[i]);
-    if (!status.ok()) {
-      LOG(ERROR) << "Failed to delete blob: " << status.ToString();
-      deleted_all = false;
-    }
+      deletions.Delete(it->key());
+  }
+  leveldb::WriteOptions options;
+  options.sync = true;
+  leveldb::Status status = db_->Write(options, &deletions);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to delete blobs: " << status.ToString();
+    return false;
   }
-  return deleted_all;
+  return true;
 }
 
 bool ObjectStoreImpl::UpdateObjectBlob(int handle, const ObjectBlob& blob) {
@@ -240,8 +282,9 @@ bool ObjectStoreImpl::UpdateObjectBlob(int handle, const ObjectBlob& blob) {
     LOG(ERROR) << "Failed to encrypt object blob.";
     return false;
   }
-  if (!WriteBlob(CreateBlobKey(type, handle), encrypted_blob.blob)) {
+  if (!PutObjectChange(CreateBlobKey(type, handle), encrypted_blob.blob)) {
     LOG(ERROR) << "Failed to write object blob.";
+    return false;
   }
   return true;
 }
@@ -258,8 +301,31 @@ bool ObjectStoreImpl::LoadPrivateObjectBlobs(map<int, ObjectBlob>* blobs) {
   return LoadObjectBlobs(kPrivate, blobs);
 }
 
+bool ObjectStoreImpl::BeginBatch() {
+  if (batch_.get()) {
+    LOG(ERROR) << "A batch is already in progress.";
+    return false;
+  }
+  batch_.reset(new leveldb::WriteBatch());
+  batch_size_ = 0;
+  batch_next_id_ = 0;
+  return true;
+}
+
+bool ObjectStoreImpl::CommitBatch() {
+  if (!batch_.get())
+    return true;
+  bool result = WriteBatch();
+  batch_.reset();
+  return result;
+}
+
 bool ObjectStoreImpl::LoadObjectBlobs(BlobType type,
                                       map<int, ObjectBlob>* blobs) {
+  // Pending changes must reach the database before it is scanned.
+  if (batch_.get() && !WriteBatch())
+    return false;
+  ObjectBlobList encrypted_blobs;
   std::unique_ptr<leveldb::Iterator>
       it(db_->NewIterator(leveldb::ReadOptions()));
   for (it->SeekToFirst(); it->Valid(); it->Next()) {
@@ -269,18 +335,51 @@ bool ObjectStoreImpl::LoadObjectBlobs(BlobType type,
       ObjectBlob encrypted_blob;
       encrypted_blob.is_private = (type == kPrivate);
       encrypted_blob.blob = it->value().ToString();
-      ObjectBlob blob;
-      if (!Decrypt(encrypted_blob, &blob)) {
-        LOG(WARNING) << "Failed to decrypt object blob.";
-        continue;
-      }
-      (*blobs)[id] = blob;
-      blob_type_map_[id] = type;
+      encrypted_blobs.push_back(std::make_pair(id, encrypted_blob));
     }
   }
+  // Decryption dominates the time it takes to load a token with many objects,
+  // so it does not happen while iterating.
+  ObjectBlobList decrypted_blobs;
+  DecryptObjectBlobs(encrypted_blobs, &decrypted_blobs);
+  for (size_t i = 0; i < decrypted_blobs.size(); ++i) {
+    (*blobs)[decrypted_blobs[i].first] = decrypted_blobs[i].second;
+    blob_type_map_[decrypted_blobs[i].first] = type;
+  }
   return true;
 }
 
+void ObjectStoreImpl::DecryptObjectBlobs(const ObjectBlobList& encrypted_blobs,
+                                         ObjectBlobList* blobs) {
+  int num_threads = std::min(
+      std::min(kMaxDecryptThreads, base::SysInfo::NumberOfProcessors()),
+      static_cast<int>(encrypted_blobs.size() / kMinBlobsPerDecryptThread));
+  num_threads = std::max(num_threads, 1);
+  // The calling thread decrypts the first range itself.
+  size_t range_size = (encrypted_blobs.size() + num_threads - 1) / num_threads;
+  std::vector<std::unique_ptr<DecryptThread>> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    size_t begin = std::min(i * range_size, encrypted_blobs.size());
+    size_t end = std::min(begin + range_size, encrypted_blobs.size());
+    threads.emplace_back(
+        new DecryptThread(this, &encrypted_blobs, begin, end));
+    if (i > 0 && !base::PlatformThread::Create(0, threads[i].get(),
+                                               &threads[i]->handle)) {
+      LOG(WARNING) << "Failed to create decryption thread.";
+      threads[i]->ThreadMain();
+      threads[i]->handle = base::PlatformThreadHandle();
+    }
+  }
+  threads[0]->ThreadMain();
+  for (int i = 0; i < num_threads; ++i) {
+    if (!threads[i]->handle.is_null())
+      base::PlatformThread::Join(threads[i]->handle);
+    blobs->insert(blobs->end(),
+                  threads[i]->blobs().begin(),
+                  threads[i]->blobs().end());
+  }
+}
+
 bool ObjectStoreImpl::Encrypt(const ObjectBlob& plain_text,
                               ObjectBlob* cipher_text) {
   if (plain_text.is_private && key_.empty()) {
@@ -399,7 +498,9 @@ bool ObjectStoreImpl::ParseBlobKey(const string& key,
 }
 
 bool ObjectStoreImpl::GetNextID(int* next_id) {
-  if (!ReadInt(kIDTrackerKey, next_id)) {
+  if (batch_.get() && batch_next_id_ != 0) {
+    *next_id = batch_next_id_;
+  } else if (!ReadInt(kIDTrackerKey, next_id)) {
     LOG(ERROR) << "Failed to read ID tracker.";
     return false;
   }
@@ -407,6 +508,12 @@ bool ObjectStoreImpl::GetNextID(int* next_id) {
     LOG(ERROR) << "Object ID overflow.";
     return false;
   }
+  if (batch_.get()) {
+    // The tracker is updated in the same batch as the blob that uses the ID.
+    batch_next_id_ = *next_id + 1;
+    batch_->Put(kIDTrackerKey, base::IntToString(batch_next_id_));
+    return true;
+  }
   if (!WriteInt(kIDTrackerKey, *next_id + 1)) {
     LOG(ERROR) << "Failed to write ID tracker.";
     return false;
@@ -450,6 +557,58 @@ bool ObjectStoreImpl::WriteInt(const string& key, int value) {
   return WriteBlob(key, base::IntToString(value));
 }
 
+bool ObjectStoreImpl::PutObjectChange(const string& key, const string& value) {
+  if (!batch_.get())
+    return WriteBlob(key, value);
+  batch_->Put(key, value);
+  return AddedToBatch();
+}
+
+bool ObjectStoreImpl::DeleteObjectChange(const string& key) {
+  if (batch_.get()) {
+    batch_->Delete(key);
+    return AddedToBatch();
+  }
+  leveldb::WriteOptions options;
+  options.sync = true;
+  leveldb::Status status = db_->Delete(options, key);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to delete blob: " << status.ToString();
+    return false;
+  }
+  return true;
+}
+
+bool ObjectStoreImpl::AddedToBatch() {
+  ++batch_size_;
+  if (batch_size_ < max_batch_size_)
+    return true;
+  return WriteBatch();
+}
+
+bool ObjectStoreImpl::WriteBatch() {
+  CHECK(batch_.get());
+  if (batch_size_ == 0)
+    return true;
+  leveldb::WriteOptions options;
+  options.sync = true;
+  leveldb::Status status = db_->Write(options, batch_.get());
+  batch_->Clear();
+  batch_size_ = 0;
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to write batch to database: " << status.ToString();
+    // Objects may already use the IDs handed out in the lost batch, so they
+    // must never be handed out again. Keep them reserved and retry writing the
+    // ID tracker along with the next changes.
+    if (batch_next_id_ != 0) {
+      batch_->Put(kIDTrackerKey, base::IntToString(batch_next_id_));
+      batch_size_ = 1;
+    }
+    return false;
+  }
+  return true;
+}
+
 ObjectStoreImpl::BlobType ObjectStoreImpl::GetBlobType(int blob_id) {
   map<int, BlobType>::iterator it = blob_type_map_.find(blob_id);
   if (it == blob_type_map_.end())
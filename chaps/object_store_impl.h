@@ -10,6 +10,8 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <base/files/file_path.h>
 #include <base/macros.h>
@@ -17,6 +19,7 @@
 #include <gtest/gtest_prod.h>
 #include <leveldb/db.h>
 #include <leveldb/env.h>
+#include <leveldb/write_batch.h>
 
 namespace chaps {
 
@@ -31,6 +34,13 @@ class ObjectStoreImpl : public ObjectStore {
   // is suitable for testing.
   bool Init(const base::FilePath& database_path);
 
+  // Sets the number of changes after which a batch is written even though it
+  // has not been committed yet. This bounds both the memory used by a batch
+  // and the changes lost on a crash.
+  void set_max_batch_size(int max_batch_size) {
+    max_batch_size_ = max_batch_size;
+  }
+
   // ObjectStore methods.
   virtual bool GetInternalBlob(int blob_id, std::string* blob);
   virtual bool SetInternalBlob(int blob_id, const std::string& blob);
@@ -41,6 +51,8 @@ class ObjectStoreImpl : public ObjectStore {
   virtual bool UpdateObjectBlob(int handle, const ObjectBlob& blob);
   virtual bool LoadPublicObjectBlobs(std::map<int, ObjectBlob>* blobs);
   virtual bool LoadPrivateObjectBlobs(std::map<int, ObjectBlob>* blobs);
+  virtual bool BeginBatch();
+  virtual bool CommitBatch();
 
  private:
   enum BlobType {
@@ -49,9 +61,18 @@ class ObjectStoreImpl : public ObjectStore {
     kPublic
   };
 
+  // Decrypts object blobs on a worker thread.
+  class DecryptThread;
+  typedef std::vector<std::pair<int, ObjectBlob>> ObjectBlobList;
+
   // Loads all object of a given type.
   bool LoadObjectBlobs(BlobType type, std::map<int, ObjectBlob>* blobs);
 
+  // Decrypts the given object blobs, on several threads if there are enough of
+  // them. Blobs that fail to decrypt are skipped.
+  void DecryptObjectBlobs(const ObjectBlobList& encrypted_blobs,
+                          ObjectBlobList* blobs);
+
   // Encrypts an object blob with a random IV and appends an HMAC.
   bool Encrypt(const ObjectBlob& plain_text,
                ObjectBlob* cipher_text);
@@ -92,6 +113,19 @@ class ObjectStoreImpl : public ObjectStore {
   // Writes an integer to the database. Returns true on success.
   bool WriteInt(const std::string& key, int value);
 
+  // Writes or deletes an object blob. If a batch is in progress, the change is
+  // added to the batch instead. Returns true on success.
+  bool PutObjectChange(const std::string& key, const std::string& value);
+  bool DeleteObjectChange(const std::string& key);
+
+  // Counts a change added to the batch and writes the batch once it holds
+  // |max_batch_size_| changes. Returns true on success.
+  bool AddedToBatch();
+
+  // Writes the pending changes of the current batch to the database. Returns
+  // true on success.
+  bool WriteBatch();
+
   // Returns the blob type for the specified blob. If 'blob_id' is unknown,
   // kInternal is returned.
   BlobType GetBlobType(int blob_id);
@@ -118,16 +152,32 @@ class ObjectStoreImpl : public ObjectStore {
   static const char kObfuscationKey[];
   // The current blob format version.
   static const int kBlobVersion;
+  // The default number of changes after which a batch is written.
+  static const int kDefaultMaxBatchSize;
+  // The maximum number of threads used to decrypt object blobs, and the
+  // minimum number of blobs worth starting a thread for.
+  static const int kMaxDecryptThreads;
+  static const int kMinBlobsPerDecryptThread;
 
   brillo::SecureBlob key_;
   std::unique_ptr<leveldb::Env> env_;
   std::unique_ptr<leveldb::DB> db_;
   std::map<int, BlobType> blob_type_map_;
+  // The pending changes of the current batch. NULL if there is no batch in
+  // progress.
+  std::unique_ptr<leveldb::WriteBatch> batch_;
+  int batch_size_;
+  int max_batch_size_;
+  // The next unused blob ID while a batch is in progress, since the ID tracker
+  // in the database may be behind the one in the batch. Zero if it has not
+  // been read yet.
+  int batch_next_id_;
 
   friend class TestObjectStoreEncryption;
   FRIEND_TEST(TestObjectStoreEncryption, EncryptionInit);
   FRIEND_TEST(TestObjectStoreEncryption, Encryption);
   FRIEND_TEST(TestObjectStoreEncryption, CBCMode);
+  FRIEND_TEST(TestObjectStore, BatchWrites);
 
   DISALLOW_COPY_AND_ASSIGN(ObjectStoreImpl);
 };
@@ -6,7 +6,10 @@
 
 namespace chaps {
 
-ObjectStoreMock::ObjectStoreMock() {}
+ObjectStoreMock::ObjectStoreMock() {
+  ON_CALL(*this, BeginBatch()).WillByDefault(testing::Return(true));
+  ON_CALL(*this, CommitBatch()).WillByDefault(testing::Return(true));
+}
 ObjectStoreMock::~ObjectStoreMock() {}
 
 }
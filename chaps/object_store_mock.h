@@ -36,6 +36,8 @@ class ObjectStoreMock : public ObjectStore {
       bool(std::map<int, ObjectBlob>* blobs));
   MOCK_METHOD1(LoadPrivateObjectBlobs,
       bool(std::map<int, ObjectBlob>* blobs));
+  MOCK_METHOD0(BeginBatch, bool());
+  MOCK_METHOD0(CommitBatch, bool());
 };
 
 }  // namespace chaps
@@ -5,8 +5,10 @@
 #include "chaps/object_store_impl.h"
 
 #include <map>
+#include <memory>
 #include <string>
 
+#include <base/strings/stringprintf.h>
 #include <gtest/gtest.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
@@ -220,6 +222,115 @@ TEST(TestObjectStore, DeleteAll) {
   EXPECT_TRUE(store.GetInternalBlob(1, &internal));
   EXPECT_EQ("internal", internal);
 }
+
+TEST(TestObjectStore, Batch) {
+  ObjectStoreImpl store;
+  const FilePath::CharType database[] = FILE_PATH_LITERAL(":memory:");
+  ASSERT_TRUE(store.Init(FilePath(database)));
+  string tmp(32, 'A');
+  SecureBlob key(tmp.begin(), tmp.end());
+  EXPECT_TRUE(store.SetEncryptionKey(key));
+  // A batch is written when it grows too large, when it is committed and when
+  // blobs are loaded.
+  store.set_max_batch_size(2);
+  EXPECT_TRUE(store.BeginBatch());
+  EXPECT_FALSE(store.BeginBatch());
+  int handles[5];
+  for (int i = 0; i < 5; ++i) {
+    ObjectBlob blob = {base::StringPrintf("blob%d", i), (i % 2) == 0};
+    EXPECT_TRUE(store.InsertObjectBlob(blob, &handles[i]));
+    for (int j = 0; j < i; ++j)
+      EXPECT_NE(handles[i], handles[j]);
+  }
+  map<int, ObjectBlob> objects;
+  EXPECT_TRUE(store.LoadPublicObjectBlobs(&objects));
+  EXPECT_EQ(2, objects.size());
+  EXPECT_TRUE(store.DeleteObjectBlob(handles[1]));
+  ObjectBlob updated = {"updated", true};
+  EXPECT_TRUE(store.UpdateObjectBlob(handles[0], updated));
+  EXPECT_TRUE(store.CommitBatch());
+  EXPECT_TRUE(store.CommitBatch());
+  objects.clear();
+  map<int, ObjectBlob> objects2;
+  EXPECT_TRUE(store.LoadPublicObjectBlobs(&objects));
+  EXPECT_TRUE(store.LoadPrivateObjectBlobs(&objects2));
+  ASSERT_EQ(1, objects.size());
+  EXPECT_EQ("blob3", objects[handles[3]].blob);
+  ASSERT_EQ(3, objects2.size());
+  EXPECT_EQ("updated", objects2[handles[0]].blob);
+  // IDs handed out after the batch do not collide with the batched ones.
+  int handle;
+  ObjectBlob blob = {"blob", false};
+  EXPECT_TRUE(store.InsertObjectBlob(blob, &handle));
+  for (int i = 0; i < 5; ++i)
+    EXPECT_NE(handles[i], handle);
+}
+
+// Enough blobs to be decrypted on several threads.
+TEST(TestObjectStore, LoadManyBlobs) {
+  const int kNumObjects = 500;
+  ObjectStoreImpl store;
+  const FilePath::CharType database[] = FILE_PATH_LITERAL(":memory:");
+  ASSERT_TRUE(store.Init(FilePath(database)));
+  string tmp(32, 'A');
+  SecureBlob key(tmp.begin(), tmp.end());
+  EXPECT_TRUE(store.SetEncryptionKey(key));
+  map<int, string> expected;
+  for (int i = 0; i < kNumObjects; ++i) {
+    ObjectBlob blob = {base::StringPrintf("blob%d", i), true};
+    int handle;
+    EXPECT_TRUE(store.InsertObjectBlob(blob, &handle));
+    expected[handle] = blob.blob;
+  }
+  map<int, ObjectBlob> objects;
+  EXPECT_TRUE(store.LoadPrivateObjectBlobs(&objects));
+  ASSERT_EQ(expected.size(), objects.size());
+  for (map<int, string>::iterator it = expected.begin(); it != expected.end();
+       ++it) {
+    EXPECT_EQ(it->second, objects[it->first].blob);
+    EXPECT_TRUE(objects[it->first].is_private);
+  }
+}
+
+// Changes made in a batch reach the database every |max_batch_size| changes
+// and when the batch is committed, rather than one write per change.
+TEST(TestObjectStore, BatchWrites) {
+  ObjectStoreImpl store;
+  const FilePath::CharType database[] = FILE_PATH_LITERAL(":memory:");
+  ASSERT_TRUE(store.Init(FilePath(database)));
+  string tmp(32, 'A');
+  SecureBlob key(tmp.begin(), tmp.end());
+  EXPECT_TRUE(store.SetEncryptionKey(key));
+  store.set_max_batch_size(10);
+  auto count_entries = [&store]() {
+    std::unique_ptr<leveldb::Iterator>
+        it(store.db_->NewIterator(leveldb::ReadOptions()));
+    int count = 0;
+    for (it->SeekToFirst(); it->Valid(); it->Next())
+      ++count;
+    return count;
+  };
+  const int initial_entries = count_entries();
+  ASSERT_TRUE(store.BeginBatch());
+  int handle;
+  for (int i = 0; i < 9; ++i) {
+    ObjectBlob blob = {base::StringPrintf("blob%d", i), (i % 2) == 0};
+    EXPECT_TRUE(store.InsertObjectBlob(blob, &handle));
+  }
+  EXPECT_EQ(initial_entries, count_entries());
+  // The tenth change writes the batch, along with the ID tracker.
+  ObjectBlob blob = {"blob9", false};
+  EXPECT_TRUE(store.InsertObjectBlob(blob, &handle));
+  const int batch_entries = count_entries();
+  EXPECT_LE(initial_entries + 10, batch_entries);
+  for (int i = 10; i < 15; ++i) {
+    ObjectBlob blob = {base::StringPrintf("blob%d", i), false};
+    EXPECT_TRUE(store.InsertObjectBlob(blob, &handle));
+  }
+  EXPECT_EQ(batch_entries, count_entries());
+  EXPECT_TRUE(store.CommitBatch());
+  EXPECT_EQ(batch_entries + 5, count_entries());
+}
 #endif
 
 }  // namespace chaps
@@ -5,10 +5,13 @@
 // The expensive PKCS #11 operations that occur during a VPN connect are C_Login
 // and C_Sign.  This program replays these along with minimal overhead calls.
 // The --generate switch can be used to prepare a private key to test against.
+// The --benchmark switch runs a mix of operations on several threads and
+// reports their latency and throughput.
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -19,7 +22,9 @@
 #include <base/logging.h>
 #include <base/macros.h>
 #include <base/strings/string_number_conversions.h>
+#include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
+#include <base/strings/stringprintf.h>
 #include <base/threading/platform_thread.h>
 #include <base/time/time.h>
 #include <brillo/syslog_logging.h>
@@ -37,6 +42,11 @@ using std::vector;
 
 namespace {
 const char* kKeyID = "test";
+const char* kDefaultBenchmarkOps =
+    "find:2,get_attribute:2,sign:1,digest:2,random:2";
+
+// Set by --benchmark so that stdout only holds the JSON results.
+bool g_print_ticks_to_stderr = false;
 
 typedef enum {
   kPrivateKey,
@@ -486,6 +496,13 @@ void PrintHelp() {
   printf("Usage: p11_replay [--slot=<slot>] [COMMAND]\n");
   printf("Commands:\n");
   printf("  --cleanup : Deletes all test keys.\n");
+  printf("  --benchmark [--threads=<count> --iterations=<count>"
+         " --warmup=<count> --ops=<op:weight,...> --label=<key_label>"
+         " --output=<path>] : Runs the given mix of operations on each thread"
+         " and prints the latency percentiles and throughput of each as JSON,"
+         " to the output file if given. Operations are find, get_attribute,"
+         " sign, digest and random. The default mix is"
+         " \"%s\".\n", kDefaultBenchmarkOps);
   printf("  --generate [--label=<key_label> --key_size=<size_in_bits>]"
          " : Generates a key pair suitable for replay tests.\n");
   printf("  --generate_delete : Generates a key pair and deletes it. This is "
@@ -512,7 +529,8 @@ void PrintTicks(base::TimeTicks* start_ticks) {
   base::TimeDelta delta = now - *start_ticks;
   *start_ticks = now;
   intmax_t value = delta.InMillisecondsRoundedUp();
-  printf("Elapsed: %jdms\n", value);
+  fprintf(g_print_ticks_to_stderr ? stderr : stdout, "Elapsed: %jdms\n",
+          value);
 }
 
 void PrintObjects(const vector<CK_OBJECT_HANDLE>& objects) {
@@ -579,6 +597,282 @@ void PrintTokens() {
   }
 }
 
+// The operations that --benchmark can run.
+enum BenchmarkOp {
+  kBenchmarkFind,
+  kBenchmarkGetAttribute,
+  kBenchmarkSign,
+  kBenchmarkDigest,
+  kBenchmarkRandom,
+  kNumBenchmarkOps,
+};
+
+const char* kBenchmarkOpNames[kNumBenchmarkOps] = {
+  "find",
+  "get_attribute",
+  "sign",
+  "digest",
+  "random",
+};
+
+// Parses a mix like "find:2,sign:1" into a schedule that holds each operation
+// as many times as its weight. A missing weight counts as 1.
+bool ParseBenchmarkOps(const string& ops, vector<BenchmarkOp>* schedule) {
+  vector<string> entries = base::SplitString(ops, ",", base::TRIM_WHITESPACE,
+                                             base::SPLIT_WANT_NONEMPTY);
+  for (size_t i = 0; i < entries.size(); ++i) {
+    vector<string> parts = base::SplitString(entries[i], ":",
+                                             base::TRIM_WHITESPACE,
+                                             base::SPLIT_WANT_ALL);
+    int weight = 1;
+    if (parts.size() > 2 ||
+        (parts.size() == 2 && !base::StringToInt(parts[1], &weight)) ||
+        weight < 0) {
+      LOG(ERROR) << "Invalid operation: " << entries[i];
+      return false;
+    }
+    int op = 0;
+    while (op < kNumBenchmarkOps && parts[0] != kBenchmarkOpNames[op])
+      ++op;
+    if (op == kNumBenchmarkOps) {
+      LOG(ERROR) << "Unknown operation: " << parts[0];
+      return false;
+    }
+    schedule->insert(schedule->end(), weight, static_cast<BenchmarkOp>(op));
+  }
+  return !schedule->empty();
+}
+
+// Finds the first test key of the given class with the given label, without
+// the logging of Find() so that it can be timed. |key| is set to
+// CK_INVALID_HANDLE if there is none.
+CK_RV FindTestKey(CK_SESSION_HANDLE session,
+                  CK_OBJECT_CLASS class_value,
+                  const string& label,
+                  CK_OBJECT_HANDLE* key) {
+  CK_ATTRIBUTE attributes[] = {
+    {CKA_CLASS, &class_value, sizeof(class_value)},
+    {CKA_ID, const_cast<char*>(kKeyID), strlen(kKeyID)},
+    {CKA_LABEL, const_cast<char*>(label.c_str()), label.length()},
+  };
+  *key = CK_INVALID_HANDLE;
+  CK_RV result = C_FindObjectsInit(session, attributes, arraysize(attributes));
+  if (result != CKR_OK)
+    return result;
+  CK_ULONG object_count = 0;
+  result = C_FindObjects(session, key, 1, &object_count);
+  CK_RV final_result = C_FindObjectsFinal(session);
+  return (result != CKR_OK) ? result : final_result;
+}
+
+// Runs a share of the --benchmark operations on its own session and records
+// the latency of each, in microseconds.
+class BenchmarkThread : public base::PlatformThread::Delegate {
+ public:
+  BenchmarkThread(CK_SLOT_ID slot,
+                  const string& label,
+                  const vector<BenchmarkOp>& schedule,
+                  int schedule_offset,
+                  int warmup,
+                  int iterations)
+      : slot_(slot),
+        label_(label),
+        schedule_(schedule),
+        schedule_offset_(schedule_offset),
+        warmup_(warmup),
+        iterations_(iterations),
+        private_key_(CK_INVALID_HANDLE),
+        public_key_(CK_INVALID_HANDLE) {
+    std::fill(errors_, errors_ + kNumBenchmarkOps, 0);
+  }
+
+  void ThreadMain() {
+    CK_SESSION_HANDLE session = OpenSession(slot_);
+    FindTestKey(session, CKO_PRIVATE_KEY, label_, &private_key_);
+    FindTestKey(session, CKO_PUBLIC_KEY, label_, &public_key_);
+    if (schedule_offset_ == 0 && private_key_ == CK_INVALID_HANDLE)
+      LOG(WARNING) << "No test key; sign and get_attribute will fail. Use "
+                   << "--generate or --inject first.";
+    for (int i = 0; i < warmup_; ++i)
+      RunOp(session, NextOp(i));
+    start_ = TimeTicks::Now();
+    for (int i = 0; i < iterations_; ++i) {
+      BenchmarkOp op = NextOp(warmup_ + i);
+      TimeTicks op_start = TimeTicks::Now();
+      CK_RV result = RunOp(session, op);
+      TimeDelta delta = TimeTicks::Now() - op_start;
+      latencies_[op].push_back(delta.InMicroseconds());
+      if (result != CKR_OK)
+        ++errors_[op];
+    }
+    end_ = TimeTicks::Now();
+    C_CloseSession(session);
+  }
+
+  const vector<int64_t>& latencies(BenchmarkOp op) const {
+    return latencies_[op];
+  }
+  int errors(BenchmarkOp op) const { return errors_[op]; }
+  TimeTicks start() const { return start_; }
+  TimeTicks end() const { return end_; }
+
+ private:
+  // Threads start at different points of the schedule so that they do not all
+  // run the same operation at the same time.
+  BenchmarkOp NextOp(int iteration) const {
+    return schedule_[(schedule_offset_ + iteration) % schedule_.size()];
+  }
+
+  CK_RV RunOp(CK_SESSION_HANDLE session, BenchmarkOp op) {
+    switch (op) {
+      case kBenchmarkFind: {
+        CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+        return FindTestKey(session, CKO_PUBLIC_KEY, label_, &key);
+      }
+      case kBenchmarkGetAttribute: {
+        CK_BYTE modulus[512];
+        CK_BYTE exponent[16];
+        CK_ATTRIBUTE attributes[] = {
+          {CKA_MODULUS, modulus, sizeof(modulus)},
+          {CKA_PUBLIC_EXPONENT, exponent, sizeof(exponent)},
+        };
+        return C_GetAttributeValue(session, public_key_, attributes,
+                                   arraysize(attributes));
+      }
+      case kBenchmarkSign: {
+        CK_MECHANISM mechanism = {CKM_SHA1_RSA_PKCS, NULL, 0};
+        CK_RV result = C_SignInit(session, &mechanism, private_key_);
+        if (result != CKR_OK)
+          return result;
+        CK_BYTE data[200] = {0};
+        CK_BYTE signature[2048];
+        CK_ULONG signature_length = arraysize(signature);
+        return C_Sign(session, data, arraysize(data), signature,
+                      &signature_length);
+      }
+      case kBenchmarkDigest: {
+        CK_MECHANISM mechanism = {CKM_SHA256, NULL, 0};
+        CK_RV result = C_DigestInit(session, &mechanism);
+        if (result != CKR_OK)
+          return result;
+        CK_BYTE data[1024] = {0};
+        CK_BYTE digest[32];
+        CK_ULONG digest_length = arraysize(digest);
+        return C_Digest(session, data, arraysize(data), digest,
+                        &digest_length);
+      }
+      case kBenchmarkRandom: {
+        CK_BYTE random[32];
+        return C_GenerateRandom(session, random, arraysize(random));
+      }
+      default:
+        NOTREACHED();
+        return CKR_GENERAL_ERROR;
+    }
+  }
+
+  CK_SLOT_ID slot_;
+  string label_;
+  vector<BenchmarkOp> schedule_;
+  int schedule_offset_;
+  int warmup_;
+  int iterations_;
+  CK_OBJECT_HANDLE private_key_;
+  CK_OBJECT_HANDLE public_key_;
+  vector<int64_t> latencies_[kNumBenchmarkOps];
+  int errors_[kNumBenchmarkOps];
+  TimeTicks start_;
+  TimeTicks end_;
+
+  DISALLOW_COPY_AND_ASSIGN(BenchmarkThread);
+};
+
+// Returns the given percentile of sorted |values| using the nearest-rank
+// method.
+int64_t Percentile(const vector<int64_t>& values, int percentile) {
+  if (values.empty())
+    return 0;
+  size_t rank = (values.size() * percentile + 99) / 100;
+  return values[std::max<size_t>(rank, 1) - 1];
+}
+
+// Runs the benchmark and returns its results as a JSON object.
+string RunBenchmark(CK_SLOT_ID slot,
+                    const string& label,
+                    const vector<BenchmarkOp>& schedule,
+                    int num_threads,
+                    int warmup,
+                    int iterations) {
+  vector<std::unique_ptr<BenchmarkThread>> threads(num_threads);
+  vector<base::PlatformThreadHandle> handles(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads[i].reset(new BenchmarkThread(slot, label, schedule, i, warmup,
+                                         iterations));
+    if (!base::PlatformThread::Create(0, threads[i].get(), &handles[i]))
+      LOG(FATAL) << "Failed to create thread.";
+  }
+  for (int i = 0; i < num_threads; ++i)
+    base::PlatformThread::Join(handles[i]);
+
+  // The measured interval runs from the first thread done warming up to the
+  // last thread done.
+  TimeTicks start = threads[0]->start();
+  TimeTicks end = threads[0]->end();
+  for (int i = 1; i < num_threads; ++i) {
+    start = std::min(start, threads[i]->start());
+    end = std::max(end, threads[i]->end());
+  }
+  double seconds = std::max((end - start).InSecondsF(), 1e-6);
+  int64_t total_count = 0;
+  string ops_json;
+  for (int op = 0; op < kNumBenchmarkOps; ++op) {
+    vector<int64_t> latencies;
+    int errors = 0;
+    for (int i = 0; i < num_threads; ++i) {
+      const vector<int64_t>& thread_latencies =
+          threads[i]->latencies(static_cast<BenchmarkOp>(op));
+      latencies.insert(latencies.end(), thread_latencies.begin(),
+                       thread_latencies.end());
+      errors += threads[i]->errors(static_cast<BenchmarkOp>(op));
+    }
+    if (latencies.empty())
+      continue;
+    std::sort(latencies.begin(), latencies.end());
+    total_count += latencies.size();
+    if (!ops_json.empty())
+      ops_json += ",";
+    ops_json += base::StringPrintf(
+        "\"%s\":{\"count\":%zu,\"errors\":%d,\"ops_per_sec\":%.1f,"
+        "\"p50_us\":%jd,\"p95_us\":%jd,\"p99_us\":%jd,\"max_us\":%jd}",
+        kBenchmarkOpNames[op], latencies.size(), errors,
+        latencies.size() / seconds,
+        static_cast<intmax_t>(Percentile(latencies, 50)),
+        static_cast<intmax_t>(Percentile(latencies, 95)),
+        static_cast<intmax_t>(Percentile(latencies, 99)),
+        static_cast<intmax_t>(latencies.back()));
+  }
+  return base::StringPrintf(
+      "{\"threads\":%d,\"warmup\":%d,\"iterations\":%d,"
+      "\"elapsed_ms\":%jd,\"ops_per_sec\":%.1f,\"ops\":{%s}}\n",
+      num_threads, warmup, iterations,
+      static_cast<intmax_t>((end - start).InMilliseconds()),
+      total_count / seconds, ops_json.c_str());
+}
+
+// Reads an integer switch, falling back to |default_value|.
+int GetIntSwitch(const base::CommandLine* cl,
+                 const char* name,
+                 int default_value) {
+  int value = default_value;
+  if (cl->HasSwitch(name) &&
+      (!base::StringToInt(cl->GetSwitchValueASCII(name), &value) ||
+       value < 0)) {
+    LOG(ERROR) << "Invalid value for --" << name;
+    exit(-1);
+  }
+  return value;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -602,13 +896,16 @@ int main(int argc, char** argv) {
       cl->HasSwitch("id");
   bool digest_test = cl->HasSwitch("digest_test");
   bool list_tokens = cl->HasSwitch("list_tokens");
+  bool benchmark = cl->HasSwitch("benchmark");
   if (!generate && !generate_delete && !vpn && !wifi && !logout && !cleanup &&
-      !inject && !list_objects && !import && !digest_test && !list_tokens) {
+      !inject && !list_objects && !import && !digest_test && !list_tokens &&
+      !benchmark) {
     PrintHelp();
     return 0;
   }
 
   brillo::InitLog(brillo::kLogToSyslog | brillo::kLogToStderr);
+  g_print_ticks_to_stderr = benchmark;
   base::TimeTicks start_ticks = base::TimeTicks::Now();
   CK_SLOT_ID slot = Initialize();
   int tmp_slot = 0;
@@ -699,6 +996,34 @@ int main(int argc, char** argv) {
   if (list_tokens) {
     PrintTokens();
   }
+  if (benchmark) {
+    vector<BenchmarkOp> schedule;
+    string ops = kDefaultBenchmarkOps;
+    if (cl->HasSwitch("ops"))
+      ops = cl->GetSwitchValueASCII("ops");
+    if (!ParseBenchmarkOps(ops, &schedule)) {
+      LOG(ERROR) << "Invalid operation mix: " << ops;
+      exit(-1);
+    }
+    int num_threads = std::max(GetIntSwitch(cl, "threads", 4), 1);
+    int warmup = GetIntSwitch(cl, "warmup", 10);
+    int iterations = GetIntSwitch(cl, "iterations", 100);
+    // Private keys can only be used once logged in.
+    session = Login(slot, false, session);
+    string results = RunBenchmark(slot, label, schedule, num_threads, warmup,
+                                  iterations);
+    if (cl->HasSwitch("output")) {
+      base::FilePath path = cl->GetSwitchValuePath("output");
+      if (base::WriteFile(path, results.data(), results.size()) !=
+          static_cast<int>(results.size())) {
+        LOG(ERROR) << "Failed to write " << path.value();
+        exit(-1);
+      }
+    } else {
+      printf("%s", results.c_str());
+    }
+    PrintTicks(&start_ticks);
+  }
   if (cleanup)
     DeleteAllTestKeys(session);
   TearDown(session, logout);
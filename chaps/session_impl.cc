@@ -12,7 +12,11 @@
 #include <vector>
 
 #include <base/logging.h>
+#include <base/macros.h>
 #include <brillo/secure_blob.h>
+#if !defined(NO_METRICS)
+#include <metrics/metrics_library.h>
+#endif
 #include <openssl/bio.h>
 #include <openssl/des.h>
 #include <openssl/err.h>
@@ -45,6 +49,8 @@ static const int kMaxDigestOutputBytes = EVP_MAX_MD_SIZE;
 static const int kMinRSAKeyBits = 512;
 static const int kMaxRSAKeyBitsHW = 2048;  // Max supported by the TPM.
 static const int kMaxRSAKeyBitsSW = kMaxRSAOutputBytes * 8;
+// The number of keys GetSoftwareKey() keeps before it starts over.
+static const size_t kMaxSoftwareKeys = 16;
 
 SessionImpl::SessionImpl(int slot_id,
                          ObjectPool* token_object_pool,
@@ -58,6 +64,8 @@ SessionImpl::SessionImpl(int slot_id,
       slot_id_(slot_id),
       token_object_pool_(token_object_pool),
       tpm_utility_(tpm_utility),
+      tpm_rsa_operations_(0),
+      software_rsa_operations_(0),
       is_legacy_loaded_(false),
       private_root_key_(0),
       public_root_key_(0) {
@@ -71,6 +79,21 @@ SessionImpl::SessionImpl(int slot_id,
 }
 
 SessionImpl::~SessionImpl() {
+  ClearSoftwareKeys();
+  if (tpm_rsa_operations_ == 0 && software_rsa_operations_ == 0)
+    return;
+  VLOG(1) << "RSA operations: " << tpm_rsa_operations_ << " by the TPM, "
+          << software_rsa_operations_ << " in software.";
+#if !defined(NO_METRICS)
+  const int kMaxOperations = 10000;
+  const int kNumBuckets = 50;
+  MetricsLibrary metrics;
+  metrics.Init();
+  metrics.SendToUMA("Chaps.RSAOperations.TPM", tpm_rsa_operations_, 1,
+                    kMaxOperations, kNumBuckets);
+  metrics.SendToUMA("Chaps.RSAOperations.Software", software_rsa_operations_,
+                    1, kMaxOperations, kNumBuckets);
+#endif
 }
 
 int SessionImpl::GetSlot() const {
@@ -1126,6 +1149,50 @@ RSA* SessionImpl::CreateKeyFromObject(const Object* key_object) {
   return rsa;
 }
 
+RSA* SessionImpl::GetSoftwareKey(const Object* key_object) {
+  // The attributes CreateKeyFromObject() builds the key from.
+  static const CK_ATTRIBUTE_TYPE kPublicKeyAttributes[] = {
+    CKA_MODULUS, CKA_PUBLIC_EXPONENT
+  };
+  static const CK_ATTRIBUTE_TYPE kPrivateKeyAttributes[] = {
+    CKA_MODULUS, CKA_PRIVATE_EXPONENT, CKA_PRIME_1, CKA_PRIME_2,
+    CKA_EXPONENT_1, CKA_EXPONENT_2, CKA_COEFFICIENT
+  };
+  const CK_ATTRIBUTE_TYPE* attributes = kPrivateKeyAttributes;
+  size_t num_attributes = arraysize(kPrivateKeyAttributes);
+  if (key_object->GetObjectClass() == CKO_PUBLIC_KEY) {
+    attributes = kPublicKeyAttributes;
+    num_attributes = arraysize(kPublicKeyAttributes);
+  }
+  vector<SecureBlob> material(num_attributes);
+  for (size_t i = 0; i < num_attributes; ++i) {
+    string value = key_object->GetAttributeString(attributes[i]);
+    material[i].assign(value.begin(), value.end());
+  }
+  map<const Object*, SoftwareKey>::iterator it =
+      software_keys_.find(key_object);
+  if (it != software_keys_.end()) {
+    if (it->second.material == material)
+      return it->second.rsa;
+    RSA_free(it->second.rsa);
+    software_keys_.erase(it);
+  }
+  if (software_keys_.size() >= kMaxSoftwareKeys)
+    ClearSoftwareKeys();
+  SoftwareKey& key = software_keys_[key_object];
+  key.rsa = CreateKeyFromObject(key_object);
+  key.material.swap(material);
+  return key.rsa;
+}
+
+void SessionImpl::ClearSoftwareKeys() {
+  for (map<const Object*, SoftwareKey>::iterator it = software_keys_.begin();
+       it != software_keys_.end(); ++it) {
+    RSA_free(it->second.rsa);
+  }
+  software_keys_.clear();
+}
+
 const EVP_CIPHER* SessionImpl::GetOpenSSLCipher(CK_MECHANISM_TYPE mechanism,
                                                 size_t key_size) {
   switch (mechanism) {
@@ -1200,8 +1267,10 @@ bool SessionImpl::RSADecrypt(OperationContext* context) {
     context->data_.clear();
     if (!tpm_utility_->Unbind(tpm_key_handle, encrypted_data, &context->data_))
       return false;
+    ++tpm_rsa_operations_;
   } else {
-    RSA* rsa = CreateKeyFromObject(context->key_);
+    ++software_rsa_operations_;
+    RSA* rsa = GetSoftwareKey(context->key_);
     uint8_t buffer[kMaxRSAOutputBytes];
     CHECK(RSA_size(rsa) <= kMaxRSAOutputBytes);
     int length = RSA_private_decrypt(
@@ -1210,7 +1279,6 @@ bool SessionImpl::RSADecrypt(OperationContext* context) {
         buffer,
         rsa,
         RSA_PKCS1_PADDING);  // Strips PKCS #1 type 2 padding.
-    RSA_free(rsa);
     if (length == -1) {
       LOG(ERROR) << "RSA_private_decrypt failed: " << GetOpenSSLError();
       return false;
@@ -1221,7 +1289,9 @@ bool SessionImpl::RSADecrypt(OperationContext* context) {
 }
 
 bool SessionImpl::RSAEncrypt(OperationContext* context) {
-  RSA* rsa = CreateKeyFromObject(context->key_);
+  // Public key operations never need the TPM.
+  ++software_rsa_operations_;
+  RSA* rsa = GetSoftwareKey(context->key_);
   uint8_t buffer[kMaxRSAOutputBytes];
   CHECK(RSA_size(rsa) <= kMaxRSAOutputBytes);
   int length = RSA_public_encrypt(
@@ -1230,7 +1300,6 @@ bool SessionImpl::RSAEncrypt(OperationContext* context) {
       buffer,
       rsa,
       RSA_PKCS1_PADDING);  // Adds PKCS #1 type 2 padding.
-  RSA_free(rsa);
   if (length == -1) {
     LOG(ERROR) << "RSA_public_encrypt failed: " << GetOpenSSLError();
     return false;
@@ -1249,8 +1318,10 @@ bool SessionImpl::RSASign(OperationContext* context) {
       return false;
     if (!tpm_utility_->Sign(tpm_key_handle, data_to_sign, &signature))
       return false;
+    ++tpm_rsa_operations_;
   } else {
-    RSA* rsa = CreateKeyFromObject(context->key_);
+    ++software_rsa_operations_;
+    RSA* rsa = GetSoftwareKey(context->key_);
     CHECK(RSA_size(rsa) <= kMaxRSAOutputBytes);
     uint8_t buffer[kMaxRSAOutputBytes];
     int length = RSA_private_encrypt(
@@ -1259,7 +1330,6 @@ bool SessionImpl::RSASign(OperationContext* context) {
         buffer,
         rsa,
         RSA_PKCS1_PADDING);  // Adds PKCS #1 type 1 padding.
-    RSA_free(rsa);
     if (length == -1) {
       LOG(ERROR) << "RSA_private_encrypt failed: " << GetOpenSSLError();
       return false;
@@ -1276,7 +1346,8 @@ CK_RV SessionImpl::RSAVerify(OperationContext* context,
   if (context->key_->GetAttributeString(CKA_MODULUS).length() !=
       signature.length())
     return CKR_SIGNATURE_LEN_RANGE;
-  RSA* rsa = CreateKeyFromObject(context->key_);
+  ++software_rsa_operations_;
+  RSA* rsa = GetSoftwareKey(context->key_);
   CHECK(RSA_size(rsa) <= kMaxRSAOutputBytes);
   uint8_t buffer[kMaxRSAOutputBytes];
   int length = RSA_public_decrypt(
@@ -1285,7 +1356,6 @@ CK_RV SessionImpl::RSAVerify(OperationContext* context,
       buffer,
       rsa,
       RSA_PKCS1_PADDING);  // Strips PKCS #1 type 1 padding.
-  RSA_free(rsa);
   if (length == -1) {
     LOG(ERROR) << "RSA_public_decrypt failed: " << GetOpenSSLError();
     return CKR_SIGNATURE_INVALID;
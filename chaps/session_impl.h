@@ -12,6 +12,7 @@
 #include <string>
 #include <vector>
 
+#include <brillo/secure_blob.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 
@@ -196,6 +197,12 @@ class SessionImpl : public Session {
   BIGNUM* ConvertToBIGNUM(const std::string& big_integer);
   // Always returns a non-NULL value.
   RSA* CreateKeyFromObject(const Object* key_object);
+  // Returns the OpenSSL key for a key object that is used in software. The key
+  // is kept for later operations so that it is not rebuilt, along with its
+  // Montgomery contexts, every time. The session owns the key. Always returns
+  // a non-NULL value.
+  RSA* GetSoftwareKey(const Object* key_object);
+  void ClearSoftwareKeys();
   const EVP_CIPHER* GetOpenSSLCipher(CK_MECHANISM_TYPE mechanism,
                                      size_t key_size);
   const EVP_MD* GetOpenSSLDigest(CK_MECHANISM_TYPE mechanism);
@@ -206,6 +213,18 @@ class SessionImpl : public Session {
   bool find_results_valid_;
   bool is_read_only_;
   std::map<const Object*, int> object_tpm_handle_map_;
+  // A key made by GetSoftwareKey() and all the key material it was made from.
+  // The object may have been changed, or destroyed and another one created at
+  // the same address, so the material is compared before the key is reused.
+  struct SoftwareKey {
+    RSA* rsa;
+    std::vector<brillo::SecureBlob> material;
+  };
+  std::map<const Object*, SoftwareKey> software_keys_;
+  // The number of RSA operations run by the TPM and in software, reported to
+  // UMA when the session closes.
+  int tpm_rsa_operations_;
+  int software_rsa_operations_;
   OperationContext operation_context_[kNumOperationTypes];
   int slot_id_;
   std::unique_ptr<ObjectPool> session_object_pool_;
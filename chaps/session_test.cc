@@ -571,6 +571,32 @@ TEST_F(TestSession, RSASign) {
   EXPECT_EQ(CKR_OK, session_->VerifyFinal(sig2));
 }
 
+// Test that software keys kept across operations are not mixed up.
+TEST_F(TestSession, RSAKeyReuse) {
+  const Object* pub = NULL;
+  const Object* priv = NULL;
+  GenerateRSAKeyPair(true, 1024, &pub, &priv);
+  const Object* pub2 = NULL;
+  const Object* priv2 = NULL;
+  GenerateRSAKeyPair(true, 1024, &pub2, &priv2);
+  string in(100, 'A');
+  for (int i = 0; i < 3; ++i) {
+    int len = 1024;
+    string sig;
+    EXPECT_EQ(CKR_OK, session_->OperationInit(kSign, CKM_SHA1_RSA_PKCS, "",
+                                              (i % 2) ? priv2 : priv));
+    EXPECT_EQ(CKR_OK, session_->OperationSinglePart(kSign, in, &len, &sig));
+    EXPECT_EQ(CKR_OK, session_->OperationInit(kVerify, CKM_SHA1_RSA_PKCS, "",
+                                              (i % 2) ? pub2 : pub));
+    EXPECT_EQ(CKR_OK, session_->OperationUpdate(kVerify, in, NULL, NULL));
+    EXPECT_EQ(CKR_OK, session_->VerifyFinal(sig));
+    EXPECT_EQ(CKR_OK, session_->OperationInit(kVerify, CKM_SHA1_RSA_PKCS, "",
+                                              (i % 2) ? pub : pub2));
+    EXPECT_EQ(CKR_OK, session_->OperationUpdate(kVerify, in, NULL, NULL));
+    EXPECT_EQ(CKR_SIGNATURE_INVALID, session_->VerifyFinal(sig));
+  }
+}
+
 // Test that requests for unsupported mechanisms are handled correctly.
 TEST_F(TestSession, MechanismInvalid) {
   const Object* key = NULL;
@@ -14,6 +14,9 @@
 #include <base/logging.h>
 #include <base/synchronization/lock.h>
 #include <brillo/secure_blob.h>
+#if !defined(NO_METRICS)
+#include <metrics/metrics_library.h>
+#endif
 #include <openssl/rand.h>
 #include <trousers/scoped_tss_type.h>
 #include <trousers/tss.h>
@@ -34,6 +37,37 @@ using std::stringstream;
 
 namespace chaps {
 
+namespace {
+
+// Returns true if a key failed to load because the TPM has no room left.
+bool IsOutOfKeySpace(TSS_RESULT result) {
+  if (result == (TSS_LAYER_TCS | TCS_E_KM_LOADFAILED))
+    return true;
+  return ERROR_LAYER(result) == TSS_LAYER_TPM &&
+         (ERROR_CODE(result) == TPM_E_NOSPACE ||
+          ERROR_CODE(result) == TPM_E_RESOURCES);
+}
+
+// Reports to UMA how the keys of a slot were used until it was unloaded.
+void ReportKeyUses(int key_hits, int key_reloads, int key_evictions) {
+  if (key_hits == 0 && key_reloads == 0 && key_evictions == 0)
+    return;
+#if !defined(NO_METRICS)
+  const int kMaxKeyUses = 10000;
+  const int kNumBuckets = 50;
+  MetricsLibrary metrics;
+  metrics.Init();
+  metrics.SendToUMA("Chaps.KeyUses.Loaded", key_hits, 1, kMaxKeyUses,
+                    kNumBuckets);
+  metrics.SendToUMA("Chaps.KeyUses.Reloaded", key_reloads, 1, kMaxKeyUses,
+                    kNumBuckets);
+  metrics.SendToUMA("Chaps.KeyEvictions", key_evictions, 1, kMaxKeyUses,
+                    kNumBuckets);
+#endif
+}
+
+}  // namespace
+
 // TSSEncryptedData wraps a TSS encrypted data object. The underlying TSS object
 // will be closed when this object falls out of scope.
 typedef ScopedTssObject<TSS_HENCDATA> ScopedTssEncData;
@@ -141,6 +175,7 @@ TPMUtilityImpl::TPMUtilityImpl(const string& srk_auth_data)
       srk_public_loaded_(false),
       default_exponent_("\x1\x0\x1", 3),
       last_handle_(0),
+      last_use_(0),
       is_enabled_(false),
       is_enabled_ready_(false) {}
 
@@ -151,8 +186,11 @@ TPMUtilityImpl::~TPMUtilityImpl() {
   for (it = slot_handles_.begin(); it != slot_handles_.end(); ++it) {
     set<int>* slot_handles = &it->second.handles_;
     for (it2 = slot_handles->begin(); it2 != slot_handles->end(); ++it2) {
-      Tspi_Key_UnloadKey(GetTssHandle(*it2));
-      Tspi_Context_CloseObject(tsp_context_, GetTssHandle(*it2));
+      TSS_HKEY key = GetTssHandle(*it2);
+      if (!key)
+        continue;
+      Tspi_Key_UnloadKey(key);
+      Tspi_Context_CloseObject(tsp_context_, key);
     }
   }
   // These can't use ScopedTssObject because they must be closed before the
@@ -321,6 +359,8 @@ bool TPMUtilityImpl::ChangeAuthData(int slot_id,
     return false;
   // Change the secret.
   AutoLock lock(lock_);
+  if (!UseKey(key_handle))
+    return false;
   TSS_RESULT result = TSS_SUCCESS;
   ScopedTssPolicy policy(tsp_context_);
   result = Tspi_Context_CreateObject(tsp_context_,
@@ -445,7 +485,8 @@ bool TPMUtilityImpl::GenerateKey(int slot,
   }
   if (!GetKeyBlob(key, key_blob))
     return false;
-  *key_handle = CreateHandle(slot, key.release(), *key_blob, auth_data);
+  *key_handle = CreateHandle(slot, key.release(), *key_blob, auth_data,
+                             static_cast<int>(srk_));
   VLOG(1) << "TPMUtilityImpl::GenerateKey success";
   return true;
 }
@@ -455,7 +496,7 @@ bool TPMUtilityImpl::GetPublicKey(int key_handle,
                                   string* modulus) {
   VLOG(1) << "TPMUtilityImpl::GetPublicKey enter";
   AutoLock lock(lock_);
-  if (!InitSRK())
+  if (!InitSRK() || !UseKey(key_handle))
     return false;
   if (!GetKeyAttributeData(GetTssHandle(key_handle),
                            TSS_TSPATTRIB_RSAKEY_INFO,
@@ -545,7 +586,8 @@ bool TPMUtilityImpl::WrapKey(int slot,
   }
   if (!GetKeyBlob(key, key_blob))
     return false;
-  *key_handle = CreateHandle(slot, key.release(), *key_blob, auth_data);
+  *key_handle = CreateHandle(slot, key.release(), *key_blob, auth_data,
+                             static_cast<int>(srk_));
   VLOG(1) << "TPMUtilityImpl::WrapKey success";
   return true;
 }
@@ -569,28 +611,47 @@ bool TPMUtilityImpl::LoadKeyWithParent(int slot,
   if (IsAlreadyLoaded(slot, key_blob, key_handle))
     return true;
   VLOG(1) << "TPMUtilityImpl::LoadKeyWithParent enter";
+  // The parent may have been evicted.
+  if (!UseKey(parent_key_handle)) {
+    LOG(ERROR) << "Failed to load parent key.";
+    return false;
+  }
   ScopedTssKey key(tsp_context_);
   if (!LoadKeyInternal(GetTssHandle(parent_key_handle), key_blob, auth_data,
                        key.ptr()))
     return false;
-  *key_handle = CreateHandle(slot, key.release(), key_blob, auth_data);
+  *key_handle = CreateHandle(slot, key.release(), key_blob, auth_data,
+                             parent_key_handle);
   VLOG(1) << "TPMUtilityImpl::LoadKeyWithParent success";
   return true;
 }
 
 void TPMUtilityImpl::UnloadKeysForSlot(int slot) {
   VLOG(1) << "TPMUtilityImpl::UnloadKeysForSlot enter";
-  AutoLock lock(lock_);
-  if (!InitSRK())
-    return;
-  set<int>* handles = &slot_handles_[slot].handles_;
-  set<int>::iterator it;
-  for (it = handles->begin(); it != handles->end(); ++it) {
-    Tspi_Key_UnloadKey(GetTssHandle(*it));
-    Tspi_Context_CloseObject(tsp_context_, GetTssHandle(*it));
-  }
-  slot_handles_.erase(slot);
-  LOG(INFO) << "Unloaded keys for slot " << slot;
+  int key_hits, key_reloads, key_evictions;
+  {
+    AutoLock lock(lock_);
+    if (!InitSRK())
+      return;
+    set<int>* handles = &slot_handles_[slot].handles_;
+    set<int>::iterator it;
+    for (it = handles->begin(); it != handles->end(); ++it) {
+      TSS_HKEY key = GetTssHandle(*it);
+      if (key) {
+        Tspi_Key_UnloadKey(key);
+        Tspi_Context_CloseObject(tsp_context_, key);
+      }
+      handle_info_.erase(*it);
+    }
+    key_hits = slot_handles_[slot].key_hits_;
+    key_reloads = slot_handles_[slot].key_reloads_;
+    key_evictions = slot_handles_[slot].key_evictions_;
+    slot_handles_.erase(slot);
+  }
+  LOG(INFO) << "Unloaded keys for slot " << slot << ". Key uses: "
+            << key_hits << " loaded, " << key_reloads << " reloaded; "
+            << key_evictions << " keys evicted.";
+  ReportKeyUses(key_hits, key_reloads, key_evictions);
   VLOG(1) << "TPMUtilityImpl::UnloadKeysForSlot success";
 }
 
@@ -599,7 +660,7 @@ bool TPMUtilityImpl::Bind(int key_handle,
                           string* output) {
   VLOG(1) << "TPMUtilityImpl::Bind enter";
   AutoLock lock(lock_);
-  if (!InitSRK())
+  if (!InitSRK() || !UseKey(key_handle))
     return false;
   TSSEncryptedData encrypted(tsp_context_);
   if (!encrypted.Create())
@@ -623,7 +684,7 @@ bool TPMUtilityImpl::Unbind(int key_handle,
                             string* output) {
   VLOG(1) << "TPMUtilityImpl::Unbind enter";
   AutoLock lock(lock_);
-  if (!InitSRK())
+  if (!InitSRK() || !UseKey(key_handle))
     return false;
   TSSEncryptedData encrypted(tsp_context_);
   if (!encrypted.Create())
@@ -659,7 +720,7 @@ bool TPMUtilityImpl::Sign(int key_handle,
                           string* signature) {
   VLOG(1) << "TPMUtilityImpl::Sign enter";
   AutoLock lock(lock_);
-  if (!InitSRK())
+  if (!InitSRK() || !UseKey(key_handle))
     return false;
   TSSHash hash(tsp_context_);
   if (!hash.Create(input))
@@ -692,7 +753,7 @@ bool TPMUtilityImpl::Verify(int key_handle,
                             const string& signature) {
   VLOG(1) << "TPMUtilityImpl::Verify enter";
   AutoLock lock(lock_);
-  if (!InitSRK())
+  if (!InitSRK() || !UseKey(key_handle))
     return false;
   TSSHash hash(tsp_context_);
   if (!hash.Create(input))
@@ -719,7 +780,8 @@ bool TPMUtilityImpl::IsSRKReady() {
 int TPMUtilityImpl::CreateHandle(int slot,
                                  TSS_HKEY key,
                                  const string& key_blob,
-                                 const SecureBlob& auth_data) {
+                                 const SecureBlob& auth_data,
+                                 int parent_handle) {
   int handle = ++last_handle_;
   HandleInfo* handle_info = &slot_handles_[slot];
   handle_info->handles_.insert(handle);
@@ -728,6 +790,9 @@ int TPMUtilityImpl::CreateHandle(int slot,
   key_info->tss_handle = key;
   key_info->blob = key_blob;
   key_info->auth_data = auth_data;
+  key_info->slot = slot;
+  key_info->parent_handle = parent_handle;
+  key_info->last_use = ++last_use_;
   return handle;
 }
 
@@ -914,6 +979,17 @@ bool TPMUtilityImpl::LoadKeyInternal(TSS_HKEY parent,
       key_blob.length(),
       ConvertStringToByteBuffer(key_blob.data()),
       key);
+  // If the TPM has no room left for the key, evict the least recently used key
+  // and try again.
+  while (IsOutOfKeySpace(result) && EvictKey(parent)) {
+    LOG(WARNING) << "TPM is full: evicted a key to load another.";
+    result = Tspi_Context_LoadKeyByBlob(
+        tsp_context_,
+        parent,
+        key_blob.length(),
+        ConvertStringToByteBuffer(key_blob.data()),
+        key);
+  }
   if (result != TSS_SUCCESS) {
     LOG(ERROR) << "Tspi_Context_LoadKeyByBlob - " << ResultToString(result);
     return false;
@@ -949,13 +1025,20 @@ bool TPMUtilityImpl::LoadKeyInternal(TSS_HKEY parent,
 bool TPMUtilityImpl::ReloadKey(int key_handle) {
   KeyInfo* key_info = &handle_info_[key_handle];
   // Unload the current handle.
-  Tspi_Key_UnloadKey(key_info->tss_handle);
-  Tspi_Context_CloseObject(tsp_context_, key_info->tss_handle);
-  key_info->tss_handle = 0;
+  if (key_info->tss_handle) {
+    Tspi_Key_UnloadKey(key_info->tss_handle);
+    Tspi_Context_CloseObject(tsp_context_, key_info->tss_handle);
+    key_info->tss_handle = 0;
+  }
+  // The parent may have been evicted too.
+  if (!UseKey(key_info->parent_handle)) {
+    LOG(ERROR) << "Failed to reload parent key.";
+    return false;
+  }
   // Load the same key blob again.
   ScopedTssKey scoped_key(tsp_context_);
-  if (!LoadKeyInternal(srk_, key_info->blob, key_info->auth_data,
-                       scoped_key.ptr())) {
+  if (!LoadKeyInternal(GetTssHandle(key_info->parent_handle), key_info->blob,
+                       key_info->auth_data, scoped_key.ptr())) {
     LOG(ERROR) << "Failed to reload key.";
     return false;
   }
@@ -963,6 +1046,43 @@ bool TPMUtilityImpl::ReloadKey(int key_handle) {
   return true;
 }
 
+bool TPMUtilityImpl::UseKey(int key_handle) {
+  if (static_cast<TSS_HKEY>(key_handle) == srk_)
+    return true;
+  map<int, KeyInfo>::iterator it = handle_info_.find(key_handle);
+  if (it == handle_info_.end()) {
+    LOG(ERROR) << "Unknown key handle: " << key_handle;
+    return false;
+  }
+  it->second.last_use = ++last_use_;
+  HandleInfo* handle_info = &slot_handles_[it->second.slot];
+  if (it->second.tss_handle) {
+    ++handle_info->key_hits_;
+    return true;
+  }
+  ++handle_info->key_reloads_;
+  return ReloadKey(key_handle);
+}
+
+bool TPMUtilityImpl::EvictKey(TSS_HKEY keep) {
+  map<int, KeyInfo>::iterator lru = handle_info_.end();
+  map<int, KeyInfo>::iterator it;
+  for (it = handle_info_.begin(); it != handle_info_.end(); ++it) {
+    if (!it->second.tss_handle || it->second.tss_handle == keep)
+      continue;
+    if (lru == handle_info_.end() || it->second.last_use < lru->second.last_use)
+      lru = it;
+  }
+  if (lru == handle_info_.end())
+    return false;
+  Tspi_Key_UnloadKey(lru->second.tss_handle);
+  Tspi_Context_CloseObject(tsp_context_, lru->second.tss_handle);
+  lru->second.tss_handle = 0;
+  ++slot_handles_[lru->second.slot].key_evictions_;
+  VLOG(1) << "Evicted key " << lru->first;
+  return true;
+}
+
 string TPMUtilityImpl::ResultToString(TSS_RESULT result) {
   if (result == TSS_SUCCESS)
     return "TSS_SUCCESS";
@@ -85,19 +85,32 @@ class TPMUtilityImpl : public TPMUtility {
     std::set<int> handles_;
     // Maps known blobs to the associated key handle.
     std::map<std::string, int> blob_handle_;
+    // Key residency statistics: uses of a key that was loaded, uses that
+    // needed the key to be reloaded, and keys evicted to make room for others.
+    int key_hits_ = 0;
+    int key_reloads_ = 0;
+    int key_evictions_ = 0;
   };
 
   // Holds key information for each key handle.
   struct KeyInfo {
+    // Zero while the key is evicted from the TPM.
     TSS_HKEY tss_handle;
     std::string blob;
     brillo::SecureBlob auth_data;
+    // The slot the key belongs to.
+    int slot;
+    // The key handle of the parent key, which may be the SRK.
+    int parent_handle;
+    // When the key was last used, as a value of |last_use_|.
+    uint64_t last_use;
   };
 
   int CreateHandle(int slot,
                    TSS_HKEY key,
                    const std::string& key_blob,
-                   const brillo::SecureBlob& auth_data);
+                   const brillo::SecureBlob& auth_data,
+                   int parent_handle);
   bool CreateKeyPolicy(TSS_HKEY key,
                        const brillo::SecureBlob& auth_data,
                        bool auth_only);
@@ -115,6 +128,14 @@ class TPMUtilityImpl : public TPMUtility {
                        const brillo::SecureBlob& auth_data,
                        TSS_HKEY* key);
   bool ReloadKey(int key_handle);
+  // Marks a key as used and makes sure it is loaded in the TPM, reloading it
+  // (and its parents) if it has been evicted. Returns false if the key handle
+  // is not known or the key cannot be loaded.
+  bool UseKey(int key_handle);
+  // Unloads the least recently used key from the TPM to make room for another
+  // key. The key keeps its handle and is reloaded by UseKey when needed.
+  // |keep| will not be evicted. Returns false if there is no key to evict.
+  bool EvictKey(TSS_HKEY keep);
   bool InitSRK();
 
   bool is_initialized_;
@@ -129,6 +150,7 @@ class TPMUtilityImpl : public TPMUtility {
   std::map<int, KeyInfo> handle_info_;
   base::Lock lock_;
   int last_handle_;
+  uint64_t last_use_;
   bool is_enabled_;
   bool is_enabled_ready_;
 
@@ -22,6 +22,9 @@
 #if USE_TPM2
 #include "chaps/tpm2_utility_impl.h"
 #else
+#include <trousers/scoped_tss_type.h>
+#include <trousers/tss.h>
+
 #include "chaps/tpm_utility_impl.h"
 #endif
 
@@ -189,6 +192,97 @@ TEST_F(TestTPMUtility, BadInput) {
   tpm_->UnloadKeysForSlot(0);
 }
 
+// Use more keys than a TPM can hold at once. Keys that have been evicted to
+// make room for others must be reloaded transparently.
+TEST_F(TestTPMUtility, ManyKeys) {
+  const int kNumKeys = 20;
+  size_ = 1024;
+  int keys[kNumKeys];
+  for (int i = 0; i < kNumKeys; ++i) {
+    ASSERT_TRUE(tpm_->GenerateKey(0, size_, e_, auth_, &blob_, &keys[i]));
+  }
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < kNumKeys; ++i) {
+      key_ = keys[i];
+      TestKey();
+    }
+  }
+  tpm_->UnloadKeysForSlot(0);
+}
+
+#if !USE_TPM2
+static bool GetKeyBlob(TSS_HCONTEXT context, TSS_HKEY key, string* blob) {
+  UINT32 length = 0;
+  BYTE* buffer = NULL;
+  if (Tspi_GetAttribData(key, TSS_TSPATTRIB_KEY_BLOB,
+                         TSS_TSPATTRIB_KEYBLOB_BLOB, &length, &buffer) !=
+      TSS_SUCCESS)
+    return false;
+  blob->assign(reinterpret_cast<char*>(buffer), length);
+  Tspi_Context_FreeMemory(context, buffer);
+  return true;
+}
+
+// Creates a storage key under the SRK and a signing key under the storage key
+// and returns their blobs. Neither key requires authorization.
+static bool CreateKeyHierarchy(string* parent_blob, string* child_blob) {
+  trousers::ScopedTssContext context;
+  if (Tspi_Context_Create(context.ptr()) != TSS_SUCCESS ||
+      Tspi_Context_Connect(context, NULL) != TSS_SUCCESS)
+    return false;
+  TSS_HKEY srk = 0;
+  TSS_UUID uuid = TSS_UUID_SRK;
+  if (Tspi_Context_LoadKeyByUUID(context, TSS_PS_TYPE_SYSTEM, uuid, &srk) !=
+      TSS_SUCCESS)
+    return false;
+  TSS_HPOLICY srk_policy = 0;
+  if (Tspi_GetPolicyObject(srk, TSS_POLICY_USAGE, &srk_policy) !=
+          TSS_SUCCESS ||
+      Tspi_Policy_SetSecret(srk_policy, TSS_SECRET_MODE_PLAIN, 0, NULL) !=
+          TSS_SUCCESS)
+    return false;
+  trousers::ScopedTssKey parent(context);
+  if (Tspi_Context_CreateObject(context, TSS_OBJECT_TYPE_RSAKEY,
+                                TSS_KEY_TYPE_STORAGE | TSS_KEY_SIZE_2048 |
+                                    TSS_KEY_NO_AUTHORIZATION,
+                                parent.ptr()) != TSS_SUCCESS ||
+      Tspi_Key_CreateKey(parent, srk, 0) != TSS_SUCCESS ||
+      Tspi_Key_LoadKey(parent, srk) != TSS_SUCCESS)
+    return false;
+  trousers::ScopedTssKey child(context);
+  if (Tspi_Context_CreateObject(context, TSS_OBJECT_TYPE_RSAKEY,
+                                TSS_KEY_TYPE_SIGNING | TSS_KEY_SIZE_1024 |
+                                    TSS_KEY_NO_AUTHORIZATION,
+                                child.ptr()) != TSS_SUCCESS ||
+      Tspi_Key_CreateKey(child, parent, 0) != TSS_SUCCESS)
+    return false;
+  return GetKeyBlob(context, parent, parent_blob) &&
+         GetKeyBlob(context, child, child_blob);
+}
+
+// Load a key under a parent that has been evicted to make room for others. The
+// parent must be reloaded first.
+TEST_F(TestTPMUtility, LoadKeyWithEvictedParent) {
+  string parent_blob, child_blob;
+  ASSERT_TRUE(CreateKeyHierarchy(&parent_blob, &child_blob));
+  int parent = 0;
+  ASSERT_TRUE(tpm_->LoadKey(0, parent_blob, brillo::SecureBlob(), &parent));
+  // The parent is the least recently used key, so it is evicted first.
+  const int kNumKeys = 20;
+  size_ = 1024;
+  int key = 0;
+  for (int i = 0; i < kNumKeys; ++i) {
+    ASSERT_TRUE(tpm_->GenerateKey(0, size_, e_, auth_, &blob_, &key));
+  }
+  int child = 0;
+  EXPECT_TRUE(tpm_->LoadKeyWithParent(0, child_blob, brillo::SecureBlob(),
+                                      parent, &child));
+  string e, n;
+  EXPECT_TRUE(tpm_->GetPublicKey(child, &e, &n));
+  tpm_->UnloadKeysForSlot(0);
+}
+#endif
+
 }  // namespace chaps
 
 int main(int argc, char** argv) {
@@ -12,6 +12,15 @@
 
 namespace quipper {
 
+AddressMapper::AddressMapper(const AddressMapper& other)
+    : mappings_(other.mappings_),
+      last_found_range_(nullptr),
+      page_alignment_(other.page_alignment_) {
+  // Reconstruct the index of real addresses, pointing into the new list.
+  for (auto iter = mappings_.begin(); iter != mappings_.end(); ++iter)
+    real_addr_to_mapped_range_[iter->real_addr] = iter;
+}
+
 bool AddressMapper::MapWithID(const uint64_t real_addr,
                               const uint64_t size,
                               const uint64_t id,
@@ -37,11 +46,20 @@ bool AddressMapper::MapWithID(const uint64_t real_addr,
   }
 
   // Check for collision with an existing mapping.  This must be an overlap that
-  // does not result in one range being completely covered by another
-  MappingList::iterator iter;
+  // does not result in one range being completely covered by another.  Since
+  // existing mappings do not overlap each other in real space, only the last
+  // one starting at or before |real_addr| and the ones starting within the new
+  // range can intersect it.
+  const uint64_t range_end = range.real_addr + range.size - 1;
+  auto index_iter = real_addr_to_mapped_range_.upper_bound(range.real_addr);
+  if (index_iter != real_addr_to_mapped_range_.begin())
+    --index_iter;
   std::vector<MappingList::iterator> mappings_to_delete;
   MappingList::iterator old_range_iter = mappings_.end();
-  for (iter = mappings_.begin(); iter != mappings_.end(); ++iter) {
+  for (; index_iter != real_addr_to_mapped_range_.end() &&
+         index_iter->first <= range_end;
+       ++index_iter) {
+    MappingList::iterator iter = index_iter->second;
     if (!iter->Intersects(range))
       continue;
     // Quit if existing ranges that collide aren't supposed to be removed.
@@ -121,6 +139,7 @@ bool AddressMapper::MapWithID(const uint64_t real_addr,
     range.mapped_addr = page_offset;
     range.unmapped_space_after = UINT64_MAX - range.size - page_offset;
     mappings_.push_back(range);
+    real_addr_to_mapped_range_[range.real_addr] = mappings_.begin();
     return true;
   }
 
@@ -130,12 +149,13 @@ bool AddressMapper::MapWithID(const uint64_t real_addr,
     range.unmapped_space_after =
         mappings_.begin()->mapped_addr - range.size - page_offset;
     mappings_.push_front(range);
+    real_addr_to_mapped_range_[range.real_addr] = mappings_.begin();
     return true;
   }
 
   // Otherwise, search through the existing mappings for a free block after one
   // of them.
-  for (iter = mappings_.begin(); iter != mappings_.end(); ++iter) {
+  for (auto iter = mappings_.begin(); iter != mappings_.end(); ++iter) {
     MappedRange& existing_mapping = *iter;
     if (page_alignment_) {
       uint64_t end_of_existing_mapping =
@@ -175,7 +195,8 @@ bool AddressMapper::MapWithID(const uint64_t real_addr,
       existing_mapping.unmapped_space_after = 0;
     }
 
-    mappings_.insert(++iter, range);
+    real_addr_to_mapped_range_[range.real_addr] =
+        mappings_.insert(++iter, range);
     return true;
   }
 
@@ -200,14 +221,11 @@ void AddressMapper::DumpToLog() const {
 bool AddressMapper::GetMappedAddress(const uint64_t real_addr,
                                      uint64_t* mapped_addr) const {
   CHECK(mapped_addr);
-  MappingList::const_iterator iter;
-  for (iter = mappings_.begin(); iter != mappings_.end(); ++iter) {
-    if (!iter->ContainsAddress(real_addr))
-      continue;
-    *mapped_addr = iter->mapped_addr + real_addr - iter->real_addr;
-    return true;
-  }
-  return false;
+  const MappedRange* range = FindRangeContaining(real_addr);
+  if (!range)
+    return false;
+  *mapped_addr = range->mapped_addr + real_addr - range->real_addr;
+  return true;
 }
 
 bool AddressMapper::GetMappedIDAndOffset(const uint64_t real_addr,
@@ -215,15 +233,12 @@ bool AddressMapper::GetMappedIDAndOffset(const uint64_t real_addr,
                                          uint64_t* offset) const {
   CHECK(id);
   CHECK(offset);
-  MappingList::const_iterator iter;
-  for (iter = mappings_.begin(); iter != mappings_.end(); ++iter) {
-    if (!iter->ContainsAddress(real_addr))
-      continue;
-    *id = iter->id;
-    *offset = real_addr - iter->real_addr + iter->offset_base;
-    return true;
-  }
-  return false;
+  const MappedRange* range = FindRangeContaining(real_addr);
+  if (!range)
+    return false;
+  *id = range->id;
+  *offset = real_addr - range->real_addr + range->offset_base;
+  return true;
 }
 
 uint64_t AddressMapper::GetMaxMappedLength() const {
@@ -248,7 +263,27 @@ void AddressMapper::Unmap(MappingList::iterator mapping_iter) {
     previous_range_iter->unmapped_space_after +=
         range.size + range.unmapped_space_after;
   }
+  last_found_range_ = nullptr;
+  real_addr_to_mapped_range_.erase(mapping_iter->real_addr);
   mappings_.erase(mapping_iter);
 }
 
+const AddressMapper::MappedRange* AddressMapper::FindRangeContaining(
+    uint64_t real_addr) const {
+  if (last_found_range_ && last_found_range_->ContainsAddress(real_addr))
+    return last_found_range_;
+
+  // Find the last range that starts at or before |real_addr|. It is the only
+  // one that can contain it.
+  auto index_iter = real_addr_to_mapped_range_.upper_bound(real_addr);
+  if (index_iter == real_addr_to_mapped_range_.begin())
+    return nullptr;
+  --index_iter;
+  const MappedRange& range = *index_iter->second;
+  if (!range.ContainsAddress(real_addr))
+    return nullptr;
+  last_found_range_ = &range;
+  return last_found_range_;
+}
+
 }  // namespace quipper
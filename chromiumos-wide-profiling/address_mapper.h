@@ -9,17 +9,20 @@
 #include <stdint.h>
 
 #include <list>
+#include <map>
 
 namespace quipper {
 
 class AddressMapper {
  public:
-  AddressMapper() : page_alignment_(0) {}
+  AddressMapper() : last_found_range_(nullptr), page_alignment_(0) {}
 
   // Copy constructor: copies mappings from |source| to this AddressMapper. This
   // is useful for copying mappings from parent to child process upon fork(). It
   // is also useful to copy kernel mappings to any process that is created.
-  AddressMapper(const AddressMapper& other) = default;
+  AddressMapper(const AddressMapper& other);
+
+  AddressMapper& operator=(const AddressMapper& other) = delete;
 
   // Maps a new address range [real_addr, real_addr + length) to quipper space.
   // |id| is an identifier value to be stored along with the mapping.
@@ -116,13 +119,19 @@ class AddressMapper {
     }
   };
 
-  // TODO(sque): implement with set or map to improve searching.
+  // Mappings are kept in a list sorted by quipper space address, so that free
+  // blocks of quipper space can be found by walking the list in order.
   typedef std::list<MappedRange> MappingList;
 
   // Removes an existing address mapping, given by an iterator pointing to an
   // element of |mappings_|.
   void Unmap(MappingList::iterator mapping_iter);
 
+  // Returns the mapped range containing |real_addr|, or nullptr if there is
+  // none. Checks the result of the previous lookup first, since consecutive
+  // lookups (e.g. the entries of a callchain) tend to hit the same range.
+  const MappedRange* FindRangeContaining(uint64_t real_addr) const;
+
   // Given an address, and a nonzero, power-of-two |page_alignment_| value,
   // returns the offset of the address from the start of the page it is on.
   // Equivalent to |addr % page_alignment_|. Should not be called if
@@ -134,6 +143,17 @@ class AddressMapper {
   // Container for all the existing mappings.
   MappingList mappings_;
 
+  // Maps real addresses to iterators pointing to entries within |mappings_|.
+  // Must maintain a 1:1 entry correspondence with |mappings_|. Since mappings
+  // never overlap in real space, this allows the range containing an address to
+  // be found in logarithmic time.
+  std::map<uint64_t, MappingList::iterator> real_addr_to_mapped_range_;
+
+  // The range found by the most recent successful lookup, or nullptr. Points to
+  // an element of |mappings_|, and is reset whenever a range is unmapped. This
+  // makes lookups unsafe to call concurrently on the same object.
+  mutable const MappedRange* last_found_range_;
+
   // If set to nonzero, use this as a mapping page boundary. If a mapping does
   // not begin at a multiple of this value, the remapped address should be given
   // an offset that is the remainder.
@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "base/logging.h"
 #include "base/macros.h"
@@ -459,4 +460,74 @@ TEST_F(AddressMapperTest, MisalignedSplitRangeWithPageAlignment) {
   EXPECT_FALSE(MapRange(kMisalignedRange, true));
 }
 
+// Map a large number of ranges in non-sorted order and check lookups against a
+// linear search over the ranges.
+TEST_F(AddressMapperTest, ManyRangesMatchLinearSearch) {
+  const int kNumRanges = 2000;
+  std::vector<Range> ranges;
+  for (int i = 0; i < kNumRanges; ++i) {
+    // Leave a gap between consecutive ranges, with varying sizes.
+    ranges.push_back(Range(0x100000 + i * 0x10000, 0x1000 * (1 + i % 15),
+                           i, 0x1000 * (i % 7)));
+  }
+  // Deterministically shuffle the order in which the ranges are mapped.
+  std::vector<Range> shuffled_ranges = ranges;
+  for (size_t i = 0; i < shuffled_ranges.size(); ++i)
+    std::swap(shuffled_ranges[i], shuffled_ranges[(i * 7919) % kNumRanges]);
+  for (const Range& range : shuffled_ranges)
+    ASSERT_TRUE(MapRange(range, false));
+  EXPECT_EQ(kNumRanges, mapper_->GetNumMappedRanges());
+
+  // Copies must be able to do lookups independently of the original.
+  AddressMapper copied_mapper(*mapper_);
+  mapper_.reset();
+
+  for (uint64_t addr = 0xff000; addr < 0x100000 + kNumRanges * 0x10000;
+       addr += 0x777) {
+    const Range* expected = nullptr;
+    for (const Range& range : ranges) {
+      if (range.contains(addr)) {
+        expected = &range;
+        break;
+      }
+    }
+    uint64_t id, offset;
+    ASSERT_EQ(expected != nullptr,
+              copied_mapper.GetMappedIDAndOffset(addr, &id, &offset))
+        << std::hex << addr;
+    if (!expected)
+      continue;
+    EXPECT_EQ(expected->id, id);
+    EXPECT_EQ(expected->base_offset + addr - expected->addr, offset);
+  }
+}
+
+// Map a range over many existing ranges and make sure all of them, and only
+// them, are removed.
+TEST_F(AddressMapperTest, OverlapManyRanges) {
+  const int kNumRanges = 100;
+  for (int i = 0; i < kNumRanges; ++i)
+    ASSERT_TRUE(MapRange(Range(0x10000 * (i + 1), 0x8000, i, 0), false));
+
+  // Overlaps the tail of range 8, all of ranges 9-18, and the head of range 19.
+  // Partially overlapped ranges are removed entirely.
+  const Range kOverlappingRange(0x94000, 0xb0000, 0x1234, 0);
+  ASSERT_FALSE(MapRange(kOverlappingRange, false));
+  ASSERT_TRUE(MapRange(kOverlappingRange, true));
+  EXPECT_EQ(kNumRanges - 12 + 1, mapper_->GetNumMappedRanges());
+
+  uint64_t id, offset;
+  ASSERT_TRUE(mapper_->GetMappedIDAndOffset(0x80000, &id, &offset));
+  EXPECT_EQ(7, id);
+  EXPECT_FALSE(mapper_->GetMappedIDAndOffset(0x90000, &id, &offset));
+  ASSERT_TRUE(mapper_->GetMappedIDAndOffset(0x94000, &id, &offset));
+  EXPECT_EQ(kOverlappingRange.id, id);
+  EXPECT_EQ(0, offset);
+  ASSERT_TRUE(mapper_->GetMappedIDAndOffset(0x143fff, &id, &offset));
+  EXPECT_EQ(kOverlappingRange.id, id);
+  EXPECT_FALSE(mapper_->GetMappedIDAndOffset(0x144000, &id, &offset));
+  ASSERT_TRUE(mapper_->GetMappedIDAndOffset(0x150000, &id, &offset));
+  EXPECT_EQ(20, id);
+}
+
 }  // namespace quipper
@@ -25,6 +25,11 @@ const int kNumHexDigitsInByte = 2;
 
 namespace quipper {
 
+void ByteSwapArray(uint64_t* values, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    values[i] = bswap_64(values[i]);
+}
+
 static uint64_t Md5Prefix(
     const unsigned char* data,
     unsigned long length) { // NOLINT
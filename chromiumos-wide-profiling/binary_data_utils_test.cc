@@ -3,6 +3,9 @@
 // found in the LICENSE file.
 
 #include "chromiumos-wide-profiling/binary_data_utils.h"
+
+#include <vector>
+
 #include "chromiumos-wide-profiling/compat/test.h"
 
 namespace quipper {
@@ -19,6 +22,22 @@ TEST(BinaryDataUtilsTest, MD5) {
             0xe4d909c290d0fb1cLL);
 }
 
+TEST(BinaryDataUtilsTest, ByteSwapArray) {
+  // Use several lengths, so that any unrolled or vectorized part of the loop
+  // is tested with and without leftover values.
+  for (size_t count : {0, 1, 2, 3, 7, 8, 9, 33}) {
+    std::vector<uint64_t> values(count);
+    for (size_t i = 0; i < count; ++i)
+      values[i] = 0x0102030405060708ULL * (i + 1);
+    std::vector<uint64_t> expected_values = values;
+    for (uint64_t& value : expected_values)
+      ByteSwap(&value);
+
+    ByteSwapArray(values.data(), values.size());
+    EXPECT_EQ(expected_values, values) << "count = " << count;
+  }
+}
+
 TEST(BinaryDataUtilsTest, Align) {
   EXPECT_EQ(12,  Align<4>(10));
   EXPECT_EQ(12,  Align<4>(12));
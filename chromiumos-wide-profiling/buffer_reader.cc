@@ -17,6 +17,15 @@ bool BufferReader::ReadData(const size_t size, void* dest) {
   return true;
 }
 
+const void* BufferReader::ReadDataPointer(const size_t size) {
+  if (offset_ + size > size_)
+    return nullptr;
+
+  const char* data = buffer_ + offset_;
+  offset_ += size;
+  return data;
+}
+
 bool BufferReader::ReadString(size_t size, string* str) {
   if (offset_ + size > size_)
     return false;
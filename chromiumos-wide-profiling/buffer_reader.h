@@ -29,6 +29,9 @@ class BufferReader : public DataReader {
 
   bool ReadData(const size_t size, void* dest) override;
 
+  // Returns a pointer into the buffer. Valid as long as the buffer is.
+  const void* ReadDataPointer(const size_t size) override;
+
   // Reads |size| bytes of the buffer as a null-terminated string into |str|.
   // Trailing nulls, if any, are not added to the string, but they are skipped
   // over. If there is no null terminator within these |size| bytes, then the
@@ -0,0 +1,149 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromiumos-wide-profiling/build_id_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <vector>
+
+#include "base/logging.h"
+
+#include "chromiumos-wide-profiling/dso.h"
+#include "chromiumos-wide-profiling/file_utils.h"
+
+namespace quipper {
+
+namespace {
+
+// Returns the cache key of the file with status |s|.
+string KeyForFile(const struct stat& s) {
+  std::stringstream key;
+  key << std::hex << s.st_dev << "-" << s.st_ino << "-" << s.st_size << "-"
+      << s.st_mtim.tv_sec << "." << s.st_mtim.tv_nsec;
+  return key.str();
+}
+
+}  // namespace
+
+BuildIdCache::BuildIdCache(const string& directory, size_t max_memory_entries)
+    : directory_(directory),
+      max_memory_entries_(max_memory_entries),
+      num_hits_(0),
+      num_misses_(0) {
+  CHECK_GT(max_memory_entries_, 0U);
+}
+
+bool BuildIdCache::ReadElfBuildId(int fd, const struct stat& s,
+                                  string* buildid) {
+  if (Lookup(s, buildid)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_hits_;
+    return !buildid->empty();
+  }
+
+  string file_buildid;
+  if (!quipper::ReadElfBuildId(fd, &file_buildid))
+    file_buildid.clear();
+  Insert(s, file_buildid);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++num_misses_;
+  }
+  if (file_buildid.empty())
+    return false;
+  *buildid = file_buildid;
+  return true;
+}
+
+bool BuildIdCache::Lookup(const struct stat& s, string* buildid) {
+  const string key = KeyForFile(s);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto iter = key_to_entry_.find(key);
+    if (iter != key_to_entry_.end()) {
+      // Move the entry to the front, as the most recently used.
+      entries_.splice(entries_.begin(), entries_, iter->second);
+      *buildid = iter->second->second;
+      return true;
+    }
+  }
+
+  if (directory_.empty())
+    return false;
+
+  // Read the persistent cache without holding the lock, so that other threads
+  // can use the in-memory cache meanwhile.
+  std::vector<char> contents;
+  if (!FileToBuffer(PathForKey(key), &contents))
+    return false;
+  buildid->assign(contents.begin(), contents.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  InsertInMemory(key, *buildid);
+  return true;
+}
+
+void BuildIdCache::Insert(const struct stat& s, const string& buildid) {
+  const string key = KeyForFile(s);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    InsertInMemory(key, buildid);
+  }
+
+  if (directory_.empty())
+    return;
+
+  // Write to a temporary file first, so that other processes reading the cache
+  // never see a partially written entry.
+  const string path = PathForKey(key);
+  string temp_path = path + ".XXXXXX";
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to create build ID cache file " << temp_path;
+    return;
+  }
+  const ssize_t size = buildid.size();
+  const bool written = write(fd, buildid.data(), size) == size;
+  close(fd);
+  if (!written || rename(temp_path.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Failed to write build ID cache file " << path;
+    unlink(temp_path.c_str());
+  }
+}
+
+size_t BuildIdCache::num_hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_hits_;
+}
+
+size_t BuildIdCache::num_misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_misses_;
+}
+
+void BuildIdCache::InsertInMemory(const string& key, const string& buildid) {
+  const auto iter = key_to_entry_.find(key);
+  if (iter != key_to_entry_.end()) {
+    iter->second->second = buildid;
+    entries_.splice(entries_.begin(), entries_, iter->second);
+    return;
+  }
+
+  if (entries_.size() >= max_memory_entries_) {
+    key_to_entry_.erase(entries_.back().first);
+    entries_.pop_back();
+  }
+  entries_.emplace_front(key, buildid);
+  key_to_entry_[key] = entries_.begin();
+}
+
+string BuildIdCache::PathForKey(const string& key) const {
+  return directory_ + "/" + key;
+}
+
+}  // namespace quipper
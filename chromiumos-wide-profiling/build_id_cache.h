@@ -0,0 +1,84 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROMIUMOS_WIDE_PROFILING_BUILD_ID_CACHE_H_
+#define CHROMIUMOS_WIDE_PROFILING_BUILD_ID_CACHE_H_
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#include "base/macros.h"
+
+#include "chromiumos-wide-profiling/compat/string.h"
+
+namespace quipper {
+
+// Caches the build IDs read from ELF files, so that profiles collected on the
+// same machine image don't have to read the same files again. Files are
+// identified by device, inode, size and modification time, so a file that is
+// replaced or modified is read again.
+//
+// The most recently used build IDs are kept in memory. If a directory is
+// given, all build IDs are also stored there, one small file per ELF file, so
+// they are kept across processes. Files without a build ID are cached as well.
+//
+// All methods may be called from multiple threads.
+class BuildIdCache {
+ public:
+  // Keeps up to |max_memory_entries| build IDs in memory. If |directory| is not
+  // empty, it must be an existing directory, used as the persistent cache.
+  BuildIdCache(const string& directory, size_t max_memory_entries);
+
+  // Reads the raw build ID of the ELF file open as |fd|, whose status is |s|,
+  // from the cache, or from the file if it is not cached. Returns false if the
+  // file has no build ID.
+  bool ReadElfBuildId(int fd, const struct stat& s, string* buildid);
+
+  // Looks up the raw build ID of the file with status |s|. Returns false if the
+  // file is not cached. Otherwise, sets |*buildid|, which is empty if the file
+  // has no build ID.
+  bool Lookup(const struct stat& s, string* buildid);
+
+  // Caches |buildid| as the raw build ID of the file with status |s|.
+  void Insert(const struct stat& s, const string& buildid);
+
+  // Number of build IDs that were found in the cache and had to be read from
+  // ELF files, respectively.
+  size_t num_hits() const;
+  size_t num_misses() const;
+
+ private:
+  // Adds an entry to the in-memory cache, evicting the least recently used
+  // entry if it is full. |mutex_| must be held.
+  void InsertInMemory(const string& key, const string& buildid);
+
+  // Returns the path of the persistent cache file for |key|.
+  string PathForKey(const string& key) const;
+
+  const string directory_;
+  const size_t max_memory_entries_;
+
+  // Guards all the members below.
+  mutable std::mutex mutex_;
+
+  // In-memory entries of (key, raw build ID), most recently used first, and an
+  // index of them by key.
+  std::list<std::pair<string, string>> entries_;
+  std::unordered_map<string, std::list<std::pair<string, string>>::iterator>
+      key_to_entry_;
+
+  size_t num_hits_;
+  size_t num_misses_;
+
+  DISALLOW_COPY_AND_ASSIGN(BuildIdCache);
+};
+
+}  // namespace quipper
+
+#endif  // CHROMIUMOS_WIDE_PROFILING_BUILD_ID_CACHE_H_
@@ -0,0 +1,126 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromiumos-wide-profiling/build_id_cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/compat/test.h"
+#include "chromiumos-wide-profiling/dso.h"
+#include "chromiumos-wide-profiling/dso_test_utils.h"
+#include "chromiumos-wide-profiling/scoped_temp_path.h"
+
+namespace quipper {
+
+namespace {
+
+// Returns a file status that only differs from others by |ino|.
+struct stat StatWithInode(ino_t ino) {
+  struct stat s;
+  memset(&s, 0, sizeof(s));
+  s.st_ino = ino;
+  return s;
+}
+
+}  // namespace
+
+TEST(BuildIdCacheTest, ReadsElfFileOnlyOnce) {
+  InitializeLibelf();
+  ScopedTempFile elf("/tmp/tempelf.");
+  const string expected_buildid = "\xde\xad\xf0\x0d";
+  testing::WriteElfWithBuildid(elf.path(), ".note.gnu.build-id",
+                               expected_buildid);
+
+  BuildIdCache cache("", 16);
+  for (int i = 0; i < 2; ++i) {
+    int fd = open(elf.path().c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    struct stat s;
+    ASSERT_EQ(0, fstat(fd, &s));
+    string buildid;
+    EXPECT_TRUE(cache.ReadElfBuildId(fd, s, &buildid));
+    EXPECT_EQ(expected_buildid, buildid);
+    close(fd);
+  }
+  EXPECT_EQ(1, cache.num_hits());
+  EXPECT_EQ(1, cache.num_misses());
+}
+
+TEST(BuildIdCacheTest, CachesMissingBuildId) {
+  InitializeLibelf();
+  ScopedTempFile elf("/tmp/tempelf.");
+  testing::WriteElfWithMultipleBuildids(elf.path(), {/*empty*/});
+
+  BuildIdCache cache("", 16);
+  for (int i = 0; i < 2; ++i) {
+    int fd = open(elf.path().c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    struct stat s;
+    ASSERT_EQ(0, fstat(fd, &s));
+    string buildid;
+    EXPECT_FALSE(cache.ReadElfBuildId(fd, s, &buildid));
+    close(fd);
+  }
+  EXPECT_EQ(1, cache.num_hits());
+  EXPECT_EQ(1, cache.num_misses());
+}
+
+TEST(BuildIdCacheTest, KeysByFileStatus) {
+  BuildIdCache cache("", 16);
+  struct stat s = StatWithInode(1);
+  cache.Insert(s, "\x01");
+
+  string buildid;
+  EXPECT_TRUE(cache.Lookup(s, &buildid));
+  EXPECT_EQ("\x01", buildid);
+
+  // A modified file is not found.
+  s.st_mtim.tv_nsec = 1;
+  EXPECT_FALSE(cache.Lookup(s, &buildid));
+  s = StatWithInode(1);
+  s.st_size = 100;
+  EXPECT_FALSE(cache.Lookup(s, &buildid));
+  EXPECT_FALSE(cache.Lookup(StatWithInode(2), &buildid));
+}
+
+TEST(BuildIdCacheTest, EvictsLeastRecentlyUsed) {
+  BuildIdCache cache("", 2);
+  cache.Insert(StatWithInode(1), "\x01");
+  cache.Insert(StatWithInode(2), "\x02");
+
+  string buildid;
+  EXPECT_TRUE(cache.Lookup(StatWithInode(1), &buildid));
+  cache.Insert(StatWithInode(3), "\x03");
+
+  EXPECT_FALSE(cache.Lookup(StatWithInode(2), &buildid));
+  EXPECT_TRUE(cache.Lookup(StatWithInode(1), &buildid));
+  EXPECT_EQ("\x01", buildid);
+  EXPECT_TRUE(cache.Lookup(StatWithInode(3), &buildid));
+  EXPECT_EQ("\x03", buildid);
+}
+
+TEST(BuildIdCacheTest, PersistsInDirectory) {
+  ScopedTempDir dir("/tmp/quipper_buildid_cache.");
+  {
+    BuildIdCache cache(dir.path(), 16);
+    cache.Insert(StatWithInode(1), "\xde\xad\xf0\x0d");
+    cache.Insert(StatWithInode(2), "");
+  }
+
+  // A new cache with an empty memory, as in another process, finds the entries
+  // in the directory.
+  BuildIdCache cache(dir.path(), 1);
+  string buildid;
+  EXPECT_TRUE(cache.Lookup(StatWithInode(1), &buildid));
+  EXPECT_EQ("\xde\xad\xf0\x0d", buildid);
+  EXPECT_TRUE(cache.Lookup(StatWithInode(2), &buildid));
+  EXPECT_EQ("", buildid);
+  EXPECT_FALSE(cache.Lookup(StatWithInode(3), &buildid));
+}
+
+}  // namespace quipper
@@ -0,0 +1,216 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromiumos-wide-profiling/columnar_profile.h"
+
+#include <vector>
+
+#include "base/logging.h"
+
+#include "chromiumos-wide-profiling/file_utils.h"
+#include "chromiumos-wide-profiling/kernel/perf_event.h"
+#include "chromiumos-wide-profiling/perf_reader.h"
+
+namespace quipper {
+
+ColumnarProfileWriter::ColumnarProfileWriter() : last_time_ns_(0) {}
+
+void ColumnarProfileWriter::AddEvents(const std::vector<ParsedEvent>& events) {
+  for (const ParsedEvent& parsed_event : events) {
+    const PerfDataProto_PerfEvent& event = *parsed_event.event_ptr;
+    if (event.header().type() != PERF_RECORD_SAMPLE ||
+        !event.has_sample_event()) {
+      continue;
+    }
+    const PerfDataProto_SampleEvent& sample = event.sample_event();
+
+    const uint64_t time_ns = sample.sample_time_ns();
+    profile_.add_time_deltas_ns(static_cast<int64_t>(time_ns - last_time_ns_));
+    last_time_ns_ = time_ns;
+    profile_.add_pids(sample.pid());
+    profile_.add_tids(sample.tid());
+
+    uint32_t command = 0;
+    if (parsed_event.command_) {
+      auto command_iter = command_indexes_.find(parsed_event.command_);
+      if (command_iter == command_indexes_.end()) {
+        command_iter = command_indexes_.emplace(parsed_event.command_,
+                                                profile_.commands_size()).first;
+        profile_.add_commands(*parsed_event.command_);
+      }
+      command = command_iter->second + 1;
+    }
+    profile_.add_sample_commands(command);
+
+    profile_.add_ip_locations(GetLocation(parsed_event.dso_and_offset));
+    profile_.add_callchain_sizes(parsed_event.callchain.size());
+    for (const auto& entry : parsed_event.callchain)
+      profile_.add_callchain_locations(GetLocation(entry));
+  }
+}
+
+void ColumnarProfileWriter::Finish(ColumnarProfileProto* profile) {
+  for (const DSOInfo* dso_info : dsos_) {
+    ColumnarProfileProto_DSO* dso = profile_.add_dsos();
+    dso->set_name(dso_info->name);
+    dso->set_build_id(dso_info->build_id);
+  }
+  dsos_.clear();
+  dso_indexes_.clear();
+  location_indexes_.clear();
+  command_indexes_.clear();
+  profile->Swap(&profile_);
+}
+
+uint32_t ColumnarProfileWriter::GetLocation(
+    const ParsedEvent::DSOAndOffset& dso_and_offset) {
+  if (!dso_and_offset.dso_info_)
+    return 0;
+
+  auto dso_iter = dso_indexes_.find(dso_and_offset.dso_info_);
+  if (dso_iter == dso_indexes_.end()) {
+    dso_iter = dso_indexes_.emplace(dso_and_offset.dso_info_,
+                                    dsos_.size()).first;
+    dsos_.push_back(dso_and_offset.dso_info_);
+    location_indexes_.emplace_back();
+  }
+  const uint32_t dso = dso_iter->second;
+
+  std::unordered_map<uint64_t, uint32_t>& offset_indexes =
+      location_indexes_[dso];
+  auto location_iter = offset_indexes.find(dso_and_offset.offset_);
+  if (location_iter == offset_indexes.end()) {
+    location_iter = offset_indexes.emplace(dso_and_offset.offset_,
+                                           profile_.location_dsos_size()).first;
+    profile_.add_location_dsos(dso);
+    profile_.add_location_offsets(dso_and_offset.offset_);
+  }
+  return location_iter->second + 1;
+}
+
+bool ColumnarProfileReader::Read(const ColumnarProfileProto& profile) {
+  dsos_.clear();
+  samples_.clear();
+
+  const int num_samples = profile.time_deltas_ns_size();
+  if (profile.pids_size() != num_samples ||
+      profile.tids_size() != num_samples ||
+      profile.sample_commands_size() != num_samples ||
+      profile.ip_locations_size() != num_samples ||
+      profile.callchain_sizes_size() != num_samples) {
+    LOG(ERROR) << "Sample columns have different sizes.";
+    return false;
+  }
+  if (profile.location_dsos_size() != profile.location_offsets_size()) {
+    LOG(ERROR) << "Location columns have different sizes.";
+    return false;
+  }
+
+  // The samples point into |dsos_|, so it must not be resized after this.
+  dsos_.resize(profile.dsos_size());
+  for (int i = 0; i < profile.dsos_size(); ++i) {
+    dsos_[i].name = profile.dsos(i).name();
+    dsos_[i].build_id = profile.dsos(i).build_id();
+  }
+
+  samples_.resize(num_samples);
+  uint64_t time_ns = 0;
+  int callchain_index = 0;
+  for (int i = 0; i < num_samples; ++i) {
+    ColumnarSample& sample = samples_[i];
+    time_ns += profile.time_deltas_ns(i);
+    sample.time_ns = time_ns;
+    sample.pid = profile.pids(i);
+    sample.tid = profile.tids(i);
+
+    const uint32_t command = profile.sample_commands(i);
+    if (command > static_cast<uint32_t>(profile.commands_size())) {
+      LOG(ERROR) << "Sample " << i << " has invalid command " << command;
+      return false;
+    }
+    if (command > 0)
+      sample.command = profile.commands(command - 1);
+
+    if (!GetLocation(profile, profile.ip_locations(i), &sample.ip))
+      return false;
+
+    const uint32_t callchain_size = profile.callchain_sizes(i);
+    if (callchain_size >
+        static_cast<uint32_t>(profile.callchain_locations_size() -
+                              callchain_index)) {
+      LOG(ERROR) << "Sample " << i << " has too many callchain entries.";
+      return false;
+    }
+    sample.callchain.resize(callchain_size);
+    for (uint32_t j = 0; j < callchain_size; ++j) {
+      if (!GetLocation(profile, profile.callchain_locations(callchain_index++),
+                       &sample.callchain[j])) {
+        return false;
+      }
+    }
+  }
+  if (callchain_index != profile.callchain_locations_size()) {
+    LOG(ERROR) << "Callchain entries do not match the callchain sizes.";
+    return false;
+  }
+  return true;
+}
+
+bool ColumnarProfileReader::GetLocation(
+    const ColumnarProfileProto& profile,
+    uint32_t location,
+    ParsedEvent::DSOAndOffset* dso_and_offset) const {
+  if (location == 0)
+    return true;
+  if (location > static_cast<uint32_t>(profile.location_dsos_size())) {
+    LOG(ERROR) << "Invalid location " << location;
+    return false;
+  }
+  const uint32_t dso = profile.location_dsos(location - 1);
+  if (dso >= dsos_.size()) {
+    LOG(ERROR) << "Location " << location << " has invalid DSO " << dso;
+    return false;
+  }
+  dso_and_offset->dso_info_ = &dsos_[dso];
+  dso_and_offset->offset_ = profile.location_offsets(location - 1);
+  return true;
+}
+
+bool SerializeFromFileToColumnarProfileFile(const string& filename,
+                                            const PerfParserOptions& options,
+                                            size_t max_events_per_batch,
+                                            const string& output_filename) {
+  ColumnarProfileWriter writer;
+  auto add_events = [&writer](PerfReader* reader, PerfParser* parser) {
+    writer.AddEvents(parser->parsed_events());
+    return true;
+  };
+  auto finish = [](PerfReader* reader, PerfParser* parser) { return true; };
+  if (!ParseFileInBatches(filename, options, max_events_per_batch, add_events,
+                          finish)) {
+    return false;
+  }
+
+  ColumnarProfileProto profile;
+  writer.Finish(&profile);
+  return WriteColumnarProfileToFile(profile, output_filename);
+}
+
+bool WriteColumnarProfileToFile(const ColumnarProfileProto& profile,
+                                const string& filename) {
+  string output;
+  if (!profile.SerializeToString(&output))
+    return false;
+  return BufferToFile(filename, output);
+}
+
+bool ReadColumnarProfileFromFile(ColumnarProfileProto* profile,
+                                 const string& filename) {
+  std::vector<char> buffer;
+  if (!FileToBuffer(filename, &buffer))
+    return false;
+  return profile->ParseFromArray(buffer.data(), buffer.size());
+}
+
+}  // namespace quipper
@@ -0,0 +1,119 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROMIUMOS_WIDE_PROFILING_COLUMNAR_PROFILE_H_
+#define CHROMIUMOS_WIDE_PROFILING_COLUMNAR_PROFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/macros.h"
+
+#include "chromiumos-wide-profiling/compat/proto.h"
+#include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/dso.h"
+#include "chromiumos-wide-profiling/perf_parser.h"
+
+namespace quipper {
+
+// Builds a ColumnarProfileProto from the sample events parsed by a PerfParser.
+class ColumnarProfileWriter {
+ public:
+  ColumnarProfileWriter();
+
+  // Adds the sample events among |events|. This may be called with each batch
+  // of events parsed by PerfParser::ParseRawEventBatch(). The DSOInfos that the
+  // events refer to must remain valid until Finish() is called, since build
+  // IDs are only filled in at the end of parsing.
+  void AddEvents(const std::vector<ParsedEvent>& events);
+
+  // Fills in the DSO dictionary and moves the profile into |profile|. No more
+  // events may be added after this.
+  void Finish(ColumnarProfileProto* profile);
+
+ private:
+  // Returns the value that refers to the location |dso_and_offset| in the
+  // columns of |profile_|, adding the location to the dictionary if needed.
+  uint32_t GetLocation(const ParsedEvent::DSOAndOffset& dso_and_offset);
+
+  ColumnarProfileProto profile_;
+
+  // Indexes of the DSOs, locations and commands in the dictionaries of
+  // |profile_|. The DSOs are kept as pointers until Finish(). Locations are
+  // indexed by DSO index, then by offset.
+  std::vector<const DSOInfo*> dsos_;
+  std::unordered_map<const DSOInfo*, uint32_t> dso_indexes_;
+  std::vector<std::unordered_map<uint64_t, uint32_t>> location_indexes_;
+  std::unordered_map<const string*, uint32_t> command_indexes_;
+
+  // Time of the last sample added.
+  uint64_t last_time_ns_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnarProfileWriter);
+};
+
+// A sample event read from a ColumnarProfileProto.
+struct ColumnarSample {
+  uint64_t time_ns = 0;
+  uint32_t pid = 0;
+  uint32_t tid = 0;
+  string command;
+  // Locations of the IP and the callchain entries. The DSOInfos are owned by
+  // the ColumnarProfileReader. Locations that could not be mapped have no DSO.
+  ParsedEvent::DSOAndOffset ip;
+  std::vector<ParsedEvent::DSOAndOffset> callchain;
+};
+
+// Reads the samples of a ColumnarProfileProto.
+class ColumnarProfileReader {
+ public:
+  ColumnarProfileReader() {}
+
+  // Decodes the samples of |profile|. Returns false if the columns do not have
+  // the same number of samples, or refer to dictionary entries that do not
+  // exist.
+  bool Read(const ColumnarProfileProto& profile);
+
+  const std::vector<ColumnarSample>& samples() const {
+    return samples_;
+  }
+
+ private:
+  // Sets |*dso_and_offset| to the location that |location| refers to in
+  // |profile|. Returns false if there is no such location.
+  bool GetLocation(const ColumnarProfileProto& profile, uint32_t location,
+                   ParsedEvent::DSOAndOffset* dso_and_offset) const;
+
+  // DSOs of the profile, which the samples' locations point to.
+  std::vector<DSOInfo> dsos_;
+
+  std::vector<ColumnarSample> samples_;
+
+  DISALLOW_COPY_AND_ASSIGN(ColumnarProfileReader);
+};
+
+// Converts a raw perf data file to a ColumnarProfileProto and writes it to
+// |output_filename| as serialized protobuf data. Only |max_events_per_batch|
+// events are held in memory at a time, as described for
+// SerializeFromFileToProtobufFile().
+bool SerializeFromFileToColumnarProfileFile(const string& filename,
+                                            const PerfParserOptions& options,
+                                            size_t max_events_per_batch,
+                                            const string& output_filename);
+
+// Writes |profile| to a file as serialized protobuf data.
+bool WriteColumnarProfileToFile(const ColumnarProfileProto& profile,
+                                const string& filename);
+
+// Reads a file written by WriteColumnarProfileToFile() into |profile|.
+bool ReadColumnarProfileFromFile(ColumnarProfileProto* profile,
+                                 const string& filename);
+
+}  // namespace quipper
+
+#endif  // CHROMIUMOS_WIDE_PROFILING_COLUMNAR_PROFILE_H_
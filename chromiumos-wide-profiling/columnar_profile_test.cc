@@ -0,0 +1,229 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromiumos-wide-profiling/columnar_profile.h"
+
+#include <sstream>
+#include <vector>
+
+#include "base/logging.h"
+
+#include "chromiumos-wide-profiling/compat/proto.h"
+#include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/compat/test.h"
+#include "chromiumos-wide-profiling/file_utils.h"
+#include "chromiumos-wide-profiling/perf_parser.h"
+#include "chromiumos-wide-profiling/perf_reader.h"
+#include "chromiumos-wide-profiling/perf_serializer.h"
+#include "chromiumos-wide-profiling/scoped_temp_path.h"
+#include "chromiumos-wide-profiling/test_perf_data.h"
+
+namespace quipper {
+
+namespace {
+
+// Returns perf data with MMAPs of foo.so and bar.so in process 1001, followed
+// by |num_samples| samples with callchains in that process, one sample in the
+// swapper process, and one sample that can not be mapped.
+string ExamplePerfDataWithCallchains(size_t num_samples) {
+  const u64 sample_type =
+      PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME |
+      PERF_SAMPLE_CALLCHAIN;
+
+  testing::ExampleMmapEvent mmap_event_foo(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so", testing::SampleInfo());
+  testing::ExampleMmapEvent mmap_event_bar(
+      1001, 0x1c3000, 0x2000, 0x2000, "/usr/lib/bar.so",
+      testing::SampleInfo());
+  std::vector<testing::ExamplePerfSampleEvent> sample_events;
+  for (size_t i = 0; i < num_samples; ++i) {
+    sample_events.emplace_back(
+        testing::SampleInfo()
+            .Ip(0x1c1000 + i % 0x100)
+            .Tid(1001, 1001 + i % 2)
+            .Time(1000000 + i * 1000)
+            .Callchain({PERF_CONTEXT_USER, 0x1c1000 + i % 0x100,
+                        0x1c3000 + i % 3, 0x1c6000 + i % 5}));
+  }
+  sample_events.emplace_back(
+      testing::SampleInfo()
+          .Ip(0xffffffff8100cafe)
+          .Tid(0)
+          .Time(1000000 + num_samples * 1000)
+          .Callchain({}));
+  sample_events.emplace_back(
+      testing::SampleInfo()
+          .Ip(0x1c2bad)
+          .Tid(1001)
+          .Time(1000000 + num_samples * 1000 + 1)
+          .Callchain({PERF_CONTEXT_USER, 0x1c2bad, 0x1c3008}));
+
+  size_t data_size = mmap_event_foo.GetSize() + mmap_event_bar.GetSize();
+  for (const auto& sample_event : sample_events)
+    data_size += sample_event.GetSize();
+
+  std::stringstream input;
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(sample_type, false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  mmap_event_foo.WriteTo(&input);
+  mmap_event_bar.WriteTo(&input);
+  for (const auto& sample_event : sample_events)
+    sample_event.WriteTo(&input);
+
+  // no metadata
+
+  return input.str();
+}
+
+PerfParserOptions ExampleOptions() {
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+  options.sort_events_by_time = false;
+  return options;
+}
+
+}  // namespace
+
+TEST(ColumnarProfileTest, RoundTripsSamples) {
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(ExamplePerfDataWithCallchains(10)));
+  PerfParser parser(&reader, ExampleOptions());
+  ASSERT_TRUE(parser.ParseRawEvents());
+
+  ColumnarProfileWriter writer;
+  writer.AddEvents(parser.parsed_events());
+  ColumnarProfileProto profile;
+  writer.Finish(&profile);
+
+  ColumnarProfileProto read_profile;
+  ASSERT_TRUE(read_profile.ParseFromString(profile.SerializeAsString()));
+  ColumnarProfileReader profile_reader;
+  ASSERT_TRUE(profile_reader.Read(read_profile));
+
+  // foo.so and bar.so.
+  EXPECT_EQ(2, read_profile.dsos_size());
+
+  const std::vector<ParsedEvent>& events = parser.parsed_events();
+  const std::vector<ColumnarSample>& samples = profile_reader.samples();
+  ASSERT_EQ(14, events.size());
+  ASSERT_EQ(12, samples.size());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    const ParsedEvent& event = events[i + 2];
+    const ColumnarSample& sample = samples[i];
+    EXPECT_EQ(event.event_ptr->sample_event().sample_time_ns(),
+              sample.time_ns) << "Sample " << i;
+    EXPECT_EQ(event.event_ptr->sample_event().pid(), sample.pid);
+    EXPECT_EQ(event.event_ptr->sample_event().tid(), sample.tid);
+    EXPECT_EQ(event.command(), sample.command);
+    EXPECT_TRUE(event.dso_and_offset == sample.ip) << "Sample " << i;
+    ASSERT_EQ(event.callchain.size(), sample.callchain.size());
+    for (size_t j = 0; j < sample.callchain.size(); ++j)
+      EXPECT_TRUE(event.callchain[j] == sample.callchain[j]);
+  }
+
+  EXPECT_EQ("/usr/lib/foo.so", samples[3].ip.dso_name());
+  EXPECT_EQ(0x3, samples[3].ip.offset());
+  ASSERT_EQ(2, samples[3].callchain.size());
+  EXPECT_EQ("/usr/lib/bar.so", samples[3].callchain[0].dso_name());
+  EXPECT_EQ(0x2000, samples[3].callchain[0].offset());
+  EXPECT_EQ("", samples[3].callchain[1].dso_name());
+
+  EXPECT_EQ("swapper", samples[10].command);
+  EXPECT_EQ("", samples[10].ip.dso_name());
+  EXPECT_EQ(0, samples[10].callchain.size());
+
+  EXPECT_EQ("", samples[11].ip.dso_name());
+  ASSERT_EQ(1, samples[11].callchain.size());
+  EXPECT_EQ("/usr/lib/bar.so", samples[11].callchain[0].dso_name());
+  EXPECT_EQ(0x2008, samples[11].callchain[0].offset());
+}
+
+TEST(ColumnarProfileTest, SerializesFromFileInBatches) {
+  ScopedTempDir output_dir;
+  ASSERT_FALSE(output_dir.path().empty());
+  const string input_path = output_dir.path() + "perf.data";
+  const string output_path = output_dir.path() + "profile.columnar";
+  ASSERT_TRUE(BufferToFile(input_path, ExamplePerfDataWithCallchains(10)));
+
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFile(input_path));
+  PerfParser parser(&reader, ExampleOptions());
+  ASSERT_TRUE(parser.ParseRawEvents());
+  ColumnarProfileWriter writer;
+  writer.AddEvents(parser.parsed_events());
+  ColumnarProfileProto expected_profile;
+  writer.Finish(&expected_profile);
+
+  ASSERT_TRUE(SerializeFromFileToColumnarProfileFile(
+      input_path, ExampleOptions(), 3 /*max_events_per_batch*/, output_path));
+  ColumnarProfileProto profile;
+  ASSERT_TRUE(ReadColumnarProfileFromFile(&profile, output_path));
+
+  EXPECT_EQ(12, profile.pids_size());
+  EXPECT_EQ(expected_profile.SerializeAsString(), profile.SerializeAsString());
+}
+
+TEST(ColumnarProfileTest, IsSmallerThanPerfDataProto) {
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(ExamplePerfDataWithCallchains(1000)));
+  PerfParser parser(&reader, ExampleOptions());
+  ASSERT_TRUE(parser.ParseRawEvents());
+
+  ColumnarProfileWriter writer;
+  writer.AddEvents(parser.parsed_events());
+  ColumnarProfileProto profile;
+  writer.Finish(&profile);
+
+  PerfDataProto perf_data_proto;
+  ASSERT_TRUE(reader.Serialize(&perf_data_proto));
+
+  const size_t columnar_size = profile.SerializeAsString().size();
+  const size_t proto_size = perf_data_proto.SerializeAsString().size();
+  LOG(INFO) << "Columnar profile: " << columnar_size << " bytes, "
+            << "PerfDataProto: " << proto_size << " bytes";
+  EXPECT_GT(proto_size / 3, columnar_size);
+}
+
+TEST(ColumnarProfileTest, RejectsInvalidProfile) {
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(ExamplePerfDataWithCallchains(2)));
+  PerfParser parser(&reader, ExampleOptions());
+  ASSERT_TRUE(parser.ParseRawEvents());
+  ColumnarProfileWriter writer;
+  writer.AddEvents(parser.parsed_events());
+  ColumnarProfileProto profile;
+  writer.Finish(&profile);
+
+  ColumnarProfileReader profile_reader;
+  ASSERT_TRUE(profile_reader.Read(profile));
+
+  ColumnarProfileProto missing_column = profile;
+  missing_column.mutable_tids()->RemoveLast();
+  EXPECT_FALSE(profile_reader.Read(missing_column));
+
+  ColumnarProfileProto invalid_location = profile;
+  invalid_location.set_ip_locations(0, profile.location_dsos_size() + 1);
+  EXPECT_FALSE(profile_reader.Read(invalid_location));
+
+  ColumnarProfileProto invalid_dso = profile;
+  invalid_dso.set_location_dsos(0, profile.dsos_size());
+  EXPECT_FALSE(profile_reader.Read(invalid_dso));
+
+  ColumnarProfileProto missing_callchain = profile;
+  missing_callchain.mutable_callchain_locations()->RemoveLast();
+  EXPECT_FALSE(profile_reader.Read(missing_callchain));
+}
+
+}  // namespace quipper
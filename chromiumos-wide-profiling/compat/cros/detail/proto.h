@@ -5,18 +5,27 @@
 #ifndef CHROMIUMOS_WIDE_PROFILING_COMPAT_CROS_DETAIL_PROTO_H_
 #define CHROMIUMOS_WIDE_PROFILING_COMPAT_CROS_DETAIL_PROTO_H_
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/repeated_field.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 
+#include "columnar_profile.pb.h"  // NOLINT(build/include)
 #include "perf_data.pb.h"  // NOLINT(build/include)
 #include "perf_stat.pb.h"  // NOLINT(build/include)
 
 namespace quipper {
 
+using ::google::protobuf::Arena;
 using ::google::protobuf::RepeatedField;
 using ::google::protobuf::RepeatedPtrField;
 using ::google::protobuf::TextFormat;
 using ::google::protobuf::uint64;
+using ::google::protobuf::internal::WireFormatLite;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::StringOutputStream;
 
 }  // namespace quipper
 
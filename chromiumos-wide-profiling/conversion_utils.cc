@@ -13,6 +13,7 @@
 
 #include "base/logging.h"
 
+#include "chromiumos-wide-profiling/columnar_profile.h"
 #include "chromiumos-wide-profiling/compat/proto.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/file_utils.h"
@@ -24,6 +25,10 @@ namespace quipper {
 
 namespace {
 
+// Number of events held in memory at a time when converting perf.data to
+// serialized protobuf data or a columnar profile.
+const size_t kEventsPerBatch = 4096;
+
 // Parse options from the format strings, set the options, and return the base
 // format. Returns the empty string if options are not recognized.
 string ParseFormatOptions(string format, PerfParserOptions* options) {
@@ -104,6 +109,29 @@ bool WriteOutput(const FormatAndFile& output,
     return BufferToFile(output.filename, data);
   }
 
+  if (output.format == kProtoBinaryFormat) {
+    PerfParser parser(reader, options);
+    if (!parser.ParseRawEvents())
+      return false;
+
+    PerfDataProto perf_data_proto;
+    reader->Serialize(&perf_data_proto);
+    PerfSerializer::SerializeParserStats(parser.stats(), &perf_data_proto);
+    return WriteProtobufToFile(perf_data_proto, output.filename);
+  }
+
+  if (output.format == kColumnarFormat) {
+    PerfParser parser(reader, options);
+    if (!parser.ParseRawEvents())
+      return false;
+
+    ColumnarProfileWriter writer;
+    writer.AddEvents(parser.parsed_events());
+    ColumnarProfileProto profile;
+    writer.Finish(&profile);
+    return WriteColumnarProfileToFile(profile, output.filename);
+  }
+
   LOG(ERROR) << "Unimplemented write format: " << output.format;
   return false;
 }
@@ -116,9 +144,40 @@ const char kPerfFormat[] = "perf";
 // Format string for protobuf text format.
 const char kProtoTextFormat[] = "text";
 
+// Format string for serialized protobuf data.
+const char kProtoBinaryFormat[] = "proto";
+
+// Format string for a serialized ColumnarProfileProto.
+const char kColumnarFormat[] = "columnar";
+
 bool ConvertFile(const FormatAndFile& input, const FormatAndFile& output) {
+  return ConvertFile(input, output, PerfParserOptions());
+}
+
+bool ConvertFile(const FormatAndFile& input,
+                 const FormatAndFile& output,
+                 const PerfParserOptions& parser_options) {
+  PerfParserOptions options = parser_options;
+  // perf.data can be converted to serialized protobuf data or a columnar
+  // profile without reading all of it into memory first, as long as its events
+  // need not be sorted by time or discarded.
+  if (output.format == kProtoBinaryFormat ||
+      output.format == kColumnarFormat) {
+    PerfParserOptions stream_options = parser_options;
+    const string format = ParseFormatOptions(input.format, &stream_options);
+    if (format == kPerfFormat && !stream_options.discard_unused_events &&
+        !stream_options.sort_events_by_time) {
+      LOG(INFO) << "Converting input in batches.";
+      if (output.format == kColumnarFormat) {
+        return SerializeFromFileToColumnarProfileFile(
+            input.filename, stream_options, kEventsPerBatch, output.filename);
+      }
+      return SerializeFromFileToProtobufFile(input.filename, stream_options,
+                                             kEventsPerBatch, output.filename);
+    }
+  }
+
   PerfReader reader;
-  PerfParserOptions options;
   if (!ReadInput(input, &reader, &options))
     return false;
   if (!WriteOutput(output, options, &reader))
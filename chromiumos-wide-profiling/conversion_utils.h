@@ -8,6 +8,7 @@
 #include <string>
 
 #include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/perf_parser.h"
 
 namespace quipper {
 
@@ -17,19 +18,37 @@ extern const char kPerfFormat[];
 // Format string for protobuf text format.
 extern const char kProtoTextFormat[];
 
+// Format string for serialized protobuf data. Converting perf.data to this
+// format reads and writes the events in batches, so memory usage does not grow
+// with the number of events.
+extern const char kProtoBinaryFormat[];
+
+// Format string for a serialized ColumnarProfileProto, which only holds the
+// sample events, compactly. Can only be used for output.
+extern const char kColumnarFormat[];
+
 // Structure to hold the format and file of an input or output.
 struct FormatAndFile {
   // The name of the file.
   string filename;
 
   // The format of the file. Options are "perf" for perf data files, "text" for
-  // proto text files and "proto" for proto binary files.
+  // proto text files, "proto" for proto binary files and "columnar" for
+  // columnar profiles.
   string format;
 };
 
 // Convert a perf file from one format to another.
 bool ConvertFile(const FormatAndFile& input, const FormatAndFile& output);
 
+// Same as above, but parses the events with |options|, to which the options
+// given in the input format are added. perf data is converted to "proto" or
+// "columnar" output in batches, without holding all of its events in memory,
+// if |options| leave the events unsorted.
+bool ConvertFile(const FormatAndFile& input,
+                 const FormatAndFile& output,
+                 const PerfParserOptions& options);
+
 }  // namespace quipper
 
 #endif  // CHROMIUMOS_WIDE_PROFILING_CONVERSION_UTILS_H_
@@ -2,13 +2,20 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <sstream>
+
 #include "base/logging.h"
 
+#include "chromiumos-wide-profiling/compat/proto.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/compat/test.h"
 #include "chromiumos-wide-profiling/conversion_utils.h"
+#include "chromiumos-wide-profiling/file_utils.h"
+#include "chromiumos-wide-profiling/kernel/perf_event.h"
+#include "chromiumos-wide-profiling/perf_protobuf_io.h"
 #include "chromiumos-wide-profiling/perf_test_files.h"
 #include "chromiumos-wide-profiling/scoped_temp_path.h"
+#include "chromiumos-wide-profiling/test_perf_data.h"
 #include "chromiumos-wide-profiling/test_utils.h"
 
 namespace quipper {
@@ -35,4 +42,45 @@ TEST(ConversionUtilsTest, TestTextOutput) {
   }
 }
 
+TEST(ConversionUtilsTest, SortsEventsWhenConvertingToProto) {
+  // A sample on CPU 0 is written before the mapping that it falls in, which was
+  // created earlier on CPU 1.
+  std::stringstream data;
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001).Time(12300020)
+                           .Cpu(0)).WriteTo(&data);
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so",
+      testing::SampleInfo().Tid(1001).Time(12300010).Cpu(1)).WriteTo(&data);
+  testing::FinishedRoundEvent().WriteTo(&data);
+  const string data_section = data.str();
+
+  std::stringstream input;
+  testing::ExamplePerfDataFileHeader(0)
+      .WithAttrCount(1)
+      .WithDataSize(data_section.size())
+      .WriteTo(&input);
+  testing::ExamplePerfFileAttr_Hardware(
+      PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU,
+      true /*sample_id_all*/).WriteTo(&input);
+  input << data_section;
+
+  ScopedTempDir output_dir;
+  ASSERT_FALSE(output_dir.path().empty());
+  FormatAndFile input_file, output_file;
+  input_file.filename = output_dir.path() + "perf.data";
+  input_file.format = kPerfFormat;
+  output_file.filename = output_dir.path() + "perf.proto";
+  output_file.format = kProtoBinaryFormat;
+  ASSERT_TRUE(BufferToFile(input_file.filename, input.str()));
+
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+  ASSERT_TRUE(ConvertFile(input_file, output_file, options));
+  PerfDataProto perf_data_proto;
+  ASSERT_TRUE(ReadProtobufFromFile(&perf_data_proto, output_file.filename));
+  EXPECT_EQ(1, perf_data_proto.stats().num_sample_events());
+  EXPECT_EQ(1, perf_data_proto.stats().num_sample_events_mapped());
+}
+
 }  // namespace quipper
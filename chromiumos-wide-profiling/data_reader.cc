@@ -33,6 +33,14 @@ bool DataReader::ReadDataValue(const size_t size, const string& value_name,
   return false;
 }
 
+bool DataReader::ReadUint64Array(const size_t count, uint64_t* dest) {
+  if (!ReadData(count * sizeof(*dest), dest))
+    return false;
+  if (is_cross_endian_)
+    ByteSwapArray(dest, count);
+  return true;
+}
+
 bool DataReader::ReadStringWithSizeFromData(string* dest) {
   uint32_t len = 0;
   if (!ReadUint32(&len)) {
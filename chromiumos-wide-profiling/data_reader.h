@@ -37,6 +37,15 @@ class DataReader {
   // Reads raw data into a string.
   virtual bool ReadDataString(const size_t size, string* dest);
 
+  // Returns a pointer to the next |size| bytes of data without copying them,
+  // and advances the read pointer past them. Returns nullptr if there are not
+  // enough bytes left, or if the data source does not support direct access,
+  // in which case the read pointer is not moved. The returned memory is only
+  // valid for the lifetime of the reader, and must not be written to.
+  virtual const void* ReadDataPointer(const size_t size) {
+    return nullptr;
+  }
+
   // Like ReadData(), but prints an error if it doesn't read all |size| bytes.
   virtual bool ReadDataValue(const size_t size, const string& value_name,
                              void* dest);
@@ -52,6 +61,10 @@ class DataReader {
     return ReadIntValue(value);
   }
 
+  // Reads |count| 64-bit integers into |dest| with endian swapping. Faster than
+  // calling ReadUint64() |count| times, since the data is read all at once.
+  bool ReadUint64Array(const size_t count, uint64_t* dest);
+
   // Read a string. Returns true if it managed to read |size| bytes (excluding
   // null terminator). The actual string may be shorter than the number of bytes
   // requested.
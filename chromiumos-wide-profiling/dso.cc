@@ -14,6 +14,7 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <mutex>
 #include <vector>
 
 #include "base/logging.h"
@@ -101,8 +102,13 @@ bool GetBuildID(Elf *elf, string* buildid) {
 }  // namespace
 
 void InitializeLibelf() {
-  const unsigned int kElfVersionNone = EV_NONE;  // correctly typed.
-  CHECK_NE(kElfVersionNone, elf_version(EV_CURRENT)) << elf_errmsg(-1);
+  // elf_version() changes global libelf state, so only the first call makes
+  // it.
+  static std::once_flag once;
+  std::call_once(once, [] {
+    const unsigned int kElfVersionNone = EV_NONE;  // correctly typed.
+    CHECK_NE(kElfVersionNone, elf_version(EV_CURRENT)) << elf_errmsg(-1);
+  });
 }
 
 bool ReadElfBuildId(string filename, string* buildid) {
@@ -33,7 +33,9 @@ struct DSOInfo {
 // Do the |DSOInfo| and |struct stat| refer to the same inode?
 bool SameInode(const DSOInfo& dso, const struct stat* s);
 
-// Must be called at least once before using libelf.
+// Must be called at least once before using libelf. Only the first call
+// initializes libelf, so callers that read ELF files on multiple threads must
+// call it before starting them.
 void InitializeLibelf();
 // Read buildid from an ELF file using libelf.
 bool ReadElfBuildId(string filename, string* buildid);
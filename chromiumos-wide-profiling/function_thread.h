@@ -0,0 +1,38 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROMIUMOS_WIDE_PROFILING_FUNCTION_THREAD_H_
+#define CHROMIUMOS_WIDE_PROFILING_FUNCTION_THREAD_H_
+
+#include <functional>
+
+#include "base/macros.h"
+
+#include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/compat/thread.h"
+
+namespace quipper {
+
+// Runs a function on its own thread. Used to split the work on a large
+// perf.data file among several threads.
+class FunctionThread : public quipper::Thread {
+ public:
+  FunctionThread(const string& name, const std::function<void()>& function)
+      : quipper::Thread(name),
+        function_(function) {}
+
+ protected:
+  void Run() override {
+    function_();
+  }
+
+ private:
+  const std::function<void()> function_;
+
+  DISALLOW_COPY_AND_ASSIGN(FunctionThread);
+};
+
+}  // namespace quipper
+
+#endif  // CHROMIUMOS_WIDE_PROFILING_FUNCTION_THREAD_H_
@@ -0,0 +1,80 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chromiumos-wide-profiling/mmap_reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base/logging.h"
+
+namespace quipper {
+
+MmapReader::MmapReader(const string& filename)
+    : is_open_(false), mapping_(nullptr), offset_(0) {
+  size_ = 0;
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode)) {
+    close(fd);
+    return;
+  }
+
+  // mmap() does not accept a zero length, so leave empty files unmapped.
+  if (stat_buf.st_size > 0) {
+    void* mapping =
+        mmap(nullptr, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      PLOG(ERROR) << "Unable to map file " << filename;
+      close(fd);
+      return;
+    }
+    mapping_ = reinterpret_cast<const char*>(mapping);
+    size_ = stat_buf.st_size;
+  }
+  // The mapping stays valid after the file descriptor is closed.
+  close(fd);
+  is_open_ = true;
+}
+
+MmapReader::~MmapReader() {
+  if (mapping_)
+    munmap(const_cast<char*>(mapping_), size_);
+}
+
+bool MmapReader::ReadData(const size_t size, void* dest) {
+  if (offset_ + size > size_)
+    return false;
+
+  memcpy(dest, mapping_ + offset_, size);
+  offset_ += size;
+  return true;
+}
+
+const void* MmapReader::ReadDataPointer(const size_t size) {
+  if (offset_ + size > size_)
+    return nullptr;
+
+  const char* data = mapping_ + offset_;
+  offset_ += size;
+  return data;
+}
+
+bool MmapReader::ReadString(const size_t size, string* str) {
+  if (offset_ + size > size_)
+    return false;
+
+  size_t actual_length = strnlen(mapping_ + offset_, size);
+  *str = string(mapping_ + offset_, actual_length);
+  offset_ += size;
+  return true;
+}
+
+}  // namespace quipper
@@ -0,0 +1,56 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROMIUMOS_WIDE_PROFILING_MMAP_READER_H_
+#define CHROMIUMOS_WIDE_PROFILING_MMAP_READER_H_
+
+#include "chromiumos-wide-profiling/data_reader.h"
+
+namespace quipper {
+
+// Read from an input file by mapping it read-only into memory. Must be a normal
+// file. Unlike FileReader, the file contents can be accessed in place using
+// ReadDataPointer().
+class MmapReader : public DataReader {
+ public:
+  explicit MmapReader(const string& filename);
+  virtual ~MmapReader();
+
+  bool IsOpen() const {
+    return is_open_;
+  }
+
+  void SeekSet(size_t offset) override {
+    offset_ = offset;
+  }
+
+  size_t Tell() const override {
+    return offset_;
+  }
+
+  bool ReadData(const size_t size, void* dest) override;
+
+  // Returns a pointer into the mapped file. Valid until the reader is
+  // destroyed.
+  const void* ReadDataPointer(const size_t size) override;
+
+  // Reads |size| bytes of the file as a null-terminated string into |str|.
+  // Behaves like BufferReader::ReadString().
+  bool ReadString(const size_t size, string* str) override;
+
+ private:
+  // Whether the file was successfully opened and mapped. An empty file is
+  // considered open, but has no mapping.
+  bool is_open_;
+
+  // Start of the read-only file mapping.
+  const char* mapping_;
+
+  // Data read offset from the start of |mapping_|.
+  size_t offset_;
+};
+
+}  // namespace quipper
+
+#endif  // CHROMIUMOS_WIDE_PROFILING_MMAP_READER_H_
@@ -0,0 +1,139 @@
+// Copyright 2016 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "base/logging.h"
+
+#include "chromiumos-wide-profiling/compat/test.h"
+#include "chromiumos-wide-profiling/file_utils.h"
+#include "chromiumos-wide-profiling/mmap_reader.h"
+#include "chromiumos-wide-profiling/scoped_temp_path.h"
+#include "chromiumos-wide-profiling/test_utils.h"
+
+namespace quipper {
+
+// Move the cursor around and make sure the offset is properly set each time.
+TEST(MmapReaderTest, MoveOffset) {
+  std::vector<uint8_t> input_data(1000);
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), input_data));
+
+  MmapReader reader(input_file.path());
+  ASSERT_TRUE(reader.IsOpen());
+  EXPECT_EQ(input_data.size(), reader.size());
+  EXPECT_EQ(0, reader.Tell());
+
+  reader.SeekSet(100);
+  EXPECT_EQ(100, reader.Tell());
+  reader.SeekSet(900);
+  EXPECT_EQ(900, reader.Tell());
+
+  // The cursor can be set to past the end of the file, but can't perform any
+  // read operations there.
+  reader.SeekSet(1200);
+  EXPECT_EQ(1200, reader.Tell());
+  int dummy;
+  EXPECT_FALSE(reader.ReadData(sizeof(dummy), &dummy));
+  EXPECT_EQ(nullptr, reader.ReadDataPointer(sizeof(dummy)));
+}
+
+// An empty file can be opened, but nothing can be read from it.
+TEST(MmapReaderTest, EmptyFile) {
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), string()));
+
+  MmapReader reader(input_file.path());
+  EXPECT_TRUE(reader.IsOpen());
+  EXPECT_EQ(0, reader.size());
+  EXPECT_TRUE(reader.ReadData(0, NULL));
+  char dummy;
+  EXPECT_FALSE(reader.ReadData(sizeof(dummy), &dummy));
+}
+
+TEST(MmapReaderTest, NonexistentFile) {
+  MmapReader reader("/path/to/nonexistent/file");
+  EXPECT_FALSE(reader.IsOpen());
+}
+
+// Read in all data from the input file in multiple chunks, in order, both with
+// and without copying.
+TEST(MmapReaderTest, ReadMultipleChunks) {
+  // This string is 26 characters long.
+  const string kInputData = "abcdefghijklmnopqrstuvwxyz";
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), kInputData));
+  MmapReader reader(input_file.path());
+
+  std::vector<uint8_t> output(kInputData.size());
+  EXPECT_TRUE(reader.ReadData(10, output.data() + reader.Tell()));
+  EXPECT_EQ(10, reader.Tell());
+
+  const void* pointer = reader.ReadDataPointer(10);
+  ASSERT_NE(nullptr, pointer);
+  memcpy(output.data() + 10, pointer, 10);
+  EXPECT_EQ(20, reader.Tell());
+
+  EXPECT_TRUE(reader.ReadData(6, output.data() + reader.Tell()));
+  EXPECT_EQ(26, reader.Tell());
+
+  EXPECT_EQ(kInputData, string(output.begin(), output.end()));
+}
+
+// Test reading past the end of the file.
+TEST(MmapReaderTest, ReadPastEndOfData) {
+  // This string is 26 characters long.
+  const string kInputData = "abcdefghijklmnopqrstuvwxyz";
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), kInputData));
+  MmapReader reader(input_file.path());
+
+  // Must not be able to read past the end of the file, and the read pointer
+  // should not move when trying to.
+  std::vector<uint8_t> output(kInputData.size());
+  EXPECT_FALSE(reader.ReadData(30, output.data()));
+  EXPECT_EQ(0, reader.Tell());
+  EXPECT_EQ(nullptr, reader.ReadDataPointer(30));
+  EXPECT_EQ(0, reader.Tell());
+
+  EXPECT_TRUE(reader.ReadData(13, output.data()));
+  EXPECT_EQ(13, reader.Tell());
+  EXPECT_EQ(nullptr, reader.ReadDataPointer(20));
+  EXPECT_EQ(13, reader.Tell());
+
+  EXPECT_TRUE(reader.ReadData(13, output.data() + reader.Tell()));
+  EXPECT_EQ(26, reader.Tell());
+  EXPECT_EQ(kInputData, string(output.begin(), output.end()));
+}
+
+// Test string reads.
+TEST(MmapReaderTest, ReadString) {
+  string input_string("The quick brown fox jumps over the lazy dog.");
+
+  // Add some zero padding behind the string. It should be skipped over, but not
+  // added to the output string.
+  string input_string_with_padding(input_string);
+  input_string_with_padding.resize(input_string.size() + 10, '\0');
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), input_string_with_padding));
+
+  MmapReader reader(input_file.path());
+  string output = "previous string value";
+  EXPECT_FALSE(reader.ReadString(input_string_with_padding.size() + 1,
+                                 &output));
+  EXPECT_EQ("previous string value", output);
+
+  EXPECT_TRUE(reader.ReadString(input_string_with_padding.size(), &output));
+  EXPECT_EQ(input_string_with_padding.size(), reader.Tell());
+  EXPECT_EQ(input_string, output);
+}
+
+}  // namespace quipper
@@ -6,17 +6,22 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "base/logging.h"
 
+#include "chromiumos-wide-profiling/build_id_cache.h"
 #include "chromiumos-wide-profiling/compat/log_level.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/conversion_utils.h"
 
+using quipper::BuildIdCache;
 using quipper::FormatAndFile;
 using quipper::kPerfFormat;
+using quipper::kColumnarFormat;
+using quipper::kProtoBinaryFormat;
 using quipper::kProtoTextFormat;
 
 namespace {
@@ -32,18 +37,31 @@ const char kDefaultInputFilename[] = "perf.data";
 // Default input format is perf.data format.
 const char kDefaultInputFormat[] = "perf";
 
-// Parses arguments, storing the results in |input| and |output|. Returns true
-// if arguments parsed successfully and false otherwise.
+// Number of build IDs kept in memory by the build ID cache.
+const size_t kBuildIdCacheMemoryEntries = 4096;
+
+// Number of threads used to read missing build IDs from the filesystem.
+const size_t kBuildIdReadingThreads = 4;
+
+// Parses arguments, storing the results in |input| and |output|, the build ID
+// cache directory, if any, in |build_id_cache_dir|, and whether to leave the
+// events unsorted in |unsorted|. Returns true if arguments parsed successfully
+// and false otherwise.
 bool ParseArguments(int argc, char* argv[], FormatAndFile* input,
-                    FormatAndFile* output) {
+                    FormatAndFile* output, string* build_id_cache_dir,
+                    bool* unsorted) {
   output->filename = kDefaultOutputFilename;
   output->format = kDefaultOutputFormat;
   input->filename = kDefaultInputFilename;
   input->format = kDefaultInputFormat;
 
   int opt;
-  while ((opt = getopt(argc, argv, "i:o:I:O:v:")) != -1) {
+  while ((opt = getopt(argc, argv, "i:o:I:O:v:b:u")) != -1) {
     switch (opt) {
+      case 'b': {
+        *build_id_cache_dir = optarg;
+        break;
+      }
       case 'i': {
         input->filename = optarg;
         break;
@@ -60,6 +78,10 @@ bool ParseArguments(int argc, char* argv[], FormatAndFile* input,
         output->format = optarg;
         break;
       }
+      case 'u': {
+        *unsorted = true;
+        break;
+      }
       case 'v': {
         quipper::SetVerbosityLevel(atoi(optarg));
         break;
@@ -74,13 +96,25 @@ bool ParseArguments(int argc, char* argv[], FormatAndFile* input,
 void PrintUsage() {
   LOG(INFO) << "Usage:";
   LOG(INFO) << "<exe> -i <input filename> -I <input format>"
-            << " -o <output filename> -O <output format> -v <verbosity level>";
-  LOG(INFO) << "Format options are: '" << kPerfFormat << "' for perf.data"
-            << " and '" << kProtoTextFormat << "' for proto text.";
+            << " -o <output filename> -O <output format> -v <verbosity level>"
+            << " -b <build ID cache directory> -u";
+  LOG(INFO) << "Format options are: '" << kPerfFormat << "' for perf.data,"
+            << " '" << kProtoTextFormat << "' for proto text, '"
+            << kProtoBinaryFormat << "' for serialized proto and '"
+            << kColumnarFormat << "' (output only) for a columnar profile of"
+            << " the samples.";
   LOG(INFO) << "By default it reads from perf.data and outputs to /dev/stdout"
             << " in proto text format.";
   LOG(INFO) << "Default verbosity level is 0. Higher values increase verbosity."
             << " Negative values filter LOG() levels.";
+  LOG(INFO) << "If a build ID cache directory is given, build IDs missing from"
+            << " the input are read from the filesystem and cached there.";
+  LOG(INFO) << "With -u, events are left in file order instead of being sorted"
+            << " by time, so that perf.data can be converted to '"
+            << kProtoBinaryFormat << "' or '" << kColumnarFormat << "' in"
+            << " batches, without reading all of it into memory. '"
+            << kProtoBinaryFormat << "' input is always read into memory at"
+            << " once.";
 }
 }  // namespace
 
@@ -89,12 +123,25 @@ void PrintUsage() {
 // <output format>
 int main(int argc, char* argv[]) {
   FormatAndFile input, output;
-  if (!ParseArguments(argc, argv, &input, &output)) {
+  string build_id_cache_dir;
+  bool unsorted = false;
+  if (!ParseArguments(argc, argv, &input, &output, &build_id_cache_dir,
+                      &unsorted)) {
     PrintUsage();
     return EXIT_FAILURE;
   }
 
-  if (!quipper::ConvertFile(input, output))
+  quipper::PerfParserOptions options;
+  options.sort_events_by_time = !unsorted;
+  std::unique_ptr<BuildIdCache> build_id_cache;
+  if (!build_id_cache_dir.empty()) {
+    build_id_cache.reset(
+        new BuildIdCache(build_id_cache_dir, kBuildIdCacheMemoryEntries));
+    options.read_missing_buildids = true;
+    options.build_id_cache = build_id_cache.get();
+    options.num_build_id_reading_threads = kBuildIdReadingThreads;
+  }
+  if (!quipper::ConvertFile(input, output, options))
     return EXIT_FAILURE;
   return EXIT_SUCCESS;
 }
@@ -11,18 +11,28 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <set>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 #include "base/logging.h"
 
 #include "chromiumos-wide-profiling/address_mapper.h"
 #include "chromiumos-wide-profiling/binary_data_utils.h"
+#include "chromiumos-wide-profiling/build_id_cache.h"
 #include "chromiumos-wide-profiling/compat/proto.h"
 #include "chromiumos-wide-profiling/compat/string.h"
+#include "chromiumos-wide-profiling/data_reader.h"
 #include "chromiumos-wide-profiling/dso.h"
+#include "chromiumos-wide-profiling/file_reader.h"
+#include "chromiumos-wide-profiling/function_thread.h"
 #include "chromiumos-wide-profiling/huge_pages_mapping_deducer.h"
+#include "chromiumos-wide-profiling/mmap_reader.h"
 
 namespace quipper {
 
@@ -55,6 +65,71 @@ bool IsNullBranchStackEntry(const BranchStackEntry& entry) {
   return (!entry.from_ip() && !entry.to_ip());
 }
 
+// Mixes |value| into the hash |seed|.
+uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+uint64_t HashDSOAndOffset(uint64_t seed,
+                          const ParsedEvent::DSOAndOffset& dso_and_offset) {
+  seed = HashCombine(seed,
+                     reinterpret_cast<uintptr_t>(dso_and_offset.dso_info_));
+  return HashCombine(seed, dso_and_offset.offset_);
+}
+
+// Unlike ParsedEvent::DSOAndOffset::operator==, compares DSOs by identity.
+bool SameDSOAndOffset(const ParsedEvent::DSOAndOffset& a,
+                      const ParsedEvent::DSOAndOffset& b) {
+  return a.dso_info_ == b.dso_info_ && a.offset_ == b.offset_;
+}
+
+// Returns whether |parsed_event| is counted by |aggregated_sample|, given the
+// command it is aggregated with.
+bool IsSameAggregatedSample(const ParsedEvent& parsed_event,
+                            const string* command,
+                            const AggregatedSample& aggregated_sample) {
+  if (aggregated_sample.command != command ||
+      !SameDSOAndOffset(aggregated_sample.dso_and_offset,
+                        parsed_event.dso_and_offset) ||
+      aggregated_sample.callchain.size() != parsed_event.callchain.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < parsed_event.callchain.size(); ++i) {
+    if (!SameDSOAndOffset(aggregated_sample.callchain[i],
+                          parsed_event.callchain[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Rearranges |events| to contain only |new_events|, which must be distinct
+// elements of |events|, in that order. Only the pointers to the events are
+// moved around, so the events stay on the arena that owns them, and pointers to
+// them remain valid. The other elements are cleared rather than deleted: on an
+// arena, deleting would not free them, while cleared elements are reused by
+// the next events added to |events|.
+void ReplaceEvents(const std::vector<PerfEvent*>& new_events,
+                   RepeatedPtrField<PerfEvent>* events) {
+  const std::unordered_set<PerfEvent*> kept_events(new_events.begin(),
+                                                   new_events.end());
+  std::vector<PerfEvent*> deleted_events;
+  for (int i = 0; i < events->size(); ++i) {
+    PerfEvent* event = events->Mutable(i);
+    if (kept_events.find(event) == kept_events.end())
+      deleted_events.push_back(event);
+  }
+  CHECK_EQ(new_events.size() + deleted_events.size(),
+           static_cast<size_t>(events->size()));
+
+  auto event_ptrs = events->pointer_begin();
+  std::copy(new_events.begin(), new_events.end(), event_ptrs);
+  std::copy(deleted_events.begin(), deleted_events.end(),
+            event_ptrs + new_events.size());
+  for (size_t i = 0; i < deleted_events.size(); ++i)
+    events->RemoveLast();
+}
+
 // Walks through all the perf events in |*reader| and searches for split
 // mappings due to huge pages. Combines these split mappings into one and
 // replaces the split mapping events. Modifies the events vector stored in
@@ -68,13 +143,13 @@ bool IsNullBranchStackEntry(const BranchStackEntry& entry) {
 void CombineHugePagesMappings(PerfReader* reader) {
     std::map<uint32_t, std::unique_ptr<HugePagesMappingDeducer>>
         pids_to_deducers;
-    RepeatedPtrField<PerfEvent> new_events;
-    new_events.Reserve(reader->events().size());
+    std::vector<PerfEvent*> new_events;
+    new_events.reserve(reader->events().size());
 
     for (int i = 0; i < reader->events().size(); ++i) {
       PerfEvent* event = reader->mutable_events()->Mutable(i);
       if (!event->has_mmap_event()) {
-        new_events.Add()->Swap(event);
+        new_events.push_back(event);
         continue;
       }
 
@@ -86,7 +161,7 @@ void CombineHugePagesMappings(PerfReader* reader) {
       }
       deducer->ProcessMmap(mmap);
       if (!deducer->CombinedMappingAvailable()) {
-        new_events.Add()->Swap(event);
+        new_events.push_back(event);
         continue;
       }
 
@@ -96,12 +171,12 @@ void CombineHugePagesMappings(PerfReader* reader) {
       // consecutively, with no other mappings in between.
       const MMapEvent& combined_mmap = deducer->combined_mapping();
       for (int j = new_events.size() - 1;
-           j >= 0 && new_events.Get(j).has_mmap_event();
+           j >= 0 && new_events[j]->has_mmap_event();
            --j) {
-        MMapEvent* old_mmap = new_events.Mutable(j)->mutable_mmap_event();
+        MMapEvent* old_mmap = new_events[j]->mutable_mmap_event();
         if (old_mmap->start() == combined_mmap.start()) {
           // Delete all split mappings except the first one...
-          new_events.DeleteSubrange(j + 1, new_events.size() - j - 1);
+          new_events.resize(j + 1);
           // ... and update it with the new combined mapping info.
           *old_mmap = combined_mmap;
           break;
@@ -109,18 +184,21 @@ void CombineHugePagesMappings(PerfReader* reader) {
       }
     }
 
-    reader->mutable_events()->Swap(&new_events);
+    ReplaceEvents(new_events, reader->mutable_events());
 }
 
 }  // namespace
 
-PerfParser::PerfParser(PerfReader* reader) : reader_(reader) {}
+PerfParser::PerfParser(PerfReader* reader)
+    : reader_(reader),
+      first_parsed_event_id_(0) {}
 
 PerfParser::~PerfParser() {}
 
 PerfParser::PerfParser(PerfReader* reader, const PerfParserOptions& options)
     : reader_(reader),
-      options_(options) {}
+      options_(options),
+      first_parsed_event_id_(0) {}
 
 bool PerfParser::ParseRawEvents() {
   if (options_.sort_events_by_time) {
@@ -135,24 +213,7 @@ bool PerfParser::ParseRawEvents() {
     CombineHugePagesMappings(reader_);
   }
 
-  // Clear the parsed events to reset their fields. Otherwise, non-sample events
-  // may have residual DSO+offset info.
-  parsed_events_.clear();
-
-  // Events of type PERF_RECORD_FINISHED_ROUND don't have a timestamp, and are
-  // not needed.
-  // TODO(dhsharp): Follow the pattern of perf's util/ordered_events to
-  // use the partial-sorting of events between rounds to sort faster.
-  parsed_events_.resize(reader_->events().size());
-  size_t write_index = 0;
-  for (int i = 0; i < reader_->events().size(); ++i) {
-    if (reader_->events().Get(i).header().type() == PERF_RECORD_FINISHED_ROUND)
-      continue;
-    parsed_events_[write_index++].event_ptr =
-        reader_->mutable_events()->Mutable(i);
-  }
-  parsed_events_.resize(write_index);
-
+  PopulateParsedEvents();
   ProcessEvents();
 
   if (!options_.discard_unused_events)
@@ -161,7 +222,7 @@ bool PerfParser::ParseRawEvents() {
   // Some MMAP/MMAP2 events' mapped regions will not have any samples. These
   // MMAP/MMAP2 events should be dropped. |parsed_events_| should be
   // reconstructed without these events.
-  write_index = 0;
+  size_t write_index = 0;
   size_t read_index;
   for (read_index = 0; read_index < parsed_events_.size(); ++read_index) {
     const ParsedEvent& event = parsed_events_[read_index];
@@ -182,7 +243,72 @@ bool PerfParser::ParseRawEvents() {
   return true;
 }
 
+bool PerfParser::StartParsingEventBatches() {
+  if (options_.discard_unused_events) {
+    LOG(ERROR) << "Unused events can not be discarded when parsing events in "
+               << "batches.";
+    return false;
+  }
+  if (options_.sort_events_by_time) {
+    // Events may be written out of order, e.g. a sample on one CPU before the
+    // MMAP on another CPU that it falls in, and such events need not be read
+    // in the same batch.
+    LOG(ERROR) << "Events can not be sorted by time when parsing events in "
+               << "batches.";
+    return false;
+  }
+  process_mappers_.clear();
+  parsed_events_.clear();
+  StartProcessingEvents();
+  return true;
+}
+
+bool PerfParser::ParseRawEventBatch() {
+  if (options_.combine_huge_pages_mappings) {
+    CombineHugePagesMappings(reader_);
+  }
+
+  PopulateParsedEvents();
+  const size_t num_events = parsed_events_.size();
+  const bool ret = ProcessEventBatch();
+  // The events of the next batch follow all events of this one, including any
+  // that were removed from |parsed_events_| while processing.
+  first_parsed_event_id_ += num_events;
+  return ret;
+}
+
+bool PerfParser::FinishParsingEventBatches() {
+  return FinishProcessingEvents();
+}
+
+void PerfParser::PopulateParsedEvents() {
+  // Clear the parsed events to reset their fields. Otherwise, non-sample events
+  // may have residual DSO+offset info.
+  parsed_events_.clear();
+
+  // Events of type PERF_RECORD_FINISHED_ROUND don't have a timestamp, and are
+  // not needed.
+  // TODO(dhsharp): Follow the pattern of perf's util/ordered_events to
+  // use the partial-sorting of events between rounds to sort faster.
+  parsed_events_.resize(reader_->events().size());
+  size_t write_index = 0;
+  for (int i = 0; i < reader_->events().size(); ++i) {
+    if (reader_->events().Get(i).header().type() == PERF_RECORD_FINISHED_ROUND)
+      continue;
+    parsed_events_[write_index++].event_ptr =
+        reader_->mutable_events()->Mutable(i);
+  }
+  parsed_events_.resize(write_index);
+}
+
 bool PerfParser::ProcessEvents() {
+  StartProcessingEvents();
+  if (!ProcessEventBatch())
+    return false;
+  return FinishProcessingEvents();
+}
+
+void PerfParser::StartProcessingEvents() {
   stats_ = {0};
 
   stats_.did_remap = false;   // Explicitly clear the remap flag.
@@ -195,19 +321,39 @@ bool PerfParser::ProcessEvents() {
   pidtid_to_comm_map_[std::make_pair(kSwapperPid, kSwapperPid)] =
       &(*commands_.find(kSwapperCommandName));
 
+  mmap_id_to_dso_.clear();
+  first_parsed_event_id_ = 0;
+
+  aggregated_samples_.clear();
+  aggregated_sample_indexes_.clear();
+}
+
+bool PerfParser::ProcessEventBatch() {
+  const bool map_samples_in_parallel = options_.num_sample_mapping_threads > 1;
+  SampleMappingResults results;
+  sample_groups_.clear();
+  pid_to_sample_group_.clear();
+
   // NB: Not necessarily actually sorted by time.
   for (size_t i = 0; i < parsed_events_.size(); ++i) {
     ParsedEvent& parsed_event = parsed_events_[i];
     PerfEvent& event = *parsed_event.event_ptr;
     switch (event.header().type()) {
       case PERF_RECORD_SAMPLE:
+      {
         // SAMPLE doesn't have any fields to log at a fixed,
         // previously-endian-swapped location. This used to log ip.
         VLOG(1) << "SAMPLE";
         ++stats_.num_sample_events;
-        if (MapSampleEvent(&parsed_event))
-          ++stats_.num_sample_events_mapped;
+        AddressMapper* mapper = PrepareSampleEvent(&parsed_event);
+        if (!mapper)
+          break;
+        if (map_samples_in_parallel)
+          QueueSampleEvent(&parsed_event, mapper);
+        else if (MapSampleEvent(&parsed_event, mapper, &results))
+          ++results.num_sample_events_mapped;
         break;
+      }
       case PERF_RECORD_MMAP:
       case PERF_RECORD_MMAP2:
       {
@@ -215,8 +361,15 @@ bool PerfParser::ProcessEvents() {
             event.header().type() == PERF_RECORD_MMAP ? "MMAP" : "MMAP2";
         VLOG(1) << mmap_type_name << ": " << event.mmap_event().filename();
         ++stats_.num_mmap_events;
-        // Use the array index of the current mmap event as a unique identifier.
-        CHECK(MapMmapEvent(event.mutable_mmap_event(), i))
+        // Use the index of the current mmap event as a unique identifier.
+        const uint64_t id = first_parsed_event_id_ + i;
+        // Samples of the process that were queued before this event must be
+        // mapped before it changes the process's mappings.
+        if (map_samples_in_parallel &&
+            pid_to_sample_group_.count(event.mmap_event().pid())) {
+          MapSampleGroups();
+        }
+        CHECK(MapMmapEvent(event.mutable_mmap_event(), id))
             << "Unable to map " << mmap_type_name << " event!";
         // No samples in this MMAP region yet, hopefully.
         parsed_event.num_samples_in_mmap_region = 0;
@@ -227,7 +380,8 @@ bool PerfParser::ProcessEvents() {
           dso_info.min = event.mmap_event().min();
           dso_info.ino = event.mmap_event().ino();
         }
-        name_to_dso_.emplace(dso_info.name, dso_info);
+        mmap_id_to_dso_[id] =
+            &name_to_dso_.emplace(dso_info.name, dso_info).first->second;
         break;
       }
       case PERF_RECORD_FORK:
@@ -268,9 +422,23 @@ bool PerfParser::ProcessEvents() {
         break;
       default:
         LOG(ERROR) << "Unknown event type: " << event.header().type();
+        sample_groups_.clear();
+        pid_to_sample_group_.clear();
         return false;
     }
   }
+
+  if (map_samples_in_parallel)
+    MapSampleGroups();
+  else
+    ApplySampleMappingResults(results);
+
+  if (options_.aggregate_samples)
+    AggregateSampleEvents();
+  return true;
+}
+
+bool PerfParser::FinishProcessingEvents() {
   if (!FillInDsoBuildIds())
     return false;
 
@@ -311,7 +479,7 @@ class FdCloser {
 };
 
 bool ReadElfBuildIdIfSameInode(const string& dso_path, const DSOInfo& dso,
-                               string* buildid) {
+                               BuildIdCache* cache, string* buildid) {
   int fd = open(dso_path.c_str(), O_RDONLY);
   FdCloser fd_closer(fd);
   if (fd == -1) {
@@ -326,13 +494,16 @@ bool ReadElfBuildIdIfSameInode(const string& dso_path, const DSOInfo& dso,
   if (dso.maj != 0 && dso.min != 0 && !SameInode(dso, &s))
     return false;
 
+  if (cache)
+    return cache->ReadElfBuildId(fd, s, buildid);
   return ReadElfBuildId(fd, buildid);
 }
 
 // Looks up build ID of a given DSO by reading directly from the file system.
 // - Does not support reading build ID of the main kernel binary.
 // - Reads build IDs of kernel modules and other DSOs using functions in dso.h.
-string FindDsoBuildId(const DSOInfo& dso_info) {
+// - Uses |cache| for ELF files, if it is not NULL.
+string FindDsoBuildId(const DSOInfo& dso_info, BuildIdCache* cache) {
   string buildid_bin;
   const string& dso_name = dso_info.name;
   if (IsKernelNonModuleName(dso_name))
@@ -353,7 +524,7 @@ string FindDsoBuildId(const DSOInfo& dso_info) {
     std::stringstream dso_path_stream;
     dso_path_stream << "/proc/" << tid << "/root/" << dso_name;
     string dso_path = dso_path_stream.str();
-    if (ReadElfBuildIdIfSameInode(dso_path, dso_info, &buildid_bin)) {
+    if (ReadElfBuildIdIfSameInode(dso_path, dso_info, cache, &buildid_bin)) {
       return buildid_bin;
     }
     // Avoid re-trying the parent process if it's the same for multiple threads.
@@ -365,12 +536,13 @@ string FindDsoBuildId(const DSOInfo& dso_info) {
     std::stringstream parent_dso_path_stream;
     parent_dso_path_stream << "/proc/" << pid << "/root/" << dso_name;
     string parent_dso_path = parent_dso_path_stream.str();
-    if (ReadElfBuildIdIfSameInode(parent_dso_path, dso_info, &buildid_bin)) {
+    if (ReadElfBuildIdIfSameInode(parent_dso_path, dso_info, cache,
+                                  &buildid_bin)) {
       return buildid_bin;
     }
   }
   // Still don't have a buildid. Try our own filesystem:
-  if (ReadElfBuildIdIfSameInode(dso_name, dso_info, &buildid_bin)) {
+  if (ReadElfBuildIdIfSameInode(dso_name, dso_info, cache, &buildid_bin)) {
     return buildid_bin;
   }
   return buildid_bin;  // still empty.
@@ -384,21 +556,55 @@ bool PerfParser::FillInDsoBuildIds() {
 
   std::map<string, string> new_buildids;
 
+  std::vector<DSOInfo*> dsos_to_read;
   for (std::pair<const string, DSOInfo>& kv : name_to_dso_) {
     DSOInfo& dso_info = kv.second;
     const auto it = filenames_to_build_ids.find(dso_info.name);
     if (it != filenames_to_build_ids.end()) {
       dso_info.build_id = it->second;
     }
-    // If there is both an existing build ID and a new build ID returned by
-    // FindDsoBuildId(), overwrite the existing build ID.
-    if (options_.read_missing_buildids && dso_info.hit) {
-      string buildid_bin = FindDsoBuildId(dso_info);
-      if (!buildid_bin.empty()) {
-        dso_info.build_id = RawDataToHexString(buildid_bin);
-        new_buildids[dso_info.name] = dso_info.build_id;
-      }
+    if (options_.read_missing_buildids && dso_info.hit)
+      dsos_to_read.push_back(&dso_info);
+  }
+
+  // Reading build IDs mostly waits on the filesystem, so with many DSOs, read
+  // them on multiple threads.
+  std::vector<string> buildids_bin(dsos_to_read.size());
+  const size_t num_threads =
+      std::min(options_.num_build_id_reading_threads, dsos_to_read.size());
+  if (num_threads > 1) {
+    // libelf must be initialized before the threads use it.
+    InitializeLibelf();
+    std::vector<std::unique_ptr<FunctionThread>> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+      const size_t begin = dsos_to_read.size() * i / num_threads;
+      const size_t end = dsos_to_read.size() * (i + 1) / num_threads;
+      const auto read_buildids = [this, begin, end, &dsos_to_read,
+                                  &buildids_bin] {
+        for (size_t j = begin; j < end; ++j) {
+          buildids_bin[j] =
+              FindDsoBuildId(*dsos_to_read[j], options_.build_id_cache);
+        }
+      };
+      threads.emplace_back(new FunctionThread("BuildIdReader", read_buildids));
+      threads.back()->Start();
     }
+    for (auto& thread : threads)
+      thread->Join();
+  } else {
+    for (size_t i = 0; i < dsos_to_read.size(); ++i)
+      buildids_bin[i] = FindDsoBuildId(*dsos_to_read[i],
+                                       options_.build_id_cache);
+  }
+
+  // If there is both an existing build ID and a new build ID returned by
+  // FindDsoBuildId(), overwrite the existing build ID.
+  for (size_t i = 0; i < dsos_to_read.size(); ++i) {
+    if (buildids_bin[i].empty())
+      continue;
+    DSOInfo* dso_info = dsos_to_read[i];
+    dso_info->build_id = RawDataToHexString(buildids_bin[i]);
+    new_buildids[dso_info->name] = dso_info->build_id;
   }
 
   if (new_buildids.empty())
@@ -409,29 +615,24 @@ bool PerfParser::FillInDsoBuildIds() {
 void PerfParser::UpdatePerfEventsFromParsedEvents() {
   // Reorder the events in |reader_| to match the order of |parsed_events_|.
   // The |event_ptr|'s in |parsed_events_| are pointers to existing events in
-  // |reader_|.
-  RepeatedPtrField<PerfEvent> new_events;
-  new_events.Reserve(parsed_events_.size());
-  for (ParsedEvent& parsed_event : parsed_events_) {
-    PerfEvent* new_event = new_events.Add();
-    new_event->Swap(parsed_event.event_ptr);
-    parsed_event.event_ptr = new_event;
-  }
+  // |reader_|, and remain valid.
+  std::vector<PerfEvent*> new_events;
+  new_events.reserve(parsed_events_.size());
+  for (const ParsedEvent& parsed_event : parsed_events_)
+    new_events.push_back(parsed_event.event_ptr);
 
-  reader_->mutable_events()->Swap(&new_events);
+  ReplaceEvents(new_events, reader_->mutable_events());
 }
 
-bool PerfParser::MapSampleEvent(ParsedEvent* parsed_event) {
-  bool mapping_failed = false;
-
+AddressMapper* PerfParser::PrepareSampleEvent(ParsedEvent* parsed_event) {
   const PerfEvent& event = *parsed_event->event_ptr;
   if (!event.has_sample_event() ||
       !(event.sample_event().has_ip() &&
         event.sample_event().has_pid() &&
         event.sample_event().has_tid())) {
-    return false;
+    return NULL;
   }
-  SampleEvent& sample_info = *parsed_event->event_ptr->mutable_sample_event();
+  const SampleEvent& sample_info = event.sample_event();
 
   // Find the associated command.
   PidTid pidtid = std::make_pair(sample_info.pid(), sample_info.tid());
@@ -439,14 +640,140 @@ bool PerfParser::MapSampleEvent(ParsedEvent* parsed_event) {
   if (comm_iter != pidtid_to_comm_map_.end())
     parsed_event->set_command(comm_iter->second);
 
+  // Sometimes the first event we see is a SAMPLE event and we don't have the
+  // time to create an address mapper for a process. Example, for pid 0.
+  return GetOrCreateProcessMapper(sample_info.pid()).first;
+}
+
+void PerfParser::QueueSampleEvent(ParsedEvent* parsed_event,
+                                  AddressMapper* mapper) {
+  const uint32_t pid = parsed_event->event_ptr->sample_event().pid();
+  auto group_iter = pid_to_sample_group_.find(pid);
+  if (group_iter == pid_to_sample_group_.end()) {
+    group_iter = pid_to_sample_group_.insert(
+        group_iter, std::make_pair(pid, sample_groups_.size()));
+    sample_groups_.emplace_back();
+    sample_groups_.back().mapper = mapper;
+  }
+  SampleGroup& group = sample_groups_[group_iter->second];
+  DCHECK(mapper == group.mapper);
+  group.events.push_back(parsed_event);
+}
+
+void PerfParser::MapSampleGroups() {
+  const size_t num_threads =
+      std::min(options_.num_sample_mapping_threads, sample_groups_.size());
+  std::vector<SampleMappingResults> thread_results(num_threads);
+  // Each thread takes the next unmapped group until there are none left. There
+  // is one group per process, so each AddressMapper is only used by one
+  // thread.
+  std::atomic<size_t> next_group(0);
+  std::vector<std::unique_ptr<FunctionThread>> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    SampleMappingResults* results = &thread_results[i];
+    const auto map_groups = [this, results, &next_group] {
+      for (size_t group_index = next_group++;
+           group_index < sample_groups_.size();
+           group_index = next_group++) {
+        const SampleGroup& group = sample_groups_[group_index];
+        for (ParsedEvent* parsed_event : group.events) {
+          if (MapSampleEvent(parsed_event, group.mapper, results))
+            ++results->num_sample_events_mapped;
+        }
+      }
+    };
+    threads.emplace_back(new FunctionThread("SampleMapper", map_groups));
+    threads.back()->Start();
+  }
+
+  for (size_t i = 0; i < num_threads; ++i) {
+    threads[i]->Join();
+    ApplySampleMappingResults(thread_results[i]);
+  }
+  sample_groups_.clear();
+  pid_to_sample_group_.clear();
+}
+
+void PerfParser::ApplySampleMappingResults(
+    const SampleMappingResults& results) {
+  stats_.num_sample_events_mapped += results.num_sample_events_mapped;
+  for (const auto& hit : results.mmap_hits) {
+    const uint64_t id = hit.first;
+    DSOInfo* dso_info = mmap_id_to_dso_.at(id);
+    dso_info->hit = true;
+    dso_info->threads.insert(hit.second.second.begin(),
+                             hit.second.second.end());
+    // The MMAP event may have been in an earlier batch, whose events are gone.
+    if (id >= first_parsed_event_id_) {
+      CHECK_GT(parsed_events_.size(), id - first_parsed_event_id_);
+      parsed_events_[id - first_parsed_event_id_].num_samples_in_mmap_region +=
+          hit.second.first;
+    }
+  }
+}
+
+void PerfParser::AggregateSampleEvents() {
+  size_t write_index = 0;
+  for (size_t read_index = 0; read_index < parsed_events_.size();
+       ++read_index) {
+    const ParsedEvent& parsed_event = parsed_events_[read_index];
+    if (parsed_event.event_ptr->header().type() != PERF_RECORD_SAMPLE) {
+      if (read_index != write_index)
+        parsed_events_[write_index] = parsed_event;
+      ++write_index;
+      continue;
+    }
+
+    const string* command =
+        options_.aggregate_samples_by_command ? parsed_event.command_ : NULL;
+    uint64_t hash = HashCombine(0, reinterpret_cast<uintptr_t>(command));
+    hash = HashDSOAndOffset(hash, parsed_event.dso_and_offset);
+    for (const auto& entry : parsed_event.callchain)
+      hash = HashDSOAndOffset(hash, entry);
+
+    AggregatedSample* aggregated_sample = NULL;
+    const auto range = aggregated_sample_indexes_.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+      AggregatedSample& candidate = aggregated_samples_[iter->second];
+      if (IsSameAggregatedSample(parsed_event, command, candidate)) {
+        aggregated_sample = &candidate;
+        break;
+      }
+    }
+    if (!aggregated_sample) {
+      aggregated_sample_indexes_.emplace(hash, aggregated_samples_.size());
+      aggregated_samples_.emplace_back();
+      aggregated_sample = &aggregated_samples_.back();
+      aggregated_sample->dso_and_offset = parsed_event.dso_and_offset;
+      aggregated_sample->callchain = parsed_event.callchain;
+      aggregated_sample->command = command;
+    }
+    ++aggregated_sample->count;
+  }
+  parsed_events_.resize(write_index);
+
+  // Drop the sample events themselves.
+  UpdatePerfEventsFromParsedEvents();
+}
+
+bool PerfParser::MapSampleEvent(ParsedEvent* parsed_event,
+                                AddressMapper* mapper,
+                                SampleMappingResults* results) const {
+  bool mapping_failed = false;
+
+  SampleEvent& sample_info = *parsed_event->event_ptr->mutable_sample_event();
+  PidTid pidtid = std::make_pair(sample_info.pid(), sample_info.tid());
+
   const uint64_t unmapped_event_ip = sample_info.ip();
   uint64_t remapped_event_ip = 0;
 
   // Map the event IP itself.
   if (!MapIPAndPidAndGetNameAndOffset(sample_info.ip(),
                                       pidtid,
+                                      mapper,
                                       &remapped_event_ip,
-                                      &parsed_event->dso_and_offset)) {
+                                      &parsed_event->dso_and_offset,
+                                      results)) {
     mapping_failed = true;
   } else {
     sample_info.set_ip(remapped_event_ip);
@@ -456,15 +783,19 @@ bool PerfParser::MapSampleEvent(ParsedEvent* parsed_event) {
       !MapCallchain(sample_info.ip(),
                     pidtid,
                     unmapped_event_ip,
+                    mapper,
                     sample_info.mutable_callchain(),
-                    parsed_event)) {
+                    parsed_event,
+                    results)) {
     mapping_failed = true;
   }
 
   if (sample_info.branch_stack_size() &&
       !MapBranchStack(pidtid,
+                      mapper,
                       sample_info.mutable_branch_stack(),
-                      parsed_event)) {
+                      parsed_event,
+                      results)) {
     mapping_failed = true;
   }
 
@@ -474,8 +805,10 @@ bool PerfParser::MapSampleEvent(ParsedEvent* parsed_event) {
 bool PerfParser::MapCallchain(const uint64_t ip,
                               const PidTid pidtid,
                               const uint64_t original_event_addr,
+                              AddressMapper* mapper,
                               RepeatedField<uint64>* callchain,
-                              ParsedEvent* parsed_event) {
+                              ParsedEvent* parsed_event,
+                              SampleMappingResults* results) const {
   if (!callchain) {
     LOG(ERROR) << "NULL call stack data.";
     return false;
@@ -505,8 +838,10 @@ bool PerfParser::MapCallchain(const uint64_t ip,
     if (!MapIPAndPidAndGetNameAndOffset(
             entry,
             pidtid,
+            mapper,
             &mapped_addr,
-            &parsed_event->callchain[num_entries_mapped++])) {
+            &parsed_event->callchain[num_entries_mapped++],
+            results)) {
       mapping_failed = true;
     } else {
       callchain->Set(i, mapped_addr);
@@ -521,8 +856,10 @@ bool PerfParser::MapCallchain(const uint64_t ip,
 
 bool PerfParser::MapBranchStack(
     const PidTid pidtid,
+    AddressMapper* mapper,
     RepeatedPtrField<BranchStackEntry>* branch_stack,
-    ParsedEvent* parsed_event) {
+    ParsedEvent* parsed_event,
+    SampleMappingResults* results) const {
   if (!branch_stack) {
     LOG(ERROR) << "NULL branch stack data.";
     return false;
@@ -558,8 +895,10 @@ bool PerfParser::MapBranchStack(
     uint64_t from_mapped = 0;
     if (!MapIPAndPidAndGetNameAndOffset(entry->from_ip(),
                                         pidtid,
+                                        mapper,
                                         &from_mapped,
-                                        &parsed_entry.from)) {
+                                        &parsed_entry.from,
+                                        results)) {
       return false;
     }
     entry->set_from_ip(from_mapped);
@@ -567,8 +906,10 @@ bool PerfParser::MapBranchStack(
     uint64_t to_mapped = 0;
     if (!MapIPAndPidAndGetNameAndOffset(entry->to_ip(),
                                         pidtid,
+                                        mapper,
                                         &to_mapped,
-                                        &parsed_entry.to)) {
+                                        &parsed_entry.to,
+                                        results)) {
       return false;
     }
     entry->set_to_ip(to_mapped);
@@ -582,8 +923,10 @@ bool PerfParser::MapBranchStack(
 bool PerfParser::MapIPAndPidAndGetNameAndOffset(
     uint64_t ip,
     PidTid pidtid,
+    AddressMapper* mapper,
     uint64_t* new_ip,
-    ParsedEvent::DSOAndOffset* dso_and_offset) {
+    ParsedEvent::DSOAndOffset* dso_and_offset,
+    SampleMappingResults* results) const {
   DCHECK(dso_and_offset);
   // Attempt to find the synthetic address of the IP sample in this order:
   // 1. Address space of the kernel.
@@ -592,29 +935,20 @@ bool PerfParser::MapIPAndPidAndGetNameAndOffset(
 
   uint64_t mapped_addr = 0;
 
-  // Sometimes the first event we see is a SAMPLE event and we don't have the
-  // time to create an address mapper for a process. Example, for pid 0.
-  AddressMapper* mapper = GetOrCreateProcessMapper(pidtid.first).first;
   bool mapped = mapper->GetMappedAddress(ip, &mapped_addr);
   // TODO(asharif): What should we do when we cannot map a SAMPLE event?
 
   if (mapped) {
     uint64_t id = UINT64_MAX;
     CHECK(mapper->GetMappedIDAndOffset(ip, &id, &dso_and_offset->offset_));
-    // Make sure the ID points to a valid event.
-    CHECK_LE(id, parsed_events_.size());
-    ParsedEvent& parsed_event = parsed_events_[id];
-    const auto& event = parsed_event.event_ptr;
-    DCHECK(event->has_mmap_event()) << "Expected MMAP or MMAP2 event";
-
-    // Find the mmap DSO filename in the set of known DSO names.
-    auto dso_iter = name_to_dso_.find(event->mmap_event().filename());
-    CHECK(dso_iter != name_to_dso_.end());
-    dso_and_offset->dso_info_ = &dso_iter->second;
+    // Make sure the ID points to a valid MMAP or MMAP2 event.
+    const auto dso_iter = mmap_id_to_dso_.find(id);
+    CHECK(dso_iter != mmap_id_to_dso_.end());
+    dso_and_offset->dso_info_ = dso_iter->second;
 
-    dso_iter->second.hit = true;
-    dso_iter->second.threads.insert(pidtid);
-    ++parsed_event.num_samples_in_mmap_region;
+    auto& hit = results->mmap_hits[id];
+    ++hit.first;
+    hit.second.insert(pidtid);
 
     if (options_.do_remap) {
       if (GetPageAlignedOffset(mapped_addr) != GetPageAlignedOffset(ip)) {
@@ -754,4 +1088,54 @@ std::pair<AddressMapper*, bool> PerfParser::GetOrCreateProcessMapper(
   return std::make_pair(inserted->second.get(), true);
 }
 
+namespace {
+
+// Does the work of ParseFileInBatches(), reading the perf data from |data|.
+bool ParseDataInBatches(DataReader* data,
+                        const PerfParserOptions& options,
+                        size_t max_events_per_batch,
+                        const EventBatchCallback& process_batch,
+                        const EventBatchCallback& finish) {
+  CHECK_GT(max_events_per_batch, 0U);
+
+  PerfReader reader;
+  if (!reader.StartReadingEvents(data))
+    return false;
+
+  PerfParser parser(&reader, options);
+  if (!parser.StartParsingEventBatches())
+    return false;
+
+  while (reader.HasMoreEvents()) {
+    if (!reader.ReadNextEvents(max_events_per_batch) ||
+        !parser.ParseRawEventBatch() ||
+        !process_batch(&reader, &parser)) {
+      return false;
+    }
+  }
+  return parser.FinishParsingEventBatches() && finish(&reader, &parser);
+}
+
+}  // namespace
+
+bool ParseFileInBatches(const string& filename,
+                        const PerfParserOptions& options,
+                        size_t max_events_per_batch,
+                        const EventBatchCallback& process_batch,
+                        const EventBatchCallback& finish) {
+  MmapReader mmap_reader(filename);
+  if (mmap_reader.IsOpen()) {
+    return ParseDataInBatches(&mmap_reader, options, max_events_per_batch,
+                              process_batch, finish);
+  }
+
+  FileReader reader(filename);
+  if (!reader.IsOpen()) {
+    LOG(ERROR) << "Unable to open file " << filename;
+    return false;
+  }
+  return ParseDataInBatches(&reader, options, max_events_per_batch,
+                            process_batch, finish);
+}
+
 }  // namespace quipper
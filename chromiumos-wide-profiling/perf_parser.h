@@ -5,8 +5,10 @@
 #ifndef CHROMIUMOS_WIDE_PROFILING_PERF_PARSER_H_
 #define CHROMIUMOS_WIDE_PROFILING_PERF_PARSER_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -26,6 +28,7 @@
 namespace quipper {
 
 class AddressMapper;
+class BuildIdCache;
 class PerfDataProto_BranchStackEntry;
 class PerfDataProto_CommEvent;
 class PerfDataProto_ForkEvent;
@@ -115,6 +118,23 @@ struct ParsedEvent {
   }
 };
 
+// Counts the sample events that have the same DSO + offset for their IP and
+// for each callchain entry, and optionally the same command. Produced by
+// PerfParser when |PerfParserOptions::aggregate_samples| is set.
+struct AggregatedSample {
+  AggregatedSample() : command(NULL), count(0) {}
+
+  ParsedEvent::DSOAndOffset dso_and_offset;
+  std::vector<ParsedEvent::DSOAndOffset> callchain;
+
+  // Command of the samples. NULL if the command is not known, or if samples
+  // are not aggregated by command.
+  const string* command;
+
+  // Number of samples.
+  uint64_t count;
+};
+
 struct PerfEventStats {
   // Number of each type of event.
   uint32_t num_sample_events;
@@ -153,6 +173,12 @@ struct PerfParserOptions {
   // If buildids are missing from the input data, they can be retrieved from
   // the filesystem.
   bool read_missing_buildids = false;
+  // If set, build IDs retrieved from the filesystem are looked up in and added
+  // to this cache, which may be shared by many PerfParsers. Not owned.
+  BuildIdCache* build_id_cache = nullptr;
+  // Maximum number of threads used to retrieve build IDs from the filesystem.
+  // No more threads are used than there are DSOs to look up.
+  size_t num_build_id_reading_threads = 1;
   // Checks for a split binary mapping where part of it is mapped as huge pages.
   // Combines the split mappings into a single mapping so future consumers of
   // the perf data can see that it is actually a single mapping and not two or
@@ -161,6 +187,25 @@ struct PerfParserOptions {
   // Right now, this is only enabled for Chrome. In the future, it could be
   // expanded to other binaries if they end up being huge pages-mapped.
   bool combine_huge_pages_mappings = false;
+  // Number of threads used to serialize the raw perf events, where the
+  // PerfReader is created along with the PerfParser, e.g. by
+  // SerializeFromFileWithOptions(). See
+  // PerfReader::set_num_serialization_threads().
+  size_t num_serialization_threads = 1;
+  // Set this to count the sample events in aggregated_samples() instead of
+  // keeping them. Sample events are removed from parsed_events() and from the
+  // PerfReader once they have been mapped and counted. Branch stacks are not
+  // counted.
+  bool aggregate_samples = false;
+  // When aggregating samples, count samples with different commands
+  // separately.
+  bool aggregate_samples_by_command = false;
+  // Number of threads used to map sample events. With more than one, samples
+  // are queued and mapped on that many threads before an MMAP event changes
+  // the mappings of a process with queued samples, and at the end of each
+  // batch. The samples of each process are mapped by the same thread. The
+  // results are the same as mapping on one thread.
+  size_t num_sample_mapping_threads = 1;
 };
 
 class PerfParser {
@@ -182,6 +227,22 @@ class PerfParser {
   // invalidated.
   bool ParseRawEvents();
 
+  // Interface for parsing perf data whose events are read in batches using
+  // PerfReader::ReadNextEvents(). Call StartParsingEventBatches() once, then
+  // ParseRawEventBatch() each time |reader_| holds a new batch of events, and
+  // FinishParsingEventBatches() after the last batch. Process state such as
+  // mappings and commands is carried over from one batch to the next.
+  // parsed_events() only holds the events of the current batch.
+  //
+  // Events are processed in the order they were read.
+  // |options_.sort_events_by_time| and |options_.discard_unused_events| are not
+  // supported, and StartParsingEventBatches() returns false if either is set.
+  // |options_.combine_huge_pages_mappings| only combines mappings within the
+  // same batch.
+  bool StartParsingEventBatches();
+  bool ParseRawEventBatch();
+  bool FinishParsingEventBatches();
+
   const std::vector<ParsedEvent>& parsed_events() const {
     return parsed_events_;
   }
@@ -190,6 +251,15 @@ class PerfParser {
     return stats_;
   }
 
+  // The counts of the sample events processed since parsing started, if
+  // |options_.aggregate_samples| is set. The DSOs and commands that they
+  // point to are owned by the PerfParser. The counts are only available here,
+  // to callers that drive the PerfParser themselves; they are not part of any
+  // serialized output.
+  const std::vector<AggregatedSample>& aggregated_samples() const {
+    return aggregated_samples_;
+  }
+
   // Use with caution. Deserialization uses this to restore stats from proto.
   PerfEventStats* mutable_stats() {
     return &stats_;
@@ -199,6 +269,17 @@ class PerfParser {
   // Used for processing events.  e.g. remapping with synthetic addresses.
   bool ProcessEvents();
 
+  // ProcessEvents() is split into these steps, so that the events can also be
+  // processed in batches. ProcessEventBatch() processes the events in
+  // |parsed_events_|, and can be called any number of times in between the
+  // other two.
+  void StartProcessingEvents();
+  bool ProcessEventBatch();
+  bool FinishProcessingEvents();
+
+  // Fills in |parsed_events_| with the events of |reader_|.
+  void PopulateParsedEvents();
+
   // Looks up build IDs for all DSOs present in |reader_| by direct lookup using
   // functions in dso.h. If there is a DSO with both an existing build ID and a
   // new build ID read using dso.h, this will overwrite the existing build ID.
@@ -209,22 +290,73 @@ class PerfParser {
   // |reader_| would be updated to contain the new sequence of events.
   void UpdatePerfEventsFromParsedEvents();
 
-  // Does a sample event remap and then returns DSO name and offset of sample.
-  bool MapSampleEvent(ParsedEvent* parsed_event);
+  // Side effects of mapping sample events on the DSOs and MMAP events that the
+  // addresses are mapped into. Mapping records them here instead of applying
+  // them directly, so that samples can be mapped on several threads at once.
+  struct SampleMappingResults {
+    SampleMappingResults() : num_sample_events_mapped(0) {}
+
+    uint32_t num_sample_events_mapped;
+    // For each ID of a MMAP event that addresses were mapped into: the number
+    // of addresses, and the threads they were sampled in.
+    std::unordered_map<uint64_t, std::pair<uint32_t, std::set<PidTid>>>
+        mmap_hits;
+  };
+
+  // Sample events of one process that are waiting to be mapped, when mapping
+  // samples on multiple threads.
+  struct SampleGroup {
+    AddressMapper* mapper;
+    std::vector<ParsedEvent*> events;
+  };
+
+  // Checks that a sample event has the fields needed to map it, and sets its
+  // command. Returns the AddressMapper of the sample's process, or NULL if the
+  // sample can not be mapped.
+  AddressMapper* PrepareSampleEvent(ParsedEvent* parsed_event);
+
+  // Adds a sample event to the SampleGroup of its process, to be mapped by
+  // MapSampleGroups(). The samples must be mapped before the mappings of the
+  // process change.
+  void QueueSampleEvent(ParsedEvent* parsed_event, AddressMapper* mapper);
+
+  // Maps the events of |sample_groups_| on
+  // |options_.num_sample_mapping_threads| threads, applies the results, and
+  // clears |sample_groups_|.
+  void MapSampleGroups();
+
+  // Applies the side effects recorded while mapping sample events.
+  void ApplySampleMappingResults(const SampleMappingResults& results);
+
+  // Counts the sample events of |parsed_events_| in |aggregated_samples_|,
+  // then removes them from |parsed_events_| and |reader_|.
+  void AggregateSampleEvents();
+
+  // Does a sample event remap using |mapper|, the AddressMapper of the sample's
+  // process, and then returns DSO name and offset of sample. Does not modify
+  // any state shared with other samples, so different processes' samples can
+  // be mapped concurrently.
+  bool MapSampleEvent(ParsedEvent* parsed_event,
+                      AddressMapper* mapper,
+                      SampleMappingResults* results) const;
 
   // Calls MapIPAndPidAndGetNameAndOffset() on the callchain of a sample event.
   bool MapCallchain(const uint64_t ip,
                     const PidTid pidtid,
                     uint64_t original_event_addr,
+                    AddressMapper* mapper,
                     RepeatedField<uint64>* callchain,
-                    ParsedEvent* parsed_event);
+                    ParsedEvent* parsed_event,
+                    SampleMappingResults* results) const;
 
   // Trims the branch stack for null entries and calls
   // MapIPAndPidAndGetNameAndOffset() on each entry.
   bool MapBranchStack(
       const PidTid pidtid,
+      AddressMapper* mapper,
       RepeatedPtrField<PerfDataProto_BranchStackEntry>* branch_stack,
-      ParsedEvent* parsed_event);
+      ParsedEvent* parsed_event,
+      SampleMappingResults* results) const;
 
   // This maps a sample event and returns the mapped address, DSO name, and
   // offset within the DSO.  This is a private function because the API might
@@ -233,8 +365,10 @@ class PerfParser {
   bool MapIPAndPidAndGetNameAndOffset(
       uint64_t ip,
       const PidTid pidtid,
+      AddressMapper* mapper,
       uint64_t* new_ip,
-      ParsedEvent::DSOAndOffset* dso_and_offset);
+      ParsedEvent::DSOAndOffset* dso_and_offset,
+      SampleMappingResults* results) const;
 
   // Parses a MMAP event. Adds the mapping to the AddressMapper of the event's
   // process. If |options_.do_remap| is set, will update |event| with the
@@ -278,12 +412,49 @@ class PerfParser {
   // A set of unique DSOs that may be referenced by multiple events.
   std::unordered_map<string, DSOInfo> name_to_dso_;
 
+  // Maps the IDs that MMAP/MMAP2 events are mapped with to the DSOs they map.
+  // The ID of an event is its index among all events processed since
+  // StartProcessingEvents().
+  std::unordered_map<uint64_t, DSOInfo*> mmap_id_to_dso_;
+
+  // ID of the first event in |parsed_events_|. Nonzero only when processing
+  // events in batches.
+  uint64_t first_parsed_event_id_;
+
   // Maps process ID to an address mapper for that process.
   std::map<uint32_t, std::unique_ptr<AddressMapper>> process_mappers_;
 
+  // Sample events waiting to be mapped on multiple threads, and the index of
+  // the SampleGroup of each process in |sample_groups_|.
+  std::vector<SampleGroup> sample_groups_;
+  std::map<uint32_t, size_t> pid_to_sample_group_;
+
+  // Counts of sample events, when aggregating samples, and the indexes of the
+  // counts in |aggregated_samples_| by the hash of their locations and
+  // command.
+  std::vector<AggregatedSample> aggregated_samples_;
+  std::unordered_multimap<uint64_t, size_t> aggregated_sample_indexes_;
+
   DISALLOW_COPY_AND_ASSIGN(PerfParser);
 };
 
+// Called by ParseFileInBatches() with the PerfReader and the PerfParser that
+// parse the events. Returns false to stop parsing.
+typedef std::function<bool(PerfReader* reader, PerfParser* parser)>
+    EventBatchCallback;
+
+// Reads the perf data in |filename| and parses its events in batches of at
+// most |max_events_per_batch| with |options|, as described for
+// PerfParser::StartParsingEventBatches(). |process_batch| is called after each
+// batch is parsed, and |finish| after the last one. Returns false if the data
+// can not be read or parsed, or if a callback returns false.
+bool ParseFileInBatches(const string& filename,
+                        const PerfParserOptions& options,
+                        size_t max_events_per_batch,
+                        const EventBatchCallback& process_batch,
+                        const EventBatchCallback& finish);
+
+
 }  // namespace quipper
 
 #endif  // CHROMIUMOS_WIDE_PROFILING_PERF_PARSER_H_
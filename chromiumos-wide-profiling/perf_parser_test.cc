@@ -11,11 +11,14 @@
 #include <algorithm>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "base/logging.h"
 
+#include "chromiumos-wide-profiling/buffer_reader.h"
+#include "chromiumos-wide-profiling/build_id_cache.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/compat/test.h"
 #include "chromiumos-wide-profiling/compat/thread.h"
@@ -515,6 +518,110 @@ TEST(PerfParserTest, MapsSampleEventIp) {
   EXPECT_EQ(0x300b, events[13].event_ptr->sample_event().ip());
 }
 
+TEST(PerfParserTest, MapsSampleEventsOnMultipleThreads) {
+  std::stringstream input;
+
+  // header
+  testing::ExamplePipedPerfDataFileHeader().WriteTo(&input);
+
+  // data
+
+  // PERF_RECORD_HEADER_ATTR
+  testing::ExamplePerfEventAttrEvent_Hardware(PERF_SAMPLE_IP |
+                                              PERF_SAMPLE_TID,
+                                              true /*sample_id_all*/)
+      .WriteTo(&input);
+
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so",
+      testing::SampleInfo().Tid(1001)).WriteTo(&input);        // 0
+  testing::ExampleMmapEvent(
+      1002, 0x2c1000, 0x2000, 0, "/usr/lib/baz.so",
+      testing::SampleInfo().Tid(1002)).WriteTo(&input);        // 1
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001))  // 2
+      .WriteTo(&input);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000002c1100).Tid(1002))  // 3
+      .WriteTo(&input);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000003c1000).Tid(1003))  // 4 (not mapped)
+      .WriteTo(&input);
+  testing::ExampleForkEvent(
+      1004, 1001, 1004, 1001, 0,
+      testing::SampleInfo().Tid(1004)).WriteTo(&input);        // 5
+  // Replaces foo.so in process 1001 after some of its samples, but not in the
+  // forked process 1004.
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/new.so",
+      testing::SampleInfo().Tid(1001)).WriteTo(&input);        // 6
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001))  // 7
+      .WriteTo(&input);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100b).Tid(1004))  // 8
+      .WriteTo(&input);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000002c2000).Tid(1002))  // 9
+      .WriteTo(&input);
+
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+  options.sort_events_by_time = false;
+  options.do_remap = true;
+
+  //
+  // Map the samples on one thread.
+  //
+
+  PerfReader expected_reader;
+  ASSERT_TRUE(expected_reader.ReadFromString(input.str()));
+  PerfParser expected_parser(&expected_reader, options);
+  ASSERT_TRUE(expected_parser.ParseRawEvents());
+  const std::vector<ParsedEvent>& expected_events =
+      expected_parser.parsed_events();
+  ASSERT_EQ(10, expected_events.size());
+
+  EXPECT_EQ("/usr/lib/foo.so", expected_events[2].dso_and_offset.dso_name());
+  EXPECT_EQ("/usr/lib/baz.so", expected_events[3].dso_and_offset.dso_name());
+  EXPECT_EQ("", expected_events[4].dso_and_offset.dso_name());
+  EXPECT_EQ("/usr/lib/new.so", expected_events[7].dso_and_offset.dso_name());
+  EXPECT_EQ("/usr/lib/foo.so", expected_events[8].dso_and_offset.dso_name());
+  EXPECT_EQ(0xb, expected_events[8].dso_and_offset.offset());
+  EXPECT_EQ("/usr/lib/baz.so", expected_events[9].dso_and_offset.dso_name());
+
+  //
+  // Map the samples on multiple threads.
+  //
+
+  options.num_sample_mapping_threads = 3;
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(input.str()));
+  PerfParser parser(&reader, options);
+  ASSERT_TRUE(parser.ParseRawEvents());
+  const std::vector<ParsedEvent>& events = parser.parsed_events();
+  ASSERT_EQ(expected_events.size(), events.size());
+
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(expected_events[i].event_ptr->SerializeAsString(),
+              events[i].event_ptr->SerializeAsString()) << "Event " << i;
+    EXPECT_TRUE(expected_events[i] == events[i]) << "Event " << i;
+    if (events[i].event_ptr->has_mmap_event()) {
+      EXPECT_EQ(expected_events[i].num_samples_in_mmap_region,
+                events[i].num_samples_in_mmap_region) << "Event " << i;
+    }
+  }
+
+  EXPECT_EQ(2, events[0].num_samples_in_mmap_region);
+  EXPECT_EQ(2, events[1].num_samples_in_mmap_region);
+  EXPECT_EQ(1, events[6].num_samples_in_mmap_region);
+
+  EXPECT_EQ(expected_parser.stats().num_sample_events,
+            parser.stats().num_sample_events);
+  EXPECT_EQ(6, parser.stats().num_sample_events);
+  EXPECT_EQ(5, parser.stats().num_sample_events_mapped);
+}
+
 TEST(PerfParserTest, DsoInfoHasBuildId) {
   std::stringstream input;
 
@@ -1433,6 +1540,74 @@ TEST(PerfParserTest, OnlyReadsBuildidIfSampled) {
   EXPECT_EQ(filenames_to_build_ids.end(), it) << it->first << " "<< it->second;
 }
 
+TEST(PerfParserTest, ReadsBuildidsWithCacheOnMultipleThreads) {
+  ScopedTempDir tmpdir("/tmp/quipper_tmp.");
+  const string foo_file = tmpdir.path() + "foo.so";
+  const string bar_file = tmpdir.path() + "bar.so";
+  InitializeLibelf();
+  testing::WriteElfWithBuildid(foo_file, ".note.gnu.build-id",
+                               "\xde\xad\xf0\x0d");
+  testing::WriteElfWithBuildid(bar_file, ".note.gnu.build-id",
+                               "\xc0\x01\xd0\x0d");
+
+  std::stringstream input;
+
+  // header
+  testing::ExamplePipedPerfDataFileHeader().WriteTo(&input);
+
+  // data
+
+  // PERF_RECORD_HEADER_ATTR
+  testing::ExamplePerfEventAttrEvent_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                              true /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // PERF_RECORD_MMAP
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, foo_file,
+      testing::SampleInfo().Tid(1001)).WriteTo(&input);        // 0
+  testing::ExampleMmapEvent(
+      1001, 0x1c3000, 0x2000, 0x2000, bar_file,
+      testing::SampleInfo().Tid(1001)).WriteTo(&input);        // 1
+
+  // PERF_RECORD_SAMPLE
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001))  // 2
+      .WriteTo(&input);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c300a).Tid(1001))  // 3
+      .WriteTo(&input);
+
+  BuildIdCache cache("", 16);
+  PerfParserOptions options;
+  options.read_missing_buildids = true;
+  options.build_id_cache = &cache;
+  options.num_build_id_reading_threads = 2;
+  options.sample_mapping_percentage_threshold = 0;
+
+  // The first profile reads the build IDs from the files, and the second one
+  // from the cache.
+  for (size_t expected_num_hits : {0, 2}) {
+    PerfReader reader;
+    ASSERT_TRUE(reader.ReadFromString(input.str()));
+    PerfParser parser(&reader, options);
+    ASSERT_TRUE(parser.ParseRawEvents());
+
+    const std::vector<ParsedEvent>& events = parser.parsed_events();
+    ASSERT_EQ(4, events.size());
+    EXPECT_EQ("deadf00d", events[2].dso_and_offset.build_id());
+    EXPECT_EQ("c001d00d", events[3].dso_and_offset.build_id());
+
+    std::map<string, string> filenames_to_build_ids;
+    reader.GetFilenamesToBuildIDs(&filenames_to_build_ids);
+    EXPECT_EQ("deadf00d", filenames_to_build_ids[foo_file].substr(0, 8));
+    EXPECT_EQ("c001d00d", filenames_to_build_ids[bar_file].substr(0, 8));
+
+    EXPECT_EQ(expected_num_hits, cache.num_hits());
+    EXPECT_EQ(2, cache.num_misses());
+  }
+}
+
 TEST(PerfParserTest, HandlesFinishedRoundEventsAndSortsByTime) {
   // For now at least, we are ignoring PERF_RECORD_FINISHED_ROUND events.
 
@@ -1739,4 +1914,377 @@ TEST(PerfParserTest, HugePagesMappings) {
   EXPECT_EQ(0x2f00, events[9].dso_and_offset.offset());
 }
 
+TEST(PerfParserTest, ParsesEventBatches) {
+  std::stringstream input;
+
+  testing::ExampleMmapEvent mmap_event_foo(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so", testing::SampleInfo());
+  testing::ExampleMmapEvent mmap_event_bar(
+      1001, 0x1c3000, 0x2000, 0x2000, "/usr/lib/bar.so",
+      testing::SampleInfo());
+  testing::ExamplePerfSampleEvent sample_event_foo(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001));
+  testing::ExamplePerfSampleEvent sample_event_bar(
+      testing::SampleInfo().Ip(0x00000000001c3fff).Tid(1001));
+  testing::ExamplePerfSampleEvent sample_event_unmapped(
+      testing::SampleInfo().Ip(0x00000000001c2bad).Tid(1001));
+
+  const size_t data_size =
+      mmap_event_foo.GetSize() + mmap_event_bar.GetSize() +
+      2 * sample_event_foo.GetSize() + sample_event_bar.GetSize() +
+      sample_event_unmapped.GetSize();
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  // With a batch size of two, the samples in the third batch refer to
+  // mappings from earlier batches.
+  mmap_event_foo.WriteTo(&input);         // 0
+  sample_event_foo.WriteTo(&input);       // 1
+  mmap_event_bar.WriteTo(&input);         // 2
+  sample_event_bar.WriteTo(&input);       // 3
+  sample_event_foo.WriteTo(&input);       // 4
+  sample_event_unmapped.WriteTo(&input);  // 5
+  ASSERT_EQ(file_header.header().data.offset + data_size,
+            static_cast<u64>(input.tellp()));
+
+  // no metadata
+
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+  options.sort_events_by_time = false;
+  options.do_remap = true;
+
+  //
+  // Parse all events at once.
+  //
+
+  PerfReader expected_reader;
+  ASSERT_TRUE(expected_reader.ReadFromString(input.str()));
+  PerfParser expected_parser(&expected_reader, options);
+  ASSERT_TRUE(expected_parser.ParseRawEvents());
+  const std::vector<ParsedEvent>& expected_events =
+      expected_parser.parsed_events();
+  ASSERT_EQ(6, expected_events.size());
+
+  //
+  // Parse events in batches.
+  //
+
+  const string input_string = input.str();
+  BufferReader data(input_string.data(), input_string.size());
+  PerfReader reader;
+  ASSERT_TRUE(reader.StartReadingEvents(&data));
+  PerfParser parser(&reader, options);
+  ASSERT_TRUE(parser.StartParsingEventBatches());
+
+  size_t num_events = 0;
+  while (reader.HasMoreEvents()) {
+    ASSERT_TRUE(reader.ReadNextEvents(2));
+    ASSERT_TRUE(parser.ParseRawEventBatch());
+    const std::vector<ParsedEvent>& events = parser.parsed_events();
+    ASSERT_EQ(2, events.size());
+    for (const ParsedEvent& event : events) {
+      const ParsedEvent& expected_event = expected_events[num_events++];
+      EXPECT_EQ(expected_event.event_ptr->SerializeAsString(),
+                event.event_ptr->SerializeAsString());
+      EXPECT_EQ(expected_event.dso_and_offset.dso_name(),
+                event.dso_and_offset.dso_name());
+      EXPECT_EQ(expected_event.dso_and_offset.offset(),
+                event.dso_and_offset.offset());
+    }
+  }
+  EXPECT_EQ(6, num_events);
+  ASSERT_TRUE(parser.FinishParsingEventBatches());
+
+  EXPECT_EQ("/usr/lib/bar.so", expected_events[3].dso_and_offset.dso_name());
+  EXPECT_EQ("/usr/lib/foo.so", expected_events[4].dso_and_offset.dso_name());
+  EXPECT_EQ(0xa, expected_events[4].dso_and_offset.offset());
+
+  EXPECT_EQ(2, parser.stats().num_mmap_events);
+  EXPECT_EQ(4, parser.stats().num_sample_events);
+  EXPECT_EQ(3, parser.stats().num_sample_events_mapped);
+  EXPECT_TRUE(parser.stats().did_remap);
+}
+
+TEST(PerfParserTest, DoesNotSortEventBatches) {
+  // Events recorded on different CPUs are not written in time order. The first
+  // sample, recorded on CPU 0, falls in a mapping created earlier on CPU 1.
+  const u64 sample_type =
+      PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CPU;
+  std::stringstream data;
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001).Time(12300020)
+                           .Cpu(0)).WriteTo(&data);
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so",
+      testing::SampleInfo().Tid(1001).Time(12300010).Cpu(1)).WriteTo(&data);
+  testing::FinishedRoundEvent().WriteTo(&data);
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001).Time(12300030)
+                           .Cpu(1)).WriteTo(&data);
+  const string data_section = data.str();
+
+  std::stringstream input;
+  testing::ExamplePerfDataFileHeader(0)
+      .WithAttrCount(1)
+      .WithDataSize(data_section.size())
+      .WriteTo(&input);
+  testing::ExamplePerfFileAttr_Hardware(sample_type, true /*sample_id_all*/)
+      .WriteTo(&input);
+  input << data_section;
+  const string input_string = input.str();
+
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+
+  // Sorted, both samples fall in the mapping.
+  PerfReader sorted_reader;
+  ASSERT_TRUE(sorted_reader.ReadFromString(input_string));
+  PerfParser sorted_parser(&sorted_reader, options);
+  ASSERT_TRUE(sorted_parser.ParseRawEvents());
+  EXPECT_EQ(2, sorted_parser.stats().num_sample_events);
+  EXPECT_EQ(2, sorted_parser.stats().num_sample_events_mapped);
+
+  // The events are not sorted when parsed in batches, so sorting is rejected.
+  BufferReader sorted_data(input_string.data(), input_string.size());
+  PerfReader batch_reader;
+  ASSERT_TRUE(batch_reader.StartReadingEvents(&sorted_data));
+  PerfParser batch_parser(&batch_reader, options);
+  EXPECT_FALSE(batch_parser.StartParsingEventBatches());
+
+  // Unsorted, the first sample comes before the mapping.
+  options.sort_events_by_time = false;
+  BufferReader unsorted_data(input_string.data(), input_string.size());
+  PerfReader unsorted_reader;
+  ASSERT_TRUE(unsorted_reader.StartReadingEvents(&unsorted_data));
+  PerfParser unsorted_parser(&unsorted_reader, options);
+  ASSERT_TRUE(unsorted_parser.StartParsingEventBatches());
+  while (unsorted_reader.HasMoreEvents()) {
+    ASSERT_TRUE(unsorted_reader.ReadNextEvents(2));
+    ASSERT_TRUE(unsorted_parser.ParseRawEventBatch());
+  }
+  ASSERT_TRUE(unsorted_parser.FinishParsingEventBatches());
+  EXPECT_EQ(2, unsorted_parser.stats().num_sample_events);
+  EXPECT_EQ(1, unsorted_parser.stats().num_sample_events_mapped);
+}
+
+namespace {
+
+// Returns normal mode perf data with MMAPs of foo.so and bar.so in process
+// 1001, followed by |num_rounds| rounds of samples with callchains. Some of the
+// samples of each round have the same IP and callchain.
+string ExamplePerfDataWithRepeatedSamples(int num_rounds) {
+  std::stringstream data;
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so",
+      testing::SampleInfo().Tid(1001)).WriteTo(&data);         // 0
+  testing::ExampleMmapEvent(
+      1001, 0x1c3000, 0x2000, 0x2000, "/usr/lib/bar.so",
+      testing::SampleInfo().Tid(1001)).WriteTo(&data);         // 1
+
+  // PERF_RECORD_SAMPLE
+  const std::vector<u64> callchain_a =
+      {PERF_CONTEXT_USER, 0x1c100a, 0x1c3010};
+  const std::vector<u64> callchain_b =
+      {PERF_CONTEXT_USER, 0x1c100a, 0x1c3020};
+  for (int i = 0; i < num_rounds; ++i) {
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0x1c100a).Tid(1001)
+            .Callchain(callchain_a)).WriteTo(&data);           // 2
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0x1c100a).Tid(1001, 1002)
+            .Callchain(callchain_a)).WriteTo(&data);           // 3
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0x1c100a).Tid(1001)
+            .Callchain(callchain_b)).WriteTo(&data);           // 4
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0xffffffff8100cafe).Tid(0)
+            .Callchain({})).WriteTo(&data);                    // 5
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0xffffffff8100beef).Tid(1001)
+            .Callchain({})).WriteTo(&data);                    // 6
+    testing::ExamplePerfSampleEvent(
+        testing::SampleInfo().Ip(0x1c100a).Tid(1001)
+            .Callchain(callchain_a)).WriteTo(&data);           // 7
+  }
+  const string data_section = data.str();
+
+  std::stringstream input;
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_section.size());
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(
+      PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN,
+      true /*sample_id_all*/).WriteTo(&input);
+
+  // data
+  input << data_section;
+
+  // no metadata
+
+  return input.str();
+}
+
+PerfParserOptions AggregatingOptions() {
+  PerfParserOptions options;
+  options.sample_mapping_percentage_threshold = 0;
+  options.sort_events_by_time = false;
+  options.aggregate_samples = true;
+  return options;
+}
+
+}  // namespace
+
+TEST(PerfParserTest, AggregatesSamples) {
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(ExamplePerfDataWithRepeatedSamples(1)));
+  PerfParser parser(&reader, AggregatingOptions());
+  ASSERT_TRUE(parser.ParseRawEvents());
+
+  // Only the MMAPs are left.
+  EXPECT_EQ(2, parser.parsed_events().size());
+  EXPECT_EQ(2, reader.events().size());
+  for (const ParsedEvent& event : parser.parsed_events())
+    EXPECT_EQ(PERF_RECORD_MMAP, event.event_ptr->header().type());
+  EXPECT_EQ(6, parser.stats().num_sample_events);
+  EXPECT_EQ(4, parser.stats().num_sample_events_mapped);
+  EXPECT_EQ(4, parser.parsed_events()[0].num_samples_in_mmap_region);
+  EXPECT_EQ(4, parser.parsed_events()[1].num_samples_in_mmap_region);
+
+  const std::vector<AggregatedSample>& samples = parser.aggregated_samples();
+  ASSERT_EQ(3, samples.size());
+
+  EXPECT_EQ(3, samples[0].count);
+  EXPECT_EQ(NULL, samples[0].command);
+  EXPECT_EQ("/usr/lib/foo.so", samples[0].dso_and_offset.dso_name());
+  EXPECT_EQ(0xa, samples[0].dso_and_offset.offset());
+  // The callchain entry of the IP itself is not mapped again.
+  ASSERT_EQ(1, samples[0].callchain.size());
+  EXPECT_EQ("/usr/lib/bar.so", samples[0].callchain[0].dso_name());
+  EXPECT_EQ(0x2010, samples[0].callchain[0].offset());
+
+  EXPECT_EQ(1, samples[1].count);
+  ASSERT_EQ(1, samples[1].callchain.size());
+  EXPECT_EQ(0x2020, samples[1].callchain[0].offset());
+
+  // Neither kernel sample could be mapped, so they are counted together.
+  EXPECT_EQ(2, samples[2].count);
+  EXPECT_EQ("", samples[2].dso_and_offset.dso_name());
+  EXPECT_EQ(0, samples[2].callchain.size());
+}
+
+TEST(PerfParserTest, AggregatesSamplesByCommand) {
+  PerfParserOptions options = AggregatingOptions();
+  options.aggregate_samples_by_command = true;
+
+  PerfReader reader;
+  ASSERT_TRUE(reader.ReadFromString(ExamplePerfDataWithRepeatedSamples(1)));
+  PerfParser parser(&reader, options);
+  ASSERT_TRUE(parser.ParseRawEvents());
+
+  const std::vector<AggregatedSample>& samples = parser.aggregated_samples();
+  ASSERT_EQ(4, samples.size());
+  EXPECT_EQ(3, samples[0].count);
+  EXPECT_EQ(NULL, samples[0].command);
+  EXPECT_EQ(1, samples[1].count);
+  EXPECT_EQ(NULL, samples[1].command);
+  EXPECT_EQ(1, samples[2].count);
+  ASSERT_NE(static_cast<const string*>(NULL), samples[2].command);
+  EXPECT_EQ("swapper", *samples[2].command);
+  EXPECT_EQ(1, samples[3].count);
+  EXPECT_EQ(NULL, samples[3].command);
+}
+
+TEST(PerfParserTest, AggregatesSamplesInBatches) {
+  // Three rounds of six samples, read three events at a time, so that the
+  // same stacks are seen in several batches.
+  const string input = ExamplePerfDataWithRepeatedSamples(3);
+
+  PerfReader expected_reader;
+  ASSERT_TRUE(expected_reader.ReadFromString(input));
+  PerfParser expected_parser(&expected_reader, AggregatingOptions());
+  ASSERT_TRUE(expected_parser.ParseRawEvents());
+  const std::vector<AggregatedSample>& expected_samples =
+      expected_parser.aggregated_samples();
+  ASSERT_EQ(3, expected_samples.size());
+  EXPECT_EQ(9, expected_samples[0].count);
+  EXPECT_EQ(3, expected_samples[1].count);
+  EXPECT_EQ(6, expected_samples[2].count);
+
+  BufferReader data(input.data(), input.size());
+  PerfReader reader;
+  ASSERT_TRUE(reader.StartReadingEvents(&data));
+  PerfParser parser(&reader, AggregatingOptions());
+  ASSERT_TRUE(parser.StartParsingEventBatches());
+  size_t num_batches = 0;
+  size_t num_mmap_events = 0;
+  while (reader.HasMoreEvents()) {
+    ASSERT_TRUE(reader.ReadNextEvents(3));
+    ASSERT_TRUE(parser.ParseRawEventBatch());
+    ++num_batches;
+    num_mmap_events += parser.parsed_events().size();
+  }
+  ASSERT_TRUE(parser.FinishParsingEventBatches());
+  EXPECT_EQ(7, num_batches);
+  EXPECT_EQ(2, num_mmap_events);
+  EXPECT_EQ(18, parser.stats().num_sample_events);
+
+  // The counts of the same stacks are merged across batches.
+  const std::vector<AggregatedSample>& samples = parser.aggregated_samples();
+  ASSERT_EQ(expected_samples.size(), samples.size());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    EXPECT_EQ(expected_samples[i].count, samples[i].count) << "Sample " << i;
+    EXPECT_TRUE(expected_samples[i].dso_and_offset ==
+                samples[i].dso_and_offset) << "Sample " << i;
+    ASSERT_EQ(expected_samples[i].callchain.size(),
+              samples[i].callchain.size());
+    for (size_t j = 0; j < samples[i].callchain.size(); ++j) {
+      EXPECT_TRUE(expected_samples[i].callchain[j] == samples[i].callchain[j])
+          << "Sample " << i << ", entry " << j;
+    }
+  }
+}
+
+// The sample events dropped from each batch are reused by the next batch, so
+// the reader's memory for events stays bounded by the batch size. Events on
+// the reader's arena are never freed, so new events would have new addresses.
+TEST(PerfParserTest, AggregatingSamplesInBatchesReusesEvents) {
+  const size_t kBatchSize = 4;
+  const string input = ExamplePerfDataWithRepeatedSamples(100);
+  BufferReader data(input.data(), input.size());
+  PerfReader reader;
+  ASSERT_TRUE(reader.StartReadingEvents(&data));
+  PerfParser parser(&reader, AggregatingOptions());
+  ASSERT_TRUE(parser.StartParsingEventBatches());
+  std::set<const PerfDataProto_PerfEvent*> events_seen;
+  while (reader.HasMoreEvents()) {
+    ASSERT_TRUE(reader.ReadNextEvents(kBatchSize));
+    for (const auto& event : reader.events())
+      events_seen.insert(&event);
+    ASSERT_TRUE(parser.ParseRawEventBatch());
+  }
+  EXPECT_LE(events_seen.size(), kBatchSize);
+  ASSERT_TRUE(parser.FinishParsingEventBatches());
+  EXPECT_EQ(600, parser.stats().num_sample_events);
+  ASSERT_EQ(3, parser.aggregated_samples().size());
+  EXPECT_EQ(300, parser.aggregated_samples()[0].count);
+}
+
 }  // namespace quipper
@@ -4,6 +4,9 @@
 
 #include "chromiumos-wide-profiling/perf_protobuf_io.h"
 
+#include <stdint.h>
+#include <stdio.h>
+
 #include <vector>
 
 #include "base/logging.h"
@@ -12,6 +15,41 @@
 
 namespace quipper {
 
+namespace {
+
+// Serializes |proto| and appends it to |fp|.
+bool AppendProtobufToFile(const PerfDataProto& proto, FILE* fp) {
+  string output;
+  if (!proto.SerializeToString(&output))
+    return false;
+  return fwrite(output.data(), 1, output.size(), fp) == output.size();
+}
+
+// Appends |events| to |fp|, serialized the same way as a PerfDataProto that
+// contains only |events|. Unlike moving the events into such a PerfDataProto,
+// this does not copy them off the arena of the PerfReader that owns them.
+bool AppendEventsToFile(const RepeatedPtrField<PerfDataProto_PerfEvent>& events,
+                        FILE* fp) {
+  string output;
+  {
+    StringOutputStream string_stream(&output);
+    CodedOutputStream coded_stream(&string_stream);
+    for (const auto& event : events) {
+      // An embedded message is encoded as its tag, its size and its fields.
+      // ByteSizeLong() caches the sizes used by SerializeWithCachedSizes().
+      WireFormatLite::WriteTag(PerfDataProto::kEventsFieldNumber,
+                               WireFormatLite::WIRETYPE_LENGTH_DELIMITED,
+                               &coded_stream);
+      coded_stream.WriteVarint32(static_cast<uint32_t>(event.ByteSizeLong()));
+      event.SerializeWithCachedSizes(&coded_stream);
+    }
+    if (coded_stream.HadError())
+      return false;
+  }
+  return fwrite(output.data(), 1, output.size(), fp) == output.size();
+}
+
+}  // namespace
 
 bool SerializeFromFile(const string& filename, PerfDataProto* perf_data_proto) {
   return SerializeFromFileWithOptions(filename, PerfParserOptions(),
@@ -22,6 +60,7 @@ bool SerializeFromFileWithOptions(const string& filename,
                                   const PerfParserOptions& options,
                                   PerfDataProto* perf_data_proto) {
   PerfReader reader;
+  reader.set_num_serialization_threads(options.num_serialization_threads);
   if (!reader.ReadFile(filename))
     return false;
 
@@ -37,6 +76,36 @@ bool SerializeFromFileWithOptions(const string& filename,
   return true;
 }
 
+bool SerializeFromFileToProtobufFile(const string& filename,
+                                     const PerfParserOptions& options,
+                                     size_t max_events_per_batch,
+                                     const string& output_filename) {
+  FILE* fp = fopen(output_filename.c_str(), "wb");
+  if (!fp) {
+    PLOG(ERROR) << "Unable to open " << output_filename << " for writing";
+    return false;
+  }
+
+  auto append_events = [fp](PerfReader* reader, PerfParser* parser) {
+    return AppendEventsToFile(reader->events(), fp);
+  };
+  auto append_other_fields = [fp](PerfReader* reader, PerfParser* parser) {
+    // The events of the last batch have already been written out.
+    reader->mutable_events()->Clear();
+    PerfDataProto perf_data_proto;
+    if (!reader->Serialize(&perf_data_proto))
+      return false;
+    PerfSerializer::SerializeParserStats(parser->stats(), &perf_data_proto);
+    return AppendProtobufToFile(perf_data_proto, fp);
+  };
+  bool ret = ParseFileInBatches(filename, options, max_events_per_batch,
+                                append_events, append_other_fields);
+
+  if (fclose(fp) != 0)
+    ret = false;
+  return ret;
+}
+
 bool DeserializeToFile(const PerfDataProto& perf_data_proto,
                        const string& filename) {
   PerfReader reader;
@@ -5,6 +5,8 @@
 #ifndef CHROMIUMOS_WIDE_PROFILING_PERF_PROTOBUF_IO_H_
 #define CHROMIUMOS_WIDE_PROFILING_PERF_PROTOBUF_IO_H_
 
+#include <stddef.h>
+
 #include "chromiumos-wide-profiling/compat/proto.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/perf_parser.h"
@@ -22,6 +24,23 @@ bool SerializeFromFileWithOptions(const string& filename,
                                   const PerfParserOptions& options,
                                   PerfDataProto* proto);
 
+// Converts a raw perf data file to a PerfDataProto protobuf and writes it to
+// |output_filename| as serialized protobuf data, like SerializeFromFile()
+// followed by WriteProtobufToFile(). Only |max_events_per_batch| events are
+// held in memory at a time. Each batch of events is written out as its own
+// serialized PerfDataProto, followed by one more containing all the other
+// fields. The concatenation parses as a single PerfDataProto, so the output
+// can be read by ReadProtobufFromFile().
+//
+// Piped mode perf data is accepted too, but it is read as a single batch, so
+// all of its events are held in memory. The events are written in file order
+// rather than sorted by time, and |options| are applied as described for
+// PerfParser::StartParsingEventBatches(), which rejects sorting.
+bool SerializeFromFileToProtobufFile(const string& filename,
+                                     const PerfParserOptions& options,
+                                     size_t max_events_per_batch,
+                                     const string& output_filename);
+
 // Convert a PerfDataProto to raw perf data, storing it in a file.
 bool DeserializeToFile(const PerfDataProto& proto, const string& filename);
 
@@ -30,7 +49,9 @@ bool WriteProtobufToFile(const quipper::PerfDataProto& perf_data_proto,
                          const string& filename);
 
 // Read from a file containing serialized PerfDataProto data into a
-// PerfDataProto object.
+// PerfDataProto object. For large profiles, |perf_data_proto| may be allocated
+// on an Arena with Arena::CreateMessage(), so that all of its events are
+// allocated on the arena as well.
 bool ReadProtobufFromFile(quipper::PerfDataProto* perf_data_proto,
                           const string& filename);
 
@@ -4,12 +4,15 @@
 
 #include "chromiumos-wide-profiling/perf_reader.h"
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include "base/logging.h"
@@ -21,6 +24,8 @@
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/file_reader.h"
 #include "chromiumos-wide-profiling/file_utils.h"
+#include "chromiumos-wide-profiling/function_thread.h"
+#include "chromiumos-wide-profiling/mmap_reader.h"
 #include "chromiumos-wide-profiling/perf_data_structures.h"
 #include "chromiumos-wide-profiling/perf_data_utils.h"
 #include "chromiumos-wide-profiling/sample_info_reader.h"
@@ -180,24 +185,49 @@ bool ReadPerfFileSection(DataReader* data, struct perf_file_section* section) {
   return true;
 }
 
-// Returns true if |e1| has an earlier timestamp than |e2|. Used to sort an
-// array of events.
-bool CompareEventTimes(const PerfEvent& e1, const PerfEvent& e2) {
-  return GetTimeFromPerfEvent(e1) < GetTimeFromPerfEvent(e2);
+// Returns true if |*e1| has an earlier timestamp than |*e2|. Used to sort an
+// array of event pointers.
+bool CompareEventTimes(const PerfEvent* e1, const PerfEvent* e2) {
+  return GetTimeFromPerfEvent(*e1) < GetTimeFromPerfEvent(*e2);
+}
+
+// Serializes the event at |event_data| into |event|. The event data need not be
+// aligned.
+bool SerializeEventData(const PerfSerializer& serializer,
+                        const char* event_data,
+                        PerfDataProto_PerfEvent* event) {
+  const event_t* event_ptr = reinterpret_cast<const event_t*>(event_data);
+
+  // The event must be aligned to be serialized in place.
+  malloced_unique_ptr<event_t> event_copy;
+  if (reinterpret_cast<uintptr_t>(event_ptr) % alignof(event_t) != 0) {
+    perf_event_header header;
+    memcpy(&header, event_data, sizeof(header));
+    event_copy.reset(CallocMemoryForEvent(header.size));
+    memcpy(event_copy.get(), event_data, header.size);
+    event_ptr = event_copy.get();
+  }
+  return serializer.SerializeEvent(*event_ptr, event);
 }
 
 }  // namespace
 
-PerfReader::PerfReader() : is_cross_endian_(false) {
+PerfReader::PerfReader()
+    : proto_(Arena::CreateMessage<PerfDataProto>(&arena_)),
+      is_cross_endian_(false),
+      data_section_remaining_bytes_(0),
+      num_serialization_threads_(1),
+      event_data_(nullptr),
+      piped_events_pending_(false) {
   // The metadata mask is stored in |proto_|. It should be initialized to 0
   // since it is used heavily.
-  proto_.add_metadata_mask(0);
+  proto_->add_metadata_mask(0);
 }
 
 PerfReader::~PerfReader() {}
 
 bool PerfReader::Serialize(PerfDataProto* perf_data_proto) const {
-  perf_data_proto->CopyFrom(proto_);
+  perf_data_proto->CopyFrom(*proto_);
 
   // Add a timestamp_sec to the protobuf.
   struct timeval timestamp_sec;
@@ -207,12 +237,12 @@ bool PerfReader::Serialize(PerfDataProto* perf_data_proto) const {
 }
 
 bool PerfReader::Deserialize(const PerfDataProto& perf_data_proto) {
-  proto_.CopyFrom(perf_data_proto);
+  proto_->CopyFrom(perf_data_proto);
 
   // Iterate through all attrs and create a SampleInfoReader for each of them.
   // This is necessary for writing the proto representation of perf data to raw
   // data.
-  for (const auto& stored_attr : proto_.file_attrs()) {
+  for (const auto& stored_attr : proto_->file_attrs()) {
     PerfFileAttr attr;
     serializer_.DeserializePerfFileAttr(stored_attr, &attr);
     serializer_.CreateSampleInfoReader(attr, false /* read_cross_endian */);
@@ -221,6 +251,12 @@ bool PerfReader::Deserialize(const PerfDataProto& perf_data_proto) {
 }
 
 bool PerfReader::ReadFile(const string& filename) {
+  // Prefer to map the file, so that events can be serialized straight from the
+  // mapped file contents.
+  MmapReader mmap_reader(filename);
+  if (mmap_reader.IsOpen())
+    return ReadFromData(&mmap_reader);
+
   FileReader reader(filename);
   if (!reader.IsOpen()) {
     LOG(ERROR) << "Unable to open file " << filename;
@@ -253,49 +289,7 @@ bool PerfReader::ReadFromData(DataReader* data) {
   // Check if it is normal perf data.
   if (header_.size == sizeof(header_)) {
     DVLOG(1) << "Perf data is in normal format.";
-
-    // Make sure sections are within the size of the file. This check prevents
-    // more obscure messages later when attempting to read from one of these
-    // sections.
-    if (header_.attrs.offset + header_.attrs.size > data->size()) {
-      LOG(ERROR) << "Header says attrs section ends at "
-                 << header_.attrs.offset + header_.attrs.size
-                 << " bytes, which is larger than perf data size of "
-                 << data->size() << " bytes.";
-      return false;
-    }
-    if (header_.data.offset + header_.data.size > data->size()) {
-      LOG(ERROR) << "Header says data section ends at "
-                 << header_.data.offset + header_.data.size
-                 << " bytes, which is larger than perf data size of "
-                 << data->size() << " bytes.";
-      return false;
-    }
-    if (header_.event_types.offset + header_.event_types.size > data->size()) {
-      LOG(ERROR) << "Header says event_types section ends at "
-                 << header_.event_types.offset + header_.event_types.size
-                 << " bytes, which is larger than perf data size of "
-                 << data->size() << " bytes.";
-      return false;
-    }
-
-    if (!get_metadata_mask_bit(HEADER_EVENT_DESC)) {
-      // Prefer to read attrs and event names from HEADER_EVENT_DESC metadata if
-      // available. event_types section of perf.data is obsolete, but use it as
-      // a fallback:
-      if (!(ReadAttrsSection(data) && ReadEventTypesSection(data)))
-        return false;
-    }
-
-    if (!(ReadMetadata(data) && ReadDataSection(data)))
-      return false;
-
-    // We can construct HEADER_EVENT_DESC from attrs and event types.
-    // NB: Can't set this before ReadMetadata(), or it may misread the metadata.
-    if (!event_types().empty())
-      set_metadata_mask_bit(HEADER_EVENT_DESC);
-
-    return true;
+    return ReadNormalModeSections(data) && ReadDataSection(data);
   }
 
   // Otherwise it is piped data.
@@ -309,6 +303,53 @@ bool PerfReader::ReadFromData(DataReader* data) {
   return ReadPipedData(data);
 }
 
+bool PerfReader::StartReadingEvents(DataReader* data) {
+  if (data->size() == 0) {
+    LOG(ERROR) << "Input data is empty!";
+    return false;
+  }
+  if (!ReadHeader(data))
+    return false;
+
+  if (header_.size != sizeof(header_)) {
+    // Piped data may have metadata after the events, so read all of it now.
+    if (piped_header_.size != sizeof(piped_header_)) {
+      LOG(ERROR) << "Expecting piped data format, but header size "
+                 << piped_header_.size << " does not match expected size "
+                 << sizeof(piped_header_);
+      return false;
+    }
+    if (!ReadPipedData(data))
+      return false;
+    piped_events_pending_ = true;
+    return true;
+  }
+  if (!ReadNormalModeSections(data))
+    return false;
+
+  data->SeekSet(header_.data.offset);
+  data_section_remaining_bytes_ = header_.data.size;
+  event_data_ = data;
+  return true;
+}
+
+bool PerfReader::ReadNextEvents(size_t max_events) {
+  if (piped_events_pending_) {
+    piped_events_pending_ = false;
+    return true;
+  }
+  // Clearing the events keeps their memory around to be reused by the next
+  // batch.
+  proto_->clear_events();
+  for (size_t i = 0;
+       i < max_events && event_data_ && data_section_remaining_bytes_ != 0;
+       ++i) {
+    if (!ReadDataSectionEvent(event_data_))
+      return false;
+  }
+  return true;
+}
+
 bool PerfReader::WriteFile(const string& filename) {
   std::vector<char> data;
   return WriteToVector(&data) && BufferToFile(filename, data);
@@ -356,7 +397,7 @@ size_t PerfReader::GetSize() const {
   total_size += header.event_types.size;
   total_size += header.data.size;
   // Add the ID info, whose size is not explicitly included in the header.
-  for (const auto& attr : proto_.file_attrs()) {
+  for (const auto& attr : proto_->file_attrs()) {
     total_size +=
         attr.ids_size() * sizeof(decltype(PerfFileAttr::ids)::value_type);
   }
@@ -392,14 +433,14 @@ void PerfReader::GenerateHeader(struct perf_file_header* header) const {
   header->size = sizeof(*header);
   header->attr_size = sizeof(perf_file_attr);
   header->attrs.size = header->attr_size * attrs().size();
-  for (const PerfEvent& event : proto_.events())
+  for (const PerfEvent& event : proto_->events())
     header->data.size += event.header().size();
   // Do not use the event_types section. Use EVENT_DESC metadata instead.
   header->event_types.size = 0;
 
   u64 current_offset = 0;
   current_offset += header->size;
-  for (const auto& attr : proto_.file_attrs()) {
+  for (const auto& attr : proto_->file_attrs()) {
     current_offset +=
         sizeof(decltype(PerfFileAttr::ids)::value_type) * attr.ids_size();
   }
@@ -429,7 +470,7 @@ bool PerfReader::InjectBuildIDs(
   set_metadata_mask_bit(HEADER_BUILD_ID);
   std::set<string> updated_filenames;
   // Inject new build ID's for existing build ID events.
-  for (auto& build_id : *proto_.mutable_build_ids()) {
+  for (auto& build_id : *proto_->mutable_build_ids()) {
     auto find_result = filenames_to_build_ids.find(build_id.filename());
     if (find_result == filenames_to_build_ids.end())
       continue;
@@ -455,7 +496,7 @@ bool PerfReader::InjectBuildIDs(
   // This requires a lookup of all MMAP's to determine the |misc| field of each
   // build ID event.
   std::map<string, uint16_t> filename_to_misc;
-  for (const PerfEvent& event : proto_.events()) {
+  for (const PerfEvent& event : proto_->events()) {
     if (event.header().type() == PERF_RECORD_MMAP ||
         event.header().type() == PERF_RECORD_MMAP2) {
       filename_to_misc[event.mmap_event().filename()] = event.header().misc();
@@ -480,7 +521,7 @@ bool PerfReader::InjectBuildIDs(
     string build_id = it->second;
     malloced_unique_ptr<build_id_event> event =
         CreateBuildIDEvent(build_id, filename, new_misc);
-    if (!serializer_.SerializeBuildIDEvent(event, proto_.add_build_ids())) {
+    if (!serializer_.SerializeBuildIDEvent(event, proto_->add_build_ids())) {
       LOG(ERROR) << "Could not serialize build ID event with ID " << build_id;
       return false;
     }
@@ -491,7 +532,7 @@ bool PerfReader::InjectBuildIDs(
 bool PerfReader::Localize(
     const std::map<string, string>& build_ids_to_filenames) {
   std::map<string, string> filename_map;
-  for (auto& build_id : *proto_.mutable_build_ids()) {
+  for (auto& build_id : *proto_->mutable_build_ids()) {
     string build_id_string = RawDataToHexString(build_id.build_id_hash());
     auto find_result = build_ids_to_filenames.find(build_id_string);
     if (find_result == build_ids_to_filenames.end())
@@ -506,7 +547,7 @@ bool PerfReader::Localize(
 bool PerfReader::LocalizeUsingFilenames(
     const std::map<string, string>& filename_map) {
   LocalizeMMapFilenames(filename_map);
-  for (auto& build_id : *proto_.mutable_build_ids()) {
+  for (auto& build_id : *proto_->mutable_build_ids()) {
     auto find_result = filename_map.find(build_id.filename());
     if (find_result != filename_map.end())
       build_id.set_filename(find_result->second);
@@ -524,7 +565,7 @@ void PerfReader::GetFilenames(std::vector<string>* filenames) const {
 
 void PerfReader::GetFilenamesAsSet(std::set<string>* filenames) const {
   filenames->clear();
-  for (const PerfEvent& event : proto_.events()) {
+  for (const PerfEvent& event : proto_->events()) {
     if (event.header().type() == PERF_RECORD_MMAP ||
         event.header().type() == PERF_RECORD_MMAP2) {
       filenames->insert(event.mmap_event().filename());
@@ -535,7 +576,7 @@ void PerfReader::GetFilenamesAsSet(std::set<string>* filenames) const {
 void PerfReader::GetFilenamesToBuildIDs(
     std::map<string, string>* filenames_to_build_ids) const {
   filenames_to_build_ids->clear();
-  for (const auto& build_id : proto_.build_ids()) {
+  for (const auto& build_id : proto_->build_ids()) {
     string build_id_string = RawDataToHexString(build_id.build_id_hash());
     PerfizeBuildIDString(&build_id_string);
     (*filenames_to_build_ids)[build_id.filename()] = build_id_string;
@@ -551,9 +592,10 @@ void PerfReader::MaybeSortEventsByTime() {
     }
   }
 
-  // Sort the events based on timestamp.
-  std::stable_sort(proto_.mutable_events()->begin(),
-                   proto_.mutable_events()->end(),
+  // Sort the events based on timestamp. Only the pointers to the events are
+  // moved around, rather than the events themselves.
+  std::stable_sort(proto_->mutable_events()->pointer_begin(),
+                   proto_->mutable_events()->pointer_end(),
                    CompareEventTimes);
 }
 
@@ -608,7 +650,7 @@ bool PerfReader::ReadHeader(DataReader* data) {
     LOG(ERROR) << "Error reading header::adds_features.";
     return false;
   }
-  proto_.set_metadata_mask(0, header_.adds_features[0]);
+  proto_->set_metadata_mask(0, header_.adds_features[0]);
 
   // Byte-swapping |adds_features| is tricky. It is defined as an array of
   // unsigned longs, which can vary between architectures. However, the overall
@@ -762,7 +804,7 @@ bool PerfReader::ReadEventTypesSection(DataReader* data) {
     // Not available.
     return true;
   }
-  CHECK_EQ(proto_.file_attrs().size(), num_event_types);
+  CHECK_EQ(proto_->file_attrs().size(), num_event_types);
   CHECK_EQ(sizeof(perf_trace_event_type) * num_event_types,
            header_.event_types.size);
   data->SeekSet(header_.event_types.offset);
@@ -796,55 +838,203 @@ bool PerfReader::ReadEventType(DataReader* data, int attr_idx,
     return false;
   }
 
-  if (attr_idx >= proto_.file_attrs().size()) {
+  if (attr_idx >= proto_->file_attrs().size()) {
     LOG(ERROR) << "Too many event types, or attrs not read yet!";
     return false;
   }
-  if (event_id != proto_.file_attrs(attr_idx).attr().config()) {
+  if (event_id != proto_->file_attrs(attr_idx).attr().config()) {
     LOG(ERROR) << "event_id for perf_trace_event_type (" << event_id << ") "
                << "does not match attr.config ("
-               << proto_.file_attrs(attr_idx).attr().config() << ")";
+               << proto_->file_attrs(attr_idx).attr().config() << ")";
+    return false;
+  }
+  attr.attr.config = proto_->file_attrs(attr_idx).attr().config();
+
+  serializer_.SerializePerfEventType(attr, proto_->add_event_types());
+  return true;
+}
+
+bool PerfReader::ReadNormalModeSections(DataReader* data) {
+  // Make sure sections are within the size of the file. This check prevents
+  // more obscure messages later when attempting to read from one of these
+  // sections.
+  if (header_.attrs.offset + header_.attrs.size > data->size()) {
+    LOG(ERROR) << "Header says attrs section ends at "
+               << header_.attrs.offset + header_.attrs.size
+               << " bytes, which is larger than perf data size of "
+               << data->size() << " bytes.";
+    return false;
+  }
+  if (header_.data.offset + header_.data.size > data->size()) {
+    LOG(ERROR) << "Header says data section ends at "
+               << header_.data.offset + header_.data.size
+               << " bytes, which is larger than perf data size of "
+               << data->size() << " bytes.";
+    return false;
+  }
+  if (header_.event_types.offset + header_.event_types.size > data->size()) {
+    LOG(ERROR) << "Header says event_types section ends at "
+               << header_.event_types.offset + header_.event_types.size
+               << " bytes, which is larger than perf data size of "
+               << data->size() << " bytes.";
     return false;
   }
-  attr.attr.config = proto_.file_attrs(attr_idx).attr().config();
 
-  serializer_.SerializePerfEventType(attr, proto_.add_event_types());
+  if (!get_metadata_mask_bit(HEADER_EVENT_DESC)) {
+    // Prefer to read attrs and event names from HEADER_EVENT_DESC metadata if
+    // available. event_types section of perf.data is obsolete, but use it as
+    // a fallback:
+    if (!(ReadAttrsSection(data) && ReadEventTypesSection(data)))
+      return false;
+  }
+
+  if (!ReadMetadata(data))
+    return false;
+
+  // We can construct HEADER_EVENT_DESC from attrs and event types.
+  // NB: Can't set this before ReadMetadata(), or it may misread the metadata.
+  if (!event_types().empty())
+    set_metadata_mask_bit(HEADER_EVENT_DESC);
+
   return true;
 }
 
 bool PerfReader::ReadDataSection(DataReader* data) {
-  u64 data_remaining_bytes = header_.data.size;
   data->SeekSet(header_.data.offset);
-  while (data_remaining_bytes != 0) {
-    // Read the header to determine the size of the event.
+  data_section_remaining_bytes_ = header_.data.size;
+
+  if (num_serialization_threads_ > 1 && !data->is_cross_endian()) {
+    const char* section = reinterpret_cast<const char*>(
+        data->ReadDataPointer(header_.data.size));
+    if (section) {
+      data_section_remaining_bytes_ = 0;
+      return ReadDataSectionInParallel(section, header_.data.size);
+    }
+  }
+
+  while (data_section_remaining_bytes_ != 0) {
+    if (!ReadDataSectionEvent(data))
+      return false;
+  }
+
+  DLOG(INFO) << "Number of events stored: "<< proto_->events_size();
+  return true;
+}
+
+bool PerfReader::ReadDataSectionInParallel(const char* section, size_t size) {
+  std::vector<size_t> event_offsets;
+  size_t offset = 0;
+  while (offset < size) {
     perf_event_header header;
-    if (!ReadPerfEventHeader(data, &header)) {
+    if (size - offset < sizeof(header)) {
       LOG(ERROR) << "Error reading event header from data section.";
       return false;
     }
-
-    // Read the rest of the event data.
-    malloced_unique_ptr<event_t> event(CallocMemoryForEvent(header.size));
-    event->header = header;
-    if (!data->ReadDataValue(event->header.size - sizeof(event->header),
-                             "rest of event", &event->header + 1)) {
+    memcpy(&header, section + offset, sizeof(header));
+    if (header.size < sizeof(header)) {
+      LOG(ERROR) << "Event size " << header.size << " is smaller than the "
+                 << "event header.";
       return false;
     }
-    // TODO(sque): Find some way to combine this with the serialization below.
-    MaybeSwapEventFields(event.get(), data->is_cross_endian());
+    if (header.size > size - offset) {
+      LOG(ERROR) << "Event at offset " << offset << " of the data section "
+                 << "extends past the end of the data section.";
+      return false;
+    }
+    event_offsets.push_back(offset);
+    offset += header.size;
+  }
 
-    // We must have a valid way to read sample info before reading perf events.
-    CHECK(serializer_.SampleInfoReaderAvailable());
+  // We must have a valid way to read sample info before reading perf events.
+  CHECK(serializer_.SampleInfoReaderAvailable());
 
-    // Serialize the event to protobuf form.
-    PerfEvent* proto_event = proto_.add_events();
-    if (!serializer_.SerializeEvent(event, proto_event))
-      return false;
+  // Add all the events first, so that each thread fills in its own range.
+  RepeatedPtrField<PerfDataProto_PerfEvent>* events = proto_->mutable_events();
+  const int first_event_index = events->size();
+  events->Reserve(first_event_index + event_offsets.size());
+  for (size_t i = 0; i < event_offsets.size(); ++i)
+    events->Add();
+
+  const size_t num_threads =
+      std::min(num_serialization_threads_, event_offsets.size());
+  const auto event_protos = events->pointer_begin() + first_event_index;
+  std::atomic<bool> success(true);
+  std::vector<std::unique_ptr<FunctionThread>> threads;
+  for (size_t i = 0; i < num_threads; ++i) {
+    const size_t begin = event_offsets.size() * i / num_threads;
+    const size_t end = event_offsets.size() * (i + 1) / num_threads;
+    const auto serialize_events = [this, section, begin, end, event_protos,
+                                   &event_offsets, &success] {
+      for (size_t j = begin; j < end; ++j) {
+        if (!SerializeEventData(serializer_, section + event_offsets[j],
+                                event_protos[j])) {
+          success = false;
+          return;
+        }
+      }
+    };
+    threads.emplace_back(new FunctionThread("EventSerializer",
+                                            serialize_events));
+    threads.back()->Start();
+  }
+  for (auto& thread : threads)
+    thread->Join();
+
+  DLOG(INFO) << "Number of events stored: "<< proto_->events_size();
+  return success;
+}
+
+bool PerfReader::ReadDataSectionEvent(DataReader* data) {
+  const size_t event_offset = data->Tell();
 
-    data_remaining_bytes -= event->header.size;
+  // Read the header to determine the size of the event.
+  perf_event_header header;
+  if (!ReadPerfEventHeader(data, &header)) {
+    LOG(ERROR) << "Error reading event header from data section.";
+    return false;
+  }
+  if (header.size < sizeof(header)) {
+    LOG(ERROR) << "Event size " << header.size << " is smaller than the "
+               << "event header.";
+    return false;
+  }
+
+  // If the data source allows direct access and no byte swapping is needed,
+  // serialize the event in place instead of copying it out first.
+  const event_t* event = nullptr;
+  if (!data->is_cross_endian()) {
+    data->SeekSet(event_offset);
+    event = reinterpret_cast<const event_t*>(
+        data->ReadDataPointer(header.size));
+    if (event && reinterpret_cast<uintptr_t>(event) % alignof(event_t) != 0)
+      event = nullptr;
+    if (!event)
+      data->SeekSet(event_offset + sizeof(header));
+  }
+
+  // Otherwise read the rest of the event data into a new buffer.
+  malloced_unique_ptr<event_t> event_copy;
+  if (!event) {
+    event_copy.reset(CallocMemoryForEvent(header.size));
+    event_copy->header = header;
+    if (!data->ReadDataValue(header.size - sizeof(header), "rest of event",
+                             &event_copy->header + 1)) {
+      return false;
+    }
+    // TODO(sque): Find some way to combine this with the serialization below.
+    MaybeSwapEventFields(event_copy.get(), data->is_cross_endian());
+    event = event_copy.get();
   }
 
-  DLOG(INFO) << "Number of events stored: "<< proto_.events_size();
+  // We must have a valid way to read sample info before reading perf events.
+  CHECK(serializer_.SampleInfoReaderAvailable());
+
+  // Serialize the event to protobuf form.
+  PerfEvent* proto_event = proto_->add_events();
+  if (!serializer_.SerializeEvent(*event, proto_event))
+    return false;
+
+  data_section_remaining_bytes_ -= header.size;
   return true;
 }
 
@@ -883,48 +1073,48 @@ bool PerfReader::ReadMetadata(DataReader* data) {
     case HEADER_HOSTNAME:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_hostname())) {
+              proto_->mutable_string_metadata()->mutable_hostname())) {
         return false;
       }
       break;
     case HEADER_OSRELEASE:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_kernel_version())) {
+              proto_->mutable_string_metadata()->mutable_kernel_version())) {
         return false;
       }
       break;
     case HEADER_VERSION:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_perf_version())) {
+              proto_->mutable_string_metadata()->mutable_perf_version())) {
         return false;
       }
       break;
     case HEADER_ARCH:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_architecture())) {
+              proto_->mutable_string_metadata()->mutable_architecture())) {
         return false;
       }
       break;
     case HEADER_CPUDESC:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_cpu_description())) {
+              proto_->mutable_string_metadata()->mutable_cpu_description())) {
         return false;
       }
       break;
     case HEADER_CPUID:
       if (!ReadSingleStringMetadata(
               data, size,
-              proto_.mutable_string_metadata()->mutable_cpu_id())) {
+              proto_->mutable_string_metadata()->mutable_cpu_id())) {
         return false;
       }
       break;
     case HEADER_CMDLINE:
     {
-      auto* string_metadata = proto_.mutable_string_metadata();
+      auto* string_metadata = proto_->mutable_string_metadata();
       if (!ReadRepeatedStringMetadata(
               data, size,
               string_metadata->mutable_perf_command_line_token(),
@@ -1003,7 +1193,7 @@ bool PerfReader::ReadBuildIDMetadataWithoutHeader(
   event->header.size =
       sizeof(*event) + GetUint64AlignedStringLength(event->filename);
 
-  if (!serializer_.SerializeBuildIDEvent(event, proto_.add_build_ids())) {
+  if (!serializer_.SerializeBuildIDEvent(event, proto_->add_build_ids())) {
     LOG(ERROR) << "Could not serialize build ID event with ID "
                << RawDataToHexString(event->build_id, sizeof(event->build_id));
     return false;
@@ -1074,7 +1264,7 @@ bool PerfReader::ReadUint32Metadata(DataReader* data, u32 type, size_t size) {
   }
 
   serializer_.SerializeSingleUint32Metadata(uint32_data,
-                                            proto_.add_uint32_metadata());
+                                            proto_->add_uint32_metadata());
   return true;
 }
 
@@ -1094,7 +1284,7 @@ bool PerfReader::ReadUint64Metadata(DataReader* data, u32 type, size_t size) {
   }
 
   serializer_.SerializeSingleUint64Metadata(uint64_data,
-                                            proto_.add_uint64_metadata());
+                                            proto_->add_uint64_metadata());
   return true;
 }
 
@@ -1122,8 +1312,8 @@ bool PerfReader::ReadEventDescMetadata(DataReader* data, u32 type,
     return false;
   }
 
-  proto_.clear_file_attrs();
-  proto_.mutable_file_attrs()->Reserve(nr_events);
+  proto_->clear_file_attrs();
+  proto_->mutable_file_attrs()->Reserve(nr_events);
 
   for (u32 i = 0; i < nr_events; i++) {
     PerfFileAttr attr;
@@ -1138,7 +1328,7 @@ bool PerfReader::ReadEventDescMetadata(DataReader* data, u32 type,
 
     if (!data->ReadStringWithSizeFromData(&attr.name))
       return false;
-    // TODO(sque): Read directly into proto_.file_attrs.
+    // TODO(sque): Read directly into proto_->file_attrs.
     std::vector<u64> &ids = attr.ids;
     ids.resize(nr_ids);
     for (u64& id : ids) {
@@ -1151,7 +1341,7 @@ bool PerfReader::ReadEventDescMetadata(DataReader* data, u32 type,
     // The EVENT_DESC metadata is the newer replacement for the older event type
     // fields. In the protobuf, both types of data are stored in the
     // |event_types| field.
-    serializer_.SerializePerfEventType(attr, proto_.add_event_types());
+    serializer_.SerializePerfEventType(attr, proto_->add_event_types());
   }
   return true;
 }
@@ -1184,7 +1374,7 @@ bool PerfReader::ReadCPUTopologyMetadata(DataReader* data, u32 type,
   }
 
   serializer_.SerializeCPUTopologyMetadata(cpu_topology,
-                                           proto_.mutable_cpu_topology());
+                                           proto_->mutable_cpu_topology());
   return true;
 }
 
@@ -1206,7 +1396,8 @@ bool PerfReader::ReadNUMATopologyMetadata(DataReader* data,
       LOG(ERROR) << "Error reading NUMA topology info for node #" << i;
       return false;
     }
-    serializer_.SerializeNodeTopologyMetadata(node, proto_.add_numa_topology());
+    serializer_.SerializeNodeTopologyMetadata(node,
+                                              proto_->add_numa_topology());
   }
   return true;
 }
@@ -1218,7 +1409,7 @@ bool PerfReader::ReadTracingMetadata(DataReader* data, size_t size) {
                            tracing_data.data())) {
     return false;
   }
-  serializer_.SerializeTracingMetadata(tracing_data, &proto_);
+  serializer_.SerializeTracingMetadata(tracing_data, proto_);
   return true;
 }
 
@@ -1262,7 +1453,7 @@ bool PerfReader::ReadPipedData(DataReader* data) {
       MaybeSwapEventFields(event.get(), data->is_cross_endian());
 
       // Serialize the event to protobuf form.
-      PerfEvent* proto_event = proto_.add_events();
+      PerfEvent* proto_event = proto_->add_events();
       if (!serializer_.SerializeEvent(event, proto_event))
         return false;
 
@@ -1303,42 +1494,43 @@ bool PerfReader::ReadPipedData(DataReader* data) {
       set_metadata_mask_bit(HEADER_HOSTNAME);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_hostname());
+                   proto_->mutable_string_metadata()->mutable_hostname());
       break;
     case PERF_RECORD_HEADER_OSRELEASE:
       set_metadata_mask_bit(HEADER_OSRELEASE);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_kernel_version());
+                   proto_->mutable_string_metadata()->mutable_kernel_version());
       break;
     case PERF_RECORD_HEADER_VERSION:
       set_metadata_mask_bit(HEADER_VERSION);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_perf_version());
+                   proto_->mutable_string_metadata()->mutable_perf_version());
       break;
     case PERF_RECORD_HEADER_ARCH:
       set_metadata_mask_bit(HEADER_ARCH);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_architecture());
+                   proto_->mutable_string_metadata()->mutable_architecture());
       break;
     case PERF_RECORD_HEADER_CPUDESC:
       set_metadata_mask_bit(HEADER_CPUDESC);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_cpu_description());
+                   proto_->mutable_string_metadata()
+                       ->mutable_cpu_description());
       break;
     case PERF_RECORD_HEADER_CPUID:
       set_metadata_mask_bit(HEADER_CPUID);
       result = ReadSingleStringMetadata(
                    data, size_without_header,
-                   proto_.mutable_string_metadata()->mutable_cpu_id());
+                   proto_->mutable_string_metadata()->mutable_cpu_id());
       break;
     case PERF_RECORD_HEADER_CMDLINE:
     {
       set_metadata_mask_bit(HEADER_CMDLINE);
-      auto* string_metadata = proto_.mutable_string_metadata();
+      auto* string_metadata = proto_->mutable_string_metadata();
       result = ReadRepeatedStringMetadata(
                    data, size_without_header,
                    string_metadata->mutable_perf_command_line_token(),
@@ -1383,7 +1575,7 @@ bool PerfReader::ReadPipedData(DataReader* data) {
   // and PERF_RECORD_HEADER_EVENT_DESC metadata events are not, we should use
   // them. Otherwise, we should use prefer the _EVENT_DESC data.
   if (!get_metadata_mask_bit(HEADER_EVENT_DESC) &&
-      num_event_types == proto_.file_attrs().size()) {
+      num_event_types == proto_->file_attrs().size()) {
     // We can construct HEADER_EVENT_DESC:
     set_metadata_mask_bit(HEADER_EVENT_DESC);
   }
@@ -1406,7 +1598,7 @@ bool PerfReader::WriteAttrs(const struct perf_file_header& header,
 
   std::vector<struct perf_file_section> id_sections;
   id_sections.reserve(attrs().size());
-  for (const auto& attr : proto_.file_attrs()) {
+  for (const auto& attr : proto_->file_attrs()) {
     size_t section_size =
         attr.ids_size() * sizeof(decltype(PerfFileAttr::ids)::value_type);
     id_sections.push_back(perf_file_section{data->Tell(), section_size});
@@ -1420,7 +1612,7 @@ bool PerfReader::WriteAttrs(const struct perf_file_header& header,
   for (int i = 0; i < attrs().size(); i++) {
     const struct perf_file_section& id_section = id_sections[i];
     PerfFileAttr attr;
-    serializer_.DeserializePerfFileAttr(proto_.file_attrs(i), &attr);
+    serializer_.DeserializePerfFileAttr(proto_->file_attrs(i), &attr);
     if (!data->WriteDataValue(&attr.attr, sizeof(attr.attr), "attribute") ||
         !data->WriteDataValue(&id_section, sizeof(id_section), "ID section")) {
       return false;
@@ -1432,12 +1624,12 @@ bool PerfReader::WriteAttrs(const struct perf_file_header& header,
 bool PerfReader::WriteData(const struct perf_file_header& header,
                            DataWriter* data) const {
   // No need to CHECK anything if no event data is being written.
-  if (proto_.events().empty())
+  if (proto_->events().empty())
     return true;
 
   CHECK(serializer_.SampleInfoReaderAvailable());
   CHECK_EQ(header.data.offset, data->Tell());
-  for (const PerfEvent& proto_event : proto_.events()) {
+  for (const PerfEvent& proto_event : proto_->events()) {
     malloced_unique_ptr<event_t> event;
     // The nominal size given by |proto_event| may not be correct, as the
     // contents may have changed since the PerfEvent was created. Use the size
@@ -1467,7 +1659,7 @@ bool PerfReader::WriteMetadata(const struct perf_file_header& header,
   metadata_sections.reserve(GetNumSupportedMetadata());
 
   // For less verbose access to string metadata fields.
-  const auto& string_metadata = proto_.string_metadata();
+  const auto& string_metadata = proto_->string_metadata();
 
   for (u32 type = HEADER_FIRST_FEATURE; type != HEADER_LAST_FEATURE; ++type) {
     if ((header.adds_features[0] & (1 << type)) == 0)
@@ -1569,7 +1761,7 @@ bool PerfReader::WriteMetadata(const struct perf_file_header& header,
 
 bool PerfReader::WriteBuildIDMetadata(u32 type, DataWriter* data) const {
   CheckNoBuildIDEventPadding();
-  for (const auto& build_id : proto_.build_ids()) {
+  for (const auto& build_id : proto_->build_ids()) {
     malloced_unique_ptr<build_id_event> event;
     if (!serializer_.DeserializeBuildIDEvent(build_id, &event)) {
       LOG(ERROR) << "Could not deserialize build ID event with build ID "
@@ -1605,7 +1797,7 @@ bool PerfReader::WriteRepeatedStringMetadata(
 }
 
 bool PerfReader::WriteUint32Metadata(u32 type, DataWriter* data) const {
-  for (const auto& metadata : proto_.uint32_metadata()) {
+  for (const auto& metadata : proto_->uint32_metadata()) {
     if (metadata.type() != type)
       continue;
     PerfUint32Metadata local_metadata;
@@ -1620,7 +1812,7 @@ bool PerfReader::WriteUint32Metadata(u32 type, DataWriter* data) const {
 }
 
 bool PerfReader::WriteUint64Metadata(u32 type, DataWriter* data) const {
-  for (const auto& metadata : proto_.uint64_metadata()) {
+  for (const auto& metadata : proto_->uint64_metadata()) {
     if (metadata.type() != type)
       continue;
     PerfUint64Metadata local_metadata;
@@ -1643,7 +1835,7 @@ bool PerfReader::WriteEventDescMetadata(u32 type, DataWriter* data) const {
     return false;
   }
 
-  event_desc_num_events num_events = proto_.file_attrs().size();
+  event_desc_num_events num_events = proto_->file_attrs().size();
   if (!data->WriteDataValue(&num_events, sizeof(num_events),
                             "event_desc num_events")) {
     return false;
@@ -1658,7 +1850,7 @@ bool PerfReader::WriteEventDescMetadata(u32 type, DataWriter* data) const {
     const auto& stored_attr = attrs().Get(i);
     PerfFileAttr attr;
     serializer_.DeserializePerfFileAttr(stored_attr, &attr);
-    if (!serializer_.DeserializePerfEventType(proto_.event_types(i), &attr))
+    if (!serializer_.DeserializePerfEventType(proto_->event_types(i), &attr))
       return false;
 
     if (!data->WriteDataValue(&attr.attr, sizeof(attr.attr),
@@ -1685,7 +1877,7 @@ bool PerfReader::WriteEventDescMetadata(u32 type, DataWriter* data) const {
 
 bool PerfReader::WriteCPUTopologyMetadata(u32 type, DataWriter* data) const {
   PerfCPUTopologyMetadata cpu_topology;
-  serializer_.DeserializeCPUTopologyMetadata(proto_.cpu_topology(),
+  serializer_.DeserializeCPUTopologyMetadata(proto_->cpu_topology(),
                                              &cpu_topology);
 
   std::vector<string>& cores = cpu_topology.core_siblings;
@@ -1710,11 +1902,11 @@ bool PerfReader::WriteCPUTopologyMetadata(u32 type, DataWriter* data) const {
 }
 
 bool PerfReader::WriteNUMATopologyMetadata(u32 type, DataWriter* data) const {
-  numa_topology_num_nodes_type num_nodes = proto_.numa_topology().size();
+  numa_topology_num_nodes_type num_nodes = proto_->numa_topology().size();
   if (!data->WriteDataValue(&num_nodes, sizeof(num_nodes), "num nodes"))
     return false;
 
-  for (const auto& node_proto : proto_.numa_topology()) {
+  for (const auto& node_proto : proto_->numa_topology()) {
     PerfNodeTopologyMetadata node;
     serializer_.DeserializeNodeTopologyMetadata(node_proto, &node);
 
@@ -1746,7 +1938,7 @@ bool PerfReader::ReadAttrEventBlock(DataReader* data, size_t size) {
 
   // Event types are found many times in the perf data file.
   // Only add this event type if it is not already present.
-  for (const auto& stored_attr : proto_.file_attrs()) {
+  for (const auto& stored_attr : proto_->file_attrs()) {
     if (stored_attr.ids(0) == attr.ids[0])
       return true;
   }
@@ -1847,7 +2039,7 @@ size_t PerfReader::GetEventDescMetadataSize() const {
 
 size_t PerfReader::GetBuildIDMetadataSize() const {
   size_t size = 0;
-  for (const auto& build_id : proto_.build_ids()) {
+  for (const auto& build_id : proto_->build_ids()) {
     size += sizeof(build_id_event) +
             GetUint64AlignedStringLength(build_id.filename());
   }
@@ -1879,14 +2071,14 @@ size_t PerfReader::GetStringMetadataSize() const {
 
 size_t PerfReader::GetUint32MetadataSize() const {
   size_t size = 0;
-  for (const auto& metadata : proto_.uint32_metadata())
+  for (const auto& metadata : proto_->uint32_metadata())
     size += metadata.data().size() * sizeof(uint32_t);
   return size;
 }
 
 size_t PerfReader::GetUint64MetadataSize() const {
   size_t size = 0;
-  for (const auto& metadata : proto_.uint64_metadata())
+  for (const auto& metadata : proto_->uint64_metadata())
     size += metadata.data().size() * sizeof(uint64_t);
   return size;
 }
@@ -1894,12 +2086,12 @@ size_t PerfReader::GetUint64MetadataSize() const {
 size_t PerfReader::GetCPUTopologyMetadataSize() const {
   // Core siblings.
   size_t size = sizeof(num_siblings_type);
-  for (const string& core_sibling : proto_.cpu_topology().core_siblings())
+  for (const string& core_sibling : proto_->cpu_topology().core_siblings())
     size += ExpectedStorageSizeOf(core_sibling);
 
   // Thread siblings.
   size += sizeof(num_siblings_type);
-  for (const string& thread_sibling : proto_.cpu_topology().thread_siblings())
+  for (const string& thread_sibling : proto_->cpu_topology().thread_siblings())
     size += ExpectedStorageSizeOf(thread_sibling);
 
   return size;
@@ -1907,7 +2099,7 @@ size_t PerfReader::GetCPUTopologyMetadataSize() const {
 
 size_t PerfReader::GetNUMATopologyMetadataSize() const {
   size_t size = sizeof(numa_topology_num_nodes_type);
-  for (const auto& node : proto_.numa_topology()) {
+  for (const auto& node : proto_->numa_topology()) {
     size += sizeof(node.id());
     size += sizeof(node.total_memory()) + sizeof(node.free_memory());
     size += ExpectedStorageSizeOf(node.cpu_list());
@@ -1924,7 +2116,7 @@ bool PerfReader::LocalizeMMapFilenames(
   CHECK(serializer_.SampleInfoReaderAvailable());
 
   // Search for mmap/mmap2 events for which the filename needs to be updated.
-  for (PerfEvent& event : *proto_.mutable_events()) {
+  for (PerfEvent& event : *proto_->mutable_events()) {
     if (event.header().type() != PERF_RECORD_MMAP &&
         event.header().type() != PERF_RECORD_MMAP2) {
       continue;
@@ -1947,7 +2139,7 @@ bool PerfReader::LocalizeMMapFilenames(
 }
 
 void PerfReader::AddPerfFileAttr(const PerfFileAttr& attr) {
-  serializer_.SerializePerfFileAttr(attr, proto_.add_file_attrs());
+  serializer_.SerializePerfFileAttr(attr, proto_->add_file_attrs());
 
   // Generate a new SampleInfoReader with the new attr.
   serializer_.CreateSampleInfoReader(attr, is_cross_endian_);
@@ -50,6 +50,22 @@ class PerfReader {
   bool ReadFromPointer(const char* data, size_t size);
   bool ReadFromData(DataReader* data);
 
+  // Interface for reading the events of a perf data file in batches, so that
+  // they do not all have to be held in memory at the same time.
+  // StartReadingEvents() reads everything except the events from |data|. Each
+  // ReadNextEvents() call then replaces the contents of events() with at most
+  // |max_events| of the next events in the data section. |data| must remain
+  // valid until HasMoreEvents() returns false.
+  //
+  // Piped mode perf data may have metadata after the events, so it is read
+  // all at once by StartReadingEvents(), and returned as a single batch.
+  bool StartReadingEvents(DataReader* data);
+  bool ReadNextEvents(size_t max_events);
+  bool HasMoreEvents() const {
+    return (event_data_ && data_section_remaining_bytes_ != 0) ||
+           piped_events_pending_;
+  }
+
   bool WriteFile(const string& filename);
   bool WriteToVector(std::vector<char>* data);
   bool WriteToString(string* str);
@@ -87,6 +103,15 @@ class PerfReader {
   // event order is unchanged.
   void MaybeSortEventsByTime();
 
+  // Sets the number of threads that Read*() uses to serialize the events in
+  // the data section of normal mode perf data. Multiple threads are only used
+  // when the data section can be accessed in place, i.e. when reading from
+  // memory or from a mapped file, and no byte swapping is needed. The events
+  // are stored in the same order either way. Defaults to 1.
+  void set_num_serialization_threads(size_t num_threads) {
+    num_serialization_threads_ = num_threads;
+  }
+
   // Accessors and mutators.
 
   // This is a plain accessor for the internal protobuf storage. It is meant for
@@ -96,44 +121,44 @@ class PerfReader {
   // Call Serialize() instead of this function to acquire an "official" protobuf
   // with a timestamp.
   const PerfDataProto& proto() const {
-    return proto_;
+    return *proto_;
   }
 
   const RepeatedPtrField<PerfDataProto_PerfFileAttr>& attrs() const {
-    return proto_.file_attrs();
+    return proto_->file_attrs();
   }
   const RepeatedPtrField<PerfDataProto_PerfEventType>& event_types() const {
-    return proto_.event_types();
+    return proto_->event_types();
   }
 
   const RepeatedPtrField<PerfDataProto_PerfEvent>& events() const {
-    return proto_.events();
+    return proto_->events();
   }
   // WARNING: Modifications to the protobuf events may change the amount of
   // space required to store the corresponding raw event. If that happens, the
   // caller is responsible for correctly updating the size in the event header.
   // TODO(sque): Remove this restriction.
   RepeatedPtrField<PerfDataProto_PerfEvent>* mutable_events() {
-    return proto_.mutable_events();
+    return proto_->mutable_events();
   }
 
   const RepeatedPtrField<PerfDataProto_PerfBuildID>& build_ids() const {
-    return proto_.build_ids();
+    return proto_->build_ids();
   }
   RepeatedPtrField<PerfDataProto_PerfBuildID>* mutable_build_ids() {
-    return proto_.mutable_build_ids();
+    return proto_->mutable_build_ids();
   }
 
   const string& tracing_data() const {
-    return proto_.tracing_data().tracing_data();
+    return proto_->tracing_data().tracing_data();
   }
 
   const PerfDataProto_StringMetadata& string_metadata() const {
-    return proto_.string_metadata();
+    return proto_->string_metadata();
   }
 
   uint64_t metadata_mask() const {
-    return proto_.metadata_mask().Get(0);
+    return proto_->metadata_mask().Get(0);
   }
 
  private:
@@ -147,7 +172,18 @@ class PerfReader {
   // if event_size == 0, then not in an event.
   bool ReadEventType(DataReader* data, int attr_idx, size_t event_size);
 
+  // Reads the attrs, event types and metadata of normal mode perf data, i.e.
+  // everything but the data section.
+  bool ReadNormalModeSections(DataReader* data);
+
   bool ReadDataSection(DataReader* data);
+  // Serializes the events of the data section, given the |size| bytes of
+  // |section|, using |num_serialization_threads_| threads. First finds where
+  // each event starts, so the events can be split evenly between the threads.
+  bool ReadDataSectionInParallel(const char* section, size_t size);
+  // Reads a single event from the data section, at the current position of
+  // |data|, and updates |data_section_remaining_bytes_|.
+  bool ReadDataSectionEvent(DataReader* data);
 
   // Reads metadata in normal mode.
   bool ReadMetadata(DataReader* data);
@@ -255,7 +291,7 @@ class PerfReader {
     return metadata_mask() & (1 << bit);
   }
   void set_metadata_mask_bit(uint32_t bit) {
-    proto_.set_metadata_mask(0, metadata_mask() | (1 << bit));
+    proto_->set_metadata_mask(0, metadata_mask() | (1 << bit));
   }
 
   // The file header is either a normal header or a piped header.
@@ -264,9 +300,13 @@ class PerfReader {
     struct perf_pipe_file_header piped_header_;
   };
 
-  // Store the perf data as a protobuf.
+  // Owns |proto_| and all of its submessages, such as the events, so that they
+  // are not allocated one by one, and are all freed at once with the reader.
+  Arena arena_;
+
+  // Store the perf data as a protobuf. Allocated on |arena_|.
   // TODO(sque): Store all fields in here, not just events.
-  PerfDataProto proto_;
+  PerfDataProto* const proto_;
 
   // Whether the incoming data is from a machine with a different endianness. We
   // got rid of this flag in the past but now we need to store this so it can be
@@ -276,6 +316,19 @@ class PerfReader {
   // For serializing individual events.
   PerfSerializer serializer_;
 
+  // Number of bytes of the data section that have not been read yet.
+  u64 data_section_remaining_bytes_;
+
+  // Number of threads used by ReadDataSection().
+  size_t num_serialization_threads_;
+
+  // When reading events in batches, this is the source of the events.
+  DataReader* event_data_;
+
+  // When reading piped data in batches, set if all the events have been read
+  // into |proto_| but not yet returned by ReadNextEvents().
+  bool piped_events_pending_;
+
   // When writing to a new perf data file, this is used to hold the generated
   // file header, which may differ from the input file header, if any.
   struct perf_file_header out_header_;
@@ -12,6 +12,7 @@
 
 #include "base/logging.h"
 
+#include "chromiumos-wide-profiling/buffer_reader.h"
 #include "chromiumos-wide-profiling/compat/string.h"
 #include "chromiumos-wide-profiling/compat/test.h"
 #include "chromiumos-wide-profiling/file_utils.h"
@@ -879,6 +880,265 @@ TEST(PerfReaderTest, ReadsAndWritesMmap2Events) {
   }
 }
 
+// Reading a perf data file should give the same result as reading the same
+// data from memory.
+TEST(PerfReaderTest, ReadFileMatchesReadFromString) {
+  std::stringstream input;
+
+  testing::ExampleMmapEvent mmap_event(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so", testing::SampleInfo());
+  testing::ExamplePerfSampleEvent sample_event_1(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001));
+  testing::ExamplePerfSampleEvent sample_event_2(
+      testing::SampleInfo().Ip(0x00000000001c1d00).Tid(1001));
+
+  const size_t data_size = mmap_event.GetSize() + sample_event_1.GetSize() +
+                           sample_event_2.GetSize();
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  ASSERT_EQ(file_header.header().data.offset,
+            static_cast<u64>(input.tellp()));
+  mmap_event.WriteTo(&input);
+  sample_event_1.WriteTo(&input);
+  sample_event_2.WriteTo(&input);
+  ASSERT_EQ(file_header.header().data.offset + data_size,
+            static_cast<u64>(input.tellp()));
+
+  // no metadata
+
+  //
+  // Parse input.
+  //
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), input.str()));
+
+  PerfReader file_reader;
+  ASSERT_TRUE(file_reader.ReadFile(input_file.path()));
+  PerfReader string_reader;
+  ASSERT_TRUE(string_reader.ReadFromString(input.str()));
+
+  ASSERT_EQ(3, file_reader.events().size());
+  EXPECT_EQ(PERF_RECORD_MMAP, file_reader.events().Get(0).header().type());
+  EXPECT_EQ("/usr/lib/foo.so",
+            file_reader.events().Get(0).mmap_event().filename());
+  EXPECT_EQ(0x00000000001c100a,
+            file_reader.events().Get(1).sample_event().ip());
+  EXPECT_EQ(0x00000000001c1d00,
+            file_reader.events().Get(2).sample_event().ip());
+  EXPECT_EQ(string_reader.proto().SerializeAsString(),
+            file_reader.proto().SerializeAsString());
+}
+
+TEST(PerfReaderTest, ReadsEventsInBatches) {
+  std::stringstream input;
+
+  testing::ExampleMmapEvent mmap_event(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so", testing::SampleInfo());
+  testing::ExamplePerfSampleEvent sample_event_1(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001));
+  testing::ExamplePerfSampleEvent sample_event_2(
+      testing::SampleInfo().Ip(0x00000000001c1d00).Tid(1001));
+
+  const size_t data_size = mmap_event.GetSize() + sample_event_1.GetSize() +
+                           sample_event_2.GetSize();
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  mmap_event.WriteTo(&input);
+  sample_event_1.WriteTo(&input);
+  sample_event_2.WriteTo(&input);
+
+  // no metadata
+
+  //
+  // Parse input.
+  //
+
+  const string input_string = input.str();
+  PerfReader expected_reader;
+  ASSERT_TRUE(expected_reader.ReadFromString(input_string));
+
+  BufferReader data(input_string.data(), input_string.size());
+  PerfReader pr;
+  ASSERT_TRUE(pr.StartReadingEvents(&data));
+  EXPECT_EQ(0, pr.events().size());
+  EXPECT_EQ(1, pr.attrs().size());
+  EXPECT_TRUE(pr.HasMoreEvents());
+
+  ASSERT_TRUE(pr.ReadNextEvents(2));
+  ASSERT_EQ(2, pr.events().size());
+  EXPECT_EQ(expected_reader.events().Get(0).SerializeAsString(),
+            pr.events().Get(0).SerializeAsString());
+  EXPECT_EQ(expected_reader.events().Get(1).SerializeAsString(),
+            pr.events().Get(1).SerializeAsString());
+  EXPECT_TRUE(pr.HasMoreEvents());
+
+  ASSERT_TRUE(pr.ReadNextEvents(2));
+  ASSERT_EQ(1, pr.events().size());
+  EXPECT_EQ(expected_reader.events().Get(2).SerializeAsString(),
+            pr.events().Get(0).SerializeAsString());
+  EXPECT_FALSE(pr.HasMoreEvents());
+}
+
+TEST(PerfReaderTest, ReadsPipedEventsInOneBatch) {
+  std::stringstream input;
+
+  // header
+  testing::ExamplePipedPerfDataFileHeader().WriteTo(&input);
+
+  // data
+
+  // PERF_RECORD_HEADER_ATTR
+  testing::ExamplePerfEventAttrEvent_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                              true /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // PERF_RECORD_MMAP
+  testing::ExampleMmapEvent(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so",
+      testing::SampleInfo().Tid(1001)).WriteTo(&input);
+
+  // PERF_RECORD_SAMPLE
+  testing::ExamplePerfSampleEvent(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001))
+      .WriteTo(&input);
+
+  //
+  // Parse input.
+  //
+
+  const string input_string = input.str();
+  BufferReader data(input_string.data(), input_string.size());
+  PerfReader pr;
+  ASSERT_TRUE(pr.StartReadingEvents(&data));
+  EXPECT_TRUE(pr.HasMoreEvents());
+
+  // Piped data is returned in a single batch, regardless of its size.
+  ASSERT_TRUE(pr.ReadNextEvents(1));
+  ASSERT_EQ(2, pr.events().size());
+  EXPECT_EQ(PERF_RECORD_MMAP, pr.events().Get(0).header().type());
+  EXPECT_EQ(PERF_RECORD_SAMPLE, pr.events().Get(1).header().type());
+  EXPECT_FALSE(pr.HasMoreEvents());
+}
+
+TEST(PerfReaderTest, SerializesEventsInParallel) {
+  std::stringstream input;
+
+  const int kNumMmapEvents = 10;
+  const int kNumSampleEventsPerMmap = 20;
+
+  std::vector<testing::ExampleMmapEvent> mmap_events;
+  std::vector<testing::ExamplePerfSampleEvent> sample_events;
+  size_t data_size = 0;
+  for (int i = 0; i < kNumMmapEvents; ++i) {
+    const u64 start = 0x1c1000 + i * 0x1000;
+    mmap_events.emplace_back(1001, start, 0x1000, 0,
+                             "/usr/lib/foo" + std::to_string(i) + ".so",
+                             testing::SampleInfo());
+    data_size += mmap_events.back().GetSize();
+    for (int j = 0; j < kNumSampleEventsPerMmap; ++j) {
+      sample_events.emplace_back(
+          testing::SampleInfo().Ip(start + j * 8).Tid(1001));
+      data_size += sample_events.back().GetSize();
+    }
+  }
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  for (int i = 0; i < kNumMmapEvents; ++i) {
+    mmap_events[i].WriteTo(&input);
+    for (int j = 0; j < kNumSampleEventsPerMmap; ++j)
+      sample_events[i * kNumSampleEventsPerMmap + j].WriteTo(&input);
+  }
+
+  // no metadata
+
+  //
+  // Parse input.
+  //
+
+  PerfReader expected_reader;
+  ASSERT_TRUE(expected_reader.ReadFromString(input.str()));
+  ASSERT_EQ(kNumMmapEvents * (1 + kNumSampleEventsPerMmap),
+            expected_reader.events().size());
+
+  // Try numbers of threads that do and do not divide the number of events,
+  // including more threads than events.
+  for (size_t num_threads : {2, 3, 8, 1000}) {
+    PerfReader pr;
+    pr.set_num_serialization_threads(num_threads);
+    ASSERT_TRUE(pr.ReadFromString(input.str())) << num_threads;
+    EXPECT_EQ(expected_reader.proto().SerializeAsString(),
+              pr.proto().SerializeAsString()) << num_threads;
+  }
+}
+
+TEST(PerfReaderTest, SerializesEventsInParallelRejectsTruncatedEvent) {
+  std::stringstream input;
+
+  testing::ExamplePerfSampleEvent sample_event(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001));
+
+  // The data section ends in the middle of the second event.
+  const size_t data_size =
+      sample_event.GetSize() + sample_event.GetSize() / 2;
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  sample_event.WriteTo(&input);
+  sample_event.WriteTo(&input);
+
+  PerfReader pr;
+  pr.set_num_serialization_threads(2);
+  EXPECT_FALSE(pr.ReadFromString(input.str()));
+}
+
 // Regression test for http://crbug.com/493533
 TEST(PerfReaderTest, ReadsAllAvailableMetadataTypes) {
   std::stringstream input;
@@ -184,8 +184,12 @@ bool PerfSerializer::DeserializePerfEventType(
 bool PerfSerializer::SerializeEvent(
     const malloced_unique_ptr<event_t>& event_ptr,
     PerfDataProto_PerfEvent* event_proto) const {
-  const event_t& event = *event_ptr;
+  return SerializeEvent(*event_ptr, event_proto);
+}
 
+bool PerfSerializer::SerializeEvent(
+    const event_t& event,
+    PerfDataProto_PerfEvent* event_proto) const {
   if (!SerializeEventHeader(event.header, event_proto->mutable_header()))
     return false;
 
@@ -63,6 +63,10 @@ class PerfSerializer {
 
   bool SerializeEvent(const malloced_unique_ptr<event_t>& event_ptr,
                       PerfDataProto_PerfEvent* event_proto) const;
+  // Like the above, but does not require |event| to be owned by the caller,
+  // e.g. when it points directly into a mapped perf data file.
+  bool SerializeEvent(const event_t& event,
+                      PerfDataProto_PerfEvent* event_proto) const;
   bool DeserializeEvent(const PerfDataProto_PerfEvent& event_proto,
                         malloced_unique_ptr<event_t>* event_ptr) const;
 
@@ -515,6 +515,84 @@ TEST(PerfSerializerTest, SerializesAndDeserializesMmapEvents) {
   }
 }
 
+TEST(PerfSerializerTest, SerializesToProtobufFileInBatches) {
+  std::stringstream input;
+
+  testing::ExampleMmapEvent mmap_event(
+      1001, 0x1c1000, 0x1000, 0, "/usr/lib/foo.so", testing::SampleInfo());
+  testing::ExamplePerfSampleEvent sample_event(
+      testing::SampleInfo().Ip(0x00000000001c100a).Tid(1001));
+  const int kNumSampleEvents = 10;
+
+  const size_t data_size =
+      mmap_event.GetSize() + kNumSampleEvents * sample_event.GetSize();
+
+  // header
+  testing::ExamplePerfDataFileHeader file_header(0);
+  file_header
+      .WithAttrCount(1)
+      .WithDataSize(data_size);
+  file_header.WriteTo(&input);
+
+  // attrs
+  testing::ExamplePerfFileAttr_Hardware(PERF_SAMPLE_IP | PERF_SAMPLE_TID,
+                                        false /*sample_id_all*/)
+      .WriteTo(&input);
+
+  // data
+  mmap_event.WriteTo(&input);
+  for (int i = 0; i < kNumSampleEvents; ++i)
+    sample_event.WriteTo(&input);
+
+  // no metadata
+
+  ScopedTempFile input_file;
+  ASSERT_TRUE(BufferToFile(input_file.path(), input.str()));
+
+  PerfParserOptions options;
+  options.sort_events_by_time = false;
+  options.do_remap = true;
+
+  PerfDataProto expected_proto;
+  ASSERT_TRUE(SerializeFromFileWithOptions(input_file.path(), options,
+                                           &expected_proto));
+
+  // Write the events three at a time.
+  ScopedTempFile output_file;
+  ASSERT_TRUE(SerializeFromFileToProtobufFile(input_file.path(), options, 3,
+                                              output_file.path()));
+  PerfDataProto perf_data_proto;
+  ASSERT_TRUE(ReadProtobufFromFile(&perf_data_proto, output_file.path()));
+
+  EXPECT_EQ(1 + kNumSampleEvents, perf_data_proto.events().size());
+  EXPECT_EQ(kNumSampleEvents, perf_data_proto.stats().num_sample_events());
+  EXPECT_EQ(1, perf_data_proto.file_attrs().size());
+
+  // Ignore the timestamps, which may differ.
+  expected_proto.clear_timestamp_sec();
+  perf_data_proto.clear_timestamp_sec();
+  EXPECT_EQ(expected_proto.SerializeAsString(),
+            perf_data_proto.SerializeAsString());
+}
+
+TEST(PerfSerializerTest, ReadsProtobufFileOntoArena) {
+  PerfDataProto expected_proto;
+  ASSERT_TRUE(SerializeFromFile(
+      GetTestInputFilePath(perf_test_files::GetPerfDataFiles()[0]),
+      &expected_proto));
+  ASSERT_GT(expected_proto.events().size(), 0);
+  ScopedTempFile output_file;
+  ASSERT_TRUE(WriteProtobufToFile(expected_proto, output_file.path()));
+
+  Arena arena;
+  PerfDataProto* perf_data_proto = Arena::CreateMessage<PerfDataProto>(&arena);
+  ASSERT_TRUE(ReadProtobufFromFile(perf_data_proto, output_file.path()));
+  // The events are allocated on the arena too.
+  EXPECT_EQ(&arena, perf_data_proto->mutable_events(0)->GetArena());
+  EXPECT_EQ(expected_proto.SerializeAsString(),
+            perf_data_proto->SerializeAsString());
+}
+
 // Regression test for http://crbug.com/501004.
 TEST(PerfSerializerTest, SerializesAndDeserializesBuildIDs) {
   std::stringstream input;
@@ -20,6 +20,8 @@
         'binary_data_utils.cc',
         'buffer_reader.cc',
         'buffer_writer.cc',
+        'build_id_cache.cc',
+        'columnar_profile.cc',
         'compat/cros/detail/log_level.cc',
         'data_reader.cc',
         'data_writer.cc',
@@ -27,6 +29,7 @@
         'file_reader.cc',
         'file_utils.cc',
         'huge_pages_mapping_deducer.cc',
+        'mmap_reader.cc',
         'perf_data_utils.cc',
         'perf_option_parser.cc',
         'perf_parser.cc',
@@ -41,10 +44,12 @@
         'string_utils.cc',
       ],
       'dependencies': [
+        'columnar_profile_proto',
         'perf_data_proto',
         'perf_stat_proto',
       ],
       'export_dependent_settings': [
+        'columnar_profile_proto',
         'perf_data_proto',
         'perf_stat_proto',
       ],
@@ -78,6 +83,18 @@
         'common',
       ],
     },
+    {
+      'target_name': 'columnar_profile_proto',
+      'type': 'static_library',
+      'variables': {
+        'proto_in_dir': '.',
+        'proto_out_dir': 'include',
+      },
+      'sources': [
+        '<(proto_in_dir)/columnar_profile.proto',
+      ],
+      'includes': ['../common-mk/protoc.gypi'],
+    },
     {
       'target_name': 'perf_data_proto',
       'type': 'static_library',
@@ -167,9 +184,12 @@
             'binary_data_utils_test.cc',
             'buffer_reader_test.cc',
             'buffer_writer_test.cc',
+            'build_id_cache_test.cc',
+            'columnar_profile_test.cc',
             'dso_test.cc',
             'file_reader_test.cc',
             'huge_pages_mapping_deducer_test.cc',
+            'mmap_reader_test.cc',
             'perf_data_utils_test.cc',
             'perf_option_parser_test.cc',
             'perf_parser_test.cc',
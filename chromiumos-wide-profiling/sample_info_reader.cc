@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include "base/logging.h"
+#include "chromiumos-wide-profiling/binary_data_utils.h"
 #include "chromiumos-wide-profiling/buffer_reader.h"
 #include "chromiumos-wide-profiling/buffer_writer.h"
 #include "chromiumos-wide-profiling/kernel/perf_internals.h"
@@ -68,8 +69,7 @@ void ReadCallchain(DataReader* reader, struct perf_sample* sample) {
       reinterpret_cast<struct ip_callchain*>(new uint64_t[callchain_size + 1]);
   callchain->nr = callchain_size;
 
-  for (size_t i = 0; i < callchain_size; ++i)
-    reader->ReadUint64(&callchain->ips[i]);
+  reader->ReadUint64Array(callchain_size, callchain->ips);
 
   sample->callchain = callchain;
 }
@@ -108,15 +108,16 @@ void ReadBranchStack(DataReader* reader, struct perf_sample* sample) {
           new uint8_t[sizeof(uint64_t) +
                       branch_stack_size * sizeof(struct branch_entry)]);
   branch_stack->nr = branch_stack_size;
-  for (size_t i = 0; i < branch_stack_size; ++i) {
-    reader->ReadUint64(&branch_stack->entries[i].from);
-    reader->ReadUint64(&branch_stack->entries[i].to);
-    reader->ReadData(sizeof(branch_stack->entries[i].flags),
-                     &branch_stack->entries[i].flags);
-    if (reader->is_cross_endian()) {
-      // TODO(sque): swap bytes of flags.
-      LOG(ERROR) << "Byte swapping of branch stack flags is not yet supported.";
+  // Read all the entries at once, then fix up their byte order.
+  reader->ReadData(branch_stack_size * sizeof(struct branch_entry),
+                   branch_stack->entries);
+  if (reader->is_cross_endian() && branch_stack_size > 0) {
+    for (size_t i = 0; i < branch_stack_size; ++i) {
+      ByteSwap(&branch_stack->entries[i].from);
+      ByteSwap(&branch_stack->entries[i].to);
     }
+    // TODO(sque): swap bytes of flags.
+    LOG(ERROR) << "Byte swapping of branch stack flags is not yet supported.";
   }
   sample->branch_stack = branch_stack;
 }
@@ -138,6 +138,62 @@ TEST(SampleInfoReaderTest, ReadSampleEventCrossEndian) {
   EXPECT_EQ(bswap_64(10001), sample.period);
 }
 
+TEST(SampleInfoReaderTest, ReadCallchainAndBranchStackCrossEndian) {
+  uint64_t sample_type =
+      PERF_SAMPLE_IP |
+      PERF_SAMPLE_CALLCHAIN |
+      PERF_SAMPLE_BRANCH_STACK;
+
+  struct perf_event_attr attr = {0};
+  attr.sample_type = sample_type;
+
+  SampleInfoReader reader(attr, true /* read_cross_endian */);
+
+  const u64 sample_event_array[] = {
+    0xffffffff01234567,                    // IP
+    bswap_64(5),                           // CALLCHAIN nr
+    PERF_CONTEXT_KERNEL,
+    0xffffffff01234567,
+    PERF_CONTEXT_USER,
+    0x00007f999c38d15a,
+    0x00007f999c38c000,
+    bswap_64(2),                           // BRANCH_STACK nr
+    0x00007f999c38d15a, 0x00007f999c38c000, 0,
+    0x00007f999c38c010, 0x00007f999c38d100, 0,
+  };
+
+  const sample_event sample_event_struct = {
+    .header = {
+      .type = PERF_RECORD_SAMPLE,
+      .misc = 0,
+      .size = sizeof(sample_event) + sizeof(sample_event_array),
+    }
+  };
+
+  std::stringstream input;
+  input.write(reinterpret_cast<const char*>(&sample_event_struct),
+              sizeof(sample_event_struct));
+  input.write(reinterpret_cast<const char*>(sample_event_array),
+              sizeof(sample_event_array));
+  string input_string = input.str();
+  const event_t& event = *reinterpret_cast<const event_t*>(input_string.data());
+
+  perf_sample sample;
+  ASSERT_TRUE(reader.ReadPerfSampleInfo(event, &sample));
+
+  EXPECT_EQ(bswap_64(0xffffffff01234567), sample.ip);
+  ASSERT_EQ(5, sample.callchain->nr);
+  for (size_t i = 0; i < sample.callchain->nr; ++i) {
+    EXPECT_EQ(bswap_64(sample_event_array[2 + i]), sample.callchain->ips[i])
+        << "Callchain entry " << i;
+  }
+  ASSERT_EQ(2, sample.branch_stack->nr);
+  EXPECT_EQ(bswap_64(0x00007f999c38d15a), sample.branch_stack->entries[0].from);
+  EXPECT_EQ(bswap_64(0x00007f999c38c000), sample.branch_stack->entries[0].to);
+  EXPECT_EQ(bswap_64(0x00007f999c38c010), sample.branch_stack->entries[1].from);
+  EXPECT_EQ(bswap_64(0x00007f999c38d100), sample.branch_stack->entries[1].to);
+}
+
 TEST(SampleInfoReaderTest, ReadMmapEvent) {
   uint64_t sample_type =      // * == in sample_id_all
       PERF_SAMPLE_IP |
@@ -276,6 +276,7 @@ const Attestation::PCRValue Attestation::kKnownPCRValues[] = {
 };
 
 const int Attestation::kNumTemporalValues = 5;
+const int Attestation::kDefaultKeyPoolSize = 2;
 
 const char Attestation::kAlternatePCAKeyAttributeName[] =
     "enterprise.alternate_pca_key";
@@ -295,6 +296,9 @@ Attestation::Attestation()
       install_attributes_observer_(this),
       is_tpm_ready_(false),
       is_prepare_in_progress_(false),
+      is_refill_in_progress_(false),
+      is_key_pool_refill_needed_(false),
+      key_pool_size_(kDefaultKeyPoolSize),
       retain_endorsement_data_(false),
       attestation_user_(0),
       attestation_group_(0) {
@@ -633,16 +637,81 @@ void Attestation::PrepareForEnrollment() {
 
 void Attestation::PrepareForEnrollmentAsync() {
   base::AutoLock lock(lock_);
-  if (!thread_.is_null()) {
-    if (!is_prepare_in_progress_) {
-      // Join the old thread and reuse the handle.
-      base::PlatformThread::Join(thread_);
-    } else {
-      LOG(WARNING) << "PrepareForEnrollmentAsync called multiple times.";
+  StartThreadLocked();
+}
+
+void Attestation::RefillKeyPool() {
+  {
+    base::AutoLock lock(lock_);
+    if (is_refill_in_progress_ || key_pool_size_ <= 0)
       return;
+    is_refill_in_progress_ = true;
+  }
+  FillKeyPool();
+  base::AutoLock lock(lock_);
+  is_refill_in_progress_ = false;
+}
+
+void Attestation::FillKeyPool() {
+  if (!IsTPMReady() || !IsPreparedForEnrollment())
+    return;
+  for (bool alternate_identity : {false, true}) {
+    while (true) {
+      // Creating a key can take seconds so |lock_| is only held to read and
+      // update the database.
+      SecureBlob identity_key_blob;
+      {
+        base::AutoLock lock(lock_);
+        const IdentityKey& identity_key = alternate_identity ?
+            database_pb_.alternate_identity_key() :
+            database_pb_.identity_key();
+        if (!identity_key.has_identity_credential() ||
+            CountPooledKeys(alternate_identity) >= key_pool_size_)
+          break;
+        identity_key_blob = SecureBlob(identity_key.identity_key_blob());
+      }
+      SecureBlob nonce;
+      if (!tpm_->GetRandomData(kNonceSize, &nonce)) {
+        LOG(ERROR) << __func__ << ": GetRandomData failed.";
+        return;
+      }
+      SecureBlob public_key;
+      SecureBlob public_key_der;
+      SecureBlob key_blob;
+      SecureBlob key_info;
+      SecureBlob proof;
+      if (!tpm_->CreateCertifiedKey(identity_key_blob, nonce,
+                                    &public_key, &public_key_der,
+                                    &key_blob, &key_info, &proof)) {
+        LOG(ERROR) << __func__ << ": Failed to create certified key.";
+        return;
+      }
+      base::AutoLock lock(lock_);
+      PooledCertifiedKey* key_pb = database_pb_.add_key_pool();
+      key_pb->set_alternate_identity(alternate_identity);
+      key_pb->set_key_blob(key_blob.to_string());
+      key_pb->set_tpm_public_key(public_key.to_string());
+      key_pb->set_public_key(public_key_der.to_string());
+      key_pb->set_certified_key_info(key_info.to_string());
+      key_pb->set_certified_key_proof(proof.to_string());
+      if (!PersistDatabaseChanges()) {
+        LOG(ERROR) << __func__ << ": Failed to persist database changes.";
+        return;
+      }
     }
   }
-  base::PlatformThread::Create(0, this, &thread_);
+}
+
+void Attestation::RefillKeyPoolAsync() {
+  // The worker thread prepares for enrollment first, which is only meant to
+  // happen once the TPM has been owned.
+  if (!IsPreparedForEnrollment())
+    return;
+  base::AutoLock lock(lock_);
+  if (key_pool_size_ <= 0 || !is_key_pool_refill_needed_)
+    return;
+  is_key_pool_refill_needed_ = false;
+  StartThreadLocked();
 }
 
 bool Attestation::Verify(bool is_cros_core) {
@@ -831,6 +900,8 @@ bool Attestation::Enroll(PCAType pca_type,
     LOG(ERROR) << __func__ << ": Failed to persist database changes.";
     return false;
   }
+  // The pool can only be filled once there is an enrolled identity key.
+  is_key_pool_refill_needed_ = true;
   LOG(INFO) << "Attestation: Enrollment complete.";
   return true;
 }
@@ -861,25 +932,42 @@ bool Attestation::CreateCertRequest(PCAType pca_type,
     request_pb.set_origin(origin);
     request_pb.set_temporal_index(ChooseTemporalIndex(username, origin));
   }
-  SecureBlob nonce;
-  if (!tpm_->GetRandomData(kNonceSize, &nonce)) {
-    LOG(ERROR) << __func__ << ": GetRandomData failed.";
-    return false;
-  }
-  SecureBlob identity_key_blob(
-      use_alternate_pca ?
-      database_pb_.alternate_identity_key().identity_key_blob() :
-      database_pb_.identity_key().identity_key_blob());
   SecureBlob public_key;
   SecureBlob public_key_der;
   SecureBlob key_blob;
   SecureBlob key_info;
   SecureBlob proof;
-  if (!tpm_->CreateCertifiedKey(identity_key_blob, nonce,
-                                &public_key, &public_key_der,
-                                &key_blob, &key_info, &proof)) {
-    LOG(ERROR) << __func__ << ": Failed to create certified key.";
-    return false;
+  is_key_pool_refill_needed_ = true;
+  // A pooled key stays in the pool until the request has been built, so that
+  // it is not lost if that fails.
+  int pooled_key_index = FindPooledKey(use_alternate_pca);
+  if (pooled_key_index >= 0) {
+    ReportAttestationKeyPoolResult(kAttestationKeyPoolHit);
+    const PooledCertifiedKey& pooled_key_pb =
+        database_pb_.key_pool(pooled_key_index);
+    public_key = SecureBlob(pooled_key_pb.tpm_public_key());
+    public_key_der = SecureBlob(pooled_key_pb.public_key());
+    key_blob = SecureBlob(pooled_key_pb.key_blob());
+    key_info = SecureBlob(pooled_key_pb.certified_key_info());
+    proof = SecureBlob(pooled_key_pb.certified_key_proof());
+  } else {
+    if (key_pool_size_ > 0)
+      ReportAttestationKeyPoolResult(kAttestationKeyPoolMiss);
+    SecureBlob nonce;
+    if (!tpm_->GetRandomData(kNonceSize, &nonce)) {
+      LOG(ERROR) << __func__ << ": GetRandomData failed.";
+      return false;
+    }
+    SecureBlob identity_key_blob(
+        use_alternate_pca ?
+        database_pb_.alternate_identity_key().identity_key_blob() :
+        database_pb_.identity_key().identity_key_blob());
+    if (!tpm_->CreateCertifiedKey(identity_key_blob, nonce,
+                                  &public_key, &public_key_der,
+                                  &key_blob, &key_info, &proof)) {
+      LOG(ERROR) << __func__ << ": Failed to create certified key.";
+      return false;
+    }
   }
   request_pb.set_certified_public_key(public_key.to_string());
   request_pb.set_certified_key_info(key_info.to_string());
@@ -899,6 +987,10 @@ bool Attestation::CreateCertRequest(PCAType pca_type,
     LOG(ERROR) << __func__ << ": Failed to serialize protobuf.";
     return false;
   }
+  if (pooled_key_index >= 0 && !RemovePooledKey(pooled_key_index)) {
+    ClearString(&tmp);
+    return false;
+  }
   pending_cert_requests_[message_id.to_string()] = SecureBlob(tmp);
   ClearString(&tmp);
   return true;
@@ -1633,6 +1725,53 @@ bool Attestation::VerifySignature(const SecureBlob& public_key,
   return true;
 }
 
+void Attestation::StartThreadLocked() {
+  if (!thread_.is_null()) {
+    if (!is_prepare_in_progress_ && !is_refill_in_progress_) {
+      // Join the old thread and reuse the handle.
+      base::PlatformThread::Join(thread_);
+    } else {
+      LOG(WARNING) << "Attestation: Worker thread is still busy.";
+      return;
+    }
+  }
+  base::PlatformThread::Create(0, this, &thread_);
+}
+
+int Attestation::CountPooledKeys(bool alternate_identity) {
+  int count = 0;
+  for (const PooledCertifiedKey& key : database_pb_.key_pool()) {
+    if (key.alternate_identity() == alternate_identity)
+      ++count;
+  }
+  return count;
+}
+
+int Attestation::FindPooledKey(bool alternate_identity) {
+  for (int i = 0; i < database_pb_.key_pool_size(); ++i) {
+    if (database_pb_.key_pool(i).alternate_identity() == alternate_identity)
+      return i;
+  }
+  return -1;
+}
+
+bool Attestation::RemovePooledKey(int index) {
+  google::protobuf::RepeatedPtrField<PooledCertifiedKey>* pool =
+      database_pb_.mutable_key_pool();
+  ClearString(pool->Mutable(index)->mutable_key_blob());
+  // Keep the order of the remaining keys so the oldest is used first.
+  for (int i = index; i + 1 < pool->size(); ++i)
+    pool->SwapElements(i, i + 1);
+  pool->RemoveLast();
+  // A key must not be handed out twice, so the removal is persisted before
+  // the key is used.
+  if (!PersistDatabaseChanges()) {
+    LOG(ERROR) << __func__ << ": Failed to persist database changes.";
+    return false;
+  }
+  return true;
+}
+
 void Attestation::ClearDatabase() {
   TPMCredentials* credentials = database_pb_.mutable_credentials();
   ClearString(credentials->mutable_endorsement_public_key());
@@ -1650,6 +1789,8 @@ void Attestation::ClearDatabase() {
                 database_pb_.mutable_alternate_identity_key());
   ClearQuote(database_pb_.mutable_alternate_pcr0_quote());
   ClearQuote(database_pb_.mutable_alternate_pcr1_quote());
+  for (int i = 0; i < database_pb_.key_pool_size(); ++i)
+    ClearString(database_pb_.mutable_key_pool(i)->mutable_key_blob());
   database_pb_.Clear();
 }
 
@@ -78,9 +78,21 @@ class Attestation : public base::PlatformThread::Delegate,
   // to be used later during enrollment.
   virtual void PrepareForEnrollment();
 
-  // Like PrepareForEnrollment(), but asynchronous.
+  // Like PrepareForEnrollment(), but asynchronous. Once prepared, the key pool
+  // is filled on the same worker thread.
   virtual void PrepareForEnrollmentAsync();
 
+  // Creates certified keys until the key pool holds key_pool_size() keys for
+  // each enrolled identity key. Certificate requests take their key from the
+  // pool when possible instead of waiting for the TPM to generate one. This has
+  // no effect unless IsPreparedForEnrollment() returns true.
+  virtual void RefillKeyPool();
+
+  // Like RefillKeyPool(), but asynchronous. Does nothing unless there has been
+  // an enrollment or a certificate request since the last call, so that keys
+  // are only created for devices that use attestation.
+  virtual void RefillKeyPoolAsync();
+
   // Verifies all attestation data as an attestation server would. Returns true
   // if all data is valid. If |is_cros_core| is true, checks that the EK is
   // endorsed for that configuration.
@@ -376,6 +388,14 @@ class Attestation : public base::PlatformThread::Delegate,
     key_store_ = key_store;
   }
 
+  // Sets how many certified keys are kept ready for each identity key. Zero
+  // disables the key pool.
+  virtual void set_key_pool_size(int key_pool_size) {
+    key_pool_size_ = key_pool_size;
+  }
+
+  virtual int key_pool_size() const { return key_pool_size_; }
+
   virtual void set_enterprise_test_key(RSA* enterprise_test_key) {
     enterprise_test_key_ = enterprise_test_key;
   }
@@ -386,7 +406,10 @@ class Attestation : public base::PlatformThread::Delegate,
   }
 
   // PlatformThread::Delegate interface.
-  virtual void ThreadMain() { PrepareForEnrollment(); }
+  virtual void ThreadMain() {
+    PrepareForEnrollment();
+    RefillKeyPool();
+  }
 
   // InstallAttributes::Observer interface.
   virtual void OnFinalized() { PrepareForEnrollmentAsync(); }
@@ -443,6 +466,7 @@ class Attestation : public base::PlatformThread::Delegate,
   // ASN.1 DigestInfo header for SHA-256 (see PKCS #1 v2.1 section 9.2).
   static const unsigned char kSha256DigestInfo[];
   static const int kNumTemporalValues;
+  static const int kDefaultKeyPoolSize;
   // Install attribute names for alternate PCA attributes.
   static const char kAlternatePCAKeyAttributeName[];
   static const char kAlternatePCAKeyIDAttributeName[];
@@ -476,6 +500,11 @@ class Attestation : public base::PlatformThread::Delegate,
   // Don't use directly, use IsTPMReady() instead.
   bool is_tpm_ready_;
   bool is_prepare_in_progress_;
+  bool is_refill_in_progress_;
+  // Set by enrollments and certificate requests, cleared by
+  // RefillKeyPoolAsync().
+  bool is_key_pool_refill_needed_;
+  int key_pool_size_;
   bool retain_endorsement_data_;
   // Can be used to override the default transport (e.g. during testing).
   std::shared_ptr<brillo::http::Transport> http_transport_;
@@ -542,6 +571,27 @@ class Attestation : public base::PlatformThread::Delegate,
                        const brillo::SecureBlob& signed_data,
                        const brillo::SecureBlob& signature);
 
+  // Starts the worker thread unless it is still busy. The caller must hold
+  // |lock_|.
+  void StartThreadLocked();
+
+  // Does the work of RefillKeyPool() once |is_refill_in_progress_| is set. The
+  // caller must not hold |lock_|.
+  void FillKeyPool();
+
+  // Returns the number of pooled keys certified by the alternate or the default
+  // identity key. The caller must hold |lock_|.
+  int CountPooledKeys(bool alternate_identity);
+
+  // Returns the index in the pool of the oldest key certified by the alternate
+  // or the default identity key, or -1 if there is none. The caller must hold
+  // |lock_|.
+  int FindPooledKey(bool alternate_identity);
+
+  // Removes the key at |index| from the pool and persists the change. The
+  // caller must hold |lock_|.
+  bool RemovePooledKey(int index);
+
   // Clears the memory of the database protobuf.
   void ClearDatabase();
 
@@ -456,6 +456,40 @@ TEST_F(AttestationTest, CertRequest) {
   EXPECT_TRUE(blob == GetX509PublicKey());
 }
 
+TEST_F(AttestationTest, CertRequestFromKeyPool) {
+  attestation_.set_key_pool_size(2);
+  // The pool is not filled before the identity key has been enrolled.
+  EXPECT_CALL(tpm_, CreateCertifiedKey(_, _, _, _, _, _, _)).Times(0);
+  attestation_.RefillKeyPool();
+  attestation_.PrepareForEnrollment();
+  attestation_.RefillKeyPool();
+  EXPECT_EQ(0, GetPersistentDatabase().key_pool_size());
+  testing::Mock::VerifyAndClearExpectations(&tpm_);
+
+  EXPECT_CALL(tpm_, CreateCertifiedKey(_, _, _, _, _, _, _))
+      .Times(2)
+      .WillRepeatedly(DoAll(SetArgPointee<3>(GetPKCS1PublicKey()),
+                            Return(true)));
+  EXPECT_TRUE(attestation_.Enroll(Attestation::kDefaultPCA, GetEnrollBlob()));
+  attestation_.RefillKeyPool();
+  EXPECT_EQ(2, GetPersistentDatabase().key_pool_size());
+  // A full pool is left alone.
+  attestation_.RefillKeyPool();
+
+  SecureBlob blob;
+  EXPECT_TRUE(attestation_.CreateCertRequest(Attestation::kDefaultPCA,
+                                             ENTERPRISE_USER_CERTIFICATE, "",
+                                             "", &blob));
+  EXPECT_EQ(1, GetPersistentDatabase().key_pool_size());
+  EXPECT_TRUE(attestation_.FinishCertRequest(GetCertRequestBlob(blob),
+                                             false,
+                                             kTestUser,
+                                             "test",
+                                             &blob));
+  EXPECT_TRUE(attestation_.GetPublicKey(false, kTestUser, "test", &blob));
+  EXPECT_TRUE(blob == GetX509PublicKey());
+}
+
 TEST_F(AttestationTest, CertRequestStorageFailure) {
   EXPECT_CALL(key_store_, Write(true, kTestUser, "test", _))
       .WillOnce(Return(false))
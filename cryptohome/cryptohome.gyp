@@ -48,6 +48,7 @@
         '<(proto_in_dir)/boot_lockbox_key.proto',
         '<(proto_in_dir)/install_attributes.proto',
         '<(proto_in_dir)/tpm_status.proto',
+        '<(proto_in_dir)/user_activity_index.proto',
         '<(proto_in_dir)/vault_keyset.proto',
         'key.proto',
         'rpc.proto',
@@ -115,6 +116,7 @@
         'pkcs11_keystore.cc',
         'platform.cc',
         'tpm.cc',
+        'tpm_command_stats.cc',
         'tpm_init.cc',
       ],
       'conditions': [
@@ -464,6 +466,7 @@
             'user_oldest_activity_timestamp_cache_unittest.cc',
             'user_session_unittest.cc',
             'vault_keyset_unittest.cc',
+            'tpm_command_stats_unittest.cc',
             'tpm_init_unittest.cc',
           ],
           'conditions': [
@@ -5,6 +5,7 @@
 #include "cryptohome/cryptohome_metrics.h"
 
 #include <base/logging.h>
+#include <base/strings/stringprintf.h>
 #include <metrics/metrics_library.h>
 #include <metrics/timer.h>
 
@@ -29,6 +30,63 @@ constexpr char kChecksumStatusHistogram[] = "Cryptohome.ChecksumStatus";
 constexpr char kCryptohomeTpmResultsHistogram[] = "Cryptohome.TpmResults";
 constexpr char kCryptohomeFreedGCacheDiskSpaceInMbHistogram[] =
     "Cryptohome.FreedGCacheDiskSpaceInMb";
+constexpr char kMountThreadQueueTimeHistogramPrefix[] =
+    "Cryptohome.MountThreadQueueTime.";
+constexpr char kMountThreadRunTimeHistogramPrefix[] =
+    "Cryptohome.MountThreadRunTime.";
+// Min and max samples of the mount thread histograms, in milliseconds.
+constexpr int kMountThreadTimeMin = 1;
+constexpr int kMountThreadTimeMax = 60 * 1000;
+constexpr int kMountThreadTimeNumBuckets = 50;
+constexpr char kAttestationKeyPoolHistogram[] = "Cryptohome.AttestationKeyPool";
+constexpr char kTpmCommandTimeHistogramPrefix[] = "Cryptohome.TpmCommandTime.";
+// Min and max samples of the TPM command histograms, in milliseconds.
+constexpr int kTpmCommandTimeMin = 1;
+constexpr int kTpmCommandTimeMax = 10 * 1000;
+constexpr int kTpmCommandTimeNumBuckets = 50;
+
+// Command names. This should match the order of 'TpmCommand'.
+const char* const kTpmCommandNames[cryptohome::kNumTpmCommands] = {
+  "EncryptBlob",
+  "DecryptBlob",
+  "SealToPCR0",
+  "Unseal",
+  "LoadWrappedKey",
+  "GetRandomData",
+  "Sign",
+  "ReadNvram",
+};
+
+// Mount thread task names. This should match the order of 'MountThreadTask'.
+const char* const kMountThreadTaskNames[cryptohome::kNumMountThreadTasks] = {
+  "InitPkcs11",
+  "InitTpm",
+  "CheckKey",
+  "AddKey",
+  "UpdateKey",
+  "RemoveKey",
+  "ListKeys",
+  "GetKeyData",
+  "MigrateKey",
+  "Remove",
+  "Rename",
+  "GetAccountDiskUsage",
+  "Mount",
+  "MountGuest",
+  "FreeDiskSpace",
+  "BootLockbox",
+  "BootAttributes",
+  "GetLoginStatus",
+  "GetTpmStatus",
+  "FirmwareManagementParameters",
+  "AsyncCallResult",
+  "AttestationEnroll",
+  "AttestationCertRequest",
+  "AttestationRegisterKey",
+  "AttestationSignChallenge",
+  "GetEndorsementInfo",
+  "InitializeCastKey",
+};
 
 // Histogram parameters. This should match the order of 'TimerType'.
 // Min and max samples are in milliseconds.
@@ -171,4 +229,46 @@ void ReportFreedGCacheDiskSpaceInMb(int mb) {
                        50 /* number of buckets */);
 }
 
+void ReportMountThreadTaskTimes(MountThreadTask task,
+                                base::TimeDelta queue_time,
+                                base::TimeDelta run_time) {
+  if (!g_metrics) {
+    return;
+  }
+  g_metrics->SendToUMA(
+      base::StringPrintf("%s%s", kMountThreadQueueTimeHistogramPrefix,
+                         kMountThreadTaskNames[task]),
+      queue_time.InMilliseconds(), kMountThreadTimeMin, kMountThreadTimeMax,
+      kMountThreadTimeNumBuckets);
+  g_metrics->SendToUMA(
+      base::StringPrintf("%s%s", kMountThreadRunTimeHistogramPrefix,
+                         kMountThreadTaskNames[task]),
+      run_time.InMilliseconds(), kMountThreadTimeMin, kMountThreadTimeMax,
+      kMountThreadTimeNumBuckets);
+}
+
+void ReportAttestationKeyPoolResult(AttestationKeyPoolResult result) {
+  if (!g_metrics) {
+    return;
+  }
+  g_metrics->SendEnumToUMA(kAttestationKeyPoolHistogram,
+                           result,
+                           kAttestationKeyPoolResultNumBuckets);
+}
+
+const char* GetTpmCommandName(TpmCommand command) {
+  return kTpmCommandNames[command];
+}
+
+void ReportTpmCommandTime(TpmCommand command, base::TimeDelta duration) {
+  if (!g_metrics) {
+    return;
+  }
+  g_metrics->SendToUMA(
+      base::StringPrintf("%s%s", kTpmCommandTimeHistogramPrefix,
+                         kTpmCommandNames[command]),
+      duration.InMilliseconds(), kTpmCommandTimeMin, kTpmCommandTimeMax,
+      kTpmCommandTimeNumBuckets);
+}
+
 }  // namespace cryptohome
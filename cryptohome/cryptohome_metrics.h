@@ -5,6 +5,8 @@
 #ifndef CRYPTOHOME_CRYPTOHOME_METRICS_H_
 #define CRYPTOHOME_CRYPTOHOME_METRICS_H_
 
+#include <base/time/time.h>
+
 #include "cryptohome/tpm.h"
 
 namespace cryptohome {
@@ -61,6 +63,61 @@ enum ChecksumStatus {
   kChecksumStatusNumBuckets
 };
 
+// Whether a certificate request was served from the attestation key pool.
+enum AttestationKeyPoolResult {
+  kAttestationKeyPoolHit,
+  kAttestationKeyPoolMiss,
+  kAttestationKeyPoolResultNumBuckets
+};
+
+// TPM commands whose latency is reported to the "Cryptohome.TpmCommandTime.*"
+// histograms.
+enum TpmCommand {
+  kTpmCommandEncryptBlob,
+  kTpmCommandDecryptBlob,
+  kTpmCommandSealToPcr0,
+  kTpmCommandUnseal,
+  kTpmCommandLoadWrappedKey,
+  kTpmCommandGetRandomData,
+  kTpmCommandSign,
+  kTpmCommandReadNvram,
+  kNumTpmCommands  // For the number of TPM commands.
+};
+
+// Kinds of tasks posted to the mount thread, whose queue and run times are
+// reported to the "Cryptohome.MountThreadQueueTime.*" and
+// "Cryptohome.MountThreadRunTime.*" histograms.
+enum MountThreadTask {
+  kMountThreadTaskInitPkcs11,
+  kMountThreadTaskInitTpm,
+  kMountThreadTaskCheckKey,
+  kMountThreadTaskAddKey,
+  kMountThreadTaskUpdateKey,
+  kMountThreadTaskRemoveKey,
+  kMountThreadTaskListKeys,
+  kMountThreadTaskGetKeyData,
+  kMountThreadTaskMigrateKey,
+  kMountThreadTaskRemove,
+  kMountThreadTaskRename,
+  kMountThreadTaskGetAccountDiskUsage,
+  kMountThreadTaskMount,
+  kMountThreadTaskMountGuest,
+  kMountThreadTaskFreeDiskSpace,
+  kMountThreadTaskBootLockbox,
+  kMountThreadTaskBootAttributes,
+  kMountThreadTaskGetLoginStatus,
+  kMountThreadTaskGetTpmStatus,
+  kMountThreadTaskFirmwareManagementParameters,
+  kMountThreadTaskAsyncCallResult,
+  kMountThreadTaskAttestationEnroll,
+  kMountThreadTaskAttestationCertRequest,
+  kMountThreadTaskAttestationRegisterKey,
+  kMountThreadTaskAttestationSignChallenge,
+  kMountThreadTaskGetEndorsementInfo,
+  kMountThreadTaskInitializeCastKey,
+  kNumMountThreadTasks  // For the number of mount thread tasks.
+};
+
 // Cros events emitted by cryptohome.
 const char kAttestationOriginSpecificIdentifiersExhausted[] =
     "Attestation.OriginSpecificExhausted";
@@ -104,6 +161,24 @@ void ReportChecksum(ChecksumStatus status);
 // "Cryptohome.FreedGCacheDiskSpaceInMb" histogram.
 void ReportFreedGCacheDiskSpaceInMb(int mb);
 
+// Reports how long a mount thread |task| waited and ran to the
+// "Cryptohome.MountThreadQueueTime.*" and "Cryptohome.MountThreadRunTime.*"
+// histograms.
+void ReportMountThreadTaskTimes(MountThreadTask task,
+                                base::TimeDelta queue_time,
+                                base::TimeDelta run_time);
+
+// Reports whether a certified key was taken from the attestation key pool or
+// generated on demand to the "Cryptohome.AttestationKeyPool" histogram.
+void ReportAttestationKeyPoolResult(AttestationKeyPoolResult result);
+
+// Returns the name of |command| as used in histogram names and status output.
+const char* GetTpmCommandName(TpmCommand command);
+
+// Reports how long |command| took to the
+// "Cryptohome.TpmCommandTime.<command name>" histogram.
+void ReportTpmCommandTime(TpmCommand command, base::TimeDelta duration);
+
 // Initialization helper.
 class ScopedMetricsInitializer {
  public:
@@ -21,6 +21,7 @@
 
 #include "cryptohome/cryptohome_metrics.h"
 #include "cryptohome/platform.h"
+#include "cryptohome/tpm_command_stats.h"
 
 // TODO(wad) This is a placeholder DBus service which allows
 //           chrome-login (and anything else running as chronos)
@@ -40,6 +41,8 @@ namespace switches {
 static const char *kNoCloseOnDaemonize = "noclose";
 static const char *kNoLegacyMount = "nolegacymount";
 static const char *kDirEncryption = "direncryption";
+// Keeps a trace of the most recent TPM commands in the status string.
+static const char *kTpmCommandTrace = "tpm_command_trace";
 }  // namespace switches
 
 static std::string ReadAbeDataFileContents(cryptohome::Platform* platform) {
@@ -72,6 +75,7 @@ int main(int argc, char **argv) {
   int noclose = cl->HasSwitch(switches::kNoCloseOnDaemonize);
   bool nolegacymount = cl->HasSwitch(switches::kNoLegacyMount);
   bool direncryption = cl->HasSwitch(switches::kDirEncryption);
+  bool tpm_command_trace = cl->HasSwitch(switches::kTpmCommandTrace);
   PLOG_IF(FATAL, daemon(0, noclose) == -1) << "Failed to daemonize";
 
   // Setup threading. This needs to be called before other calls into glib and
@@ -82,6 +86,8 @@ int main(int argc, char **argv) {
   OpenSSL_add_all_algorithms();
 
   cryptohome::ScopedMetricsInitializer metrics_initializer;
+  cryptohome::TpmCommandStats::GetInstance()->SetTraceEnabled(
+      tpm_command_trace);
 
   cryptohome::Service* service = cryptohome::Service::CreateDefault(abe_data);
 
@@ -5,15 +5,18 @@
 #include "cryptohome/homedirs.h"
 
 #include <algorithm>
+#include <map>
 #include <memory>
 #include <vector>
 
 #include <base/bind.h>
 #include <base/files/file_path.h>
 #include <base/json/json_file_value_serializer.h>
+#include <base/lazy_instance.h>
 #include <base/logging.h>
 #include <base/strings/string_number_conversions.h>
 #include <base/strings/stringprintf.h>
+#include <base/synchronization/lock.h>
 #include <brillo/cryptohome.h>
 #include <brillo/secure_blob.h>
 #include <chromeos/constants/cryptohome.h>
@@ -39,6 +42,13 @@ const FilePath::CharType *kShadowRoot = "/home/.shadow";
 const char *kEmptyOwner = "";
 const char kGCacheFilesAttribute[] = "user.GCacheFiles";
 const char kAndroidCacheFilesAttribute[] = "user.AndroidCache";
+const char kActivityIndexFile[] = "activity_index";
+const char kLastValidKeysetFile[] = "last_valid_keyset";
+
+// Serializes updates of the activity index file, which is written by the
+// HomeDirs instances of every Mount as well as the service's.
+static base::LazyInstance<base::Lock>::Leaky g_activity_index_lock =
+    LAZY_INSTANCE_INITIALIZER;
 
 HomeDirs::HomeDirs()
     : default_platform_(new Platform()),
@@ -122,17 +132,32 @@ bool HomeDirs::FreeDiskSpace() {
     // than the threshold to do more aggressive cleanup by removing users.
     return false;
 
-  // Initialize user timestamp cache if it has not been yet. This reads the
-  // last-activity time from each homedir's SerializedVaultKeyset.  This value
-  // is only updated in the value keyset on unmount and every 24 hrs, so a
+  // Take a snapshot of the activity index, which saves reading vault keysets
+  // below.
+  activity_index_.clear();
+  {
+    UserActivityIndex index;
+    base::AutoLock lock(g_activity_index_lock.Get());
+    if (ReadActivityIndex(&index)) {
+      for (const auto& entry : index.entries())
+        activity_index_[entry.obfuscated_username()] = entry;
+    }
+  }
+
+  // Initialize user timestamp cache if it has not been yet. This takes the
+  // last-activity time of each homedir from the activity index, or reads it
+  // from its SerializedVaultKeyset if the index does not know about it yet.
+  // This value is only updated on mount, unmount and every 24 hrs, so a
   // currently logged in user probably doesn't have an up to date value. This
   // is okay, since we don't delete currently logged in homedirs anyway.  (See
   // Mount::UpdateCurrentUserActivityTimestamp()).
   if (!timestamp_cache_->initialized()) {
     timestamp_cache_->Initialize();
+    loaded_timestamps_.clear();
     DoForEveryUnmountedCryptohome(base::Bind(
         &HomeDirs::AddUserTimestampToCacheCallback,
         base::Unretained(this)));
+    SaveLoadedTimestampsToActivityIndex();
   }
 
   // Delete old users, the oldest first.
@@ -231,6 +256,11 @@ bool HomeDirs::GetValidKeyset(const Credentials& creds, VaultKeyset* vk) {
   SecureBlob passkey;
   creds.GetPasskey(&passkey);
 
+  // Without a label, every keyset may have to be decrypted, and each failed
+  // attempt costs a full scrypt or TPM unseal.
+  if (creds.key_data().label().empty())
+    PrioritizeLastValidKeyset(obfuscated, &key_indices);
+
   for (int index : key_indices) {
     if (!vk->Load(GetVaultKeysetPath(obfuscated, index)))
       continue;
@@ -242,8 +272,11 @@ bool HomeDirs::GetValidKeyset(const Credentials& creds, VaultKeyset* vk) {
         creds.key_data().label() !=
           base::StringPrintf("%s%d", kKeyLegacyPrefix, index))
       continue;
-    if (vk->Decrypt(passkey))
+    if (vk->Decrypt(passkey)) {
+      if (key_indices.size() > 1)
+        SetLastValidKeyset(obfuscated, index);
       return true;
+    }
   }
   return false;
 }
@@ -318,6 +351,36 @@ bool HomeDirs::GetVaultKeysets(const std::string& obfuscated,
   return keysets->size() != 0;
 }
 
+void HomeDirs::PrioritizeLastValidKeyset(const std::string& obfuscated,
+                                         std::vector<int>* keysets) const {
+  if (keysets->size() < 2)
+    return;
+  std::string contents;
+  int last_valid;
+  if (!platform_->ReadFileToString(
+          shadow_root_.Append(obfuscated).Append(kLastValidKeysetFile),
+          &contents) ||
+      !base::StringToInt(contents, &last_valid))
+    return;
+  auto it = std::find(keysets->begin(), keysets->end(), last_valid);
+  if (it != keysets->end())
+    std::rotate(keysets->begin(), it, it + 1);
+}
+
+void HomeDirs::SetLastValidKeyset(const std::string& obfuscated, int index) {
+  FilePath path = shadow_root_.Append(obfuscated).Append(kLastValidKeysetFile);
+  std::string contents;
+  const std::string index_str = base::IntToString(index);
+  if (platform_->ReadFileToString(path, &contents) && contents == index_str)
+    return;
+  // This is only a hint, so there is no need to sync it to disk.
+  if (!platform_->WriteFileAtomic(
+          path, brillo::Blob(index_str.begin(), index_str.end()), 0600)) {
+    LOG(WARNING) << "Failed to remember the last valid keyset of "
+                 << obfuscated;
+  }
+}
+
 bool HomeDirs::GetVaultKeysetLabels(const Credentials& credentials,
                                     std::vector<std::string>* labels) const {
   CHECK(labels);
@@ -999,6 +1062,14 @@ void HomeDirs::DeleteAndroidCacheCallback(const FilePath& user_dir) {
 
 void HomeDirs::AddUserTimestampToCacheCallback(const FilePath& user_dir) {
   const std::string obfuscated_username = user_dir.BaseName().value();
+  const auto entry = activity_index_.find(obfuscated_username);
+  if (entry != activity_index_.end() &&
+      entry->second.has_last_activity_timestamp()) {
+    timestamp_cache_->AddExistingUser(
+        user_dir, base::Time::FromInternalValue(
+                      entry->second.last_activity_timestamp()));
+    return;
+  }
   //  Add a timestamp for every key.
   std::vector<int> key_indices;
   // Failure is okay since the loop falls through.
@@ -1020,11 +1091,96 @@ void HomeDirs::AddUserTimestampToCacheCallback(const FilePath& user_dir) {
   }
   if (!timestamp.is_null()) {
       timestamp_cache_->AddExistingUser(user_dir, timestamp);
+      loaded_timestamps_[obfuscated_username] = timestamp;
   } else {
       timestamp_cache_->AddExistingUserNotime(user_dir);
   }
 }
 
+FilePath HomeDirs::GetActivityIndexPath() const {
+  return shadow_root_.Append(kActivityIndexFile);
+}
+
+bool HomeDirs::ReadActivityIndex(UserActivityIndex* index) const {
+  FilePath path = GetActivityIndexPath();
+  if (!platform_->FileExists(path))
+    return false;
+  std::string serialized;
+  if (!platform_->ReadFileToString(path, &serialized)) {
+    LOG(ERROR) << "Failed to read " << path.value();
+    return false;
+  }
+  if (!index->ParseFromString(serialized)) {
+    LOG(ERROR) << "Failed to parse " << path.value();
+    index->Clear();
+    return false;
+  }
+  return true;
+}
+
+bool HomeDirs::WriteActivityIndex(UserActivityIndex* index) {
+  // Forget users that have been removed, so that a user recreated with the
+  // same name does not inherit their timestamp.
+  auto* entries = index->mutable_entries();
+  for (int i = entries->size() - 1; i >= 0; --i) {
+    if (!platform_->DirectoryExists(
+            shadow_root_.Append(entries->Get(i).obfuscated_username()))) {
+      entries->SwapElements(i, entries->size() - 1);
+      entries->RemoveLast();
+    }
+  }
+  std::string serialized;
+  if (!index->SerializeToString(&serialized)) {
+    LOG(ERROR) << "Failed to serialize the activity index.";
+    return false;
+  }
+  if (!platform_->WriteStringToFileAtomicDurable(GetActivityIndexPath(),
+                                                 serialized, 0600)) {
+    LOG(ERROR) << "Failed to write the activity index.";
+    return false;
+  }
+  return true;
+}
+
+void HomeDirs::UpdateActivityIndex(const std::string& obfuscated,
+                                   base::Time timestamp) {
+  base::AutoLock lock(g_activity_index_lock.Get());
+  UserActivityIndex index;
+  ReadActivityIndex(&index);
+  UserActivityIndex::Entry* entry = NULL;
+  for (auto& existing : *index.mutable_entries()) {
+    if (existing.obfuscated_username() == obfuscated) {
+      entry = &existing;
+      break;
+    }
+  }
+  if (!entry) {
+    entry = index.add_entries();
+    entry->set_obfuscated_username(obfuscated);
+  }
+  entry->set_last_activity_timestamp(timestamp.ToInternalValue());
+  WriteActivityIndex(&index);
+}
+
+void HomeDirs::SaveLoadedTimestampsToActivityIndex() {
+  if (loaded_timestamps_.empty())
+    return;
+  base::AutoLock lock(g_activity_index_lock.Get());
+  UserActivityIndex index;
+  ReadActivityIndex(&index);
+  // Users may have been mounted or unmounted since the keysets were read, in
+  // which case the index already holds a newer timestamp.
+  for (const auto& entry : index.entries())
+    loaded_timestamps_.erase(entry.obfuscated_username());
+  for (const auto& loaded : loaded_timestamps_) {
+    UserActivityIndex::Entry* entry = index.add_entries();
+    entry->set_obfuscated_username(loaded.first);
+    entry->set_last_activity_timestamp(loaded.second.ToInternalValue());
+  }
+  loaded_timestamps_.clear();
+  WriteActivityIndex(&index);
+}
+
 bool HomeDirs::LoadVaultKeysetForUser(const std::string& obfuscated_user,
                                       int index,
                                       VaultKeyset* keyset) const {
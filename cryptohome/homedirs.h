@@ -10,6 +10,7 @@
 
 #include <stdint.h>
 
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -30,6 +31,7 @@
 #include "cryptohome/vault_keyset_factory.h"
 
 #include "rpc.pb.h"  // NOLINT(build/include)
+#include "user_activity_index.pb.h"  // NOLINT(build/include)
 #include "vault_keyset.pb.h"  // NOLINT(build/include)
 
 namespace cryptohome {
@@ -38,6 +40,8 @@ const int64_t kFreeSpaceThresholdToTriggerCleanup = 1LL << 30;
 const int64_t kTargetFreeSpaceAfterCleanup = 2LL << 30;
 extern const char kGCacheFilesAttribute[];
 extern const char kAndroidCacheFilesAttribute[];
+extern const char kActivityIndexFile[];
+extern const char kLastValidKeysetFile[];
 
 class Credentials;
 class Platform;
@@ -80,6 +84,16 @@ class HomeDirs {
   virtual bool GetVaultKeysets(const std::string& obfuscated,
                                std::vector<int>* keysets) const;
 
+  // Moves the keyset that last accepted the credentials of the |obfuscated|
+  // user to the front of |keysets|, so that credentials without a label are
+  // tried against it first.
+  virtual void PrioritizeLastValidKeyset(const std::string& obfuscated,
+                                         std::vector<int>* keysets) const;
+
+  // Remembers that the keyset at |index| accepted the credentials of the
+  // |obfuscated| user, for PrioritizeLastValidKeyset().
+  virtual void SetLastValidKeyset(const std::string& obfuscated, int index);
+
   // Outputs a list of present keysets by label for a given credential.
   // There is no guarantee the keysets are valid nor is the ordering guaranteed.
   // Returns true on success, false if no keysets are found.
@@ -106,6 +120,11 @@ class HomeDirs {
   // Computes the size of cryptohome for the named user.
   virtual int64_t ComputeSize(const std::string& account_id);
 
+  // Records |timestamp| as the last activity time of the cryptohome of the
+  // |obfuscated| user in the activity index kept in the shadow root.
+  virtual void UpdateActivityIndex(const std::string& obfuscated,
+                                   base::Time timestamp);
+
   // Returns true if the supplied Credentials are a valid (username, passkey)
   // pair.
   virtual bool AreCredentialsValid(const Credentials& credentials);
@@ -250,8 +269,20 @@ class HomeDirs {
   // the same as the obfuscated owner name.
   void RemoveNonOwnerDirectories(const base::FilePath& prefix);
   // Callback used during FreeDiskSpace() if the timestamp cache is not yet
-  // initialized. Loads the last activity timestamp from the vault keyset.
+  // initialized. Takes the last activity timestamp from |activity_index_|, or
+  // loads it from the vault keysets for users missing from the index.
   void AddUserTimestampToCacheCallback(const base::FilePath& user_dir);
+  // Returns the path of the persistent user activity index.
+  base::FilePath GetActivityIndexPath() const;
+  // Reads the activity index. Returns false if it does not exist or cannot be
+  // parsed. The caller must hold the activity index lock.
+  bool ReadActivityIndex(UserActivityIndex* index) const;
+  // Writes |index| back, dropping users whose shadow directory no longer
+  // exists. The caller must hold the activity index lock.
+  bool WriteActivityIndex(UserActivityIndex* index);
+  // Adds the timestamps in |loaded_timestamps_| to the activity index for
+  // users that are still missing from it.
+  void SaveLoadedTimestampsToActivityIndex();
   // Loads the serialized vault keyset for the supplied obfuscated username.
   // Returns true for success, false for failure.
   bool LoadVaultKeysetForUser(const std::string& obfuscated_user,
@@ -281,6 +312,12 @@ class HomeDirs {
   VaultKeysetFactory* vault_keyset_factory_;
   brillo::SecureBlob system_salt_;
   chaps::TokenManagerClient chaps_client_;
+  // Snapshot of the activity index by obfuscated username, taken by
+  // FreeDiskSpace() before it removes users.
+  std::map<std::string, UserActivityIndex::Entry> activity_index_;
+  // Timestamps that AddUserTimestampToCacheCallback() loaded from vault
+  // keysets because the users were missing from |activity_index_|.
+  std::map<std::string, base::Time> loaded_timestamps_;
 
   friend class HomeDirsTest;
   FRIEND_TEST(HomeDirsTest, GetTrackedDirectoryForDirCrypto);
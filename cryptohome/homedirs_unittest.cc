@@ -116,6 +116,9 @@ class HomeDirsTest : public ::testing::Test {
     EXPECT_CALL(platform_, FileExists(
         Property(&FilePath::value, EndsWith(kTrackedDirectoriesJsonFile))))
         .WillRepeatedly(Return(false));
+    // No activity index unless a test provides one.
+    EXPECT_CALL(platform_, FileExists(kTestRoot.Append(kActivityIndexFile)))
+        .WillRepeatedly(Return(false));
 
     test_helper_.SetUpSystemSalt();
     // TODO(wad) Only generate the user data we need. This is time consuming.
@@ -160,6 +163,27 @@ class HomeDirsTest : public ::testing::Test {
     homedirs_.own_policy_provider(new policy::PolicyProvider(device_policy));
   }
 
+  // Makes the activity index in the shadow root read as |index|.
+  void SetActivityIndex(const UserActivityIndex& index) {
+    std::string serialized;
+    ASSERT_TRUE(index.SerializeToString(&serialized));
+    EXPECT_CALL(platform_, FileExists(kTestRoot.Append(kActivityIndexFile)))
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(platform_,
+                ReadFileToString(kTestRoot.Append(kActivityIndexFile), _))
+        .WillRepeatedly(DoAll(SetArgPointee<1>(serialized), Return(true)));
+  }
+
+  // Adds an entry for the user of |homedir_paths_[user]| to |index|, with the
+  // timestamp of |homedir_times_[user]|.
+  UserActivityIndex::Entry* AddActivityIndexEntry(UserActivityIndex* index,
+                                                  size_t user) {
+    UserActivityIndex::Entry* entry = index->add_entries();
+    entry->set_obfuscated_username(homedir_paths_[user].BaseName().value());
+    entry->set_last_activity_timestamp(homedir_times_[user].ToInternalValue());
+    return entry;
+  }
+
  protected:
   MakeTests test_helper_;
   NiceMock<MockPlatform> platform_;
@@ -320,6 +344,43 @@ TEST_F(HomeDirsTest, GetTrackedDirectoryForDirCrypto) {
       temp_dir.path(), FilePath(FILE_PATH_LITERAL("aaa/zzz")), &result));
 }
 
+TEST_F(HomeDirsTest, UpdateActivityIndex) {
+  UserActivityIndex index;
+  AddActivityIndexEntry(&index, 0);
+  UserActivityIndex::Entry* removed = index.add_entries();
+  removed->set_obfuscated_username("removed");
+  removed->set_last_activity_timestamp(time_jan1.ToInternalValue());
+  SetActivityIndex(index);
+
+  EXPECT_CALL(platform_, DirectoryExists(_))
+    .WillRepeatedly(Return(true));
+  EXPECT_CALL(platform_, DirectoryExists(kTestRoot.Append("removed")))
+    .WillRepeatedly(Return(false));
+  std::string written;
+  EXPECT_CALL(platform_, WriteStringToFileAtomicDurable(
+        kTestRoot.Append(kActivityIndexFile), _, 0600))
+    .WillRepeatedly(DoAll(SaveArg<1>(&written), Return(true)));
+
+  // Users whose shadow directory is gone are forgotten.
+  const std::string obfuscated = homedir_paths_[0].BaseName().value();
+  homedirs_.UpdateActivityIndex(obfuscated, time_apr5);
+  UserActivityIndex updated;
+  ASSERT_TRUE(updated.ParseFromString(written));
+  ASSERT_EQ(1, updated.entries_size());
+  EXPECT_EQ(obfuscated, updated.entries(0).obfuscated_username());
+  EXPECT_EQ(time_apr5.ToInternalValue(),
+            updated.entries(0).last_activity_timestamp());
+
+  // New users are added.
+  const std::string new_user = homedir_paths_[1].BaseName().value();
+  homedirs_.UpdateActivityIndex(new_user, time_apr5);
+  ASSERT_TRUE(updated.ParseFromString(written));
+  ASSERT_EQ(2, updated.entries_size());
+  EXPECT_EQ(new_user, updated.entries(1).obfuscated_username());
+  EXPECT_EQ(time_apr5.ToInternalValue(),
+            updated.entries(1).last_activity_timestamp());
+}
+
 class FreeDiskSpaceTest : public HomeDirsTest {
  public:
   FreeDiskSpaceTest() { }
@@ -536,6 +597,37 @@ TEST_F(FreeDiskSpaceTest, InitializeTimeCacheWithOneTime) {
   EXPECT_FALSE(homedirs_.FreeDiskSpace());
 }
 
+TEST_F(FreeDiskSpaceTest, InitializeTimeCacheFromActivityIndex) {
+  // Users found in the activity index get their timestamp from it, without
+  // loading any vault keyset.
+  UserActivityIndex index;
+  for (size_t i = 0; i < arraysize(kHomedirs); ++i)
+    AddActivityIndexEntry(&index, i);
+  SetActivityIndex(index);
+
+  EXPECT_CALL(timestamp_cache_, initialized())
+    .WillOnce(Return(false));
+  EXPECT_CALL(timestamp_cache_, Initialize())
+    .Times(1);
+  for (size_t i = 0; i < arraysize(kHomedirs); ++i) {
+    EXPECT_CALL(timestamp_cache_,
+                AddExistingUser(homedir_paths_[i], homedir_times_[i]))
+      .Times(1);
+  }
+  EXPECT_CALL(vault_keyset_factory_, New(_, _))
+    .Times(0);
+  homedirs_.set_vault_keyset_factory(&vault_keyset_factory_);
+  // Nothing new was learned, so the index is not rewritten.
+  EXPECT_CALL(platform_, WriteStringToFileAtomicDurable(_, _, _))
+    .Times(0);
+
+  // Now skip the deletion steps by not having a legit owner.
+  set_policy(false, "", false, "");
+
+  ExpectCacheDirCleanupCalls(4);
+  EXPECT_FALSE(homedirs_.FreeDiskSpace());
+}
+
 TEST_F(FreeDiskSpaceTest, NoCacheCleanup) {
   // Pretend we have lots of free space
   EXPECT_CALL(platform_, AmountOfFreeDiskSpace(kTestRoot))
@@ -1286,6 +1378,78 @@ class KeysetManagementTest : public HomeDirsTest {
   SerializedVaultKeyset serialized_;
 };
 
+TEST_F(KeysetManagementTest, GetValidKeysetTriesLastValidKeysetFirst) {
+  KeysetSetUp();
+  const FilePath& user_dir = test_helper_.users[1].base_path;
+  const std::string obfuscated = user_dir.BaseName().value();
+
+  NiceMock<MockFileEnumerator>* files = new NiceMock<MockFileEnumerator>();
+  EXPECT_CALL(*files, Next())
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 0)))
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 1)))
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 2)))
+    .WillRepeatedly(Return(FilePath()));
+  EXPECT_CALL(platform_, GetFileEnumerator(user_dir, false, _))
+    .WillOnce(Return(files));
+  EXPECT_CALL(platform_,
+              ReadFileToString(user_dir.Append(kLastValidKeysetFile), _))
+    .WillRepeatedly(DoAll(SetArgPointee<1>(std::string("2")), Return(true)));
+
+  // Only the keyset that was valid last time is decrypted, and the hint does
+  // not need to be rewritten.
+  MockVaultKeyset vk;
+  EXPECT_CALL(vk, Load(homedirs_.GetVaultKeysetPath(obfuscated, 2)))
+    .WillOnce(Return(true));
+  EXPECT_CALL(vk, serialized())
+    .WillRepeatedly(ReturnRef(serialized_));
+  EXPECT_CALL(vk, Decrypt(_))
+    .WillOnce(Return(true));
+  EXPECT_CALL(platform_, WriteFileAtomic(_, _, _))
+    .Times(0);
+
+  EXPECT_TRUE(homedirs_.GetValidKeyset(*up_, &vk));
+}
+
+TEST_F(KeysetManagementTest, GetValidKeysetRemembersValidKeyset) {
+  KeysetSetUp();
+  const FilePath& user_dir = test_helper_.users[1].base_path;
+  const std::string obfuscated = user_dir.BaseName().value();
+
+  NiceMock<MockFileEnumerator>* files = new NiceMock<MockFileEnumerator>();
+  EXPECT_CALL(*files, Next())
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 0)))
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 1)))
+    .WillOnce(Return(homedirs_.GetVaultKeysetPath(obfuscated, 2)))
+    .WillRepeatedly(Return(FilePath()));
+  EXPECT_CALL(platform_, GetFileEnumerator(user_dir, false, _))
+    .WillOnce(Return(files));
+  EXPECT_CALL(platform_,
+              ReadFileToString(user_dir.Append(kLastValidKeysetFile), _))
+    .WillRepeatedly(Return(false));
+
+  // Keysets are tried in order until one accepts the credentials.
+  MockVaultKeyset vk;
+  {
+    InSequence s;
+    EXPECT_CALL(vk, Load(homedirs_.GetVaultKeysetPath(obfuscated, 0)))
+      .WillOnce(Return(true));
+    EXPECT_CALL(vk, Decrypt(_))
+      .WillOnce(Return(false));
+    EXPECT_CALL(vk, Load(homedirs_.GetVaultKeysetPath(obfuscated, 1)))
+      .WillOnce(Return(true));
+    EXPECT_CALL(vk, Decrypt(_))
+      .WillOnce(Return(true));
+  }
+  EXPECT_CALL(vk, serialized())
+    .WillRepeatedly(ReturnRef(serialized_));
+  const brillo::Blob expected_hint = {'1'};
+  EXPECT_CALL(platform_, WriteFileAtomic(user_dir.Append(kLastValidKeysetFile),
+                                         expected_hint, 0600))
+    .WillOnce(Return(true));
+
+  EXPECT_TRUE(homedirs_.GetValidKeyset(*up_, &vk));
+}
+
 TEST_F(KeysetManagementTest, AddKeysetSuccess) {
   KeysetSetUp();
 
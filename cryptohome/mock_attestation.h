@@ -34,6 +34,8 @@ class MockAttestation : public Attestation {
   MOCK_METHOD0(PrepareForEnrollment, void());
   MOCK_METHOD0(CacheEndorsementData, void());
   MOCK_METHOD0(PrepareForEnrollmentAsync, void());
+  MOCK_METHOD0(RefillKeyPool, void());
+  MOCK_METHOD0(RefillKeyPoolAsync, void());
   MOCK_METHOD1(Verify, bool(bool));
   MOCK_METHOD1(VerifyEK, bool(bool));
   MOCK_METHOD2(CreateEnrollRequest, bool(Attestation::PCAType,
@@ -35,6 +35,9 @@ class MockHomeDirs : public HomeDirs {
   MOCK_CONST_METHOD1(GetVaultKeyset, VaultKeyset*(const Credentials&));
   MOCK_CONST_METHOD2(GetVaultKeysets,
                      bool(const std::string&, std::vector<int>*));
+  MOCK_CONST_METHOD2(PrioritizeLastValidKeyset,
+                     void(const std::string&, std::vector<int>*));
+  MOCK_METHOD2(SetLastValidKeyset, void(const std::string&, int));
   MOCK_CONST_METHOD2(GetVaultKeysetLabels, bool(const Credentials&,
                                                 std::vector<std::string>*));
   MOCK_METHOD5(AddKeyset, CryptohomeErrorCode(const Credentials&,
@@ -47,6 +50,7 @@ class MockHomeDirs : public HomeDirs {
   MOCK_METHOD2(ForceRemoveKeyset, bool(const std::string&, int));
   MOCK_METHOD3(MoveKeyset, bool(const std::string&, int, int));
   MOCK_METHOD0(AmountOfFreeDiskSpace, int64_t(void));
+  MOCK_METHOD2(UpdateActivityIndex, void(const std::string&, base::Time));
 
   // Some unit tests require that MockHomeDirs actually call the real
   // GetPlainOwner() function. In those cases, you can use this function
@@ -1004,6 +1004,7 @@ bool Mount::UpdateCurrentUserActivityTimestamp(int time_shift_sec) {
       user_timestamp_cache_->UpdateExistingUser(
           FilePath(GetUserDirectoryForUser(obfuscated_username)), timestamp);
     }
+    homedirs_->UpdateActivityIndex(obfuscated_username, timestamp);
     return true;
   }
   return false;
@@ -1134,6 +1135,8 @@ bool Mount::DecryptVaultKeyset(const Credentials& credentials,
   if (!homedirs_->GetVaultKeysets(obfuscated_username, &key_indices)) {
     LOG(WARNING) << "No valid keysets on disk for " << obfuscated_username;
   }
+  if (credentials.key_data().label().empty())
+    homedirs_->PrioritizeLastValidKeyset(obfuscated_username, &key_indices);
   for (auto key_index : key_indices) {
     // Load the encrypted keyset
     if (!LoadVaultKeysetForUser(obfuscated_username, key_index, serialized)) {
@@ -1172,6 +1175,8 @@ bool Mount::DecryptVaultKeyset(const Credentials& credentials,
       // Success!
       *error = MOUNT_ERROR_NONE;
       *index = key_index;
+      if (key_indices.size() > 1)
+        homedirs_->SetLastValidKeyset(obfuscated_username, key_index);
       break;
     }
 
@@ -1232,6 +1232,10 @@ TEST_P(MountTest, UserActivityTimestampUpdated) {
   EXPECT_CALL(platform_, Unmount(_, _, _))
       .Times(ShouldTestEcryptfs() ? 5 : 4)
       .WillRepeatedly(Return(true));
+  EXPECT_CALL(homedirs_, UpdateActivityIndex(
+        user->obfuscated_username,
+        base::Time::FromInternalValue(kMagicTimestamp2)))
+      .Times(1);
   mount_->UnmountCryptohome();
   SerializedVaultKeyset serialized2;
   ASSERT_TRUE(serialized2.ParseFromArray(updated_keyset.data(),
@@ -18,15 +18,18 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/xattr.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <limits>
 #include <sstream>
 #include <utility>
@@ -35,6 +38,7 @@
 #include <base/callback.h>
 #include <base/files/file_path.h>
 #include <base/files/file_util.h>
+#include <base/files/scoped_file.h>
 #include <base/location.h>
 #include <base/logging.h>
 #include <base/posix/eintr_wrapper.h>
@@ -42,7 +46,10 @@
 #include <base/strings/string_split.h>
 #include <base/strings/string_util.h>
 #include <base/strings/stringprintf.h>
+#include <base/synchronization/condition_variable.h>
+#include <base/synchronization/lock.h>
 #include <base/sys_info.h>
+#include <base/threading/platform_thread.h>
 #include <base/threading/thread.h>
 #include <base/time/time.h>
 #include <brillo/process.h>
@@ -62,6 +69,11 @@ extern "C" {
 #include "cryptohome/cryptohome_metrics.h"
 #include "cryptohome/dircrypto_util.h"
 
+// Older kernel headers lack the reflink ioctl.
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 using base::FilePath;
 using base::SplitString;
 using base::StringPrintf;
@@ -92,6 +104,20 @@ bool IsDirectory(const struct stat& file_info) {
   return !!S_ISDIR(file_info.st_mode);
 }
 
+// The most threads that ComputeDirectorySize() walks a tree with.
+const int kMaxDirectorySizeThreads = 4;
+
+// The most directories that the directory size cache holds before it starts
+// over.
+const size_t kMaxCachedDirectories = 100000;
+
+// The most threads that Copy() and CopyWithPermissions() copy files with.
+const int kMaxCopyThreads = 4;
+
+// The size of the buffer used to copy files that can't be copied in the
+// kernel.
+const size_t kCopyBufferSize = 128 * 1024;
+
 }  // namespace
 
 namespace cryptohome {
@@ -114,6 +140,493 @@ Platform::Platform() {
 Platform::~Platform() {
 }
 
+// What ComputeDirectorySize() read from a single directory.
+struct DirectoryContents {
+  DirectoryContents() : file_bytes(0) {}
+
+  // The total size of the entries that are not directories.
+  int64_t file_bytes;
+  std::vector<std::string> subdirectories;
+};
+
+// The contents of the directories read by ComputeDirectorySize(), keyed by
+// device and inode. A directory's entry is valid while its mtime and ctime are
+// unchanged, which is the case until an entry is added, removed or renamed.
+class DirectorySizeCache {
+ public:
+  explicit DirectorySizeCache(base::TimeDelta max_age) : max_age_(max_age) {}
+
+  bool Lookup(const struct stat& dir_info, DirectoryContents* contents) {
+    base::AutoLock lock(lock_);
+    auto it = entries_.find(std::make_pair(dir_info.st_dev, dir_info.st_ino));
+    if (it == entries_.end())
+      return false;
+    const Entry& entry = it->second;
+    if (!IsSameTime(entry.mtime, dir_info.st_mtim) ||
+        !IsSameTime(entry.ctime, dir_info.st_ctim) ||
+        base::TimeTicks::Now() - entry.cached_at > max_age_) {
+      entries_.erase(it);
+      return false;
+    }
+    *contents = entry.contents;
+    return true;
+  }
+
+  void Store(const struct stat& dir_info, const DirectoryContents& contents) {
+    base::AutoLock lock(lock_);
+    if (entries_.size() >= kMaxCachedDirectories)
+      entries_.clear();
+    Entry& entry = entries_[std::make_pair(dir_info.st_dev, dir_info.st_ino)];
+    entry.mtime = dir_info.st_mtim;
+    entry.ctime = dir_info.st_ctim;
+    entry.cached_at = base::TimeTicks::Now();
+    entry.contents = contents;
+  }
+
+ private:
+  struct Entry {
+    struct timespec mtime;
+    struct timespec ctime;
+    base::TimeTicks cached_at;
+    DirectoryContents contents;
+  };
+
+  static bool IsSameTime(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+  }
+
+  base::Lock lock_;
+  base::TimeDelta max_age_;
+  std::map<std::pair<dev_t, ino_t>, Entry> entries_;
+
+  DISALLOW_COPY_AND_ASSIGN(DirectorySizeCache);
+};
+
+namespace {
+
+// Reads the entries of the directory at |path| with getdents() and, for those
+// that aren't known to be directories, fstatat(). Symbolic links are only
+// followed if |follow_links| is true, and then only for |path| itself.
+bool ReadDirectoryContents(const FilePath& path,
+                           bool follow_links,
+                           DirectorySizeCache* cache,
+                           DirectoryContents* contents) {
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (!follow_links)
+    flags |= O_NOFOLLOW;
+  int fd = HANDLE_EINTR(open(path.value().c_str(), flags));
+  if (fd < 0)
+    return false;
+  // Without the directory's own stat, the cache can't be used.
+  struct stat dir_info;
+  if (cache && fstat(fd, &dir_info) != 0)
+    cache = nullptr;
+  if (cache && cache->Lookup(dir_info, contents)) {
+    IGNORE_EINTR(close(fd));
+    return true;
+  }
+  DIR* dir = fdopendir(fd);
+  if (!dir) {
+    IGNORE_EINTR(close(fd));
+    return false;
+  }
+  while (struct dirent* entry = readdir(dir)) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    if (entry->d_type == DT_DIR) {
+      contents->subdirectories.push_back(entry->d_name);
+      continue;
+    }
+    struct stat file_info;
+    if (fstatat(fd, entry->d_name, &file_info, AT_SYMLINK_NOFOLLOW) != 0)
+      continue;
+    if (IsDirectory(file_info))
+      contents->subdirectories.push_back(entry->d_name);
+    else
+      contents->file_bytes += file_info.st_size;
+  }
+  closedir(dir);
+  if (cache)
+    cache->Store(dir_info, *contents);
+  return true;
+}
+
+// Walks a directory tree on several threads and adds up the size of its
+// files. Threads take directories off a shared stack, read them, and push
+// their subdirectories back.
+class DirectorySizeWalker : public base::PlatformThread::Delegate {
+ public:
+  explicit DirectorySizeWalker(DirectorySizeCache* cache)
+      : cache_(cache),
+        pending_changed_(&lock_),
+        busy_threads_(0),
+        total_bytes_(0) {}
+
+  int64_t Walk(const FilePath& path) {
+    DirectoryContents root;
+    if (!ReadDirectoryContents(path, true, cache_, &root))
+      return 0;
+    total_bytes_ = root.file_bytes;
+    for (const std::string& name : root.subdirectories)
+      pending_.push_back(path.Append(name));
+    if (pending_.empty())
+      return total_bytes_;
+
+    int num_threads = std::min(base::SysInfo::NumberOfProcessors(),
+                               kMaxDirectorySizeThreads);
+    std::vector<base::PlatformThreadHandle> threads;
+    for (int i = 1; i < num_threads; ++i) {
+      base::PlatformThreadHandle thread;
+      if (!base::PlatformThread::Create(0, this, &thread)) {
+        LOG(WARNING) << "Failed to create a directory size thread.";
+        break;
+      }
+      threads.push_back(thread);
+    }
+    ThreadMain();
+    for (const base::PlatformThreadHandle& thread : threads)
+      base::PlatformThread::Join(thread);
+    return total_bytes_;
+  }
+
+  void ThreadMain() override {
+    base::AutoLock lock(lock_);
+    while (true) {
+      while (pending_.empty() && busy_threads_ > 0)
+        pending_changed_.Wait();
+      if (pending_.empty())
+        return;
+      FilePath path = pending_.back();
+      pending_.pop_back();
+      ++busy_threads_;
+      DirectoryContents contents;
+      bool read = false;
+      {
+        base::AutoUnlock unlock(lock_);
+        read = ReadDirectoryContents(path, false, cache_, &contents);
+      }
+      --busy_threads_;
+      if (read) {
+        total_bytes_ += contents.file_bytes;
+        for (const std::string& name : contents.subdirectories)
+          pending_.push_back(path.Append(name));
+      }
+      // Wakes up idle threads for the new directories, or to finish when
+      // there is nothing left.
+      if (!pending_.empty() || busy_threads_ == 0)
+        pending_changed_.Broadcast();
+    }
+  }
+
+ private:
+  DirectorySizeCache* cache_;  // May be NULL.
+  base::Lock lock_;
+  base::ConditionVariable pending_changed_;
+  std::vector<FilePath> pending_;
+  int busy_threads_;
+  int64_t total_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(DirectorySizeWalker);
+};
+
+// Copies |size| bytes from |from_fd| to |to_fd|. The data is shared with a
+// reflink if the file system supports it, copied by the kernel with
+// copy_file_range() otherwise, and read and written as a last resort. Both
+// descriptors must be at offset 0.
+bool CopyFileData(int from_fd, int to_fd, off_t size) {
+  if (size > 0 && ioctl(to_fd, FICLONE, from_fd) == 0)
+    return true;
+#if defined(__NR_copy_file_range)
+  off_t copied = 0;
+  while (copied < size) {
+    ssize_t bytes = syscall(__NR_copy_file_range, from_fd, nullptr, to_fd,
+                            nullptr, size - copied, 0);
+    // The call may be unsupported or unable to copy across file systems. The
+    // file offsets have moved past what was copied, so the loop below picks up
+    // from there.
+    if (bytes <= 0)
+      break;
+    copied += bytes;
+  }
+#endif
+  std::vector<char> buffer(kCopyBufferSize);
+  while (true) {
+    ssize_t bytes = HANDLE_EINTR(read(from_fd, buffer.data(), buffer.size()));
+    if (bytes < 0)
+      return false;
+    if (bytes == 0)
+      return true;
+    if (!base::WriteFileDescriptor(to_fd, buffer.data(), bytes))
+      return false;
+  }
+}
+
+// Copies the extended attributes of |from_fd| to |to_fd|. Attributes that
+// cannot be set on |to_path| are logged and skipped.
+void CopyExtendedAttributes(int from_fd, int to_fd, const FilePath& to_path) {
+  ssize_t names_size = flistxattr(from_fd, nullptr, 0);
+  if (names_size <= 0)
+    return;
+  std::vector<char> names(names_size);
+  names_size = flistxattr(from_fd, names.data(), names.size());
+  if (names_size <= 0)
+    return;
+  std::vector<char> value;
+  for (const char* name = names.data(); name < names.data() + names_size;
+       name += strlen(name) + 1) {
+    ssize_t value_size = fgetxattr(from_fd, name, nullptr, 0);
+    if (value_size < 0)
+      continue;
+    value.resize(value_size);
+    value_size = fgetxattr(from_fd, name, value.data(), value.size());
+    if (value_size < 0)
+      continue;
+    if (fsetxattr(to_fd, name, value.data(), value_size, 0) != 0 &&
+        errno != ENOTSUP) {
+      PLOG(WARNING) << "Failed to copy extended attribute " << name << " to "
+                    << to_path.value();
+    }
+  }
+}
+
+// Gives |to_fd| the ownership, extended attributes and permissions of
+// |from_fd|, which are described by |from_info|.
+bool CopyAttributes(int from_fd,
+                    int to_fd,
+                    const struct stat& from_info,
+                    const FilePath& to_path) {
+  if (fchown(to_fd, from_info.st_uid, from_info.st_gid) != 0) {
+    PLOG(ERROR) << "Failed to set ownership for " << to_path.value();
+    return false;
+  }
+  CopyExtendedAttributes(from_fd, to_fd, to_path);
+  // Set last, since changing the owner drops the set-user-ID and set-group-ID
+  // bits.
+  const mode_t permissions_mask = 07777;
+  if (fchmod(to_fd, from_info.st_mode & permissions_mask) != 0) {
+    PLOG(ERROR) << "Failed to set permissions for " << to_path.value();
+    return false;
+  }
+  return true;
+}
+
+// Copies a directory tree, or a single file, in one pass. The calling thread
+// walks the source and creates the directories, while regular files are queued
+// and copied by up to kMaxCopyThreads threads. Symbolic links and special
+// files are skipped, as base::CopyDirectory() does. If |preserve_attributes|
+// is true, every copy also gets the ownership, permissions and extended
+// attributes of its source; otherwise permissions are kept as
+// base::CopyDirectory() keeps them.
+class TreeCopier : public base::PlatformThread::Delegate {
+ public:
+  explicit TreeCopier(bool preserve_attributes)
+      : preserve_attributes_(preserve_attributes),
+        files_changed_(&lock_),
+        walk_done_(false),
+        failed_(false) {}
+
+  // Copies |from| to |to|, which must be the path of the copy itself.
+  bool Copy(const FilePath& from, const FilePath& to) {
+    struct stat from_info;
+    if (stat(from.value().c_str(), &from_info) != 0)
+      return false;
+    if (S_ISREG(from_info.st_mode))
+      return CopyFile(from, to, from_info);
+    if (!S_ISDIR(from_info.st_mode)) {
+      LOG(WARNING) << "Skipping non-regular file " << from.value();
+      return true;
+    }
+
+    int num_threads = std::min(base::SysInfo::NumberOfProcessors(),
+                               kMaxCopyThreads);
+    std::vector<base::PlatformThreadHandle> threads;
+    for (int i = 1; i < num_threads; ++i) {
+      base::PlatformThreadHandle thread;
+      if (!base::PlatformThread::Create(0, this, &thread)) {
+        LOG(WARNING) << "Failed to create a copy thread.";
+        break;
+      }
+      threads.push_back(thread);
+    }
+    bool walked = Walk(from, to, from_info);
+    {
+      base::AutoLock lock(lock_);
+      walk_done_ = true;
+      if (!walked)
+        failed_ = true;
+      files_changed_.Broadcast();
+    }
+    // Help with the files that are still queued.
+    ThreadMain();
+    for (const base::PlatformThreadHandle& thread : threads)
+      base::PlatformThread::Join(thread);
+    if (failed_)
+      return false;
+
+    // Directories were created writable so that they could be filled. Their
+    // own attributes are applied last, deepest first.
+    if (preserve_attributes_) {
+      for (auto it = directories_.rbegin(); it != directories_.rend(); ++it) {
+        if (!CopyDirectoryAttributes(it->from, it->to, it->info))
+          return false;
+      }
+    }
+    return true;
+  }
+
+  void ThreadMain() override {
+    base::AutoLock lock(lock_);
+    while (true) {
+      while (files_.empty() && !walk_done_ && !failed_)
+        files_changed_.Wait();
+      if (files_.empty() || failed_)
+        return;
+      Entry file = files_.back();
+      files_.pop_back();
+      bool copied = false;
+      {
+        base::AutoUnlock unlock(lock_);
+        copied = CopyFile(file.from, file.to, file.info);
+      }
+      if (!copied) {
+        failed_ = true;
+        files_changed_.Broadcast();
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    FilePath from;
+    FilePath to;
+    struct stat info;
+  };
+
+  // Creates the directories below |from| under |to| and queues the files.
+  bool Walk(const FilePath& from, const FilePath& to,
+            const struct stat& from_info) {
+    if (!CreateDirectory(from, to, from_info))
+      return false;
+    std::vector<std::pair<FilePath, FilePath>> pending;
+    pending.push_back(std::make_pair(from, to));
+    while (!pending.empty()) {
+      {
+        base::AutoLock lock(lock_);
+        if (failed_)
+          return false;
+      }
+      FilePath from_dir = pending.back().first;
+      FilePath to_dir = pending.back().second;
+      pending.pop_back();
+      DIR* dir = opendir(from_dir.value().c_str());
+      if (!dir) {
+        PLOG(ERROR) << "Failed to open " << from_dir.value();
+        return false;
+      }
+      while (struct dirent* entry = readdir(dir)) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0)
+          continue;
+        Entry child;
+        child.from = from_dir.Append(entry->d_name);
+        child.to = to_dir.Append(entry->d_name);
+        if (fstatat(dirfd(dir), entry->d_name, &child.info,
+                    AT_SYMLINK_NOFOLLOW) != 0) {
+          PLOG(ERROR) << "Failed to stat " << child.from.value();
+          closedir(dir);
+          return false;
+        }
+        if (S_ISDIR(child.info.st_mode)) {
+          if (!CreateDirectory(child.from, child.to, child.info)) {
+            closedir(dir);
+            return false;
+          }
+          pending.push_back(std::make_pair(child.from, child.to));
+        } else if (S_ISREG(child.info.st_mode)) {
+          base::AutoLock lock(lock_);
+          files_.push_back(child);
+          files_changed_.Signal();
+        } else {
+          DLOG(WARNING) << "Skipping non-regular file " << child.from.value();
+        }
+      }
+      closedir(dir);
+    }
+    return true;
+  }
+
+  bool CreateDirectory(const FilePath& from, const FilePath& to,
+                       const struct stat& from_info) {
+    mode_t mode = preserve_attributes_ ? S_IRWXU :
+        (from_info.st_mode & 01777) | S_IRWXU;
+    if (mkdir(to.value().c_str(), mode) != 0 &&
+        (errno != EEXIST || !base::DirectoryExists(to))) {
+      PLOG(ERROR) << "Failed to create " << to.value();
+      return false;
+    }
+    if (preserve_attributes_)
+      directories_.push_back({from, to, from_info});
+    return true;
+  }
+
+  bool CopyFile(const FilePath& from, const FilePath& to,
+                const struct stat& from_info) {
+    base::ScopedFD from_fd(HANDLE_EINTR(
+        open(from.value().c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    if (!from_fd.is_valid()) {
+      PLOG(ERROR) << "Failed to open " << from.value();
+      return false;
+    }
+    mode_t mode = preserve_attributes_ ? S_IRUSR | S_IWUSR :
+        from_info.st_mode & 0777;
+    base::ScopedFD to_fd(HANDLE_EINTR(
+        open(to.value().c_str(),
+             O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, mode)));
+    if (!to_fd.is_valid()) {
+      PLOG(ERROR) << "Failed to create " << to.value();
+      return false;
+    }
+    if (!CopyFileData(from_fd.get(), to_fd.get(), from_info.st_size)) {
+      PLOG(ERROR) << "Failed to copy " << from.value();
+      return false;
+    }
+    if (preserve_attributes_ &&
+        !CopyAttributes(from_fd.get(), to_fd.get(), from_info, to))
+      return false;
+    if (IGNORE_EINTR(close(to_fd.release())) != 0) {
+      PLOG(ERROR) << "Failed to close " << to.value();
+      return false;
+    }
+    return true;
+  }
+
+  bool CopyDirectoryAttributes(const FilePath& from, const FilePath& to,
+                               const struct stat& from_info) {
+    const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+    base::ScopedFD from_fd(HANDLE_EINTR(open(from.value().c_str(), flags)));
+    base::ScopedFD to_fd(HANDLE_EINTR(open(to.value().c_str(), flags)));
+    if (!from_fd.is_valid() || !to_fd.is_valid()) {
+      PLOG(ERROR) << "Failed to open " << from.value() << " or "
+                  << to.value();
+      return false;
+    }
+    return CopyAttributes(from_fd.get(), to_fd.get(), from_info, to);
+  }
+
+  const bool preserve_attributes_;
+  // Only touched by the walking thread.
+  std::vector<Entry> directories_;
+  base::Lock lock_;
+  base::ConditionVariable files_changed_;
+  std::vector<Entry> files_;
+  bool walk_done_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(TreeCopier);
+};
+
+}  // namespace
+
 /*
  * Split a /proc/<id>/mountinfo line in arguments,
  * Point to the file system type, first argument after the optional
@@ -501,7 +1014,15 @@ bool Platform::GetFileSize(const FilePath& path, int64_t* size) {
 }
 
 int64_t Platform::ComputeDirectorySize(const FilePath& path) {
-  return base::ComputeDirectorySize(path);
+  DirectorySizeWalker walker(directory_size_cache_.get());
+  return walker.Walk(path);
+}
+
+void Platform::SetDirectorySizeCacheMaxAge(base::TimeDelta max_age) {
+  if (max_age.is_zero())
+    directory_size_cache_.reset();
+  else
+    directory_size_cache_.reset(new DirectorySizeCache(max_age));
 }
 
 FILE* Platform::CreateAndOpenTemporaryFile(FilePath* path) {
@@ -861,62 +1382,40 @@ bool Platform::Rename(const FilePath& from, const FilePath& to) {
 }
 
 bool Platform::Copy(const FilePath& from, const FilePath& to) {
-  return base::CopyDirectory(from, to, true);
-}
-
-bool Platform::CopyPermissionsCallback(
-    const FilePath& old_base,
-    const FilePath& new_base,
-    const FilePath& file_path,
-    const struct stat& file_info) {
-  // Find the new path that corresponds with the old path given by file_info.
-  FilePath old_path = file_path;
-  FilePath new_path = new_base;
-  if (old_path != old_base) {
-    if (old_path.IsAbsolute()) {
-      if (!old_base.AppendRelativePath(old_path, &new_path)) {
-        LOG(ERROR) << "AppendRelativePath failed: parent="
-                   << old_base.value() << ", child=" << old_path.value();
-        return false;
-      }
-    } else {
-      new_path = new_base.Append(old_path);
-    }
-  }
-  if (!SetOwnership(new_path,
-                    file_info.st_uid,
-                    file_info.st_gid,
-                    true /* follow_links */)) {
-    PLOG(ERROR) << "Failed to set ownership for " << new_path.value();
+  // Like base::CopyDirectory(), copy into |to| if it is an existing directory.
+  FilePath target = base::DirectoryExists(to) ? to.Append(from.BaseName()) : to;
+  FilePath real_from = base::MakeAbsoluteFilePath(from);
+  FilePath real_target_parent = base::MakeAbsoluteFilePath(target.DirName());
+  if (real_from.empty() || real_target_parent.empty())
     return false;
-  }
-  const mode_t permissions_mask = 07777;
-  if (!SetPermissions(new_path, file_info.st_mode & permissions_mask)) {
-    PLOG(ERROR) << "Failed to set permissions for " << new_path.value();
+  FilePath real_target = real_target_parent.Append(target.BaseName());
+  if (real_from == real_target || real_from.IsParent(real_target)) {
+    LOG(ERROR) << "Cannot copy " << from.value() << " into itself";
     return false;
   }
-  return true;
+  TreeCopier copier(false /* preserve_attributes */);
+  return copier.Copy(from, target);
 }
 
 bool Platform::CopyWithPermissions(const FilePath& from_path,
                                    const FilePath& to_path) {
-  if (!Copy(from_path, to_path)) {
-    PLOG(ERROR) << "Failed to copy " << from_path.value();
+  // |to_path| becomes the copy of |from_path| itself, so it must not exist
+  // yet.
+  if (base::PathExists(to_path)) {
+    LOG(ERROR) << "Copy destination already exists: " << to_path.value();
     return false;
   }
 
   // If something goes wrong we want to blow away the half-baked path.
   ScopedPath scoped_new_path(this, to_path);
 
-  // Unfortunately, ownership and permissions are not always retained.
-  // Apply the old ownership / permissions on a per-file basis.
-  FileEnumeratorCallback callback = base::Bind(
-      &Platform::CopyPermissionsCallback,
-      base::Unretained(this),
-      from_path,
-      to_path);
-  if (!WalkPath(from_path, callback))
+  // Ownership, permissions and extended attributes are applied to each file
+  // as it is copied.
+  TreeCopier copier(true /* preserve_attributes */);
+  if (!copier.Copy(from_path, to_path)) {
+    PLOG(ERROR) << "Failed to copy " << from_path.value();
     return false;
+  }
 
   // The copy is done, keep the new path.
   scoped_new_path.release();
@@ -19,6 +19,7 @@
 #include <base/files/file_enumerator.h>
 #include <base/files/file_path.h>
 #include <base/macros.h>
+#include <base/time/time.h>
 #include <brillo/secure_blob.h>
 #include <gtest/gtest_prod.h>
 
@@ -38,6 +39,7 @@ namespace cryptohome {
 // Default umask
 extern const int kDefaultUmask;
 
+class DirectorySizeCache;
 class ProcessInformation;
 
 // A class for enumerating the files in a provided path. The order of the
@@ -280,13 +282,25 @@ class Platform {
   // Returns true if the size was acquired and false otherwise.
   virtual bool GetFileSize(const base::FilePath& path, int64_t* size);
 
-  // Returns the size of a directory at |path| if it exists.
+  // Returns the size of a directory at |path| if it exists. The tree is walked
+  // by several threads, and symbolic links are not followed below |path|.
   //
   // Parameters
   //   path - Path of the directory to check
   // Returns the directory size if it was acquired, and -1 on failure.
   virtual int64_t ComputeDirectorySize(const base::FilePath& path);
 
+  // Makes ComputeDirectorySize() remember the files and subdirectories of each
+  // directory it reads, and reuse them for up to |max_age| while the directory
+  // is unchanged. Growing or shrinking an existing file does not change its
+  // directory, so such changes may go unnoticed for up to |max_age|. A zero
+  // |max_age|, the default, disables the cache. This must not be called while
+  // ComputeDirectorySize() runs on another thread.
+  //
+  // Parameters
+  //   max_age - How long a directory is reused for
+  virtual void SetDirectorySizeCacheMaxAge(base::TimeDelta max_age);
+
   // Opens a file, if possible, returning a FILE*. If not, returns NULL.
   //
   // Parameters
@@ -513,10 +527,14 @@ class Platform {
   // Returns the current time.
   virtual base::Time GetCurrentTime() const;
 
-  // Copies from to to.
+  // Copies from to to. Like base::CopyDirectory(), a directory is copied
+  // recursively, into |to| if that is an existing directory, and symbolic links
+  // are skipped. Files are cloned or copied in the kernel where the file system
+  // allows it, on several threads.
   virtual bool Copy(const base::FilePath& from, const base::FilePath& to);
 
-  // Copies and retains permissions and ownership.
+  // Copies |from| to |to|, which must not exist, and retains permissions,
+  // ownership and extended attributes. On failure nothing is left at |to|.
   virtual bool CopyWithPermissions(const base::FilePath& from,
                                    const base::FilePath& to);
 
@@ -661,13 +679,6 @@ class Platform {
   bool WalkPath(const base::FilePath& path,
                 const FileEnumeratorCallback& callback);
 
-  // Copies permissions from a file specified by |file_path| and |file_info| to
-  // another file with the same name but a child of |new_base|, not |old_base|.
-  bool CopyPermissionsCallback(const base::FilePath& old_base,
-                               const base::FilePath& new_base,
-                               const base::FilePath& file_path,
-                               const struct stat& file_info);
-
   // Applies ownership and permissions to a single file or directory.
   //
   // Parameters
@@ -704,6 +715,7 @@ class Platform {
                           size_t* file_system_type_idx);
 
   base::FilePath mount_info_path_;
+  std::unique_ptr<DirectorySizeCache> directory_size_cache_;
 
   friend class PlatformTest;
   FRIEND_TEST(PlatformTest, DecodeProcInfoLineCorruptedMountInfo);
@@ -262,6 +262,114 @@ TEST_F(PlatformTest, SyncDirectoryHasSaneReturnCodes) {
   platform_.DeleteFile(dirname, true /* recursive */);
 }
 
+TEST_F(PlatformTest, ComputeDirectorySizeMatchesBase) {
+  const FilePath dirname(GetTempName());
+  ASSERT_TRUE(platform_.CreateDirectory(dirname));
+  for (int i = 0; i < 20; ++i) {
+    const FilePath subdir =
+        dirname.Append(std::to_string(i)).Append(std::to_string(i % 3));
+    ASSERT_TRUE(platform_.CreateDirectory(subdir));
+    ASSERT_TRUE(platform_.WriteStringToFile(subdir.Append("file"),
+                                            std::string(100 * i, 'a')));
+  }
+  ASSERT_TRUE(platform_.WriteStringToFile(dirname.Append(".hidden"), "bla"));
+  // Links are not followed, so the tree is not counted twice.
+  ASSERT_TRUE(base::CreateSymbolicLink(dirname, dirname.Append("link")));
+  EXPECT_EQ(base::ComputeDirectorySize(dirname),
+            platform_.ComputeDirectorySize(dirname));
+  EXPECT_EQ(0, platform_.ComputeDirectorySize(dirname.Append("missing")));
+  platform_.DeleteFile(dirname, true /* recursive */);
+}
+
+TEST_F(PlatformTest, ComputeDirectorySizeCached) {
+  const FilePath dirname(GetTempName());
+  const FilePath subdir = dirname.Append("sub");
+  ASSERT_TRUE(platform_.CreateDirectory(subdir));
+  ASSERT_TRUE(platform_.WriteStringToFile(subdir.Append("a"), "0123456789"));
+  platform_.SetDirectorySizeCacheMaxAge(base::TimeDelta::FromMinutes(1));
+  EXPECT_EQ(10, platform_.ComputeDirectorySize(dirname));
+  // Adding a file changes its directory.
+  ASSERT_TRUE(platform_.WriteStringToFile(subdir.Append("b"), "01234"));
+  EXPECT_EQ(15, platform_.ComputeDirectorySize(dirname));
+  // Growing a file doesn't, so the cached size is used until it expires.
+  ASSERT_TRUE(platform_.WriteStringToFile(subdir.Append("b"), "0123456789"));
+  EXPECT_EQ(15, platform_.ComputeDirectorySize(dirname));
+  platform_.SetDirectorySizeCacheMaxAge(base::TimeDelta());
+  EXPECT_EQ(20, platform_.ComputeDirectorySize(dirname));
+  platform_.DeleteFile(dirname, true /* recursive */);
+}
+
+TEST_F(PlatformTest, CopyTree) {
+  const FilePath from(GetTempName());
+  for (int i = 0; i < 20; ++i) {
+    const FilePath subdir =
+        from.Append(std::to_string(i % 4)).Append(std::to_string(i % 3));
+    ASSERT_TRUE(platform_.CreateDirectory(subdir));
+    ASSERT_TRUE(platform_.WriteStringToFile(
+        subdir.Append(std::to_string(i)), std::string(1000 * i, 'a' + i)));
+  }
+  ASSERT_TRUE(platform_.WriteStringToFile(from.Append("empty"), ""));
+  ASSERT_TRUE(base::CreateSymbolicLink(from, from.Append("link")));
+
+  const FilePath to(GetTempName());
+  ASSERT_TRUE(platform_.Copy(from, to));
+  for (int i = 0; i < 20; ++i) {
+    const FilePath file = FilePath(std::to_string(i % 4))
+                              .Append(std::to_string(i % 3))
+                              .Append(std::to_string(i));
+    std::string content;
+    EXPECT_TRUE(platform_.ReadFileToString(to.Append(file), &content));
+    EXPECT_EQ(std::string(1000 * i, 'a' + i), content);
+  }
+  EXPECT_TRUE(platform_.FileExists(to.Append("empty")));
+  // Links are skipped, like base::CopyDirectory() does.
+  EXPECT_FALSE(platform_.FileExists(to.Append("link")));
+
+  // Copying into an existing directory creates a copy inside of it.
+  ASSERT_TRUE(platform_.Copy(from.Append("0"), to));
+  EXPECT_TRUE(platform_.FileExists(
+      to.Append("0").Append("0").Append("0")));
+  // A tree cannot be copied into itself.
+  EXPECT_FALSE(platform_.Copy(from, from.Append("1")));
+  platform_.DeleteFile(from, true /* recursive */);
+  platform_.DeleteFile(to, true /* recursive */);
+}
+
+TEST_F(PlatformTest, CopyWithPermissions) {
+  const FilePath from(GetTempName());
+  const FilePath subdir = from.Append("sub");
+  ASSERT_TRUE(platform_.CreateDirectory(subdir));
+  ASSERT_TRUE(platform_.WriteStringToFile(subdir.Append("file"), "bla"));
+  ASSERT_TRUE(platform_.SetPermissions(subdir.Append("file"), 0640));
+  const std::string name("user.foo");
+  const std::string value("bar");
+  ASSERT_EQ(0, setxattr(subdir.Append("file").value().c_str(), name.c_str(),
+                        value.c_str(), value.length(), 0));
+  // A read-only directory still gets its files.
+  ASSERT_TRUE(platform_.SetPermissions(subdir, 0510));
+
+  const FilePath to(GetTempName());
+  ASSERT_TRUE(platform_.CopyWithPermissions(from, to));
+  mode_t mode = 0;
+  EXPECT_TRUE(platform_.GetPermissions(to.Append("sub"), &mode));
+  EXPECT_EQ(0510, mode & 07777);
+  EXPECT_TRUE(platform_.GetPermissions(to.Append("sub").Append("file"), &mode));
+  EXPECT_EQ(0640, mode & 07777);
+  std::string copied_value;
+  EXPECT_TRUE(platform_.GetExtendedFileAttributeAsString(
+      to.Append("sub").Append("file"), name, &copied_value));
+  EXPECT_EQ(value, copied_value);
+
+  // The destination must not exist yet, and is left alone.
+  EXPECT_FALSE(platform_.CopyWithPermissions(from, to));
+  EXPECT_TRUE(platform_.DirectoryExists(to.Append("sub")));
+
+  ASSERT_TRUE(platform_.SetPermissions(subdir, 0700));
+  ASSERT_TRUE(platform_.SetPermissions(to.Append("sub"), 0700));
+  platform_.DeleteFile(from, true /* recursive */);
+  platform_.DeleteFile(to, true /* recursive */);
+}
+
 TEST_F(PlatformTest, HasExtendedFileAttribute) {
   const FilePath filename(GetTempName());
   const std::string content("blablabla");
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <memory>
 #include <utility>
 
@@ -48,6 +49,7 @@
 #include "cryptohome/platform.h"
 #include "cryptohome/stateful_recovery.h"
 #include "cryptohome/tpm.h"
+#include "cryptohome/tpm_command_stats.h"
 #include "cryptohome/username_passkey.h"
 
 #include "key.pb.h"  // NOLINT(build/include)
@@ -85,7 +87,13 @@ const char kChapsSystemToken[] = "/var/lib/chaps";
 const int kAutoCleanupPeriodMS = 1000 * 60 * 60;  // 1 hour
 const int kUpdateUserActivityPeriod = 24;  // divider of the former
 const int kLowDiskNotificationPeriodMS = 1000 * 60 * 1;  // 1 minute
+// While requests are pending on the mount thread, automatic disk cleanup is
+// retried this often instead of running, up to kMaxAutoCleanupDeferrals times
+// in a row so that a steady stream of requests cannot starve it.
+const int kAutoCleanupRetryPeriodMS = 1000;  // 1 second
+const int kMaxAutoCleanupDeferrals = 60;
 const int64_t kNotifyDiskSpaceThreshold = 1 << 30;  // 1GB
+const int kDirectorySizeCacheMaxAgeSec = 60;
 const int kDefaultRandomSeedLength = 64;
 const char kMountThreadName[] = "MountThread";
 const char kTpmInitStatusEventType[] = "TpmInitStatus";
@@ -182,7 +190,9 @@ Service::Service()
       boot_lockbox_(nullptr),
       boot_attributes_(nullptr),
       firmware_management_parameters_(nullptr),
-      low_disk_notification_period_ms_(kLowDiskNotificationPeriodMS) {
+      low_disk_notification_period_ms_(kLowDiskNotificationPeriodMS),
+      pending_mount_thread_tasks_(0),
+      auto_cleanup_deferrals_(0) {
 }
 
 Service::~Service() {
@@ -403,6 +413,10 @@ bool Service::Initialize() {
     return false;
   if (!homedirs_->Init(platform_, crypto_, user_timestamp_cache_.get()))
     return false;
+  // Disk usage queries reuse what they read from directories that have not
+  // changed since.
+  platform_->SetDirectorySizeCacheMaxAge(
+      base::TimeDelta::FromSeconds(kDirectorySizeCacheMaxAgeSec));
 
   // If the TPM is unowned or doesn't exist, it's safe for
   // this function to be called again. However, it shouldn't
@@ -590,7 +604,7 @@ void Service::InitializePkcs11(cryptohome::Mount* mount) {
       new MountTaskPkcs11Init(bridge, mount);
   LOG(INFO) << "Putting a Pkcs11_Initialize on the mount thread.";
   pkcs11_tasks_[pkcs11_init_task->sequence_id()] = pkcs11_init_task.get();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskInitPkcs11,
       base::Bind(&MountTaskPkcs11Init::Run, pkcs11_init_task.get()));
 }
 
@@ -714,12 +728,12 @@ void Service::InitializeTpmComplete(bool status, bool took_ownership) {
     for (const auto& mount_pair : mounts_) {
       scoped_refptr<MountTaskResetTpmContext> mount_task =
           new MountTaskResetTpmContext(NULL, mount_pair.second.get());
-      mount_thread_.message_loop()->PostTask(FROM_HERE,
+      PostMountThreadTask(FROM_HERE, kMountThreadTaskInitTpm,
           base::Bind(&MountTaskResetTpmContext::Run, mount_task.get()));
     }
     mounts_lock_.Release();
   }
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskInitTpm,
       base::Bind(&Service::InitializeTpmFinalize, base::Unretained(this),
                  status, took_ownership));
 }
@@ -782,7 +796,7 @@ gboolean Service::CheckKey(gchar *userid,
       new MountTaskTestCredentials(NULL, NULL, homedirs_, credentials);
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskCheckKey,
       base::Bind(&MountTaskTestCredentials::Run, mount_task.get()));
   event.Wait();
   *OUT_result = result.return_status();
@@ -815,7 +829,7 @@ gboolean Service::AsyncCheckKey(gchar *userid,
   scoped_refptr<MountTaskTestCredentials> mount_task
       = new MountTaskTestCredentials(bridge, NULL, homedirs_, credentials);
   *OUT_async_id = mount_task->sequence_id();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskCheckKey,
       base::Bind(&MountTaskTestCredentials::Run, mount_task.get()));
   return TRUE;
 }
@@ -888,7 +902,7 @@ gboolean Service::CheckKeyEx(GArray* account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskCheckKey,
       base::Bind(&Service::DoCheckKeyEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -963,7 +977,7 @@ gboolean Service::RemoveKeyEx(GArray* account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskRemoveKey,
       base::Bind(&Service::DoRemoveKeyEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -1023,7 +1037,7 @@ gboolean Service::ListKeysEx(GArray* account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskListKeys,
       base::Bind(&Service::DoListKeysEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -1102,7 +1116,7 @@ gboolean Service::GetKeyDataEx(GArray* account_id,
   }
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskGetKeyData,
       base::Bind(&Service::DoGetKeyDataEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -1125,7 +1139,7 @@ gboolean Service::MigrateKey(gchar *userid,
       new MountTaskMigratePasskey(NULL, homedirs_, credentials, from_key);
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMigrateKey,
       base::Bind(&MountTaskMigratePasskey::Run, mount_task.get()));
   event.Wait();
   *OUT_result = result.return_status();
@@ -1145,7 +1159,7 @@ gboolean Service::AsyncMigrateKey(gchar *userid,
   scoped_refptr<MountTaskMigratePasskey> mount_task =
       new MountTaskMigratePasskey(bridge, homedirs_, credentials, from_key);
   *OUT_async_id = mount_task->sequence_id();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMigrateKey,
       base::Bind(&MountTaskMigratePasskey::Run, mount_task.get()));
   return TRUE;
 }
@@ -1164,7 +1178,7 @@ gboolean Service::AddKey(gchar *userid,
       new MountTaskAddPasskey(NULL, homedirs_, credentials, new_key);
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskAddKey,
       base::Bind(&MountTaskAddPasskey::Run, mount_task.get()));
   event.Wait();
   *OUT_key_id = result.return_code();
@@ -1184,7 +1198,7 @@ gboolean Service::AsyncAddKey(gchar *userid,
   scoped_refptr<MountTaskAddPasskey> mount_task =
       new MountTaskAddPasskey(bridge, homedirs_, credentials, new_key);
   *OUT_async_id = mount_task->sequence_id();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskAddKey,
       base::Bind(&MountTaskAddPasskey::Run, mount_task.get()));
   return TRUE;
 }
@@ -1283,7 +1297,7 @@ gboolean Service::AddKeyEx(GArray* account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskAddKey,
       base::Bind(&Service::DoAddKeyEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -1378,7 +1392,7 @@ gboolean Service::UpdateKeyEx(GArray* account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskUpdateKey,
       base::Bind(&Service::DoUpdateKeyEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -1405,7 +1419,7 @@ gboolean Service::Remove(gchar *userid,
       new MountTaskRemove(bridge, NULL, credentials, homedirs_);
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskRemove,
       base::Bind(&MountTaskRemove::Run, mount_task.get()));
   event.Wait();
   *OUT_result = result.return_status();
@@ -1422,14 +1436,14 @@ gboolean Service::AsyncRemove(gchar *userid,
     scoped_refptr<MountTaskNop> mount_task = new MountTaskNop(bridge);
     mount_task->result()->set_return_status(false);
     *OUT_async_id = mount_task->sequence_id();
-    mount_thread_.message_loop()->PostTask(FROM_HERE,
+    PostMountThreadTask(FROM_HERE, kMountThreadTaskRemove,
         base::Bind(&MountTaskNop::Run, mount_task.get()));
   } else {
     UsernamePasskey credentials(userid, brillo::Blob());
     scoped_refptr<MountTaskRemove> mount_task =
         new MountTaskRemove(bridge, NULL, credentials, homedirs_);
     *OUT_async_id = mount_task->sequence_id();
-    mount_thread_.message_loop()->PostTask(FROM_HERE,
+    PostMountThreadTask(FROM_HERE, kMountThreadTaskRemove,
         base::Bind(&MountTaskRemove::Run, mount_task.get()));
   }
   return TRUE;
@@ -1449,8 +1463,8 @@ gboolean Service::RenameCryptohome(const GArray* account_id_from,
   }
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskRename,
       base::Bind(&Service::DoRenameCryptohome, base::Unretained(this),
                  base::Owned(id_from.release()), base::Owned(id_to.release()),
                  base::Unretained(response)));
@@ -1495,8 +1509,8 @@ gboolean Service::GetAccountDiskUsage(const GArray* account_id,
   }
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskGetAccountDiskUsage,
       base::Bind(&Service::DoGetAccountDiskUsage, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Unretained(response)));
@@ -1681,7 +1695,7 @@ gboolean Service::Mount(const gchar *userid,
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
 
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMount,
       base::Bind(&MountTaskMount::Run, mount_task.get()));
   event.Wait();
   // We only report successful mounts.
@@ -1906,7 +1920,7 @@ gboolean Service::MountEx(const GArray *account_id,
     request.reset(NULL);
 
   // If PBs don't parse, the validation in the handler will catch it.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMount,
       base::Bind(&Service::DoMountEx, base::Unretained(this),
                  base::Owned(identifier.release()),
                  base::Owned(authorization.release()),
@@ -2012,7 +2026,7 @@ void Service::DoAsyncMount(const std::string& userid,
   if (install_attrs_->is_first_install()) {
     MountTaskInstallAttrsFinalize *finalize =
         new MountTaskInstallAttrsFinalize(NULL, install_attrs_);
-    mount_thread_.message_loop()->PostTask(FROM_HERE,
+    PostMountThreadTask(FROM_HERE, kMountThreadTaskMount,
         base::Bind(&MountTaskInstallAttrsFinalize::Run, finalize));
   }
 
@@ -2050,7 +2064,7 @@ gboolean Service::AsyncMount(const gchar *userid,
             << " for later PKCS#11 initialization.";
 
   // Just pass the task and the args.
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMount,
       base::Bind(&Service::DoAsyncMount, base::Unretained(this),
                  std::string(userid),
                  base::Owned(key_blob.release()),
@@ -2083,7 +2097,7 @@ gboolean Service::MountGuest(gint *OUT_error_code,
       = new MountTaskMountGuest(NULL, guest_mount.get());
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMountGuest,
       base::Bind(&MountTaskMountGuest::Run, mount_task.get()));
   event.Wait();
   // We only report successful mounts.
@@ -2125,7 +2139,7 @@ gboolean Service::AsyncMountGuest(gint *OUT_async_id,
       = new MountTaskMountGuest(bridge, guest_mount.get());
   mount_task->result()->set_guest(true);
   *OUT_async_id = mount_task->sequence_id();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMountGuest,
       base::Bind(&MountTaskMountGuest::Run, mount_task.get()));
   return TRUE;
 }
@@ -2182,7 +2196,7 @@ gboolean Service::AsyncMountPublic(const gchar* public_mount_id,
 
 
   // This should really call DoAsyncMount
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskMount,
       base::Bind(&Service::DoAsyncMount, base::Unretained(this),
                  std::string(public_mount_id),
                  base::Owned(key_blob.release()),
@@ -2216,7 +2230,7 @@ gboolean Service::DoAutomaticFreeDiskSpaceControl(gboolean *OUT_result,
       new MountTaskAutomaticFreeDiskSpace(bridge, homedirs_);
   mount_task->set_result(&result);
   mount_task->set_complete_event(&event);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskFreeDiskSpace,
       base::Bind(&MountTaskAutomaticFreeDiskSpace::Run, mount_task.get()));
   event.Wait();
   *OUT_result = result.return_status();
@@ -2230,7 +2244,7 @@ gboolean Service::AsyncDoAutomaticFreeDiskSpaceControl(gint *OUT_async_id,
   scoped_refptr<MountTaskAutomaticFreeDiskSpace> mount_task =
       new MountTaskAutomaticFreeDiskSpace(bridge, homedirs_);
   *OUT_async_id = mount_task->sequence_id();
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskFreeDiskSpace,
       base::Bind(&MountTaskAutomaticFreeDiskSpace::Run, mount_task.get()));
   return TRUE;
 }
@@ -2504,7 +2518,7 @@ void Service::DoSignBootLockbox(const brillo::SecureBlob& request,
 
 gboolean Service::SignBootLockbox(const GArray* request,
                                   DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootLockbox,
       base::Bind(&Service::DoSignBootLockbox, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2530,7 +2544,7 @@ void Service::DoVerifyBootLockbox(const brillo::SecureBlob& request,
 
 gboolean Service::VerifyBootLockbox(const GArray* request,
                                     DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootLockbox,
       base::Bind(&Service::DoVerifyBootLockbox, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2553,7 +2567,7 @@ void Service::DoFinalizeBootLockbox(const brillo::SecureBlob& request,
 
 gboolean Service::FinalizeBootLockbox(const GArray* request,
                                       DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootLockbox,
       base::Bind(&Service::DoFinalizeBootLockbox, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2579,7 +2593,7 @@ void Service::DoGetBootAttribute(const brillo::SecureBlob& request,
 
 gboolean Service::GetBootAttribute(const GArray* request,
                                    DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootAttributes,
       base::Bind(&Service::DoGetBootAttribute, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2600,7 +2614,7 @@ void Service::DoSetBootAttribute(const brillo::SecureBlob& request,
 
 gboolean Service::SetBootAttribute(const GArray* request,
                                    DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootAttributes,
       base::Bind(&Service::DoSetBootAttribute, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2623,7 +2637,7 @@ void Service::DoFlushAndSignBootAttributes(const brillo::SecureBlob& request,
 
 gboolean Service::FlushAndSignBootAttributes(const GArray* request,
                                              DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskBootAttributes,
       base::Bind(&Service::DoFlushAndSignBootAttributes, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2650,7 +2664,7 @@ void Service::DoGetLoginStatus(const brillo::SecureBlob& request,
 
 gboolean Service::GetLoginStatus(const GArray* request,
                                  DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskGetLoginStatus,
       base::Bind(&Service::DoGetLoginStatus, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2702,7 +2716,7 @@ void Service::DoGetTpmStatus(const brillo::SecureBlob& request,
 
 gboolean Service::GetTpmStatus(const GArray* request,
                                DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskGetTpmStatus,
       base::Bind(&Service::DoGetTpmStatus, base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
                  base::Unretained(context)));
@@ -2742,7 +2756,7 @@ void Service::DoGetFirmwareManagementParameters(
 
 gboolean Service::GetFirmwareManagementParameters(const GArray* request,
     DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskFirmwareManagementParameters,
       base::Bind(&Service::DoGetFirmwareManagementParameters,
                  base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
@@ -2789,7 +2803,7 @@ void Service::DoSetFirmwareManagementParameters(
 
 gboolean Service::SetFirmwareManagementParameters(const GArray* request,
                           DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskFirmwareManagementParameters,
       base::Bind(&Service::DoSetFirmwareManagementParameters,
                  base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
@@ -2819,7 +2833,7 @@ void Service::DoRemoveFirmwareManagementParameters(
 
 gboolean Service::RemoveFirmwareManagementParameters(const GArray* request,
                              DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskFirmwareManagementParameters,
       base::Bind(&Service::DoRemoveFirmwareManagementParameters,
                  base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
@@ -2856,6 +2870,7 @@ gboolean Service::GetStatusString(gchar** OUT_status, GError** error) {
   tpm->SetBoolean("enabled", tpm_->IsEnabled());
   tpm->SetBoolean("owned", tpm_->IsOwned());
   tpm->SetBoolean("being_owned", tpm_->IsBeingOwned());
+  tpm->Set("commands", TpmCommandStats::GetInstance()->GetStatus());
 
   dv.Set("mounts", std::move(mounts));
   dv.Set("installattrs", std::move(attrs));
@@ -2867,10 +2882,44 @@ gboolean Service::GetStatusString(gchar** OUT_status, GError** error) {
   return TRUE;
 }
 
+void Service::PostMountThreadTask(const tracked_objects::Location& from_here,
+                                  MountThreadTask task_type,
+                                  const base::Closure& task) {
+  base::subtle::NoBarrier_AtomicIncrement(&pending_mount_thread_tasks_, 1);
+  mount_thread_.message_loop()->PostTask(from_here,
+      base::Bind(&Service::RunMountThreadTask, base::Unretained(this),
+                 task_type, base::TimeTicks::Now(), task));
+}
+
+// Called on Mount thread.
+void Service::RunMountThreadTask(MountThreadTask task_type,
+                                 base::TimeTicks posted_time,
+                                 const base::Closure& task) {
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  task.Run();
+  base::subtle::NoBarrier_AtomicIncrement(&pending_mount_thread_tasks_, -1);
+  ReportMountThreadTaskTimes(task_type, start_time - posted_time,
+                             base::TimeTicks::Now() - start_time);
+}
+
 // Called on Mount thread.
 void Service::AutoCleanupCallback() {
   static int ticks;
 
+  // Disk cleanup may take a while, and requests queued behind it would have to
+  // wait for it. Let them go first.
+  if (base::subtle::NoBarrier_Load(&pending_mount_thread_tasks_) > 0 &&
+      auto_cleanup_deferrals_ < kMaxAutoCleanupDeferrals) {
+    ++auto_cleanup_deferrals_;
+    mount_thread_.message_loop()->PostDelayedTask(
+        FROM_HERE,
+        base::Bind(&Service::AutoCleanupCallback, base::Unretained(this)),
+        base::TimeDelta::FromMilliseconds(
+            std::min(auto_cleanup_period_, kAutoCleanupRetryPeriodMS)));
+    return;
+  }
+  auto_cleanup_deferrals_ = 0;
+
   // Update current user's activity timestamp every day.
   if (++ticks > update_user_activity_period_) {
     mounts_lock_.Acquire();
@@ -2886,6 +2935,9 @@ void Service::AutoCleanupCallback() {
   // Reset the dictionary attack counter if possible and necessary.
   ResetDictionaryAttackMitigation();
 
+  // Top up the attestation key pool in the background.
+  AttestationRefillKeyPool();
+
   // Schedule our next call. If the thread is terminating, we would
   // not be called. We use base::Unretained here because the Service object is
   // never destroyed.
@@ -3090,7 +3142,7 @@ int Service::PostAsyncCallResult(MountTaskObserver* bridge,
   scoped_refptr<MountTaskNop> mount_task = new MountTaskNop(bridge);
   mount_task->result()->set_return_code(return_code);
   mount_task->result()->set_return_status(return_status);
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskAsyncCallResult,
       base::Bind(&MountTaskNop::Run, mount_task.get()));
 
   return mount_task->sequence_id();
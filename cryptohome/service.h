@@ -10,11 +10,15 @@
 #include <string>
 #include <vector>
 
+#include <base/atomicops.h>
+#include <base/callback.h>
 #include <base/files/file_path.h>
+#include <base/location.h>
 #include <base/logging.h>
 #include <base/gtest_prod_util.h>
 #include <base/memory/ref_counted.h>
 #include <base/threading/thread.h>
+#include <base/time/time.h>
 #include <brillo/glib/abstract_dbus_service.h>
 #include <brillo/glib/dbus.h>
 #include <brillo/glib/object.h>
@@ -23,6 +27,7 @@
 #include <dbus/dbus-glib.h>
 
 #include "cryptohome/cryptohome_event_source.h"
+#include "cryptohome/cryptohome_metrics.h"
 #include "cryptohome/dbus_transition.h"
 #include "cryptohome/firmware_management_parameters.h"
 #include "cryptohome/install_attributes.h"
@@ -389,6 +394,9 @@ class Service : public brillo::dbus::AbstractDbusService,
   virtual void AttestationInitializeTpm() = 0;
   // Called from Service::InitializeTpmComplete().
   virtual void AttestationInitializeTpmComplete() = 0;
+  // Called from Service::AutoCleanupCallback() to pre-create certified keys
+  // while the mount thread is idle.
+  virtual void AttestationRefillKeyPool() = 0;
   // Called from Service::DoGetTpmStatus to fill attestation-related fields.
   virtual void AttestationGetTpmStatus(GetTpmStatusReply* reply) = 0;
   // Called from Service::ResetDictionaryAttackMitigation()
@@ -757,6 +765,14 @@ class Service : public brillo::dbus::AbstractDbusService,
                                     MountError return_code,
                                     bool return_status);
 
+  // Posts |task| to mount_thread_ on behalf of a request. Tasks run one at a
+  // time in the order they were posted, and periodic housekeeping waits for
+  // the pending ones (see AutoCleanupCallback()). How long each task waits and
+  // runs is reported under |task_type|.
+  void PostMountThreadTask(const tracked_objects::Location& from_here,
+                           MountThreadTask task_type,
+                           const base::Closure& task);
+
   // Stop processing tasks on dbus and mount threads.
   // Must be called from derived destructors. Otherwise, after derived
   // destructor, all pure virtual functions from Service overloaded there and
@@ -796,6 +812,12 @@ class Service : public brillo::dbus::AbstractDbusService,
                                   MountError return_code,
                                   bool return_status);
 
+  // Runs a task of |task_type| posted by PostMountThreadTask() at
+  // |posted_time|, and reports its timings.
+  void RunMountThreadTask(MountThreadTask task_type,
+                          base::TimeTicks posted_time,
+                          const base::Closure& task);
+
   // Called on Mount thread. This method calls ReportDictionaryAttackResetStatus
   // exactly once (i.e. records one sample) with the status of the operation.
   void ResetDictionaryAttackMitigation();
@@ -831,6 +853,10 @@ class Service : public brillo::dbus::AbstractDbusService,
       default_firmware_management_params_;
   FirmwareManagementParameters* firmware_management_parameters_;
   int low_disk_notification_period_ms_;
+  // Tasks posted by PostMountThreadTask() that have not finished running.
+  base::subtle::Atomic32 pending_mount_thread_tasks_;
+  // Consecutive runs of AutoCleanupCallback() postponed for pending tasks.
+  int auto_cleanup_deferrals_;
 
   DISALLOW_COPY_AND_ASSIGN(Service);
 };
@@ -240,6 +240,11 @@ void ServiceDistributed::AttestationInitializeTpmComplete() {
   tpm_init_->RemoveTpmOwnerDependency(Tpm::TpmOwnerDependency::kAttestation);
 }
 
+void ServiceDistributed::AttestationRefillKeyPool() {
+  VLOG(1) << __func__;
+  // Certified keys are created by attestationd.
+}
+
 void ServiceDistributed::AttestationGetTpmStatus(GetTpmStatusReply* reply_out) {
   VLOG(1) << __func__;
   attestation::GetStatusRequest request;
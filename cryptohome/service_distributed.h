@@ -23,6 +23,7 @@ class ServiceDistributed : public Service {
   void AttestationInitialize() override;
   void AttestationInitializeTpm() override;
   void AttestationInitializeTpmComplete() override;
+  void AttestationRefillKeyPool() override;
   void AttestationGetTpmStatus(GetTpmStatusReply* reply) override;
   bool AttestationGetDelegateCredentials(
       brillo::SecureBlob* blob,
@@ -14,6 +14,7 @@
 namespace cryptohome {
 
 const char kRetainEndorsementDataSwitch[] = "retain_endorsement_data";
+const char kAttestationKeyPoolSizeSwitch[] = "attestation_key_pool_size";
 
 // A helper function which maps an integer to a valid CertificateProfile.
 CertificateProfile GetProfile(int profile_value) {
@@ -65,6 +66,18 @@ void ServiceMonolithic::AttestationInitialize() {
     LOG(WARNING) << "Attestation-based enterprise enrollment"
                  << " will not be available.";
 
+  base::CommandLine* cl = base::CommandLine::ForCurrentProcess();
+  if (cl->HasSwitch(kAttestationKeyPoolSizeSwitch)) {
+    std::string value = cl->GetSwitchValueASCII(kAttestationKeyPoolSizeSwitch);
+    int key_pool_size;
+    if (base::StringToInt(value, &key_pool_size) && key_pool_size >= 0) {
+      attestation_->set_key_pool_size(key_pool_size);
+    } else {
+      LOG(WARNING) << "Invalid attestation key pool size, using "
+                   << attestation_->key_pool_size() << ".";
+    }
+  }
+
   // Pass in all the shared dependencies here rather than
   // needing to always get the Attestation object to set them
   // during testing.
@@ -85,6 +98,10 @@ void ServiceMonolithic::AttestationInitializeTpmComplete() {
   attestation_->PrepareForEnrollment();
 }
 
+void ServiceMonolithic::AttestationRefillKeyPool() {
+  attestation_->RefillKeyPoolAsync();
+}
+
 void ServiceMonolithic::AttestationGetTpmStatus(GetTpmStatusReply* reply) {
   reply->set_attestation_prepared(attestation_->IsPreparedForEnrollment());
   reply->set_attestation_enrolled(attestation_->IsEnrolled());
@@ -145,8 +162,8 @@ gboolean ServiceMonolithic::AsyncTpmAttestationCreateEnrollRequest(
       new CreateEnrollRequestTask(observer, attestation_,
                                   GetPCAType(pca_type));
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationEnroll,
       base::Bind(&CreateEnrollRequestTask::Run, task.get()));
   return TRUE;
 }
@@ -174,8 +191,8 @@ gboolean ServiceMonolithic::AsyncTpmAttestationEnroll(
   scoped_refptr<EnrollTask> task =
       new EnrollTask(observer, attestation_, GetPCAType(pca_type), blob);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationEnroll,
       base::Bind(&EnrollTask::Run, task.get()));
   return TRUE;
 }
@@ -217,8 +234,8 @@ gboolean ServiceMonolithic::AsyncTpmAttestationCreateCertRequest(
                                 username,
                                 request_origin);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationCertRequest,
       base::Bind(&CreateCertRequestTask::Run, task.get()));
   return TRUE;
 }
@@ -266,8 +283,8 @@ gboolean ServiceMonolithic::AsyncTpmAttestationFinishCertRequest(
                                 username,
                                 key_name);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationCertRequest,
       base::Bind(&FinishCertRequestTask::Run, task.get()));
   return TRUE;
 }
@@ -342,8 +359,8 @@ gboolean ServiceMonolithic::TpmAttestationRegisterKey(
                           username,
                           key_name);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationRegisterKey,
       base::Bind(&RegisterKeyTask::Run, task.get()));
   return TRUE;
 }
@@ -375,8 +392,8 @@ gboolean ServiceMonolithic::TpmAttestationSignEnterpriseChallenge(
                             include_signed_public_key,
                             challenge_blob);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationSignChallenge,
       base::Bind(&SignChallengeTask::Run, task.get()));
   return TRUE;
 }
@@ -400,8 +417,8 @@ gboolean ServiceMonolithic::TpmAttestationSignSimpleChallenge(
                             key_name,
                             challenge_blob);
   *OUT_async_id = task->sequence_id();
-  mount_thread_.message_loop()->PostTask(
-      FROM_HERE,
+  PostMountThreadTask(
+      FROM_HERE, kMountThreadTaskAttestationSignChallenge,
       base::Bind(&SignChallengeTask::Run, task.get()));
   return TRUE;
 }
@@ -510,7 +527,7 @@ void ServiceMonolithic::DoGetEndorsementInfo(const brillo::SecureBlob& request,
 
 gboolean ServiceMonolithic::GetEndorsementInfo(const GArray* request,
                                      DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskGetEndorsementInfo,
       base::Bind(&ServiceMonolithic::DoGetEndorsementInfo,
                  base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
@@ -605,7 +622,7 @@ void ServiceMonolithic::DoInitializeCastKey(const brillo::SecureBlob& request,
 
 gboolean ServiceMonolithic::InitializeCastKey(const GArray* request,
                                     DBusGMethodInvocation* context) {
-  mount_thread_.message_loop()->PostTask(FROM_HERE,
+  PostMountThreadTask(FROM_HERE, kMountThreadTaskInitializeCastKey,
       base::Bind(&ServiceMonolithic::DoInitializeCastKey,
                  base::Unretained(this),
                  SecureBlob(request->data, request->data + request->len),
@@ -27,6 +27,7 @@ class ServiceMonolithic : public Service {
   void AttestationInitialize() override;
   void AttestationInitializeTpm() override;
   void AttestationInitializeTpmComplete() override;
+  void AttestationRefillKeyPool() override;
   void AttestationGetTpmStatus(GetTpmStatusReply* reply) override;
   bool AttestationGetDelegateCredentials(
       brillo::SecureBlob* blob,
@@ -27,6 +27,7 @@
 #include <trunks/trunks_dbus_proxy.h>
 
 #include "cryptohome/cryptolib.h"
+#include "cryptohome/tpm_command_stats.h"
 
 using brillo::SecureBlob;
 using trunks::GetErrorString;
@@ -175,6 +176,7 @@ void Tpm2Impl::SetIsBeingOwned(bool /* value */) {
 }
 
 bool Tpm2Impl::GetRandomData(size_t length, brillo::Blob* data) {
+  ScopedTpmCommandTimer timer(kTpmCommandGetRandomData);
   CHECK(data);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
@@ -256,6 +258,7 @@ bool Tpm2Impl::WriteNvram(uint32_t index, const SecureBlob& blob) {
 }
 
 bool Tpm2Impl::ReadNvram(uint32_t index, SecureBlob* blob) {
+  ScopedTpmCommandTimer timer(kTpmCommandReadNvram);
   if (!InitializeTpmManagerClients()) {
     return false;
   }
@@ -394,6 +397,7 @@ bool Tpm2Impl::QuotePCR(int pcr_index,
 
 bool Tpm2Impl::SealToPCR0(const brillo::Blob& value,
                           brillo::Blob* sealed_value) {
+  ScopedTpmCommandTimer timer(kTpmCommandSealToPcr0);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
     return false;
@@ -424,6 +428,7 @@ bool Tpm2Impl::SealToPCR0(const brillo::Blob& value,
 }
 
 bool Tpm2Impl::Unseal(const brillo::Blob& sealed_value, brillo::Blob* value) {
+  ScopedTpmCommandTimer timer(kTpmCommandUnseal);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
     return false;
@@ -519,6 +524,7 @@ bool Tpm2Impl::Sign(const SecureBlob& key_blob,
                     const SecureBlob& input,
                     int bound_pcr_index,
                     SecureBlob* signature) {
+  ScopedTpmCommandTimer timer(kTpmCommandSign);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
     return false;
@@ -777,6 +783,7 @@ bool Tpm2Impl::WrapRsaKey(const SecureBlob& public_modulus,
 
 Tpm::TpmRetryAction Tpm2Impl::LoadWrappedKey(const SecureBlob& wrapped_key,
                                              ScopedKeyHandle* key_handle) {
+  ScopedTpmCommandTimer timer(kTpmCommandLoadWrappedKey);
   CHECK(key_handle);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
@@ -818,6 +825,7 @@ Tpm::TpmRetryAction Tpm2Impl::EncryptBlob(TpmKeyHandle key_handle,
                                           const SecureBlob& plaintext,
                                           const SecureBlob& key,
                                           SecureBlob* ciphertext) {
+  ScopedTpmCommandTimer timer(kTpmCommandEncryptBlob);
   CHECK(ciphertext);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
@@ -843,6 +851,7 @@ Tpm::TpmRetryAction Tpm2Impl::DecryptBlob(TpmKeyHandle key_handle,
                                           const SecureBlob& ciphertext,
                                           const SecureBlob& key,
                                           SecureBlob* plaintext) {
+  ScopedTpmCommandTimer timer(kTpmCommandDecryptBlob);
   CHECK(plaintext);
   TrunksClientContext* trunks;
   if (!GetTrunksContext(&trunks)) {
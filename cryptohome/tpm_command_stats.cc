@@ -0,0 +1,119 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "cryptohome/tpm_command_stats.h"
+
+#include <utility>
+
+#include <base/lazy_instance.h>
+#include <base/memory/ptr_util.h>
+
+namespace cryptohome {
+
+namespace {
+
+base::LazyInstance<TpmCommandStats>::Leaky g_tpm_command_stats =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // namespace
+
+const size_t TpmCommandStats::kMaxTraceEntries = 128;
+
+TpmCommandStats::TpmCommandStats() : trace_enabled_(false) {}
+
+TpmCommandStats::~TpmCommandStats() {}
+
+// static
+TpmCommandStats* TpmCommandStats::GetInstance() {
+  return g_tpm_command_stats.Pointer();
+}
+
+void TpmCommandStats::Record(TpmCommand command,
+                             base::Time start_time,
+                             base::TimeDelta duration) {
+  base::AutoLock lock(lock_);
+  CommandTimes& times = times_[command];
+  times.count++;
+  times.total += duration;
+  if (duration > times.max)
+    times.max = duration;
+
+  if (!trace_enabled_)
+    return;
+  if (trace_.size() >= kMaxTraceEntries)
+    trace_.pop_front();
+  trace_.push_back({command, start_time, duration});
+}
+
+void TpmCommandStats::SetTraceEnabled(bool enabled) {
+  base::AutoLock lock(lock_);
+  trace_enabled_ = enabled;
+  if (!enabled)
+    trace_.clear();
+}
+
+int64_t TpmCommandStats::GetCount(TpmCommand command) const {
+  base::AutoLock lock(lock_);
+  return times_[command].count;
+}
+
+base::TimeDelta TpmCommandStats::GetTotalTime(TpmCommand command) const {
+  base::AutoLock lock(lock_);
+  return times_[command].total;
+}
+
+base::TimeDelta TpmCommandStats::GetMaxTime(TpmCommand command) const {
+  base::AutoLock lock(lock_);
+  return times_[command].max;
+}
+
+std::unique_ptr<base::DictionaryValue> TpmCommandStats::GetStatus() const {
+  base::AutoLock lock(lock_);
+  auto status = base::MakeUnique<base::DictionaryValue>();
+  for (int i = 0; i < kNumTpmCommands; ++i) {
+    const CommandTimes& times = times_[i];
+    if (!times.count)
+      continue;
+    auto command = base::MakeUnique<base::DictionaryValue>();
+    command->SetDouble("count", static_cast<double>(times.count));
+    command->SetDouble("total_ms", times.total.InMillisecondsF());
+    command->SetDouble("average_ms",
+                       times.total.InMillisecondsF() / times.count);
+    command->SetDouble("max_ms", times.max.InMillisecondsF());
+    status->SetWithoutPathExpansion(
+        GetTpmCommandName(static_cast<TpmCommand>(i)), std::move(command));
+  }
+  if (trace_enabled_) {
+    auto trace = base::MakeUnique<base::ListValue>();
+    for (const TraceEntry& entry : trace_) {
+      auto item = base::MakeUnique<base::DictionaryValue>();
+      item->SetString("command", GetTpmCommandName(entry.command));
+      item->SetDouble("start", entry.start_time.ToDoubleT());
+      item->SetDouble("duration_ms", entry.duration.InMillisecondsF());
+      trace->Append(std::move(item));
+    }
+    status->Set("trace", std::move(trace));
+  }
+  return status;
+}
+
+void TpmCommandStats::Reset() {
+  base::AutoLock lock(lock_);
+  for (CommandTimes& times : times_)
+    times = CommandTimes();
+  trace_.clear();
+}
+
+ScopedTpmCommandTimer::ScopedTpmCommandTimer(TpmCommand command)
+    : command_(command),
+      start_time_(base::Time::Now()),
+      start_ticks_(base::TimeTicks::Now()) {}
+
+ScopedTpmCommandTimer::~ScopedTpmCommandTimer() {
+  base::TimeDelta duration = base::TimeTicks::Now() - start_ticks_;
+  ReportTpmCommandTime(command_, duration);
+  TpmCommandStats::GetInstance()->Record(command_, start_time_, duration);
+}
+
+}  // namespace cryptohome
@@ -0,0 +1,101 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CRYPTOHOME_TPM_COMMAND_STATS_H_
+#define CRYPTOHOME_TPM_COMMAND_STATS_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+
+#include <base/macros.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+#include <base/values.h>
+
+#include "cryptohome/cryptohome_metrics.h"
+
+namespace cryptohome {
+
+// Keeps latency statistics of the TPM commands issued by cryptohome so that
+// slow logins can be attributed to individual TPM operations. Besides the
+// per-command aggregates, the most recent commands can optionally be kept in a
+// bounded trace. Both are exported through the status string.
+//
+// All methods are thread-safe.
+class TpmCommandStats {
+ public:
+  // Maximum number of commands kept in the trace.
+  static const size_t kMaxTraceEntries;
+
+  TpmCommandStats();
+  ~TpmCommandStats();
+
+  // Returns the process-wide instance used by ScopedTpmCommandTimer.
+  static TpmCommandStats* GetInstance();
+
+  // Records that |command| was started at |start_time| and took |duration|.
+  void Record(TpmCommand command,
+              base::Time start_time,
+              base::TimeDelta duration);
+
+  // Enables or disables the trace of the most recent commands. Disabling the
+  // trace drops the commands recorded so far.
+  void SetTraceEnabled(bool enabled);
+
+  // Returns the number of times |command| was recorded.
+  int64_t GetCount(TpmCommand command) const;
+
+  // Returns the accumulated and the maximum duration of |command|.
+  base::TimeDelta GetTotalTime(TpmCommand command) const;
+  base::TimeDelta GetMaxTime(TpmCommand command) const;
+
+  // Returns the statistics of all the commands recorded so far, keyed by
+  // command name, together with the trace if it is enabled.
+  std::unique_ptr<base::DictionaryValue> GetStatus() const;
+
+  // Forgets all the recorded commands.
+  void Reset();
+
+ private:
+  struct CommandTimes {
+    int64_t count = 0;
+    base::TimeDelta total;
+    base::TimeDelta max;
+  };
+
+  struct TraceEntry {
+    TpmCommand command;
+    base::Time start_time;
+    base::TimeDelta duration;
+  };
+
+  mutable base::Lock lock_;
+  CommandTimes times_[kNumTpmCommands];
+  bool trace_enabled_;
+  std::deque<TraceEntry> trace_;
+
+  DISALLOW_COPY_AND_ASSIGN(TpmCommandStats);
+};
+
+// Measures the time spent in a TPM command from construction to destruction
+// using a monotonic clock. The result is reported to UMA and recorded in
+// TpmCommandStats::GetInstance().
+class ScopedTpmCommandTimer {
+ public:
+  explicit ScopedTpmCommandTimer(TpmCommand command);
+  ~ScopedTpmCommandTimer();
+
+ private:
+  TpmCommand command_;
+  base::Time start_time_;
+  base::TimeTicks start_ticks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedTpmCommandTimer);
+};
+
+}  // namespace cryptohome
+
+#endif  // CRYPTOHOME_TPM_COMMAND_STATS_H_
@@ -0,0 +1,91 @@
+// Copyright 2017 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+//
+// Unit tests for TpmCommandStats.
+
+#include "cryptohome/tpm_command_stats.h"
+
+#include <memory>
+#include <string>
+
+#include <base/time/time.h>
+#include <base/values.h>
+#include <gtest/gtest.h>
+
+namespace cryptohome {
+
+class TpmCommandStatsTest : public ::testing::Test {
+ public:
+  TpmCommandStatsTest() = default;
+  ~TpmCommandStatsTest() override = default;
+
+ protected:
+  void RecordMs(TpmCommand command, int64_t ms) {
+    stats_.Record(command, base::Time::Now(),
+                  base::TimeDelta::FromMilliseconds(ms));
+  }
+
+  TpmCommandStats stats_;
+};
+
+TEST_F(TpmCommandStatsTest, AccumulatesPerCommand) {
+  RecordMs(kTpmCommandUnseal, 100);
+  RecordMs(kTpmCommandUnseal, 300);
+  RecordMs(kTpmCommandSign, 50);
+
+  EXPECT_EQ(2, stats_.GetCount(kTpmCommandUnseal));
+  EXPECT_EQ(400, stats_.GetTotalTime(kTpmCommandUnseal).InMilliseconds());
+  EXPECT_EQ(300, stats_.GetMaxTime(kTpmCommandUnseal).InMilliseconds());
+  EXPECT_EQ(1, stats_.GetCount(kTpmCommandSign));
+  EXPECT_EQ(0, stats_.GetCount(kTpmCommandReadNvram));
+
+  std::unique_ptr<base::DictionaryValue> status = stats_.GetStatus();
+  const base::DictionaryValue* unseal = nullptr;
+  ASSERT_TRUE(status->GetDictionaryWithoutPathExpansion(
+      GetTpmCommandName(kTpmCommandUnseal), &unseal));
+  double average_ms = 0;
+  EXPECT_TRUE(unseal->GetDouble("average_ms", &average_ms));
+  EXPECT_DOUBLE_EQ(200, average_ms);
+  // Commands that never ran and the disabled trace are left out.
+  EXPECT_FALSE(status->HasKey(GetTpmCommandName(kTpmCommandReadNvram)));
+  EXPECT_FALSE(status->HasKey("trace"));
+
+  stats_.Reset();
+  EXPECT_EQ(0, stats_.GetCount(kTpmCommandUnseal));
+}
+
+TEST_F(TpmCommandStatsTest, TraceKeepsMostRecentCommands) {
+  stats_.SetTraceEnabled(true);
+  RecordMs(kTpmCommandLoadWrappedKey, 1);
+  for (size_t i = 0; i < TpmCommandStats::kMaxTraceEntries; ++i)
+    RecordMs(kTpmCommandGetRandomData, 2);
+
+  std::unique_ptr<base::DictionaryValue> status = stats_.GetStatus();
+  const base::ListValue* trace = nullptr;
+  ASSERT_TRUE(status->GetList("trace", &trace));
+  ASSERT_EQ(TpmCommandStats::kMaxTraceEntries, trace->GetSize());
+  // The oldest command was dropped to make room.
+  const base::DictionaryValue* first = nullptr;
+  ASSERT_TRUE(trace->GetDictionary(0, &first));
+  std::string command;
+  EXPECT_TRUE(first->GetString("command", &command));
+  EXPECT_EQ(GetTpmCommandName(kTpmCommandGetRandomData), command);
+
+  stats_.SetTraceEnabled(false);
+  EXPECT_FALSE(stats_.GetStatus()->HasKey("trace"));
+  // Disabling the trace keeps the aggregates.
+  EXPECT_EQ(1, stats_.GetCount(kTpmCommandLoadWrappedKey));
+}
+
+TEST_F(TpmCommandStatsTest, ScopedTimerRecordsIntoInstance) {
+  TpmCommandStats* stats = TpmCommandStats::GetInstance();
+  stats->Reset();
+  {
+    ScopedTpmCommandTimer timer(kTpmCommandReadNvram);
+  }
+  EXPECT_EQ(1, stats->GetCount(kTpmCommandReadNvram));
+  stats->Reset();
+}
+
+}  // namespace cryptohome
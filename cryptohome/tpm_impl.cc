@@ -25,6 +25,7 @@
 
 #include "cryptohome/cryptohome_metrics.h"
 #include "cryptohome/cryptolib.h"
+#include "cryptohome/tpm_command_stats.h"
 
 using base::PlatformThread;
 using brillo::SecureBlob;
@@ -454,6 +455,7 @@ Tpm::TpmRetryAction TpmImpl::EncryptBlob(TpmKeyHandle key_handle,
                                          const SecureBlob& plaintext,
                                          const SecureBlob& key,
                                          SecureBlob* ciphertext) {
+  ScopedTpmCommandTimer timer(kTpmCommandEncryptBlob);
   TSS_RESULT result = TSS_SUCCESS;
   TSS_FLAG init_flags = TSS_ENCDATA_SEAL;
   ScopedTssKey enc_handle(tpm_context_.value());
@@ -496,6 +498,7 @@ Tpm::TpmRetryAction TpmImpl::DecryptBlob(TpmKeyHandle key_handle,
                                          const SecureBlob& ciphertext,
                                          const SecureBlob& key,
                                          SecureBlob* plaintext) {
+  ScopedTpmCommandTimer timer(kTpmCommandDecryptBlob);
   TSS_RESULT result = TSS_SUCCESS;
   SecureBlob local_data;
   if (!CryptoLib::UnobscureRSAMessage(ciphertext, key, &local_data)) {
@@ -931,6 +934,7 @@ bool TpmImpl::GetOwnerPassword(brillo::Blob* owner_password) {
 }
 
 bool TpmImpl::GetRandomData(size_t length, brillo::Blob* data) {
+  ScopedTpmCommandTimer timer(kTpmCommandGetRandomData);
   ScopedTssContext context_handle;
   if ((*(context_handle.ptr()) = ConnectContext()) == 0) {
     LOG(ERROR) << "Could not open the TPM";
@@ -1210,6 +1214,7 @@ bool TpmImpl::IsNvramLockedForContext(TSS_HCONTEXT context_handle,
 }
 
 bool TpmImpl::ReadNvram(uint32_t index, SecureBlob* blob) {
+  ScopedTpmCommandTimer timer(kTpmCommandReadNvram);
   // TODO(wad) longer term, add support for checking when a space is restricted
   //           and needs an authenticated handle.
   ScopedTssContext context_handle;
@@ -1865,6 +1870,7 @@ bool TpmImpl::QuotePCR(int pcr_index,
 
 bool TpmImpl::SealToPCR0(const brillo::Blob& value,
                          brillo::Blob* sealed_value) {
+  ScopedTpmCommandTimer timer(kTpmCommandSealToPcr0);
   CHECK(sealed_value);
   ScopedTssContext context_handle;
   TSS_HTPM tpm_handle;
@@ -1945,6 +1951,7 @@ bool TpmImpl::SealToPCR0(const brillo::Blob& value,
 
 bool TpmImpl::Unseal(const brillo::Blob& sealed_value,
                      brillo::Blob* value) {
+  ScopedTpmCommandTimer timer(kTpmCommandUnseal);
   CHECK(value);
   ScopedTssContext context_handle;
   TSS_HTPM tpm_handle;
@@ -2290,6 +2297,7 @@ bool TpmImpl::Sign(const SecureBlob& key_blob,
                    const SecureBlob& input,
                    int bound_pcr_index,
                    SecureBlob* signature) {
+  ScopedTpmCommandTimer timer(kTpmCommandSign);
   CHECK(signature);
   ScopedTssContext context_handle;
   TSS_HTPM tpm_handle;
@@ -2790,6 +2798,7 @@ bool TpmImpl::GetKeyBlob(TSS_HCONTEXT context_handle, TSS_HKEY key_handle,
 Tpm::TpmRetryAction TpmImpl::LoadWrappedKey(
     const brillo::SecureBlob& wrapped_key,
     ScopedKeyHandle* key_handle) {
+  ScopedTpmCommandTimer timer(kTpmCommandLoadWrappedKey);
   CHECK(key_handle);
   TSS_RESULT result = TSS_SUCCESS;
   // Load the Storage Root Key